@@ -25,7 +25,7 @@
 #include <sys/ioctl.h>
 #include <sys/uio.h>
 #include <wordexp.h>
-#include <sys/timerfd.h>
+#include <time.h>
 #include <sys/stat.h>
 
 #include <glib.h>
@@ -43,6 +43,7 @@
 #include "src/shared/shell.h"
 #include "src/shared/io.h"
 #include "src/shared/queue.h"
+#include "src/shared/pacer.h"
 #include "src/shared/bap-debug.h"
 #include "print.h"
 #include "player.h"
@@ -64,7 +65,6 @@
 #define NSEC_USEC(_t) (_t / 1000L)
 #define SEC_USEC(_t)  (_t  * 1000000L)
 #define TS_USEC(_ts)  (SEC_USEC((_ts)->tv_sec) + NSEC_USEC((_ts)->tv_nsec))
-#define ROUND_CLOSEST(_x, _y) (((_x) + (_y / 2)) / (_y))
 
 #define EP_SRC_LOCATIONS 0x00000003
 #define EP_SNK_LOCATIONS 0x00000003
@@ -133,6 +133,7 @@ static GList *endpoints = NULL;
 static GList *local_endpoints = NULL;
 static GList *transports = NULL;
 static struct queue *ios = NULL;
+static struct bt_pacer *pacer = NULL;
 static uint8_t bcast_code[] = BCAST_CODE;
 
 struct transport {
@@ -144,8 +145,7 @@ struct transport {
 	struct stat stat;
 	struct io *io;
 	uint32_t seq;
-	struct io *timer_io;
-	int num;
+	unsigned int pacer_id;
 };
 
 struct transport_select_args {
@@ -4783,6 +4783,11 @@ static GDBusProxy *find_link_by_proxy(GDBusProxy *proxy)
 
 static void transport_close(struct transport *transport)
 {
+	if (transport->pacer_id) {
+		bt_pacer_remove(pacer, transport->pacer_id);
+		transport->pacer_id = 0;
+	}
+
 	if (transport->fd < 0)
 		return;
 
@@ -4796,7 +4801,7 @@ static void transport_free(void *data)
 {
 	struct transport *transport = data;
 
-	io_destroy(transport->timer_io);
+	transport_close(transport);
 	io_destroy(transport->io);
 	free(transport);
 }
@@ -5607,61 +5612,27 @@ static int transport_send_seq(struct transport *transport, int fd, uint32_t num)
 	return i;
 }
 
-static bool transport_timer_read(struct io *io, void *user_data)
+static void transport_sent(unsigned int id, int err,
+				const struct bt_pacer_stats *stats,
+				void *user_data)
 {
 	struct transport *transport = user_data;
-	struct bt_iso_qos qos;
-	socklen_t len;
-	int ret, fd;
-	uint64_t exp;
-
-	if (transport->fd < 0)
-		return false;
-
-	fd = io_get_fd(io);
-	if (fd < 0) {
-		bt_shell_printf("io_get_fd() returned %d\n", fd);
-		return false;
-	}
-
-	ret = read(fd, &exp, sizeof(exp));
-	if (ret < 0) {
-		bt_shell_printf("Failed to read: %s (%d)\n", strerror(errno),
-								-errno);
-		return false;
-	}
-
-	/* Read QoS if available */
-	memset(&qos, 0, sizeof(qos));
-	len = sizeof(qos);
-	if (getsockopt(transport->sk, SOL_BLUETOOTH, BT_ISO_QOS, &qos,
-							&len) < 0) {
-		bt_shell_printf("Failed to getsockopt(BT_ISO_QOS): %s (%d)\n",
-					strerror(errno), -errno);
-		return false;
-	}
 
-	ret = transport_send_seq(transport, transport->fd, transport->num);
-	if (ret < 0) {
-		bt_shell_printf("Unable to send: %s (%d)\n",
-					strerror(-ret), ret);
-		return false;
-	}
+	if (err < 0)
+		bt_shell_printf("Unable to send: %s (%d)\n", strerror(-err),
+									err);
 
-	if (!ret) {
-		transport_close(transport);
-		return false;
-	}
+	bt_shell_printf("Sent %u SDUs: %zu/%zu bytes (%u late, %u dropped)\n",
+				stats->sent, stats->offset, stats->size,
+				stats->late, stats->dropped);
 
-	return true;
+	transport->pacer_id = 0;
+	transport_close(transport);
 }
 
 static int transport_send(struct transport *transport, int fd,
 					struct bt_iso_io_qos *qos)
 {
-	struct itimerspec ts;
-	int timer_fd;
-
 	transport->seq = 0;
 
 	if (!qos)
@@ -5670,35 +5641,27 @@ static int transport_send(struct transport *transport, int fd,
 	if (transport->fd >= 0)
 		return -EALREADY;
 
-	timer_fd = timerfd_create(CLOCK_MONOTONIC, 0);
-	if (timer_fd < 0)
-		return -errno;
+	if (!pacer) {
+		pacer = bt_pacer_new();
+		if (!pacer)
+			return -errno;
+	}
 
-	/* Send data in bursts of
-	 * num = ROUND_CLOSEST(Transport_Latency (ms) / SDU_Interval (us))
-	 * with average data rate = 1 packet / SDU_Interval
+	/* SDUs are paced at one per SDU_Interval (us), with
+	 * ROUND_CLOSEST(Transport_Latency (ms) / SDU_Interval (us)) queued
+	 * ahead, all transports sharing a single timer.
 	 */
-	transport->num = ROUND_CLOSEST(qos->latency * 1000, qos->interval);
-	if (!transport->num)
-		transport->num = 1;
-
-	memset(&ts, 0, sizeof(ts));
-	ts.it_value.tv_nsec = 1;
-	ts.it_interval.tv_nsec = transport->num * qos->interval * 1000;
-
-	if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &ts, NULL) < 0) {
-		close(timer_fd);
-		return -errno;
-	}
+	transport->pacer_id = bt_pacer_add(pacer, transport->sk, fd,
+						transport->mtu[1],
+						qos->interval, qos->latency,
+						transport_sent, transport,
+						NULL);
+	if (!transport->pacer_id)
+		return -EIO;
 
 	transport->fd = fd;
-	transport->timer_io = io_new(timer_fd);
 
-	io_set_read_handler(transport->timer_io, transport_timer_read,
-						transport, NULL);
-
-	/* One extra packet to buffers immediately */
-	return transport_send_seq(transport, fd, 1);
+	return 0;
 }
 
 static void cmd_send_transport(int argc, char *argv[])
@@ -5964,4 +5927,6 @@ void player_remove_submenu(void)
 {
 	g_dbus_client_unref(client);
 	queue_destroy(ios, transport_free);
+	bt_pacer_free(pacer);
+	pacer = NULL;
 }
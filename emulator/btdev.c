@@ -275,13 +275,30 @@ struct inquiry_data {
 
 #define DEFAULT_INQUIRY_INTERVAL 100 /* 100 milliseconds */
 
-#define MAX_BTDEV_ENTRIES 16
+#define BTDEV_LIST_MIN 16
+/* Default addresses store index >> 8 as 0x01 + n in one octet */
+#define BTDEV_LIST_MAX 0xff00
+#define BTDEV_HASH_SIZE 256
 
 static const uint8_t LINK_KEY_NONE[16] = { 0 };
 static const uint8_t LINK_KEY_DUMMY[16] = {	0, 1, 2, 3, 4, 5, 6, 7,
 						8, 9, 0, 1, 2, 3, 4, 5 };
 
-static struct btdev *btdev_list[MAX_BTDEV_ENTRIES] = { };
+/* Registry of all virtual controllers, slots are reused so the index (and
+ * with it the default address) of a device stays stable for its lifetime.
+ */
+static struct btdev **btdev_list;
+static int btdev_list_len;
+static int btdev_count;
+
+/* Address lookup tables and the subscription sets used to deliver
+ * advertising without walking over every registered device.
+ */
+static struct queue *btdev_bdaddr_hash[BTDEV_HASH_SIZE];
+static struct queue *btdev_random_hash[BTDEV_HASH_SIZE];
+static struct queue *btdev_adv_hash[BTDEV_HASH_SIZE];
+static struct queue *btdev_scanners;
+static struct queue *btdev_advertisers;
 
 static int get_hook_index(struct btdev *btdev, enum btdev_hook_type type,
 								uint16_t opcode)
@@ -311,41 +328,198 @@ static bool run_hooks(struct btdev *btdev, enum btdev_hook_type type,
 					btdev->hook_list[index]->user_data);
 }
 
+static unsigned int bdaddr_hash(const uint8_t *bdaddr)
+{
+	unsigned int hash = 0;
+	int i;
+
+	for (i = 0; i < 6; i++)
+		hash = hash * 31 + bdaddr[i];
+
+	return hash % BTDEV_HASH_SIZE;
+}
+
+static bool match_btdev_bdaddr(const void *data, const void *match_data)
+{
+	const struct btdev *btdev = data;
+
+	return !memcmp(btdev->bdaddr, match_data, 6);
+}
+
+static bool match_btdev_random_addr(const void *data, const void *match_data)
+{
+	const struct btdev *btdev = data;
+
+	return !memcmp(btdev->random_addr, match_data, 6);
+}
+
+static void hash_add(struct queue **table, const uint8_t *addr, void *data)
+{
+	unsigned int hash;
+
+	if (!bacmp((bdaddr_t *) addr, BDADDR_ANY))
+		return;
+
+	hash = bdaddr_hash(addr);
+
+	if (!table[hash])
+		table[hash] = queue_new();
+
+	queue_push_tail(table[hash], data);
+}
+
+static void hash_del(struct queue **table, const uint8_t *addr, void *data)
+{
+	unsigned int hash = bdaddr_hash(addr);
+
+	if (!table[hash])
+		return;
+
+	queue_remove(table[hash], data);
+
+	if (queue_isempty(table[hash])) {
+		queue_destroy(table[hash], NULL);
+		table[hash] = NULL;
+	}
+}
+
+static void set_bdaddr(struct btdev *btdev, const uint8_t *bdaddr)
+{
+	hash_del(btdev_bdaddr_hash, btdev->bdaddr, btdev);
+	memcpy(btdev->bdaddr, bdaddr, 6);
+	hash_add(btdev_bdaddr_hash, btdev->bdaddr, btdev);
+}
+
+static void set_random_addr(struct btdev *btdev, const uint8_t *addr)
+{
+	hash_del(btdev_random_hash, btdev->random_addr, btdev);
+	memcpy(btdev->random_addr, addr, 6);
+	hash_add(btdev_random_hash, btdev->random_addr, btdev);
+}
+
+static void set_adv_random_addr(struct le_ext_adv *ext_adv,
+							const uint8_t *addr)
+{
+	hash_del(btdev_adv_hash, ext_adv->random_addr, ext_adv);
+	memcpy(ext_adv->random_addr, addr, 6);
+	hash_add(btdev_adv_hash, ext_adv->random_addr, ext_adv);
+}
+
+static void set_le_scan_enable(struct btdev *btdev, uint8_t enable)
+{
+	if (!btdev_scanners)
+		btdev_scanners = queue_new();
+
+	if (!btdev->le_scan_enable && enable)
+		queue_push_tail(btdev_scanners, btdev);
+	else if (btdev->le_scan_enable && !enable)
+		queue_remove(btdev_scanners, btdev);
+
+	btdev->le_scan_enable = enable;
+}
+
+static void set_le_adv_enable(struct btdev *btdev, uint8_t enable)
+{
+	if (!btdev_advertisers)
+		btdev_advertisers = queue_new();
+
+	if (!btdev->le_adv_enable && enable)
+		queue_push_tail(btdev_advertisers, btdev);
+	else if (btdev->le_adv_enable && !enable)
+		queue_remove(btdev_advertisers, btdev);
+
+	btdev->le_adv_enable = enable;
+}
+
 static inline int add_btdev(struct btdev *btdev)
 {
-	int i, index = -1;
+	struct btdev **list;
+	int i, len;
 
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
+	for (i = 0; i < btdev_list_len; i++) {
 		if (btdev_list[i] == NULL) {
-			index = i;
-			btdev_list[index] = btdev;
-			break;
+			btdev_list[i] = btdev;
+			btdev_count++;
+			return i;
 		}
 	}
 
-	return index;
+	if (btdev_list_len >= BTDEV_LIST_MAX)
+		return -1;
+
+	len = btdev_list_len ? btdev_list_len * 2 : BTDEV_LIST_MIN;
+	if (len > BTDEV_LIST_MAX)
+		len = BTDEV_LIST_MAX;
+
+	list = realloc(btdev_list, len * sizeof(*list));
+	if (!list)
+		return -1;
+
+	memset(list + btdev_list_len, 0,
+			(len - btdev_list_len) * sizeof(*list));
+
+	btdev_list = list;
+	i = btdev_list_len;
+	btdev_list_len = len;
+	btdev_list[i] = btdev;
+	btdev_count++;
+
+	return i;
 }
 
 static inline int del_btdev(struct btdev *btdev)
 {
 	int i, index = -1;
 
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
+	for (i = 0; i < btdev_list_len; i++) {
 		if (btdev_list[i] == btdev) {
 			index = i;
 			btdev_list[index] = NULL;
+			btdev_count--;
 			break;
 		}
 	}
 
+	hash_del(btdev_bdaddr_hash, btdev->bdaddr, btdev);
+	hash_del(btdev_random_hash, btdev->random_addr, btdev);
+	queue_remove(btdev_scanners, btdev);
+	queue_remove(btdev_advertisers, btdev);
+
 	return index;
 }
 
+/* Release the registry and lookup tables once the last device is gone */
+static void free_btdev_list(void)
+{
+	int i;
+
+	if (btdev_count)
+		return;
+
+	for (i = 0; i < BTDEV_HASH_SIZE; i++) {
+		queue_destroy(btdev_bdaddr_hash[i], NULL);
+		btdev_bdaddr_hash[i] = NULL;
+		queue_destroy(btdev_random_hash[i], NULL);
+		btdev_random_hash[i] = NULL;
+		queue_destroy(btdev_adv_hash[i], NULL);
+		btdev_adv_hash[i] = NULL;
+	}
+
+	queue_destroy(btdev_scanners, NULL);
+	btdev_scanners = NULL;
+	queue_destroy(btdev_advertisers, NULL);
+	btdev_advertisers = NULL;
+
+	free(btdev_list);
+	btdev_list = NULL;
+	btdev_list_len = 0;
+}
+
 static inline bool valid_btdev(struct btdev *btdev)
 {
 	int i;
 
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
+	for (i = 0; i < btdev_list_len; i++) {
 		if (btdev_list[i] == btdev)
 			return true;
 	}
@@ -355,14 +529,8 @@ static inline bool valid_btdev(struct btdev *btdev)
 
 static inline struct btdev *find_btdev_by_bdaddr(const uint8_t *bdaddr)
 {
-	int i;
-
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
-		if (btdev_list[i] && !memcmp(btdev_list[i]->bdaddr, bdaddr, 6))
-			return btdev_list[i];
-	}
-
-	return NULL;
+	return queue_find(btdev_bdaddr_hash[bdaddr_hash(bdaddr)],
+						match_btdev_bdaddr, bdaddr);
 }
 
 static bool match_adv_addr(const void *data, const void *match_data)
@@ -376,42 +544,30 @@ static bool match_adv_addr(const void *data, const void *match_data)
 static inline struct btdev *find_btdev_by_bdaddr_type(const uint8_t *bdaddr,
 							uint8_t bdaddr_type)
 {
-	int i;
-
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
-		struct btdev *dev = btdev_list[i];
-		int cmp;
-		struct le_ext_adv *adv;
+	struct btdev *dev;
+	struct le_ext_adv *adv;
 
-		if (!dev)
-			continue;
+	if (bdaddr_type != 0x01)
+		return find_btdev_by_bdaddr(bdaddr);
 
-		if (bdaddr_type == 0x01)
-			cmp = memcmp(dev->random_addr, bdaddr, 6);
-		else
-			cmp = memcmp(dev->bdaddr, bdaddr, 6);
+	dev = queue_find(btdev_random_hash[bdaddr_hash(bdaddr)],
+					match_btdev_random_addr, bdaddr);
+	if (dev)
+		return dev;
 
-		if (!cmp)
-			return dev;
-
-		/* Check for instance own Random addresses */
-		if (bdaddr_type == 0x01) {
-			adv = queue_find(dev->le_ext_adv, match_adv_addr,
-								bdaddr);
-			if (adv)
-				return dev;
-		}
-	}
+	/* Check for instance own Random addresses */
+	adv = queue_find(btdev_adv_hash[bdaddr_hash(bdaddr)],
+						match_adv_addr, bdaddr);
 
-	return NULL;
+	return adv ? adv->dev : NULL;
 }
 
-static void get_bdaddr(uint16_t id, uint8_t index, uint8_t *bdaddr)
+static void get_bdaddr(uint16_t id, uint16_t index, uint8_t *bdaddr)
 {
 	bdaddr[0] = id & 0xff;
 	bdaddr[1] = id >> 8;
-	bdaddr[2] = index;
-	bdaddr[3] = 0x01;
+	bdaddr[2] = index & 0xff;
+	bdaddr[3] = 0x01 + (index >> 8);
 	bdaddr[4] = 0xaa;
 	bdaddr[5] = 0x00;
 }
@@ -582,6 +738,7 @@ static void le_ext_adv_free(void *data)
 
 	/* Remove to queue */
 	queue_remove(ext_adv->dev->le_ext_adv, ext_adv);
+	hash_del(btdev_adv_hash, ext_adv->random_addr, ext_adv);
 
 	if (ext_adv->broadcast_id)
 		timeout_remove(ext_adv->broadcast_id);
@@ -606,8 +763,8 @@ static void btdev_reset(struct btdev *btdev)
 	 * cleared upon HCI_Reset
 	 */
 
-	btdev->le_scan_enable		= 0x00;
-	btdev->le_adv_enable		= 0x00;
+	set_le_scan_enable(btdev, 0x00);
+	set_le_adv_enable(btdev, 0x00);
 	btdev->le_pa_enable		= 0x00;
 
 	al_clear(btdev);
@@ -939,10 +1096,10 @@ static bool inquiry_callback(void *user_data)
 	int i;
 
 	/*Report devices only once and wait for inquiry timeout*/
-	if (data->iter == MAX_BTDEV_ENTRIES)
+	if (data->iter == btdev_list_len)
 		return true;
 
-	for (i = data->iter; i < MAX_BTDEV_ENTRIES; i++) {
+	for (i = data->iter; i < btdev_list_len; i++) {
 		/*Lets sent 10 inquiry results at once */
 		if (sent + 10 == data->sent_count)
 			break;
@@ -3387,7 +3544,7 @@ static int cmd_set_random_address(struct btdev *dev, const void *data,
 		goto done;
 	}
 
-	memcpy(dev->random_addr, cmd->addr, 6);
+	set_random_addr(dev, cmd->addr);
 	status = BT_HCI_ERR_SUCCESS;
 
 done:
@@ -3584,29 +3741,29 @@ static bool adv_match(struct btdev *scan, struct btdev *adv)
 
 static void le_set_adv_enable_complete(struct btdev *btdev)
 {
+	const struct queue_entry *entry;
 	uint8_t report_type;
-	int i;
 
 	report_type = get_adv_report_type(btdev->le_adv_type);
 
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
-		if (!btdev_list[i] || btdev_list[i] == btdev)
-			continue;
+	for (entry = queue_get_entries(btdev_scanners); entry;
+							entry = entry->next) {
+		struct btdev *scan = entry->data;
 
-		if (!btdev_list[i]->le_scan_enable)
+		if (scan == btdev)
 			continue;
 
-		if (!adv_match(btdev_list[i], btdev))
+		if (!adv_match(scan, btdev))
 			continue;
 
-		le_send_adv_report(btdev_list[i], btdev, report_type);
+		le_send_adv_report(scan, btdev, report_type);
 
-		if (btdev_list[i]->le_scan_type != 0x01)
+		if (scan->le_scan_type != 0x01)
 			continue;
 
 		/* ADV_IND & ADV_SCAN_IND generate a scan response */
 		if (btdev->le_adv_type == 0x00 || btdev->le_adv_type == 0x02)
-			le_send_adv_report(btdev_list[i], btdev, 0x04);
+			le_send_adv_report(scan, btdev, 0x04);
 	}
 }
 
@@ -3639,7 +3796,7 @@ static int cmd_set_adv_enable(struct btdev *dev, const void *data, uint8_t len)
 		goto done;
 	}
 
-	dev->le_adv_enable = cmd->enable;
+	set_le_adv_enable(dev, cmd->enable);
 	status = BT_HCI_ERR_SUCCESS;
 
 	if (!cmd->enable)
@@ -3726,7 +3883,7 @@ static int cmd_set_scan_enable(struct btdev *dev, const void *data, uint8_t len)
 		goto done;
 	}
 
-	dev->le_scan_enable = cmd->enable;
+	set_le_scan_enable(dev, cmd->enable);
 	dev->le_filter_dup = cmd->filter_dup;
 	status = BT_HCI_ERR_SUCCESS;
 
@@ -3741,33 +3898,31 @@ static int cmd_set_scan_enable_complete(struct btdev *dev, const void *data,
 							uint8_t len)
 {
 	const struct bt_hci_cmd_le_set_scan_enable *cmd = data;
-	int i;
+	const struct queue_entry *entry;
 
 	if (!dev->le_scan_enable || !cmd->enable)
 		return 0;
 
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
+	for (entry = queue_get_entries(btdev_advertisers); entry;
+							entry = entry->next) {
+		struct btdev *adv = entry->data;
 		uint8_t report_type;
 
-		if (!btdev_list[i] || btdev_list[i] == dev)
-			continue;
-
-		if (!btdev_list[i]->le_adv_enable)
+		if (adv == dev)
 			continue;
 
-		if (!adv_match(dev, btdev_list[i]))
+		if (!adv_match(dev, adv))
 			continue;
 
-		report_type = get_adv_report_type(btdev_list[i]->le_adv_type);
-		le_send_adv_report(dev, btdev_list[i], report_type);
+		report_type = get_adv_report_type(adv->le_adv_type);
+		le_send_adv_report(dev, adv, report_type);
 
 		if (dev->le_scan_type != 0x01)
 			continue;
 
 		/* ADV_IND & ADV_SCAN_IND generate a scan response */
-		if (btdev_list[i]->le_adv_type == 0x00 ||
-					btdev_list[i]->le_adv_type == 0x02)
-			le_send_adv_report(dev, btdev_list[i], 0x04);
+		if (adv->le_adv_type == 0x00 || adv->le_adv_type == 0x02)
+			le_send_adv_report(dev, adv, 0x04);
 	}
 
 	return 0;
@@ -3817,8 +3972,8 @@ static void le_conn_complete(struct btdev *btdev,
 		if (!conn)
 			return;
 
-		btdev->le_adv_enable = 0;
-		conn->link->dev->le_adv_enable = 0;
+		set_le_adv_enable(btdev, 0);
+		set_le_adv_enable(conn->link->dev, 0);
 
 		cc.status = status;
 		cc.peer_addr_type = btdev->le_scan_own_addr_type;
@@ -4749,7 +4904,7 @@ static const uint8_t *ext_adv_gen_rpa(const struct btdev *dev,
 		rpa[5] |= 0x40; /* Set second most significant bit */
 		bt_crypto_ah(dev->crypto, rl->peer_irk, rpa + 3, rpa);
 
-		memcpy(adv->random_addr, rpa, sizeof(rpa));
+		set_adv_random_addr(adv, rpa);
 		adv->rpa = true;
 	}
 
@@ -4860,7 +5015,7 @@ static int cmd_set_adv_rand_addr(struct btdev *dev, const void *data,
 		return 0;
 	}
 
-	memcpy(ext_adv->random_addr, cmd->bdaddr, 6);
+	set_adv_random_addr(ext_adv, cmd->bdaddr);
 	cmd_complete(dev, BT_HCI_CMD_LE_SET_ADV_SET_RAND_ADDR, &status,
 						sizeof(status));
 
@@ -5046,24 +5201,24 @@ static bool ext_adv_broadcast(void *user_data)
 {
 	struct le_ext_adv *ext_adv = user_data;
 	struct btdev *btdev = ext_adv->dev;
+	const struct queue_entry *entry;
 	uint16_t report_type;
-	int i;
 
 	report_type = get_ext_adv_type(ext_adv->type);
 
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
-		if (!btdev_list[i] || btdev_list[i] == btdev)
-			continue;
+	for (entry = queue_get_entries(btdev_scanners); entry;
+							entry = entry->next) {
+		struct btdev *scan = entry->data;
 
-		if (!btdev_list[i]->le_scan_enable)
+		if (scan == btdev)
 			continue;
 
-		if (!ext_adv_match_addr(btdev_list[i], ext_adv))
+		if (!ext_adv_match_addr(scan, ext_adv))
 			continue;
 
-		send_ext_adv(btdev_list[i], btdev, ext_adv, report_type, false);
+		send_ext_adv(scan, btdev, ext_adv, report_type, false);
 
-		if (btdev_list[i]->le_scan_type != 0x01)
+		if (scan->le_scan_type != 0x01)
 			continue;
 
 		/* if scannable bit is set the send scan response */
@@ -5077,8 +5232,7 @@ static bool ext_adv_broadcast(void *user_data)
 			else
 				continue;
 
-			send_ext_adv(btdev_list[i], btdev, ext_adv,
-							report_type, true);
+			send_ext_adv(scan, btdev, ext_adv, report_type, true);
 		}
 	}
 
@@ -5128,7 +5282,7 @@ static int cmd_set_ext_adv_enable(struct btdev *dev, const void *data,
 		/* Disable all advertising sets */
 		queue_foreach(dev->le_ext_adv, ext_adv_disable, NULL);
 
-		dev->le_adv_enable = 0x00;
+		set_le_adv_enable(dev, 0x00);
 
 		goto exit_complete;
 	}
@@ -5184,7 +5338,7 @@ static int cmd_set_ext_adv_enable(struct btdev *dev, const void *data,
 
 		ext_adv->enable = cmd->enable;
 
-		dev->le_adv_enable = 0x01;
+		set_le_adv_enable(dev, 0x01);
 
 		if (!cmd->enable)
 			ext_adv_disable(ext_adv, NULL);
@@ -5266,8 +5420,7 @@ static int cmd_remove_adv_set(struct btdev *dev, const void *data,
 		return 0;
 	}
 
-	queue_remove(dev->le_ext_adv, ext_adv);
-	free(ext_adv);
+	le_ext_adv_free(ext_adv);
 
 	cmd_complete(dev, BT_HCI_CMD_LE_REMOVE_ADV_SET, &status,
 							sizeof(status));
@@ -5493,8 +5646,8 @@ static void le_pa_sync_estabilished(struct btdev *dev, struct btdev *remote,
 static int cmd_set_pa_enable(struct btdev *dev, const void *data, uint8_t len)
 {
 	const struct bt_hci_cmd_le_set_pa_enable *cmd = data;
+	const struct queue_entry *entry;
 	uint8_t status;
-	int i;
 
 	if (dev->le_pa_enable == cmd->enable) {
 		status = BT_HCI_ERR_COMMAND_DISALLOWED;
@@ -5506,15 +5659,15 @@ static int cmd_set_pa_enable(struct btdev *dev, const void *data, uint8_t len)
 	cmd_complete(dev, BT_HCI_CMD_LE_SET_PA_ENABLE, &status,
 							sizeof(status));
 
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
-		struct btdev *remote = btdev_list[i];
+	for (entry = queue_get_entries(btdev_scanners); entry;
+							entry = entry->next) {
+		struct btdev *remote = entry->data;
 
-		if (!remote || remote == dev)
+		if (remote == dev)
 			continue;
 
-		if (remote->le_scan_enable &&
-			queue_find(remote->le_per_adv, match_sync_handle,
-			UINT_TO_PTR(INV_HANDLE)))
+		if (queue_find(remote->le_per_adv, match_sync_handle,
+						UINT_TO_PTR(INV_HANDLE)))
 			le_pa_sync_estabilished(remote, dev,
 							BT_HCI_ERR_SUCCESS);
 	}
@@ -5572,7 +5725,7 @@ static int cmd_set_ext_scan_enable(struct btdev *dev, const void *data,
 		goto done;
 	}
 
-	dev->le_scan_enable = cmd->enable;
+	set_le_scan_enable(dev, cmd->enable);
 	dev->le_filter_dup = cmd->filter_dup;
 	status = BT_HCI_ERR_SUCCESS;
 
@@ -5602,17 +5755,21 @@ static int cmd_set_ext_scan_enable_complete(struct btdev *dev, const void *data,
 							uint8_t len)
 {
 	const struct bt_hci_cmd_le_set_ext_scan_enable *cmd = data;
-	int i;
+	struct le_per_adv *per_adv;
+	struct btdev *remote;
 
 	if (!dev->le_scan_enable || !cmd->enable)
 		return 0;
 
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
-		if (!btdev_list[i] || btdev_list[i] == dev)
-			continue;
+	/* Only the device owning the synchronizing address can match */
+	per_adv = queue_find(dev->le_per_adv, match_sync_handle,
+						UINT_TO_PTR(INV_HANDLE));
+	if (!per_adv)
+		return 0;
 
-		scan_pa(dev, btdev_list[i]);
-	}
+	remote = find_btdev_by_bdaddr_type(per_adv->addr, per_adv->addr_type);
+	if (remote && remote != dev)
+		scan_pa(dev, remote);
 
 	return 0;
 }
@@ -7382,6 +7539,7 @@ struct btdev *btdev_create(enum btdev_type type, uint16_t id)
 	}
 
 	get_bdaddr(id, index, btdev->bdaddr);
+	hash_add(btdev_bdaddr_hash, btdev->bdaddr, btdev);
 
 	btdev->conns = queue_new();
 	btdev->le_ext_adv = queue_new();
@@ -7410,6 +7568,8 @@ void btdev_destroy(struct btdev *btdev)
 	queue_destroy(btdev->le_big, le_big_free);
 
 	free(btdev);
+
+	free_btdev_list();
 }
 
 bool btdev_set_debug(struct btdev *btdev, btdev_debug_func_t callback,
@@ -7438,7 +7598,7 @@ bool btdev_set_bdaddr(struct btdev *btdev, const uint8_t *bdaddr)
 	if (!btdev || !bdaddr)
 		return false;
 
-	memcpy(btdev->bdaddr, bdaddr, sizeof(btdev->bdaddr));
+	set_bdaddr(btdev, bdaddr);
 
 	return true;
 }
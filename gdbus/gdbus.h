@@ -339,6 +339,18 @@ void g_dbus_emit_property_changed_full(DBusConnection *connection,
 gboolean g_dbus_get_properties(DBusConnection *connection, const char *path,
 				const char *interface, DBusMessageIter *iter);
 
+/*
+ * Limit PropertiesChanged for the given property, or for every property
+ * of the interface if name is NULL, to at most one signal per interval
+ * milliseconds. Changes within the interval are merged and emitted with
+ * the latest value once it ends. An interval of 0 removes the limit.
+ */
+void g_dbus_set_property_changed_interval(const char *interface,
+						const char *name,
+						unsigned int interval);
+void g_dbus_get_property_changed_stats(unsigned int *emitted,
+						unsigned int *suppressed);
+
 gboolean g_dbus_attach_object_manager(DBusConnection *connection);
 gboolean g_dbus_detach_object_manager(DBusConnection *connection);
 
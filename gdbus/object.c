@@ -50,8 +50,10 @@ struct generic_data {
 	GSList *objects;
 	GSList *added;
 	GSList *removed;
-	guint process_id;
+	gboolean queued;
 	gboolean pending_prop;
+	guint throttle_id;
+	gint64 throttle_next;
 	char *introspect;
 	struct generic_data *parent;
 };
@@ -62,10 +64,22 @@ struct interface_data {
 	const GDBusSignalTable *signals;
 	const GDBusPropertyTable *properties;
 	GSList *pending_prop;
+	GSList *emitted;
 	void *user_data;
 	GDBusDestroyFunction destroy;
 };
 
+struct property_limit {
+	char *interface;
+	char *name;
+	unsigned int interval;
+};
+
+struct property_emitted {
+	const GDBusPropertyTable *property;
+	gint64 last;
+};
+
 struct security_data {
 	GDBusPendingReply pending;
 	DBusMessage *message;
@@ -88,12 +102,18 @@ struct debug_data {
 static int global_flags = 0;
 static struct generic_data *root;
 static GSList *pending = NULL;
+static guint pending_id = 0;
+static GSList *property_limits = NULL;
+static unsigned int properties_emitted = 0;
+static unsigned int properties_suppressed = 0;
 static struct debug_data debug = { NULL, NULL, NULL };
 
 static gboolean process_changes(gpointer user_data);
-static void process_properties_from_interface(struct generic_data *data,
-						struct interface_data *iface);
-static void process_property_changes(struct generic_data *data);
+static gint64 process_properties_from_interface(struct generic_data *data,
+						struct interface_data *iface,
+						gboolean force);
+static void process_property_changes(struct generic_data *data,
+							gboolean force);
 
 static void print_arguments(GString *gstr, const GDBusArgInfo *args,
 						const char *direction)
@@ -708,21 +728,32 @@ static gboolean g_dbus_args_have_signature(const GDBusArgInfo *args,
 	return TRUE;
 }
 
-static void add_pending(struct generic_data *data)
+static gboolean process_pending(gpointer user_data)
 {
-	guint old_id = data->process_id;
+	GSList *l;
 
-	data->process_id = g_idle_add(process_changes, data);
+	pending_id = 0;
 
-	if (old_id > 0) {
-		/*
-		 * If the element already had an old idler, remove the old one,
-		 * no need to re-add it to the pending list.
-		 */
-		g_source_remove(old_id);
-		return;
+	/* Flush the changes of every object at once */
+	for (l = pending; l;) {
+		struct generic_data *data = l->data;
+
+		l = l->next;
+		process_changes(data);
 	}
 
+	return FALSE;
+}
+
+static void add_pending(struct generic_data *data)
+{
+	if (!pending_id)
+		pending_id = g_idle_add(process_pending, NULL);
+
+	if (data->queued)
+		return;
+
+	data->queued = TRUE;
 	pending = g_slist_append(pending, data);
 }
 
@@ -734,7 +765,10 @@ static gboolean remove_interface(struct generic_data *data, const char *name)
 	if (iface == NULL)
 		return FALSE;
 
-	process_properties_from_interface(data, iface);
+	process_properties_from_interface(data, iface, TRUE);
+
+	g_slist_free_full(iface->emitted, g_free);
+	iface->emitted = NULL;
 
 	data->interfaces = g_slist_remove(data->interfaces, iface);
 
@@ -1071,12 +1105,16 @@ static void emit_interfaces_removed(struct generic_data *data)
 
 static void remove_pending(struct generic_data *data)
 {
-	if (data->process_id > 0) {
-		g_source_remove(data->process_id);
-		data->process_id = 0;
-	}
+	if (!data->queued)
+		return;
 
+	data->queued = FALSE;
 	pending = g_slist_remove(pending, data);
+
+	if (!pending && pending_id > 0) {
+		g_source_remove(pending_id);
+		pending_id = 0;
+	}
 }
 
 static gboolean process_changes(gpointer user_data)
@@ -1090,13 +1128,11 @@ static gboolean process_changes(gpointer user_data)
 
 	/* Flush pending properties */
 	if (data->pending_prop == TRUE)
-		process_property_changes(data);
+		process_property_changes(data, FALSE);
 
 	if (data->removed != NULL)
 		emit_interfaces_removed(data);
 
-	data->process_id = 0;
-
 	return FALSE;
 }
 
@@ -1108,11 +1144,11 @@ static void generic_unregister(DBusConnection *connection, void *user_data)
 	if (parent != NULL)
 		parent->objects = g_slist_remove(parent->objects, data);
 
-	if (data->process_id > 0) {
-		g_source_remove(data->process_id);
-		data->process_id = 0;
+	if (data->queued)
 		process_changes(data);
-	}
+
+	if (data->throttle_id > 0)
+		g_source_remove(data->throttle_id);
 
 	g_slist_foreach(data->objects, reset_parent, data->parent);
 	g_slist_free(data->objects);
@@ -1800,27 +1836,110 @@ fail:
 	return ret;
 }
 
-static void process_properties_from_interface(struct generic_data *data,
-						struct interface_data *iface)
+static unsigned int property_interval(struct interface_data *iface,
+					const GDBusPropertyTable *property)
+{
+	GSList *l;
+
+	for (l = property_limits; l != NULL; l = l->next) {
+		struct property_limit *limit = l->data;
+
+		if (strcmp(limit->interface, iface->name))
+			continue;
+
+		if (limit->name == NULL || !strcmp(limit->name, property->name))
+			return limit->interval;
+	}
+
+	return 0;
+}
+
+/*
+ * Check if the property has been emitted less than its interval ago, in
+ * which case next is updated with the time it may be emitted again.
+ */
+static gboolean property_throttled(struct interface_data *iface,
+					const GDBusPropertyTable *property,
+					gint64 now, gint64 *next)
+{
+	struct property_emitted *emitted = NULL;
+	unsigned int interval;
+	gint64 deadline;
+	GSList *l;
+
+	interval = property_interval(iface, property);
+	if (!interval)
+		return FALSE;
+
+	for (l = iface->emitted; l != NULL; l = l->next) {
+		struct property_emitted *e = l->data;
+
+		if (e->property == property) {
+			emitted = e;
+			break;
+		}
+	}
+
+	if (emitted == NULL) {
+		emitted = g_new0(struct property_emitted, 1);
+		emitted->property = property;
+		iface->emitted = g_slist_prepend(iface->emitted, emitted);
+	} else {
+		deadline = emitted->last + interval * G_GINT64_CONSTANT(1000);
+		if (now < deadline) {
+			if (*next == 0 || deadline < *next)
+				*next = deadline;
+			return TRUE;
+		}
+	}
+
+	emitted->last = now;
+
+	return FALSE;
+}
+
+static gint64 process_properties_from_interface(struct generic_data *data,
+						struct interface_data *iface,
+						gboolean force)
 {
 	GSList *l;
 	DBusMessage *signal;
 	DBusMessageIter iter, dict, array;
-	GSList *invalidated;
+	GSList *invalidated, *ready, *deferred;
+	gint64 now, next = 0;
 
 	if (iface->pending_prop == NULL)
-		return;
+		return 0;
+
+	now = g_get_monotonic_time();
+	ready = NULL;
+	deferred = NULL;
+
+	/* Keep rate limited properties pending until their interval ends */
+	for (l = iface->pending_prop; l != NULL; l = l->next) {
+		GDBusPropertyTable *p = l->data;
+
+		if (!force && property_throttled(iface, p, now, &next))
+			deferred = g_slist_prepend(deferred, p);
+		else
+			ready = g_slist_prepend(ready, p);
+	}
+
+	g_slist_free(iface->pending_prop);
+	iface->pending_prop = g_slist_reverse(deferred);
+
+	if (ready == NULL)
+		return next;
 
 	signal = dbus_message_new_signal(data->path,
 			DBUS_INTERFACE_PROPERTIES, "PropertiesChanged");
 	if (signal == NULL) {
 		error("Unable to allocate new " DBUS_INTERFACE_PROPERTIES
 						".PropertiesChanged signal");
-		return;
+		g_slist_free(ready);
+		return next;
 	}
 
-	iface->pending_prop = g_slist_reverse(iface->pending_prop);
-
 	dbus_message_iter_init_append(signal, &iter);
 	dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING,	&iface->name);
 	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
@@ -1830,7 +1949,7 @@ static void process_properties_from_interface(struct generic_data *data,
 
 	invalidated = NULL;
 
-	for (l = iface->pending_prop; l != NULL; l = l->next) {
+	for (l = ready; l != NULL; l = l->next) {
 		GDBusPropertyTable *p = l->data;
 
 		if (p->get == NULL)
@@ -1857,24 +1976,61 @@ static void process_properties_from_interface(struct generic_data *data,
 	g_slist_free(invalidated);
 	dbus_message_iter_close_container(&iter, &array);
 
-	g_slist_free(iface->pending_prop);
-	iface->pending_prop = NULL;
+	g_slist_free(ready);
+
+	properties_emitted++;
 
 	/* Use g_dbus_send_unref to avoid recursive calls to g_dbus_flush */
 	g_dbus_send_unref(data->conn, signal);
+
+	return next;
+}
+
+static gboolean throttle_timeout(gpointer user_data)
+{
+	struct generic_data *data = user_data;
+
+	data->throttle_id = 0;
+
+	add_pending(data);
+
+	return FALSE;
 }
 
-static void process_property_changes(struct generic_data *data)
+static void process_property_changes(struct generic_data *data,
+							gboolean force)
 {
 	GSList *l;
+	gint64 next = 0, delay;
 
 	data->pending_prop = FALSE;
 
 	for (l = data->interfaces; l != NULL; l = l->next) {
 		struct interface_data *iface = l->data;
+		gint64 n;
+
+		n = process_properties_from_interface(data, iface, force);
+		if (n && (!next || n < next))
+			next = n;
+	}
+
+	if (!next)
+		return;
+
+	data->pending_prop = TRUE;
+
+	if (data->throttle_id > 0) {
+		if (data->throttle_next <= next)
+			return;
 
-		process_properties_from_interface(data, iface);
+		g_source_remove(data->throttle_id);
 	}
+
+	delay = MAX(next - g_get_monotonic_time(), 0);
+
+	data->throttle_next = next;
+	data->throttle_id = g_timeout_add((delay + 999) / 1000,
+						throttle_timeout, data);
 }
 
 void g_dbus_emit_property_changed_full(DBusConnection *connection,
@@ -1911,15 +2067,19 @@ void g_dbus_emit_property_changed_full(DBusConnection *connection,
 		return;
 	}
 
-	if (g_slist_find(iface->pending_prop, (void *) property) != NULL)
-		return;
-
-	data->pending_prop = TRUE;
-	iface->pending_prop = g_slist_prepend(iface->pending_prop,
-						(void *) property);
+	/* A flush still applies to a change that is already pending */
+	if (g_slist_find(iface->pending_prop, (void *) property) != NULL) {
+		properties_suppressed++;
+		if (!(flags & G_DBUS_PROPERTY_CHANGED_FLAG_FLUSH))
+			return;
+	} else {
+		data->pending_prop = TRUE;
+		iface->pending_prop = g_slist_prepend(iface->pending_prop,
+							(void *) property);
+	}
 
 	if (flags & G_DBUS_PROPERTY_CHANGED_FLAG_FLUSH)
-		process_property_changes(data);
+		process_property_changes(data, TRUE);
 	else
 		add_pending(data);
 }
@@ -1930,6 +2090,76 @@ void g_dbus_emit_property_changed(DBusConnection *connection, const char *path,
 	g_dbus_emit_property_changed_full(connection, path, interface, name, 0);
 }
 
+static gint property_limit_cmp(gconstpointer a, gconstpointer b)
+{
+	const struct property_limit *limit = a;
+	const struct property_limit *match = b;
+
+	if (strcmp(limit->interface, match->interface))
+		return 1;
+
+	return g_strcmp0(limit->name, match->name);
+}
+
+static void property_limit_free(gpointer user_data)
+{
+	struct property_limit *limit = user_data;
+
+	g_free(limit->interface);
+	g_free(limit->name);
+	g_free(limit);
+}
+
+void g_dbus_set_property_changed_interval(const char *interface,
+						const char *name,
+						unsigned int interval)
+{
+	struct property_limit match = { (char *) interface, (char *) name, 0 };
+	struct property_limit *limit;
+	GSList *l;
+
+	if (interface == NULL)
+		return;
+
+	l = g_slist_find_custom(property_limits, &match, property_limit_cmp);
+	if (l != NULL) {
+		limit = l->data;
+
+		if (interval) {
+			limit->interval = interval;
+			return;
+		}
+
+		property_limits = g_slist_delete_link(property_limits, l);
+		property_limit_free(limit);
+		return;
+	}
+
+	if (!interval)
+		return;
+
+	limit = g_new0(struct property_limit, 1);
+	limit->interface = g_strdup(interface);
+	limit->name = g_strdup(name);
+	limit->interval = interval;
+
+	/* Rules for a single property take precedence over interface ones */
+	if (name != NULL)
+		property_limits = g_slist_prepend(property_limits, limit);
+	else
+		property_limits = g_slist_append(property_limits, limit);
+}
+
+void g_dbus_get_property_changed_stats(unsigned int *emitted,
+						unsigned int *suppressed)
+{
+	if (emitted)
+		*emitted = properties_emitted;
+
+	if (suppressed)
+		*suppressed = properties_suppressed;
+}
+
 gboolean g_dbus_get_properties(DBusConnection *connection, const char *path,
 				const char *interface, DBusMessageIter *iter)
 {
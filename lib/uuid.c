@@ -114,6 +114,26 @@ int bt_uuid_cmp(const bt_uuid_t *uuid1, const bt_uuid_t *uuid2)
 {
 	bt_uuid_t u1, u2;
 
+	/*
+	 * Values of the same type share the same base so they can be compared
+	 * directly, the result has the same sign as comparing the expanded
+	 * 128-bit (big-endian) forms.
+	 */
+	if (uuid1->type == uuid2->type) {
+		switch (uuid1->type) {
+		case BT_UUID16:
+			return (int) uuid1->value.u16 - (int) uuid2->value.u16;
+		case BT_UUID32:
+			return (uuid1->value.u32 > uuid2->value.u32) -
+				(uuid1->value.u32 < uuid2->value.u32);
+		case BT_UUID128:
+			return bt_uuid128_cmp(uuid1, uuid2);
+		case BT_UUID_UNSPEC:
+		default:
+			break;
+		}
+	}
+
 	bt_uuid_to_uuid128(uuid1, &u1);
 	bt_uuid_to_uuid128(uuid2, &u2);
 
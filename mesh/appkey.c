@@ -52,33 +52,64 @@ static bool match_bound_key(const void *a, const void *b)
 	return key->net_idx == idx;
 }
 
-static void finalize_key(void *a, void *b)
+/*
+ * Each key is also kept in the per AID lists of the network, under both its
+ * current and updated AID, so received messages only try candidate keys.
+ */
+static void index_key(struct mesh_net *net, struct mesh_app_key *key)
+{
+	l_queue_push_tail(mesh_net_get_app_aid_keys(net, key->key_aid), key);
+
+	if (key->new_key_aid == APP_AID_INVALID ||
+					key->new_key_aid == key->key_aid)
+		return;
+
+	l_queue_push_tail(mesh_net_get_app_aid_keys(net, key->new_key_aid),
+									key);
+}
+
+static void unindex_key(struct mesh_net *net, struct mesh_app_key *key)
 {
-	struct mesh_app_key *key = a;
-	uint16_t net_idx = L_PTR_TO_UINT(b);
+	l_queue_remove(mesh_net_get_app_aid_keys(net, key->key_aid), key);
+
+	if (key->new_key_aid == APP_AID_INVALID ||
+					key->new_key_aid == key->key_aid)
+		return;
 
+	l_queue_remove(mesh_net_get_app_aid_keys(net, key->new_key_aid), key);
+}
+
+static void finalize_key(struct mesh_net *net, struct mesh_app_key *key,
+							uint16_t net_idx)
+{
 	if (key->net_idx != net_idx)
 		return;
 
 	if (key->new_key_aid == APP_AID_INVALID)
 		return;
 
+	unindex_key(net, key);
+
 	key->key_aid = key->new_key_aid;
 
 	key->new_key_aid = APP_AID_INVALID;
 
 	memcpy(key->key, key->new_key, 16);
+
+	index_key(net, key);
 }
 
 void appkey_finalize(struct mesh_net *net, uint16_t net_idx)
 {
+	const struct l_queue_entry *entry;
 	struct l_queue *app_keys;
 
 	app_keys = mesh_net_get_app_keys(net);
 	if (!app_keys)
 		return;
 
-	l_queue_foreach(app_keys, finalize_key, L_UINT_TO_PTR(net_idx));
+	for (entry = l_queue_get_entries(app_keys); entry; entry = entry->next)
+		finalize_key(net, entry->data, net_idx);
 }
 
 static struct mesh_app_key *app_key_new(void)
@@ -152,6 +183,7 @@ bool appkey_key_init(struct mesh_net *net, uint16_t net_idx, uint16_t app_idx,
 	}
 
 	l_queue_push_tail(app_keys, key);
+	index_key(net, key);
 
 	return true;
 }
@@ -273,8 +305,14 @@ int appkey_key_update(struct mesh_net *net, uint16_t net_idx, uint16_t app_idx,
 	if (memcmp(new_key, key->new_key, 16) == 0)
 		return MESH_STATUS_SUCCESS;
 
-	if (!set_key(key, app_idx, new_key, true))
+	unindex_key(net, key);
+
+	if (!set_key(key, app_idx, new_key, true)) {
+		index_key(net, key);
 		return MESH_STATUS_INSUFF_RESOURCES;
+	}
+
+	index_key(net, key);
 
 	node = mesh_net_node_get(net);
 
@@ -330,6 +368,7 @@ int appkey_key_add(struct mesh_net *net, uint16_t net_idx, uint16_t app_idx,
 	key->net_idx = net_idx;
 	key->app_idx = app_idx;
 	l_queue_push_tail(app_keys, key);
+	index_key(net, key);
 
 	return MESH_STATUS_SUCCESS;
 }
@@ -358,6 +397,7 @@ int appkey_key_delete(struct mesh_net *net, uint16_t net_idx,
 	node_app_key_delete(node, net_idx, app_idx);
 
 	l_queue_remove(app_keys, key);
+	unindex_key(net, key);
 	appkey_key_free(key);
 
 	if (!mesh_config_app_key_del(node_config_get(node), net_idx, app_idx))
@@ -382,6 +422,7 @@ void appkey_delete_bound_keys(struct mesh_net *net, uint16_t net_idx)
 					L_UINT_TO_PTR(net_idx));
 
 	while (key) {
+		unindex_key(net, key);
 		node_app_key_delete(node, net_idx, key->app_idx);
 		mesh_config_app_key_del(node_config_get(node), net_idx,
 								key->app_idx);
@@ -39,10 +39,13 @@
 
 #define VIRTUAL_BASE			0x10000
 
+#define BINDING_MAP_SIZE		((APP_IDX_MASK + 1) / 32)
+
 struct mesh_model {
 	const struct mesh_model_ops *cbs;
 	void *user_data;
 	struct l_queue *bindings;
+	uint32_t *binding_map;
 	struct l_queue *subs;
 	struct l_queue *virtuals;
 	struct mesh_model_pub *pub;
@@ -75,6 +78,35 @@ struct mod_forward {
 
 static struct l_queue *mesh_virtuals;
 
+/* Virtual labels indexed by the low bits of their virtual address */
+#define VIRT_HASH_SIZE	64
+#define VIRT_HASH(addr)	((addr) & (VIRT_HASH_SIZE - 1))
+
+static struct l_queue *virt_hash[VIRT_HASH_SIZE];
+
+/* Payload decryption attempts and failures, logged on cleanup */
+static struct {
+	uint32_t attempts;
+	uint32_t failures;
+} decrypt_stats;
+
+/*
+ * Per node index of subscription addresses (group and virtual) to the
+ * element models subscribed to them. It is rebuilt on the next received
+ * message whenever any subscription or model changes.
+ */
+struct mesh_sub_index {
+	uint32_t gen;
+	struct l_hashmap *dsts;
+};
+
+struct sub_ref {
+	uint8_t ele_idx;
+	struct mesh_model *mod;
+};
+
+static uint32_t sub_index_gen = 1;
+
 static bool is_internal(uint32_t id)
 {
 	if (id == CONFIG_SRV_MODEL || id == CONFIG_CLI_MODEL)
@@ -100,6 +132,7 @@ static void unref_virt(void *data)
 		return;
 
 	l_queue_remove(mesh_virtuals, virt);
+	l_queue_remove(virt_hash[VIRT_HASH(virt->addr)], virt);
 	l_free(virt);
 }
 
@@ -108,15 +141,35 @@ static bool simple_match(const void *a, const void *b)
 	return a == b;
 }
 
-static bool has_binding(struct l_queue *bindings, uint16_t idx)
+static void invalidate_sub_index(void)
 {
-	const struct l_queue_entry *entry;
+	sub_index_gen++;
+}
 
-	for (entry = l_queue_get_entries(bindings); entry; entry = entry->next)
-		if (L_PTR_TO_INT(entry->data) == idx)
-			return true;
+static bool has_binding(struct mesh_model *mod, uint16_t idx)
+{
+	if (!mod->binding_map || idx > APP_IDX_MASK)
+		return false;
 
-	return false;
+	return mod->binding_map[idx / 32] & (1U << (idx % 32));
+}
+
+static void set_binding(struct mesh_model *mod, uint16_t idx, bool bound)
+{
+	if (idx > APP_IDX_MASK)
+		return;
+
+	if (!mod->binding_map) {
+		if (!bound)
+			return;
+
+		mod->binding_map = l_new(uint32_t, BINDING_MAP_SIZE);
+	}
+
+	if (bound)
+		mod->binding_map[idx / 32] |= 1U << (idx % 32);
+	else
+		mod->binding_map[idx / 32] &= ~(1U << (idx % 32));
 }
 
 static bool find_virt_by_label(const void *a, const void *b)
@@ -359,7 +412,7 @@ static void forward_model(void *a, void *b)
 
 	if (fwd->app_idx != APP_IDX_DEV_LOCAL &&
 				fwd->app_idx != APP_IDX_DEV_REMOTE &&
-				!has_binding(mod->bindings, fwd->app_idx))
+				!has_binding(mod, fwd->app_idx))
 		return;
 
 	dst = fwd->dst;
@@ -395,13 +448,31 @@ static void forward_model(void *a, void *b)
 		fwd->done = true;
 }
 
+static bool payload_decrypt(const uint8_t *virt, uint16_t virt_size,
+				const uint8_t *data, uint16_t size,
+				bool szmict, uint16_t src, uint16_t dst,
+				uint8_t key_aid, uint32_t seq, uint32_t iv_idx,
+				uint8_t *out, const uint8_t *key)
+{
+	decrypt_stats.attempts++;
+
+	if (mesh_crypto_payload_decrypt(virt, virt_size, data, size, szmict,
+					src, dst, key_aid, seq, iv_idx, out,
+					key))
+		return true;
+
+	decrypt_stats.failures++;
+
+	return false;
+}
+
 static int app_packet_decrypt(struct mesh_net *net, const uint8_t *data,
 				uint16_t size, bool szmict, uint16_t src,
 				uint16_t dst, uint8_t *virt, uint16_t virt_size,
 				uint8_t key_aid, uint32_t seq,
 				uint32_t iv_idx, uint8_t *out)
 {
-	struct l_queue *app_keys = mesh_net_get_app_keys(net);
+	struct l_queue *app_keys = mesh_net_get_app_aid_keys(net, key_aid);
 	const struct l_queue_entry *entry;
 
 	if (!app_keys)
@@ -422,7 +493,7 @@ static int app_packet_decrypt(struct mesh_net *net, const uint8_t *data,
 			continue;
 
 		if (old_key && old_key_aid == key_aid) {
-			decrypted = mesh_crypto_payload_decrypt(virt, virt_size,
+			decrypted = payload_decrypt(virt, virt_size,
 					data, size, szmict, src, dst, key_aid,
 						seq, iv_idx, out, old_key);
 
@@ -435,7 +506,7 @@ static int app_packet_decrypt(struct mesh_net *net, const uint8_t *data,
 		}
 
 		if (new_key && new_key_aid == key_aid) {
-			decrypted = mesh_crypto_payload_decrypt(virt, virt_size,
+			decrypted = payload_decrypt(virt, virt_size,
 					data, size, szmict, src, dst, key_aid,
 						seq, iv_idx, out, new_key);
 
@@ -463,14 +534,14 @@ static int dev_packet_decrypt(struct mesh_node *node, const uint8_t *data,
 	if (!key)
 		return -1;
 
-	if (mesh_crypto_payload_decrypt(NULL, 0, data, size, szmict, src,
+	if (payload_decrypt(NULL, 0, data, size, szmict, src,
 					dst, key_aid, seq, iv_idx, out, key))
 		return APP_IDX_DEV_LOCAL;
 
 	key = dev_key;
 
 	if (keyring_get_remote_dev_key(node, src, dev_key)) {
-		if (mesh_crypto_payload_decrypt(NULL, 0, data, size, szmict,
+		if (payload_decrypt(NULL, 0, data, size, szmict,
 				src, dst, key_aid, seq, iv_idx, out, key))
 			return APP_IDX_DEV_REMOTE;
 	}
@@ -479,7 +550,7 @@ static int dev_packet_decrypt(struct mesh_node *node, const uint8_t *data,
 	if (!node_get_device_key_candidate(node, dev_key))
 		return -1;
 
-	if (mesh_crypto_payload_decrypt(NULL, 0, data, size, szmict,
+	if (payload_decrypt(NULL, 0, data, size, szmict,
 				src, dst, key_aid, seq, iv_idx, out, key)) {
 
 		/* If candidate dev_key worked, it is considered finalized */
@@ -498,7 +569,9 @@ static int virt_packet_decrypt(struct mesh_net *net, const uint8_t *data,
 {
 	const struct l_queue_entry *v;
 
-	for (v = l_queue_get_entries(mesh_virtuals); v; v = v->next) {
+	v = l_queue_get_entries(virt_hash[VIRT_HASH(dst)]);
+
+	for (; v; v = v->next) {
 		struct mesh_virtual *virt = v->data;
 		int decrypt_idx;
 
@@ -603,6 +676,7 @@ static void model_unbind_idx(struct mesh_node *node, uint16_t ele_idx,
 					struct mesh_model *mod, uint16_t idx)
 {
 	l_queue_remove(mod->bindings, L_UINT_TO_PTR(idx));
+	set_binding(mod, idx, false);
 
 	if (!mod->cbs)
 		/* External model */
@@ -623,6 +697,7 @@ static void model_bind_idx(struct mesh_node *node, uint16_t ele_idx,
 		mod->bindings = l_queue_new();
 
 	l_queue_push_tail(mod->bindings, L_UINT_TO_PTR(idx));
+	set_binding(mod, idx, true);
 
 	l_debug("Bind key %4.4x to model %8.8x", idx, mod->id);
 
@@ -662,7 +737,7 @@ static int update_binding(struct mesh_node *node, uint16_t addr, uint32_t id,
 	 * If deleting a binding that is not present, return success.
 	 * If adding a binding that already exists, return success.
 	 */
-	if (unbind ^ has_binding(mod->bindings, app_idx))
+	if (unbind ^ has_binding(mod, app_idx))
 		return MESH_STATUS_SUCCESS;
 
 	vendor = IS_VENDOR(id);
@@ -713,6 +788,11 @@ static struct mesh_virtual *add_virtual(const uint8_t *v)
 	virt->ref_cnt = 1;
 	l_queue_push_head(mesh_virtuals, virt);
 
+	if (!virt_hash[VIRT_HASH(virt->addr)])
+		virt_hash[VIRT_HASH(virt->addr)] = l_queue_new();
+
+	l_queue_push_head(virt_hash[VIRT_HASH(virt->addr)], virt);
+
 	return virt;
 }
 
@@ -765,6 +845,7 @@ static int add_virt_sub(struct mesh_net *net, struct mesh_model *mod,
 
 		l_queue_push_head(mod->virtuals, virt);
 		mesh_net_dst_reg(net, virt->addr);
+		invalidate_sub_index();
 		l_debug("Added virtual sub addr %4.4x", virt->addr);
 	}
 
@@ -789,6 +870,7 @@ static int add_sub(struct mesh_net *net, struct mesh_model *mod,
 
 	l_queue_push_tail(mod->subs, L_UINT_TO_PTR(addr));
 	mesh_net_dst_reg(net, addr);
+	invalidate_sub_index();
 	l_debug("Added group subscription %4.4x", addr);
 
 	return MESH_STATUS_SUCCESS;
@@ -875,6 +957,101 @@ static void send_msg_rcvd(struct mesh_node *node, uint8_t ele_idx,
 	l_dbus_send(dbus, msg);
 }
 
+static void sub_refs_free(void *data)
+{
+	l_queue_destroy(data, l_free);
+}
+
+static void sub_index_add(struct l_hashmap *dsts, uint16_t addr,
+					uint8_t ele_idx, struct mesh_model *mod)
+{
+	struct l_queue *refs = l_hashmap_lookup(dsts, L_UINT_TO_PTR(addr));
+	struct sub_ref *ref;
+
+	if (!refs) {
+		refs = l_queue_new();
+		l_hashmap_insert(dsts, L_UINT_TO_PTR(addr), refs);
+	}
+
+	ref = l_new(struct sub_ref, 1);
+	ref->ele_idx = ele_idx;
+	ref->mod = mod;
+
+	/* Elements are visited in order, keeping each list sorted */
+	l_queue_push_tail(refs, ref);
+}
+
+static void sub_index_rebuild(struct mesh_node *node,
+						struct mesh_sub_index *index)
+{
+	uint8_t num_ele = node_get_num_elements(node);
+	int i;
+
+	l_hashmap_destroy(index->dsts, sub_refs_free);
+	index->dsts = l_hashmap_new();
+	index->gen = sub_index_gen;
+
+	for (i = 0; i < num_ele; i++) {
+		const struct l_queue_entry *m;
+
+		m = l_queue_get_entries(node_get_element_models(node, i));
+
+		for (; m; m = m->next) {
+			struct mesh_model *mod = m->data;
+			const struct l_queue_entry *entry;
+
+			entry = l_queue_get_entries(mod->subs);
+			for (; entry; entry = entry->next)
+				sub_index_add(index->dsts,
+						L_PTR_TO_UINT(entry->data),
+						i, mod);
+
+			entry = l_queue_get_entries(mod->virtuals);
+			for (; entry; entry = entry->next) {
+				struct mesh_virtual *virt = entry->data;
+
+				sub_index_add(index->dsts, virt->addr, i, mod);
+			}
+		}
+	}
+}
+
+static const struct l_queue_entry *lookup_sub_index(struct mesh_node *node,
+								uint16_t dst)
+{
+	struct mesh_sub_index *index = node_get_sub_index(node);
+
+	if (!index)
+		return NULL;
+
+	if (index->gen != sub_index_gen)
+		sub_index_rebuild(node, index);
+
+	return l_queue_get_entries(l_hashmap_lookup(index->dsts,
+							L_UINT_TO_PTR(dst)));
+}
+
+static uint8_t sub_ref_ele_idx(const struct l_queue_entry *entry)
+{
+	const struct sub_ref *ref = entry->data;
+
+	return ref->ele_idx;
+}
+
+struct mesh_sub_index *mesh_model_sub_index_new(void)
+{
+	return l_new(struct mesh_sub_index, 1);
+}
+
+void mesh_model_sub_index_free(struct mesh_sub_index *index)
+{
+	if (!index)
+		return;
+
+	l_hashmap_destroy(index->dsts, sub_refs_free);
+	l_free(index);
+}
+
 bool mesh_model_rx(struct mesh_node *node, bool szmict, uint32_t seq0,
 			uint32_t iv_index, uint16_t net_idx, uint16_t src,
 			uint16_t dst, uint8_t key_aid, const uint8_t *data,
@@ -893,6 +1070,7 @@ bool mesh_model_rx(struct mesh_node *node, bool szmict, uint32_t seq0,
 	int decrypt_idx, i, ele_idx;
 	uint16_t addr;
 	struct mesh_virtual *decrypt_virt = NULL;
+	const struct l_queue_entry *subs = NULL;
 	bool result = false;
 	bool is_subscription;
 
@@ -947,12 +1125,30 @@ bool mesh_model_rx(struct mesh_node *node, bool szmict, uint32_t seq0,
 
 	is_subscription = !(IS_UNICAST(dst));
 
+	/* Only visit elements with models subscribed to the destination */
+	if (is_subscription && !IS_FIXED_GROUP_ADDRESS(dst)) {
+		subs = lookup_sub_index(node, dst);
+		if (!subs)
+			goto done;
+	}
+
 	for (i = 0; i < num_ele; i++) {
 		struct l_queue *models;
 
 		if (!is_subscription && ele_idx != i)
 			continue;
 
+		if (subs) {
+			while (subs && sub_ref_ele_idx(subs) < i)
+				subs = subs->next;
+
+			if (!subs)
+				break;
+
+			if (sub_ref_ele_idx(subs) != i)
+				continue;
+		}
+
 		forward.unicast = addr + i;
 		forward.has_dst = false;
 
@@ -1089,7 +1285,7 @@ int mesh_model_pub_set(struct mesh_node *node, uint16_t addr, uint32_t id,
 		return MESH_STATUS_INVALID_PUB_PARAM;
 
 	if (!appkey_have_key(node_get_net(node), idx) ||
-			!has_binding(mod->bindings, idx))
+			!has_binding(mod, idx))
 		return MESH_STATUS_INVALID_APPKEY;
 
 	/*
@@ -1167,8 +1363,11 @@ void mesh_model_free(void *data)
 	l_queue_destroy(mod->bindings, NULL);
 	l_queue_destroy(mod->subs, NULL);
 	l_queue_destroy(mod->virtuals, unref_virt);
+	l_free(mod->binding_map);
 	l_free(mod->pub);
 	l_free(mod);
+
+	invalidate_sub_index();
 }
 
 static void remove_subs(struct mesh_node *node, struct mesh_model *mod)
@@ -1183,6 +1382,7 @@ static void remove_subs(struct mesh_node *node, struct mesh_model *mod)
 
 	l_queue_clear(mod->subs, NULL);
 	l_queue_clear(mod->virtuals, unref_virt);
+	invalidate_sub_index();
 }
 
 static struct mesh_model *model_new(uint32_t id)
@@ -1267,6 +1467,8 @@ bool mesh_model_add(struct mesh_node *node, struct l_queue *mods,
 	}
 
 	l_queue_insert(mods, mod, compare_model_id, NULL);
+	invalidate_sub_index();
+
 	return true;
 }
 
@@ -1516,6 +1718,7 @@ int mesh_model_sub_ovrt(struct mesh_node *node, uint16_t ele_addr, uint32_t id,
 
 	l_queue_clear(mod->subs, NULL);
 	l_queue_clear(mod->virtuals, unref_virt);
+	invalidate_sub_index();
 
 	add_sub(node_get_net(node), mod, addr);
 
@@ -1545,6 +1748,7 @@ int mesh_model_virt_sub_ovrt(struct mesh_node *node, uint16_t ele_addr,
 
 	l_queue_clear(mod->subs, NULL);
 	l_queue_clear(mod->virtuals, unref_virt);
+	invalidate_sub_index();
 
 	status = add_virt_sub(node_get_net(node), mod, label, addr);
 
@@ -1573,6 +1777,7 @@ int mesh_model_sub_del(struct mesh_node *node, uint16_t ele_addr, uint32_t id,
 
 	if (l_queue_remove(mod->subs, L_UINT_TO_PTR(addr))) {
 		mesh_net_dst_unreg(node_get_net(node), addr);
+		invalidate_sub_index();
 
 		if (!mod->cbs)
 			/* External models */
@@ -1605,6 +1810,7 @@ int mesh_model_virt_sub_del(struct mesh_node *node, uint16_t ele_addr,
 	if (virt) {
 		*addr = virt->addr;
 		unref_virt(virt);
+		invalidate_sub_index();
 	} else {
 		*addr = UNASSIGNED_ADDRESS;
 		return MESH_STATUS_SUCCESS;
@@ -1685,9 +1891,11 @@ static struct mesh_model *model_setup(struct mesh_net *net, uint8_t ele_idx,
 	/* Add application key bindings if present */
 	if (db_mod->bindings) {
 		mod->bindings = l_queue_new();
-		for (i = 0; i < db_mod->num_bindings; i++)
+		for (i = 0; i < db_mod->num_bindings; i++) {
 			l_queue_push_tail(mod->bindings,
 					L_UINT_TO_PTR(db_mod->bindings[i]));
+			set_binding(mod, db_mod->bindings[i], true);
+		}
 	}
 
 	mod->pub_enabled = db_mod->pub_enabled;
@@ -1989,6 +2197,16 @@ void mesh_model_init(void)
 
 void mesh_model_cleanup(void)
 {
+	int i;
+
+	l_debug("Payload decrypt attempts %u failures %u",
+				decrypt_stats.attempts, decrypt_stats.failures);
+
+	for (i = 0; i < VIRT_HASH_SIZE; i++) {
+		l_queue_destroy(virt_hash[i], NULL);
+		virt_hash[i] = NULL;
+	}
+
 	l_queue_destroy(mesh_virtuals, l_free);
 	mesh_virtuals = NULL;
 }
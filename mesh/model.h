@@ -120,5 +120,10 @@ void mesh_model_update_opts(struct mesh_node *node, uint8_t ele_idx,
 				struct l_queue *curr, struct l_queue *updated);
 uint16_t mesh_model_generate_composition(struct l_queue *mods, uint16_t buf_sz,
 								uint8_t *buf);
+struct mesh_sub_index;
+
+struct mesh_sub_index *mesh_model_sub_index_new(void);
+void mesh_model_sub_index_free(struct mesh_sub_index *index);
+
 void mesh_model_init(void);
 void mesh_model_cleanup(void);
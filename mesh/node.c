@@ -81,6 +81,7 @@ struct mesh_node {
 	char *obj_path;
 	struct mesh_agent *agent;
 	struct mesh_config *cfg;
+	struct mesh_sub_index *sub_index;
 	char *storage_dir;
 	uint32_t disc_watch;
 	uint32_t seq_number;
@@ -230,6 +231,7 @@ static struct mesh_node *node_new(const uint8_t uuid[16])
 	node->net = mesh_net_new(node);
 	node->elements = l_queue_new();
 	node->pages = l_queue_new();
+	node->sub_index = mesh_model_sub_index_new();
 	memcpy(node->uuid, uuid, sizeof(node->uuid));
 	set_defaults(node);
 
@@ -300,6 +302,7 @@ static void free_node_resources(void *data)
 	free_node_dbus_resources(node);
 	l_queue_destroy(node->elements, element_free);
 	l_queue_destroy(node->pages, l_free);
+	mesh_model_sub_index_free(node->sub_index);
 	mesh_agent_remove(node->agent);
 	mesh_config_release(node->cfg);
 	mesh_net_free(node->net);
@@ -691,6 +694,14 @@ struct l_queue *node_get_element_models(struct mesh_node *node, uint8_t ele_idx)
 	return ele->models;
 }
 
+struct mesh_sub_index *node_get_sub_index(struct mesh_node *node)
+{
+	if (!node)
+		return NULL;
+
+	return node->sub_index;
+}
+
 uint8_t node_default_ttl_get(struct mesh_node *node)
 {
 	if (!node)
@@ -23,6 +23,7 @@
 #include <stdbool.h>
 #include <errno.h>
 #include <limits.h>
+#include <time.h>
 #include <sys/stat.h>
 
 #include <glib.h>
@@ -54,22 +55,69 @@ struct att_read {
 	struct iovec *iov;
 };
 
+struct db_hash {
+	uint8_t value[16];
+	bool valid;
+};
+
 struct att_conn_data {
 	struct gatt_db *ldb;
-	struct timespec ldb_mtim;
+	struct gatt_file *lfile;
 	struct gatt_db *rdb;
-	struct timespec rdb_mtim;
+	struct gatt_file *rfile;
+	struct db_hash rdb_hash;
+	bdaddr_t src;
+	bdaddr_t id;
 	struct queue *reads;
 	uint16_t mtu;
 };
 
+/* Attribute files written by bluetoothd are parsed once and the resulting
+ * database is shared by all connections using them. The files are checked
+ * for modifications at most once per second.
+ */
+struct gatt_file {
+	char *path;
+	struct timespec mtim;
+	struct timespec checked;
+	struct gatt_db *db;
+};
+
+/* Databases discovered in the trace itself, by adapter, device identity
+ * and database hash if known.
+ */
 struct gatt_cache {
+	bdaddr_t src;
 	bdaddr_t id;
+	struct db_hash hash;
 	struct gatt_db *db;
 };
 
+static struct queue *file_list;
 static struct queue *cache_list;
 
+/* Name lookups are linear searches, so remember the names of the 16-bit
+ * UUIDs seen so far in a direct mapped cache.
+ */
+#define UUID_CACHE_SIZE		256
+
+static struct uuid_str_cache {
+	uint16_t uuid;
+	const char *str;
+} uuid_str_cache[UUID_CACHE_SIZE];
+
+static const char *uuid16_str(uint16_t uuid)
+{
+	struct uuid_str_cache *entry = &uuid_str_cache[uuid % UUID_CACHE_SIZE];
+
+	if (!entry->str || entry->uuid != uuid) {
+		entry->uuid = uuid;
+		entry->str = bt_uuid16_to_str(uuid);
+	}
+
+	return entry->str;
+}
+
 static void print_uuid(const char *label, const void *data, uint16_t size)
 {
 	const char *str;
@@ -77,7 +125,7 @@ static void print_uuid(const char *label, const void *data, uint16_t size)
 
 	switch (size) {
 	case 2:
-		str = bt_uuid16_to_str(get_le16(data));
+		str = uuid16_str(get_le16(data));
 		print_field("%s: %s (0x%4.4x)", label, str, get_le16(data));
 		break;
 	case 4:
@@ -171,8 +219,7 @@ static void print_value(struct gatt_db_attribute *attr)
 	case BT_UUID16:
 		sprintf(label, "Value Handle: 0x%4.4x Type", handle);
 		print_field("%s: %s (0x%4.4x)", label,
-				bt_uuid16_to_str(uuid->value.u16),
-				uuid->value.u16);
+				uuid16_str(uuid->value.u16), uuid->value.u16);
 		return;
 	case BT_UUID128:
 		sprintf(label, "Value Handle: 0x%4.4x Type", handle);
@@ -202,8 +249,7 @@ static void print_attribute(struct gatt_db_attribute *attr)
 	case BT_UUID16:
 		sprintf(label, "Handle: 0x%4.4x Type", handle);
 		print_field("%s: %s (0x%4.4x)", label,
-				bt_uuid16_to_str(uuid->value.u16),
-				uuid->value.u16);
+				uuid16_str(uuid->value.u16), uuid->value.u16);
 		print_value(attr);
 		return;
 	case BT_UUID128:
@@ -229,6 +275,11 @@ static void att_read_free(struct att_read *read)
 	free(read);
 }
 
+static void read_destroy(void *data)
+{
+	att_read_free(data);
+}
+
 static void print_data_list(const char *label, uint8_t length,
 					const struct l2cap_frame *frame)
 {
@@ -268,7 +319,7 @@ static void print_data_list(const char *label, uint8_t length,
 
 static void print_attribute_info(uint16_t type, const void *data, uint16_t len)
 {
-	const char *str = bt_uuid16_to_str(type);
+	const char *str = uuid16_str(type);
 
 	print_field("%s: %s (0x%4.4x)", "Attribute type", str, type);
 
@@ -404,33 +455,80 @@ static const struct bitfield_data chrc_prop_table[] = {
 	{ }
 };
 
-static bool match_cache_id(const void *data, const void *match_data)
+static void db_hash_read_value(struct gatt_db_attribute *attrib, int err,
+					const uint8_t *value, size_t length,
+					void *user_data)
+{
+	struct db_hash *hash = user_data;
+
+	if (err || length != sizeof(hash->value))
+		return;
+
+	memcpy(hash->value, value, sizeof(hash->value));
+	hash->valid = true;
+}
+
+static void db_hash_attr(struct gatt_db_attribute *attrib, void *user_data)
+{
+	gatt_db_attribute_read(attrib, 0, BT_ATT_OP_READ_REQ, NULL,
+					db_hash_read_value, user_data);
+}
+
+static void db_get_hash(struct gatt_db *db, struct db_hash *hash)
+{
+	bt_uuid_t uuid;
+
+	memset(hash, 0, sizeof(*hash));
+	bt_uuid16_create(&uuid, GATT_CHARAC_DB_HASH);
+	gatt_db_find_by_type(db, 0x0001, 0xffff, &uuid, db_hash_attr, hash);
+}
+
+struct cache_match {
+	const bdaddr_t *src;
+	const bdaddr_t *id;
+	const struct db_hash *hash;
+};
+
+static bool match_cache(const void *data, const void *match_data)
 {
 	const struct gatt_cache *cache = data;
-	const bdaddr_t *id = match_data;
+	const struct cache_match *match = match_data;
+
+	if (bacmp(&cache->src, match->src) || bacmp(&cache->id, match->id))
+		return false;
 
-	return !bacmp(&cache->id, id);
+	/* Without a hash the most recent database of the device is used */
+	if (!match->hash || !match->hash->valid)
+		return true;
+
+	return cache->hash.valid && !memcmp(cache->hash.value,
+				match->hash->value, sizeof(cache->hash.value));
 }
 
-static void gatt_cache_add(struct packet_conn_data *conn, struct gatt_db *db)
+static struct gatt_cache *gatt_cache_find(struct att_conn_data *data,
+						const struct db_hash *hash)
 {
-	struct gatt_cache *cache;
-	bdaddr_t id;
-	uint8_t id_type;
+	struct cache_match match = { &data->src, &data->id, hash };
 
-	if (!keys_resolve_identity(conn->dst, id.b, &id_type))
-		bacpy(&id, (bdaddr_t *)conn->dst);
+	return queue_find(cache_list, match_cache, &match);
+}
+
+static void gatt_cache_add(struct att_conn_data *data)
+{
+	struct gatt_cache *cache;
 
-	if (queue_find(cache_list, match_cache_id, &id))
+	if (gatt_cache_find(data, &data->rdb_hash))
 		return;
 
 	if (!cache_list)
 		cache_list = queue_new();
 
 	cache = new0(struct gatt_cache, 1);
-	bacpy(&cache->id, &id);
-	cache->db = gatt_db_ref(db);
-	queue_push_tail(cache_list, cache);
+	bacpy(&cache->src, &data->src);
+	bacpy(&cache->id, &data->id);
+	cache->hash = data->rdb_hash;
+	cache->db = gatt_db_ref(data->rdb);
+	queue_push_head(cache_list, cache);
 }
 
 static void att_conn_data_free(struct packet_conn_data *conn, void *data)
@@ -438,7 +536,7 @@ static void att_conn_data_free(struct packet_conn_data *conn, void *data)
 	struct att_conn_data *att_data = data;
 
 	if (!gatt_db_isempty(att_data->rdb))
-		gatt_cache_add(conn, att_data->rdb);
+		gatt_cache_add(att_data);
 
 	gatt_db_unref(att_data->rdb);
 	gatt_db_unref(att_data->ldb);
@@ -467,60 +565,169 @@ static struct att_conn_data *att_get_conn_data(struct packet_conn_data *conn)
 	return data;
 }
 
-static void gatt_load_db(struct gatt_db *db, const char *filename,
-						struct timespec *mtim)
+static bool match_file_path(const void *data, const void *match_data)
+{
+	const struct gatt_file *file = data;
+
+	return !strcmp(file->path, match_data);
+}
+
+static struct gatt_file *gatt_file_get(const char *path)
 {
+	struct gatt_file *file;
+
+	file = queue_find(file_list, match_file_path, path);
+	if (file)
+		return file;
+
+	if (!file_list)
+		file_list = queue_new();
+
+	file = new0(struct gatt_file, 1);
+	file->path = strdup(path);
+	queue_push_tail(file_list, file);
+
+	return file;
+}
+
+static void gatt_file_update(struct gatt_file *file)
+{
+	struct timespec now;
+	struct gatt_db *db;
 	struct stat st;
 
-	if (lstat(filename, &st))
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	if (file->checked.tv_sec && now.tv_sec == file->checked.tv_sec)
 		return;
 
-	if (!gatt_db_isempty(db)) {
-		/* Check if file has been modified since last time */
-		if (st.st_mtim.tv_sec == mtim->tv_sec &&
-				    st.st_mtim.tv_nsec == mtim->tv_nsec)
-			return;
-		/* Clear db before reloading */
-		gatt_db_clear(db);
+	file->checked = now;
+
+	if (lstat(file->path, &st))
+		return;
+
+	/* Check if file has been modified since last time */
+	if (file->db && st.st_mtim.tv_sec == file->mtim.tv_sec &&
+				st.st_mtim.tv_nsec == file->mtim.tv_nsec)
+		return;
+
+	file->mtim = st.st_mtim;
+
+	db = gatt_db_new();
+	btd_settings_gatt_db_load(db, file->path);
+
+	if (gatt_db_isempty(db)) {
+		gatt_db_unref(db);
+		return;
 	}
 
-	*mtim = st.st_mtim;
+	/* Connections still using the previous version keep their ref */
+	gatt_db_unref(file->db);
+	file->db = db;
+}
 
-	btd_settings_gatt_db_load(db, filename);
+static bool set_db(struct gatt_db **db, struct gatt_db *new_db)
+{
+	if (*db == new_db)
+		return false;
+
+	gatt_db_unref(*db);
+	*db = gatt_db_ref(new_db);
+
+	return true;
 }
 
-static void load_gatt_db(struct packet_conn_data *conn)
+static void load_files(struct packet_conn_data *conn,
+					struct att_conn_data *data)
 {
-	struct att_conn_data *data = att_get_conn_data(conn);
 	char filename[PATH_MAX];
 	char local[18];
 	char peer[18];
-	bdaddr_t id;
 	uint8_t id_type;
 
-	ba2str((bdaddr_t *)conn->src, local);
+	bacpy(&data->src, (bdaddr_t *)conn->src);
 
-	if (keys_resolve_identity(conn->dst, id.b, &id_type)) {
-		ba2str(&id, peer);
-	} else {
-		bacpy(&id, (bdaddr_t *)conn->dst);
-		ba2str((bdaddr_t *)conn->dst, peer);
-	}
+	if (!keys_resolve_identity(conn->dst, data->id.b, &id_type))
+		bacpy(&data->id, (bdaddr_t *)conn->dst);
+
+	ba2str(&data->src, local);
+	ba2str(&data->id, peer);
 
 	create_filename(filename, PATH_MAX, "/%s/attributes", local);
-	gatt_load_db(data->ldb, filename, &data->ldb_mtim);
+	data->lfile = gatt_file_get(filename);
 
 	create_filename(filename, PATH_MAX, "/%s/cache/%s", local, peer);
-	gatt_load_db(data->rdb, filename, &data->rdb_mtim);
+	data->rfile = gatt_file_get(filename);
+}
+
+static void load_gatt_db(struct packet_conn_data *conn)
+{
+	struct att_conn_data *data = att_get_conn_data(conn);
+	struct gatt_cache *cache;
+
+	/* Resolve the files once per connection */
+	if (!data->lfile)
+		load_files(conn, data);
+
+	gatt_file_update(data->lfile);
+	if (data->lfile->db)
+		set_db(&data->ldb, data->lfile->db);
+
+	/* The remote file is dropped if the device reports a different hash */
+	if (data->rfile) {
+		gatt_file_update(data->rfile);
+		if (data->rfile->db && set_db(&data->rdb, data->rfile->db))
+			db_get_hash(data->rdb, &data->rdb_hash);
+	}
 
 	/* If rdb cannot be loaded from file try local cache */
-	if (gatt_db_isempty(data->rdb)) {
-		struct gatt_cache *cache;
+	if (!gatt_db_isempty(data->rdb))
+		return;
+
+	/* Once a hash has been seen only a matching database may be used,
+	 * otherwise fall back to the most recent one of the device.
+	 */
+	cache = gatt_cache_find(data, &data->rdb_hash);
+	if (cache && set_db(&data->rdb, cache->db))
+		data->rdb_hash = cache->hash;
+}
+
+/* Called when the remote Database Hash is read, a database cached with a
+ * different hash is stale and replaced by a matching or an empty one.
+ */
+static void att_update_hash(const struct l2cap_frame *frame,
+						const uint8_t *value)
+{
+	struct packet_conn_data *conn;
+	struct att_conn_data *data;
+	struct gatt_cache *cache;
+	struct db_hash hash;
 
-		cache = queue_find(cache_list, match_cache_id, &id);
+	conn = packet_get_conn_data(frame->handle);
+	data = att_get_conn_data(conn);
+	if (!data)
+		return;
+
+	memcpy(hash.value, value, sizeof(hash.value));
+	hash.valid = true;
+
+	if (data->rdb_hash.valid && memcmp(data->rdb_hash.value, hash.value,
+						sizeof(hash.value))) {
+		data->rfile = NULL;
+
+		/* Outstanding reads may refer to the old attributes */
+		queue_remove_all(data->reads, NULL, NULL, read_destroy);
+
+		cache = gatt_cache_find(data, &hash);
 		if (cache)
-			data->rdb = gatt_db_ref(cache->db);
+			set_db(&data->rdb, cache->db);
+		else {
+			gatt_db_unref(data->rdb);
+			data->rdb = gatt_db_new();
+		}
 	}
+
+	data->rdb_hash = hash;
 }
 
 static struct gatt_db *get_db(const struct l2cap_frame *frame, bool rsp)
@@ -702,6 +909,18 @@ static void ccc_read(const struct l2cap_frame *frame)
 	print_ccc_value(frame);
 }
 
+static void db_hash_read(const struct l2cap_frame *frame)
+{
+	if (frame->size != 16) {
+		print_text(COLOR_ERROR, "  Database Hash: invalid size");
+		return;
+	}
+
+	/* Only the hash of the remote database is used for decoding */
+	if (frame->in)
+		att_update_hash(frame, frame->data);
+}
+
 static void ccc_write(const struct l2cap_frame *frame)
 {
 	print_ccc_value(frame);
@@ -4083,6 +4302,7 @@ static const struct gatt_handler {
 	GATT_HANDLER(0x2801, sec_svc_read, NULL, NULL),
 	GATT_HANDLER(0x2803, chrc_read, NULL, NULL),
 	GATT_HANDLER(0x2902, ccc_read, ccc_write, NULL),
+	GATT_HANDLER(0x2b2a, db_hash_read, NULL, NULL),
 	GATT_HANDLER(0x2bc4, ase_read, NULL, ase_notify),
 	GATT_HANDLER(0x2bc5, ase_read, NULL, ase_notify),
 	GATT_HANDLER(0x2bc6, NULL, ase_cp_write, ase_cp_notify),
@@ -4147,13 +4367,10 @@ static const struct gatt_handler {
 	GMAS
 };
 
-static const struct gatt_handler *get_handler_uuid(const bt_uuid_t *uuid)
+static const struct gatt_handler *find_handler(const bt_uuid_t *uuid)
 {
 	size_t i;
 
-	if (!uuid)
-		return NULL;
-
 	for (i = 0; i < ARRAY_SIZE(gatt_handlers); i++) {
 		const struct gatt_handler *handler = &gatt_handlers[i];
 
@@ -4164,6 +4381,33 @@ static const struct gatt_handler *get_handler_uuid(const bt_uuid_t *uuid)
 	return NULL;
 }
 
+static struct handler_cache {
+	uint16_t uuid;
+	bool valid;
+	const struct gatt_handler *handler;
+} handler_cache[UUID_CACHE_SIZE];
+
+static const struct gatt_handler *get_handler_uuid(const bt_uuid_t *uuid)
+{
+	struct handler_cache *entry;
+
+	if (!uuid)
+		return NULL;
+
+	if (uuid->type != BT_UUID16)
+		return find_handler(uuid);
+
+	/* Misses are cached too, most attributes have no handler */
+	entry = &handler_cache[uuid->value.u16 % UUID_CACHE_SIZE];
+	if (!entry->valid || entry->uuid != uuid->value.u16) {
+		entry->uuid = uuid->value.u16;
+		entry->valid = true;
+		entry->handler = find_handler(uuid);
+	}
+
+	return entry->handler;
+}
+
 static const struct gatt_handler *get_handler(struct gatt_db_attribute *attr)
 {
 	return get_handler_uuid(gatt_db_attribute_get_type(attr));
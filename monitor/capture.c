@@ -0,0 +1,404 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <linux/sock_diag.h>
+
+#include "lib/bluetooth.h"
+#include "lib/mgmt.h"
+
+#include "src/shared/util.h"
+#include "src/shared/btsnoop.h"
+#include "src/shared/mainloop.h"
+
+#include "capture.h"
+
+/* The capture thread only drains the monitor socket into the ring, all
+ * decoding and writing stays on the main loop since the decoders keep
+ * global state. While the ring is full the socket is left alone, so that
+ * any overflow shows up as kernel drops.
+ */
+#define RING_SIZE		1024
+#define RING_MASK		(RING_SIZE - 1)
+#define BATCH_SIZE		32
+#define DISPATCH_SIZE		128
+#define LATE_USEC		100000
+
+struct capture_pkt {
+	struct mgmt_hdr hdr;
+	unsigned char buf[BTSNOOP_MAX_PACKET_SIZE];
+	unsigned char control[64];
+	size_t controllen;
+	ssize_t len;
+};
+
+struct capture {
+	int fd;
+	int stop_event;
+	int ready_event;
+	int space_event;
+	pthread_t thread;
+	bool closed;
+	bool waiting;
+	unsigned int head;
+	unsigned int tail;
+	struct capture_pkt *ring;
+	uint32_t kernel_drops;
+	uint32_t late;
+	capture_func_t func;
+	void *user_data;
+};
+
+static void event_signal(int fd)
+{
+	uint64_t val = 1;
+
+	if (write(fd, &val, sizeof(val)) < 0)
+		return;
+}
+
+static void event_clear(int fd)
+{
+	uint64_t val;
+
+	if (read(fd, &val, sizeof(val)) < 0)
+		return;
+}
+
+static void update_kernel_drops(struct capture *capture)
+{
+	uint32_t meminfo[SK_MEMINFO_VARS];
+	socklen_t len = sizeof(meminfo);
+
+	if (getsockopt(capture->fd, SOL_SOCKET, SO_MEMINFO, meminfo,
+								&len) < 0)
+		return;
+
+	if (len <= SK_MEMINFO_DROPS * sizeof(uint32_t))
+		return;
+
+	__atomic_store_n(&capture->kernel_drops, meminfo[SK_MEMINFO_DROPS],
+							__ATOMIC_RELAXED);
+}
+
+static bool ring_full(struct capture *capture)
+{
+	unsigned int head = __atomic_load_n(&capture->head, __ATOMIC_ACQUIRE);
+
+	return capture->tail - head == RING_SIZE;
+}
+
+static int receive_batch(struct capture *capture)
+{
+	struct mmsghdr msgs[BATCH_SIZE];
+	struct iovec iov[BATCH_SIZE][2];
+	unsigned int head, tail, count, i;
+	int n;
+
+	tail = capture->tail;
+	head = __atomic_load_n(&capture->head, __ATOMIC_ACQUIRE);
+
+	count = RING_SIZE - (tail - head);
+	if (!count)
+		return 0;
+
+	if (count > BATCH_SIZE)
+		count = BATCH_SIZE;
+
+	memset(msgs, 0, sizeof(msgs));
+
+	for (i = 0; i < count; i++) {
+		struct capture_pkt *pkt = &capture->ring[(tail + i) & RING_MASK];
+
+		iov[i][0].iov_base = &pkt->hdr;
+		iov[i][0].iov_len = MGMT_HDR_SIZE;
+		iov[i][1].iov_base = pkt->buf;
+		iov[i][1].iov_len = sizeof(pkt->buf);
+
+		msgs[i].msg_hdr.msg_iov = iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 2;
+		msgs[i].msg_hdr.msg_control = pkt->control;
+		msgs[i].msg_hdr.msg_controllen = sizeof(pkt->control);
+	}
+
+	n = recvmmsg(capture->fd, msgs, count, MSG_DONTWAIT, NULL);
+	if (n <= 0)
+		return n < 0 && errno != EAGAIN && errno != EINTR ? -1 : 0;
+
+	for (i = 0; i < (unsigned int) n; i++) {
+		struct capture_pkt *pkt = &capture->ring[(tail + i) & RING_MASK];
+
+		pkt->len = msgs[i].msg_len;
+		pkt->controllen = msgs[i].msg_hdr.msg_controllen;
+	}
+
+	__atomic_store_n(&capture->tail, tail + n, __ATOMIC_RELEASE);
+	event_signal(capture->ready_event);
+
+	return n;
+}
+
+static void *capture_thread(void *user_data)
+{
+	struct capture *capture = user_data;
+	struct pollfd fds[3];
+
+	fds[0].fd = capture->fd;
+	fds[1].fd = capture->stop_event;
+	fds[1].events = POLLIN;
+	fds[2].fd = capture->space_event;
+	fds[2].events = POLLIN;
+
+	while (1) {
+		bool full = ring_full(capture);
+
+		/* Ask for a wakeup once the main loop has made room, and
+		 * check again in case that already happened.
+		 */
+		if (full) {
+			__atomic_store_n(&capture->waiting, true,
+							__ATOMIC_RELAXED);
+			__atomic_thread_fence(__ATOMIC_SEQ_CST);
+			full = ring_full(capture);
+		}
+
+		fds[0].events = full ? 0 : POLLIN;
+
+		if (poll(fds, 3, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		if (fds[1].revents)
+			return NULL;
+
+		if (fds[2].revents)
+			event_clear(capture->space_event);
+
+		if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL))
+			break;
+
+		/* Keep draining while the socket has data */
+		if (fds[0].revents & POLLIN) {
+			while (receive_batch(capture) == BATCH_SIZE)
+				continue;
+		}
+
+		update_kernel_drops(capture);
+	}
+
+	__atomic_store_n(&capture->closed, true, __ATOMIC_RELEASE);
+	event_signal(capture->ready_event);
+
+	return NULL;
+}
+
+static bool is_late(struct timeval *tv)
+{
+	struct timeval now, diff;
+
+	gettimeofday(&now, NULL);
+	timersub(&now, tv, &diff);
+
+	return diff.tv_sec > 0 || diff.tv_usec > LATE_USEC;
+}
+
+static void process_packet(struct capture *capture, struct capture_pkt *pkt)
+{
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct timeval *tv = NULL;
+	struct timeval ctv;
+	struct ucred *cred = NULL;
+	struct ucred ccred;
+	uint16_t opcode, index, pktlen;
+
+	if (pkt->len < MGMT_HDR_SIZE)
+		return;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_control = pkt->control;
+	msg.msg_controllen = pkt->controllen;
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+				cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET)
+			continue;
+
+		if (cmsg->cmsg_type == SCM_TIMESTAMP) {
+			memcpy(&ctv, CMSG_DATA(cmsg), sizeof(ctv));
+			tv = &ctv;
+		}
+
+		if (cmsg->cmsg_type == SCM_CREDENTIALS) {
+			memcpy(&ccred, CMSG_DATA(cmsg), sizeof(ccred));
+			cred = &ccred;
+		}
+	}
+
+	if (tv && is_late(tv))
+		capture->late++;
+
+	opcode = le16_to_cpu(pkt->hdr.opcode);
+	index  = le16_to_cpu(pkt->hdr.index);
+	pktlen = le16_to_cpu(pkt->hdr.len);
+
+	if (pktlen > pkt->len - MGMT_HDR_SIZE)
+		pktlen = pkt->len - MGMT_HDR_SIZE;
+
+	capture->func(tv, cred, index, opcode, pkt->buf, pktlen,
+					capture_get_kernel_drops(capture),
+					capture->user_data);
+}
+
+static void ready_callback(int fd, uint32_t events, void *user_data)
+{
+	struct capture *capture = user_data;
+	unsigned int head, tail, count;
+	bool closed;
+
+	event_clear(fd);
+
+	head = capture->head;
+	tail = __atomic_load_n(&capture->tail, __ATOMIC_ACQUIRE);
+
+	for (count = 0; head != tail && count < DISPATCH_SIZE; count++) {
+		process_packet(capture, &capture->ring[head & RING_MASK]);
+
+		head++;
+		__atomic_store_n(&capture->head, head, __ATOMIC_RELEASE);
+
+		/* Pick up packets captured while decoding */
+		if (head == tail)
+			tail = __atomic_load_n(&capture->tail,
+							__ATOMIC_ACQUIRE);
+	}
+
+	/* Let the capture thread resume reading */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_exchange_n(&capture->waiting, false, __ATOMIC_SEQ_CST))
+		event_signal(capture->space_event);
+
+	closed = __atomic_load_n(&capture->closed, __ATOMIC_ACQUIRE);
+
+	/* Come back for the rest after other sources had their turn */
+	if (head != __atomic_load_n(&capture->tail, __ATOMIC_ACQUIRE)) {
+		event_signal(fd);
+		return;
+	}
+
+	if (closed)
+		mainloop_remove_fd(capture->ready_event);
+}
+
+static void capture_free(void *user_data)
+{
+	struct capture *capture = user_data;
+
+	event_signal(capture->stop_event);
+	pthread_join(capture->thread, NULL);
+
+	close(capture->stop_event);
+	close(capture->ready_event);
+	close(capture->space_event);
+	close(capture->fd);
+
+	free(capture->ring);
+	free(capture);
+}
+
+struct capture *capture_start(int fd, capture_func_t func, void *user_data)
+{
+	struct capture *capture;
+
+	if (fd < 0 || !func)
+		return NULL;
+
+	capture = calloc(1, sizeof(*capture));
+	if (!capture)
+		return NULL;
+
+	capture->ring = calloc(RING_SIZE, sizeof(struct capture_pkt));
+	if (!capture->ring) {
+		free(capture);
+		return NULL;
+	}
+
+	capture->fd = fd;
+	capture->func = func;
+	capture->user_data = user_data;
+
+	capture->stop_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	capture->ready_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	capture->space_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	if (capture->stop_event < 0 || capture->ready_event < 0 ||
+						capture->space_event < 0)
+		goto failed;
+
+	if (pthread_create(&capture->thread, NULL, capture_thread, capture))
+		goto failed;
+
+	if (mainloop_add_fd(capture->ready_event, EPOLLIN, ready_callback,
+						capture, capture_free) < 0) {
+		event_signal(capture->stop_event);
+		pthread_join(capture->thread, NULL);
+		goto failed;
+	}
+
+	return capture;
+
+failed:
+	if (capture->stop_event >= 0)
+		close(capture->stop_event);
+
+	if (capture->ready_event >= 0)
+		close(capture->ready_event);
+
+	if (capture->space_event >= 0)
+		close(capture->space_event);
+
+	free(capture->ring);
+	free(capture);
+
+	return NULL;
+}
+
+void capture_stop(struct capture *capture)
+{
+	if (!capture)
+		return;
+
+	mainloop_remove_fd(capture->ready_event);
+}
+
+uint32_t capture_get_kernel_drops(struct capture *capture)
+{
+	return __atomic_load_n(&capture->kernel_drops, __ATOMIC_RELAXED);
+}
+
+uint32_t capture_get_late(struct capture *capture)
+{
+	return capture->late;
+}
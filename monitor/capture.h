@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#include <stdint.h>
+
+struct timeval;
+struct ucred;
+struct capture;
+
+typedef void (*capture_func_t)(struct timeval *tv, struct ucred *cred,
+					uint16_t index, uint16_t opcode,
+					const void *data, uint16_t size,
+					uint32_t drops, void *user_data);
+
+/* The socket is owned by the capture once started */
+struct capture *capture_start(int fd, capture_func_t func, void *user_data);
+void capture_stop(struct capture *capture);
+
+uint32_t capture_get_kernel_drops(struct capture *capture);
+uint32_t capture_get_late(struct capture *capture);
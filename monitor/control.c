@@ -45,11 +45,17 @@
 #include "tty.h"
 #include "control.h"
 #include "jlink.h"
+#include "capture.h"
+#include "output.h"
 
 static struct btsnoop *btsnoop_file = NULL;
 static bool hcidump_fallback = false;
 static bool decode_control = true;
 static uint16_t filter_index = HCI_DEV_NONE;
+static int socket_rcvbuf = 0;
+static unsigned long reader_offset = 0;
+static struct capture *monitor_capture = NULL;
+static uint32_t reported_drops = 0;
 
 struct control_data {
 	uint16_t channel;
@@ -966,8 +972,11 @@ static void data_callback(int fd, uint32_t events, void *user_data)
 							data->buf, pktlen);
 			break;
 		case HCI_CHANNEL_MONITOR:
-			btsnoop_write_hci(btsnoop_file, tv, index, opcode, 0,
-							data->buf, pktlen);
+			if (!packet_filter_match(index, opcode, data->buf,
+								pktlen))
+				break;
+
+			output_write(tv, index, opcode, 0, data->buf, pktlen);
 			ellisys_inject_hci(tv, index, opcode,
 							data->buf, pktlen);
 			packet_monitor(tv, cred, index, opcode,
@@ -977,6 +986,33 @@ static void data_callback(int fd, uint32_t events, void *user_data)
 	}
 }
 
+static void monitor_callback(struct timeval *tv, struct ucred *cred,
+					uint16_t index, uint16_t opcode,
+					const void *data, uint16_t size,
+					uint32_t drops, void *user_data)
+{
+	struct capture *capture = monitor_capture;
+
+	if (drops != reported_drops) {
+		char str[80];
+
+		snprintf(str, sizeof(str), "Dropped %u packets (late %u)",
+				drops - reported_drops,
+				capture_get_late(capture));
+		packet_system_note(tv, cred, HCI_DEV_NONE, str);
+
+		reported_drops = drops;
+	}
+
+	/* Filtered packets are neither decoded nor written */
+	if (!packet_filter_match(index, opcode, data, size))
+		return;
+
+	output_write(tv, index, opcode, drops, data, size);
+	ellisys_inject_hci(tv, index, opcode, data, size);
+	packet_monitor(tv, cred, index, opcode, data, size);
+}
+
 static int open_socket(uint16_t channel)
 {
 	struct sockaddr_hci addr;
@@ -1017,6 +1053,13 @@ static int open_socket(uint16_t channel)
 		return -1;
 	}
 
+	/* Try to go beyond rmem_max first, which needs CAP_NET_ADMIN */
+	if (socket_rcvbuf > 0 && setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE,
+				&socket_rcvbuf, sizeof(socket_rcvbuf)) < 0 &&
+			setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &socket_rcvbuf,
+						sizeof(socket_rcvbuf)) < 0)
+		perror("Failed to set receive buffer size");
+
 	return fd;
 }
 
@@ -1051,6 +1094,26 @@ static void attach_index_filter(int fd, uint16_t index)
 	setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog));
 }
 
+static int open_capture(void)
+{
+	int fd;
+
+	fd = open_socket(HCI_CHANNEL_MONITOR);
+	if (fd < 0)
+		return -1;
+
+	if (filter_index != HCI_DEV_NONE)
+		attach_index_filter(fd, filter_index);
+
+	monitor_capture = capture_start(fd, monitor_callback, NULL);
+	if (!monitor_capture) {
+		close(fd);
+		return -1;
+	}
+
+	return 0;
+}
+
 static int open_channel(uint16_t channel)
 {
 	struct control_data *data;
@@ -1109,7 +1172,9 @@ static void client_callback(int fd, uint32_t events, void *user_data)
 		opcode = le16_to_cpu(hdr->opcode);
 		index = le16_to_cpu(hdr->index);
 
-		packet_monitor(NULL, NULL, index, opcode,
+		if (packet_filter_match(index, opcode,
+					data->buf + MGMT_HDR_SIZE, pktlen))
+			packet_monitor(NULL, NULL, index, opcode,
 					data->buf + MGMT_HDR_SIZE, pktlen);
 
 		data->offset -= pktlen + MGMT_HDR_SIZE;
@@ -1300,6 +1365,7 @@ static void process_data(struct control_data *data)
 	while (data->offset >= sizeof(struct tty_hdr)) {
 		struct tty_hdr *hdr = (struct tty_hdr *) data->buf;
 		uint16_t pktlen, opcode, data_len;
+		const uint8_t *pkt;
 		struct timeval *tv = NULL;
 		struct timeval ctv;
 		uint32_t drops = 0;
@@ -1322,13 +1388,13 @@ static void process_data(struct control_data *data)
 
 		opcode = le16_to_cpu(hdr->opcode);
 		pktlen = data_len - 4 - hdr->hdr_len;
+		pkt = hdr->ext_hdr + hdr->hdr_len;
 
-		btsnoop_write_hci(btsnoop_file, tv, 0, opcode, drops,
-					hdr->ext_hdr + hdr->hdr_len, pktlen);
-		ellisys_inject_hci(tv, 0, opcode, hdr->ext_hdr + hdr->hdr_len,
-					pktlen);
-		packet_monitor(tv, NULL, 0, opcode,
-					hdr->ext_hdr + hdr->hdr_len, pktlen);
+		if (packet_filter_match(0, opcode, pkt, pktlen)) {
+			output_write(tv, 0, opcode, drops, pkt, pktlen);
+			ellisys_inject_hci(tv, 0, opcode, pkt, pktlen);
+			packet_monitor(tv, NULL, 0, opcode, pkt, pktlen);
+		}
 
 		data->offset -= 2 + data_len;
 
@@ -1465,11 +1531,21 @@ int control_rtt(char *jlink, char *rtt)
 	return 0;
 }
 
-bool control_writer(const char *path)
+/* Skip forward to the given number of seconds after the first packet */
+static void seek_reader(void *buf)
 {
-	btsnoop_file = btsnoop_create(path, 0, 0, BTSNOOP_FORMAT_MONITOR);
+	struct timeval tv;
+	uint16_t index, opcode, pktlen;
+
+	if (!btsnoop_read_hci(btsnoop_file, &tv, &index, &opcode, buf,
+								&pktlen))
+		return;
 
-	return !!btsnoop_file;
+	tv.tv_sec += reader_offset;
+
+	if (!btsnoop_seek(btsnoop_file, &tv))
+		fprintf(stderr, "Failed to seek to offset %lu\n",
+							reader_offset);
 }
 
 void control_reader(const char *path, bool pager)
@@ -1500,6 +1576,9 @@ void control_reader(const char *path, bool pager)
 	if (pager)
 		open_pager();
 
+	if (reader_offset)
+		seek_reader(buf);
+
 	switch (format) {
 	case BTSNOOP_FORMAT_HCI:
 	case BTSNOOP_FORMAT_UART:
@@ -1514,6 +1593,16 @@ void control_reader(const char *path, bool pager)
 			if (opcode == 0xffff)
 				continue;
 
+			if (!packet_filter_match(index, opcode, buf, pktlen))
+				continue;
+
+			/* Converting or splitting skips the decoding */
+			if (output_enabled()) {
+				output_write(&tv, index, opcode, 0, buf,
+									pktlen);
+				continue;
+			}
+
 			packet_monitor(&tv, NULL, index, opcode, buf, pktlen);
 			ellisys_inject_hci(&tv, index, opcode, buf, pktlen);
 		}
@@ -1545,7 +1634,7 @@ int control_tracing(void)
 	if (server_fd >= 0)
 		return 0;
 
-	if (open_channel(HCI_CHANNEL_MONITOR) < 0) {
+	if (open_capture() < 0) {
 		if (!hcidump_fallback)
 			return -1;
 		if (hcidump_tracing() < 0)
@@ -1568,3 +1657,13 @@ void control_filter_index(uint16_t index)
 {
 	filter_index = index;
 }
+
+void control_set_rcvbuf(int size)
+{
+	socket_rcvbuf = size;
+}
+
+void control_set_offset(unsigned long offset)
+{
+	reader_offset = offset;
+}
@@ -11,7 +11,6 @@
 
 #include <stdint.h>
 
-bool control_writer(const char *path);
 void control_reader(const char *path, bool pager);
 void control_server(const char *path);
 int control_tty(const char *path, unsigned int speed);
@@ -19,5 +18,7 @@ int control_rtt(char *jlink, char *rtt);
 int control_tracing(void);
 void control_disable_decoding(void);
 void control_filter_index(uint16_t index);
+void control_set_rcvbuf(int size);
+void control_set_offset(unsigned long offset);
 
 void control_message(uint16_t opcode, const void *data, uint16_t size);
@@ -0,0 +1,783 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include "src/shared/util.h"
+#include "src/shared/queue.h"
+#include "src/shared/btsnoop.h"
+
+#include "filter.h"
+
+/* Expressions are compiled into a flat program in postfix order, which is
+ * run over a small stack of booleans for every packet. Only HCI packets are
+ * subject to filtering, index and system messages always match so that the
+ * output stays decodable.
+ */
+#define MAX_INSNS		256
+#define MAX_DEPTH		32
+
+#define FIELD_TRACK_ADDR	(1 << 0)
+#define FIELD_TRACK_CID		(1 << 1)
+
+#define NO_OFFSET		0xff
+
+enum {
+	OP_INDEX,
+	OP_IN,
+	OP_OUT,
+	OP_CMD,
+	OP_EVT,
+	OP_ACL,
+	OP_SCO,
+	OP_ISO,
+	OP_OPCODE,
+	OP_EVENT,
+	OP_SUBEVENT,
+	OP_HANDLE,
+	OP_ADDR,
+	OP_CID,
+	OP_ATT_HANDLE,
+	OP_AND,
+	OP_OR,
+	OP_NOT,
+};
+
+struct filter_insn {
+	uint8_t op;
+	uint16_t value;
+	uint8_t addr[6];
+};
+
+struct filter_conn {
+	uint16_t index;
+	uint16_t handle;
+	bool has_addr;
+	uint8_t addr[6];
+	int cid[2];
+};
+
+struct filter {
+	struct filter_insn insns[MAX_INSNS];
+	unsigned int len;
+	unsigned int fields;
+	struct queue *conns;
+	uint8_t addr[6];
+};
+
+struct filter_pkt {
+	uint16_t index;
+	uint16_t opcode;
+	bool in;
+	int hci_opcode;
+	int event;
+	int subevent;
+	int handle;
+	const uint8_t *addr;
+	int cid;
+	int att_handle;
+	bool disconnected;
+};
+
+struct field_offset {
+	uint16_t code;
+	uint8_t handle;
+	uint8_t addr;
+	uint8_t status;
+};
+
+static const struct field_offset cmd_table[] = {
+	{ 0x0405, NO_OFFSET, 0, NO_OFFSET },	/* Create Connection */
+	{ 0x0406, 0, NO_OFFSET, NO_OFFSET },	/* Disconnect */
+	{ 0x040b, NO_OFFSET, 0, NO_OFFSET },	/* Link Key Request Reply */
+	{ 0x0411, 0, NO_OFFSET, NO_OFFSET },	/* Auth Requested */
+	{ 0x0413, 0, NO_OFFSET, NO_OFFSET },	/* Set Conn Encryption */
+	{ 0x0419, NO_OFFSET, 0, NO_OFFSET },	/* Remote Name Request */
+	{ 0x041b, 0, NO_OFFSET, NO_OFFSET },	/* Read Remote Features */
+	{ 0x041d, 0, NO_OFFSET, NO_OFFSET },	/* Read Remote Version */
+	{ 0x200d, NO_OFFSET, 6, NO_OFFSET },	/* LE Create Connection */
+	{ 0x2013, 0, NO_OFFSET, NO_OFFSET },	/* LE Connection Update */
+	{ 0x2016, 0, NO_OFFSET, NO_OFFSET },	/* LE Read Remote Feat */
+	{ 0x2019, 0, NO_OFFSET, NO_OFFSET },	/* LE Start Encryption */
+	{ 0x201a, 0, NO_OFFSET, NO_OFFSET },	/* LE LTK Request Reply */
+	{ 0x201b, 0, NO_OFFSET, NO_OFFSET },	/* LE LTK Neg Reply */
+	{ 0x2022, 0, NO_OFFSET, NO_OFFSET },	/* LE Set Data Length */
+	{ 0x2030, 0, NO_OFFSET, NO_OFFSET },	/* LE Read PHY */
+	{ 0x2032, 0, NO_OFFSET, NO_OFFSET },	/* LE Set PHY */
+	{ 0x2043, NO_OFFSET, 3, NO_OFFSET },	/* LE Ext Create Conn */
+	{ }
+};
+
+static const struct field_offset evt_table[] = {
+	{ 0x03, 1, 3, 0 },			/* Connection Complete */
+	{ 0x04, NO_OFFSET, 0, NO_OFFSET },	/* Connection Request */
+	{ 0x05, 1, NO_OFFSET, NO_OFFSET },	/* Disconnect Complete */
+	{ 0x06, 1, NO_OFFSET, NO_OFFSET },	/* Auth Complete */
+	{ 0x07, NO_OFFSET, 1, NO_OFFSET },	/* Remote Name Req Complete */
+	{ 0x08, 1, NO_OFFSET, NO_OFFSET },	/* Encryption Change */
+	{ 0x0b, 1, NO_OFFSET, NO_OFFSET },	/* Remote Features Complete */
+	{ 0x0c, 1, NO_OFFSET, NO_OFFSET },	/* Remote Version Complete */
+	{ 0x17, NO_OFFSET, 0, NO_OFFSET },	/* Link Key Request */
+	{ 0x2c, 1, 3, 0 },			/* Sync Connection Complete */
+	{ 0x30, 1, NO_OFFSET, NO_OFFSET },	/* Key Refresh Complete */
+	{ 0x31, NO_OFFSET, 0, NO_OFFSET },	/* IO Capability Request */
+	{ 0x33, NO_OFFSET, 0, NO_OFFSET },	/* User Confirm Request */
+	{ 0x59, 1, NO_OFFSET, NO_OFFSET },	/* Encryption Change v2 */
+	{ }
+};
+
+/* Offsets of LE Meta events include the subevent code */
+static const struct field_offset le_evt_table[] = {
+	{ 0x01, 2, 6, 1 },			/* Connection Complete */
+	{ 0x03, 2, NO_OFFSET, NO_OFFSET },	/* Conn Update Complete */
+	{ 0x04, 2, NO_OFFSET, NO_OFFSET },	/* Remote Features Complete */
+	{ 0x05, 1, NO_OFFSET, NO_OFFSET },	/* LTK Request */
+	{ 0x06, 1, NO_OFFSET, NO_OFFSET },	/* Remote Conn Param Req */
+	{ 0x07, 1, NO_OFFSET, NO_OFFSET },	/* Data Length Change */
+	{ 0x0a, 2, 6, 1 },			/* Enh Conn Complete */
+	{ 0x0c, 2, NO_OFFSET, NO_OFFSET },	/* PHY Update Complete */
+	{ 0x19, 2, NO_OFFSET, NO_OFFSET },	/* CIS Established */
+	{ 0x1a, 1, NO_OFFSET, NO_OFFSET },	/* CIS Request */
+	{ 0x29, 2, 6, 1 },			/* Enh Conn Complete v2 */
+	{ }
+};
+
+/* Offsets are relative to the ATT opcode */
+static const struct field_offset att_table[] = {
+	{ 0x01, 2, NO_OFFSET, NO_OFFSET },	/* Error Response */
+	{ 0x0a, 1, NO_OFFSET, NO_OFFSET },	/* Read Request */
+	{ 0x0c, 1, NO_OFFSET, NO_OFFSET },	/* Read Blob Request */
+	{ 0x12, 1, NO_OFFSET, NO_OFFSET },	/* Write Request */
+	{ 0x16, 1, NO_OFFSET, NO_OFFSET },	/* Prepare Write Request */
+	{ 0x17, 1, NO_OFFSET, NO_OFFSET },	/* Prepare Write Response */
+	{ 0x1b, 1, NO_OFFSET, NO_OFFSET },	/* Notification */
+	{ 0x1d, 1, NO_OFFSET, NO_OFFSET },	/* Indication */
+	{ 0x52, 1, NO_OFFSET, NO_OFFSET },	/* Write Command */
+	{ 0xd2, 1, NO_OFFSET, NO_OFFSET },	/* Signed Write Command */
+	{ }
+};
+
+static const struct {
+	const char *str;
+	uint8_t op;
+	enum { ARG_NONE, ARG_NUM, ARG_ADDR } arg;
+} keywords[] = {
+	{ "index",	OP_INDEX,	ARG_NUM		},
+	{ "in",		OP_IN,		ARG_NONE	},
+	{ "out",	OP_OUT,		ARG_NONE	},
+	{ "cmd",	OP_CMD,		ARG_NONE	},
+	{ "evt",	OP_EVT,		ARG_NONE	},
+	{ "acl",	OP_ACL,		ARG_NONE	},
+	{ "sco",	OP_SCO,		ARG_NONE	},
+	{ "iso",	OP_ISO,		ARG_NONE	},
+	{ "opcode",	OP_OPCODE,	ARG_NUM		},
+	{ "event",	OP_EVENT,	ARG_NUM		},
+	{ "subevent",	OP_SUBEVENT,	ARG_NUM		},
+	{ "handle",	OP_HANDLE,	ARG_NUM		},
+	{ "addr",	OP_ADDR,	ARG_ADDR	},
+	{ "cid",	OP_CID,		ARG_NUM		},
+	{ "atthandle",	OP_ATT_HANDLE,	ARG_NUM		},
+	{ }
+};
+
+struct parser {
+	struct filter *filter;
+	const char *str;
+	const char *pos;
+	char token[32];
+	unsigned int depth;
+	bool error;
+};
+
+static void next_token(struct parser *p)
+{
+	size_t len = 0;
+
+	while (isspace(*p->pos))
+		p->pos++;
+
+	p->str = p->pos;
+
+	if (*p->pos == '(' || *p->pos == ')' || *p->pos == '!') {
+		p->token[len++] = *p->pos++;
+	} else if ((p->pos[0] == '&' && p->pos[1] == '&') ||
+				(p->pos[0] == '|' && p->pos[1] == '|')) {
+		p->token[len++] = *p->pos++;
+		p->token[len++] = *p->pos++;
+	} else {
+		while (isalnum(*p->pos) || *p->pos == ':') {
+			if (len == sizeof(p->token) - 1) {
+				p->error = true;
+				break;
+			}
+
+			p->token[len++] = *p->pos++;
+		}
+
+		/* Unknown character */
+		if (!len && *p->pos)
+			p->error = true;
+	}
+
+	p->token[len] = '\0';
+}
+
+static bool accept(struct parser *p, const char *a, const char *b)
+{
+	if (p->error)
+		return false;
+
+	if (strcasecmp(p->token, a) && strcasecmp(p->token, b))
+		return false;
+
+	next_token(p);
+
+	return true;
+}
+
+static struct filter_insn *emit(struct parser *p, uint8_t op)
+{
+	struct filter *filter = p->filter;
+	struct filter_insn *insn;
+
+	if (filter->len == MAX_INSNS) {
+		p->error = true;
+		return NULL;
+	}
+
+	switch (op) {
+	case OP_AND:
+	case OP_OR:
+		p->depth--;
+		break;
+	case OP_NOT:
+		break;
+	default:
+		if (++p->depth > MAX_DEPTH)
+			p->error = true;
+		break;
+	}
+
+	insn = &filter->insns[filter->len++];
+	memset(insn, 0, sizeof(*insn));
+	insn->op = op;
+
+	return insn;
+}
+
+static bool parse_addr(const char *str, uint8_t *addr)
+{
+	unsigned int b[6];
+	int i, n;
+
+	if (sscanf(str, "%2x:%2x:%2x:%2x:%2x:%2x%n", &b[5], &b[4], &b[3],
+					&b[2], &b[1], &b[0], &n) != 6)
+		return false;
+
+	if (str[n] != '\0')
+		return false;
+
+	for (i = 0; i < 6; i++)
+		addr[i] = b[i];
+
+	return true;
+}
+
+static void parse_primitive(struct parser *p)
+{
+	struct filter_insn *insn;
+	unsigned long value;
+	char *endptr;
+	int i;
+
+	if (p->error)
+		return;
+
+	for (i = 0; keywords[i].str; i++) {
+		if (!strcasecmp(p->token, keywords[i].str))
+			break;
+	}
+
+	if (!keywords[i].str) {
+		p->error = true;
+		return;
+	}
+
+	next_token(p);
+
+	insn = emit(p, keywords[i].op);
+	if (!insn)
+		return;
+
+	switch (keywords[i].arg) {
+	case ARG_NONE:
+		return;
+	case ARG_NUM:
+		value = strtoul(p->token, &endptr, 0);
+		if (!p->token[0] || *endptr != '\0' || value > UINT16_MAX) {
+			p->error = true;
+			return;
+		}
+
+		insn->value = value;
+		break;
+	case ARG_ADDR:
+		if (!parse_addr(p->token, insn->addr)) {
+			p->error = true;
+			return;
+		}
+
+		p->filter->fields |= FIELD_TRACK_ADDR;
+		break;
+	}
+
+	if (insn->op == OP_CID || insn->op == OP_ATT_HANDLE)
+		p->filter->fields |= FIELD_TRACK_CID;
+
+	next_token(p);
+}
+
+static void parse_or(struct parser *p);
+
+static void parse_not(struct parser *p)
+{
+	if (accept(p, "not", "!")) {
+		parse_not(p);
+		emit(p, OP_NOT);
+		return;
+	}
+
+	if (accept(p, "(", "(")) {
+		parse_or(p);
+
+		if (!accept(p, ")", ")"))
+			p->error = true;
+
+		return;
+	}
+
+	parse_primitive(p);
+}
+
+static void parse_and(struct parser *p)
+{
+	parse_not(p);
+
+	while (accept(p, "and", "&&")) {
+		parse_not(p);
+		emit(p, OP_AND);
+	}
+}
+
+static void parse_or(struct parser *p)
+{
+	parse_and(p);
+
+	while (accept(p, "or", "||")) {
+		parse_and(p);
+		emit(p, OP_OR);
+	}
+}
+
+struct filter *filter_compile(const char *str)
+{
+	struct filter *filter;
+	struct parser p;
+
+	filter = new0(struct filter, 1);
+
+	memset(&p, 0, sizeof(p));
+	p.filter = filter;
+	p.pos = str;
+
+	next_token(&p);
+	parse_or(&p);
+
+	if (p.error || p.token[0]) {
+		if (*p.str)
+			fprintf(stderr, "Invalid filter expression at \"%s\"\n",
+									p.str);
+		else
+			fprintf(stderr, "Incomplete filter expression\n");
+
+		free(filter);
+		return NULL;
+	}
+
+	filter->conns = queue_new();
+
+	return filter;
+}
+
+void filter_free(struct filter *filter)
+{
+	if (!filter)
+		return;
+
+	queue_destroy(filter->conns, free);
+	free(filter);
+}
+
+static const struct field_offset *find_offset(const struct field_offset *table,
+								uint16_t code)
+{
+	for (; table->code; table++) {
+		if (table->code == code)
+			return table;
+	}
+
+	return NULL;
+}
+
+static struct filter_conn *get_conn(struct filter *filter, uint16_t index,
+						uint16_t handle, bool create)
+{
+	const struct queue_entry *entry;
+	struct filter_conn *conn;
+
+	for (entry = queue_get_entries(filter->conns); entry;
+						entry = entry->next) {
+		conn = entry->data;
+
+		if (conn->index == index && conn->handle == handle)
+			return conn;
+	}
+
+	if (!create)
+		return NULL;
+
+	conn = new0(struct filter_conn, 1);
+	conn->index = index;
+	conn->handle = handle;
+	conn->cid[0] = -1;
+	conn->cid[1] = -1;
+	queue_push_tail(filter->conns, conn);
+
+	return conn;
+}
+
+static void parse_params(struct filter *filter, struct filter_pkt *pkt,
+				const struct field_offset *offset,
+				const uint8_t *params, uint16_t plen)
+{
+	struct filter_conn *conn;
+
+	if (!offset)
+		return;
+
+	if (offset->handle != NO_OFFSET && plen >= offset->handle + 2)
+		pkt->handle = get_le16(params + offset->handle) & 0x0fff;
+
+	if (offset->addr != NO_OFFSET && plen >= offset->addr + 6)
+		pkt->addr = params + offset->addr;
+
+	if (!(filter->fields & FIELD_TRACK_ADDR) ||
+					offset->status == NO_OFFSET)
+		return;
+
+	if (pkt->handle < 0 || !pkt->addr || params[offset->status])
+		return;
+
+	conn = get_conn(filter, pkt->index, pkt->handle, true);
+	memcpy(conn->addr, pkt->addr, 6);
+	conn->has_addr = true;
+	conn->cid[0] = -1;
+	conn->cid[1] = -1;
+}
+
+static void parse_cmd(struct filter *filter, struct filter_pkt *pkt,
+					const uint8_t *data, uint16_t size)
+{
+	if (size < 3)
+		return;
+
+	pkt->hci_opcode = get_le16(data);
+
+	parse_params(filter, pkt, find_offset(cmd_table, pkt->hci_opcode),
+							data + 3, size - 3);
+}
+
+static void parse_evt(struct filter *filter, struct filter_pkt *pkt,
+					const uint8_t *data, uint16_t size)
+{
+	const uint8_t *params;
+	uint16_t plen;
+
+	if (size < 2)
+		return;
+
+	pkt->event = data[0];
+	params = data + 2;
+	plen = size - 2;
+
+	switch (pkt->event) {
+	case 0x0e:
+		if (plen >= 3)
+			pkt->hci_opcode = get_le16(params + 1);
+		break;
+	case 0x0f:
+		if (plen >= 4)
+			pkt->hci_opcode = get_le16(params + 2);
+		break;
+	case 0x3e:
+		if (plen < 1)
+			break;
+
+		pkt->subevent = params[0];
+		parse_params(filter, pkt, find_offset(le_evt_table,
+						pkt->subevent), params, plen);
+		break;
+	default:
+		/* Disconnect Complete */
+		if (pkt->event == 0x05 && plen >= 1 && !params[0])
+			pkt->disconnected = true;
+
+		parse_params(filter, pkt, find_offset(evt_table, pkt->event),
+								params, plen);
+		break;
+	}
+}
+
+static void parse_acl(struct filter *filter, struct filter_pkt *pkt,
+					const uint8_t *data, uint16_t size)
+{
+	const struct field_offset *offset;
+	struct filter_conn *conn = NULL;
+	uint16_t handle;
+	uint8_t flags;
+
+	if (size < 4)
+		return;
+
+	handle = get_le16(data);
+	flags = handle >> 12;
+	pkt->handle = handle & 0x0fff;
+
+	if (filter->fields & FIELD_TRACK_CID)
+		conn = get_conn(filter, pkt->index, pkt->handle, true);
+
+	/* Continuation fragments belong to the channel of the last start */
+	if ((flags & 0x03) == 0x01) {
+		if (conn)
+			pkt->cid = conn->cid[pkt->in];
+		return;
+	}
+
+	if (size < 8)
+		return;
+
+	pkt->cid = get_le16(data + 6);
+
+	if (conn)
+		conn->cid[pkt->in] = pkt->cid;
+
+	if (pkt->cid != 0x0004 || size < 9)
+		return;
+
+	offset = find_offset(att_table, data[8]);
+	if (offset && size >= 8 + offset->handle + 2)
+		pkt->att_handle = get_le16(data + 8 + offset->handle);
+}
+
+static void parse_pkt(struct filter *filter, struct filter_pkt *pkt,
+					const uint8_t *data, uint16_t size)
+{
+	struct filter_conn *conn;
+
+	switch (pkt->opcode) {
+	case BTSNOOP_OPCODE_COMMAND_PKT:
+		parse_cmd(filter, pkt, data, size);
+		break;
+	case BTSNOOP_OPCODE_EVENT_PKT:
+		parse_evt(filter, pkt, data, size);
+		break;
+	case BTSNOOP_OPCODE_ACL_TX_PKT:
+	case BTSNOOP_OPCODE_ACL_RX_PKT:
+		parse_acl(filter, pkt, data, size);
+		break;
+	case BTSNOOP_OPCODE_SCO_TX_PKT:
+	case BTSNOOP_OPCODE_SCO_RX_PKT:
+	case BTSNOOP_OPCODE_ISO_TX_PKT:
+	case BTSNOOP_OPCODE_ISO_RX_PKT:
+		if (size >= 2)
+			pkt->handle = get_le16(data) & 0x0fff;
+		break;
+	}
+
+	if (pkt->handle < 0 || !filter->fields)
+		return;
+
+	conn = get_conn(filter, pkt->index, pkt->handle, false);
+	if (!conn)
+		return;
+
+	/* Copied since the connection may go away with this packet */
+	if (!pkt->addr && conn->has_addr) {
+		memcpy(filter->addr, conn->addr, 6);
+		pkt->addr = filter->addr;
+	}
+
+	if (pkt->disconnected) {
+		queue_remove(filter->conns, conn);
+		free(conn);
+	}
+}
+
+static bool match_insn(const struct filter_insn *insn,
+						const struct filter_pkt *pkt)
+{
+	switch (insn->op) {
+	case OP_INDEX:
+		return pkt->index == insn->value;
+	case OP_IN:
+		return pkt->in;
+	case OP_OUT:
+		return !pkt->in;
+	case OP_CMD:
+		return pkt->opcode == BTSNOOP_OPCODE_COMMAND_PKT;
+	case OP_EVT:
+		return pkt->opcode == BTSNOOP_OPCODE_EVENT_PKT;
+	case OP_ACL:
+		return pkt->opcode == BTSNOOP_OPCODE_ACL_TX_PKT ||
+				pkt->opcode == BTSNOOP_OPCODE_ACL_RX_PKT;
+	case OP_SCO:
+		return pkt->opcode == BTSNOOP_OPCODE_SCO_TX_PKT ||
+				pkt->opcode == BTSNOOP_OPCODE_SCO_RX_PKT;
+	case OP_ISO:
+		return pkt->opcode == BTSNOOP_OPCODE_ISO_TX_PKT ||
+				pkt->opcode == BTSNOOP_OPCODE_ISO_RX_PKT;
+	case OP_OPCODE:
+		return pkt->hci_opcode == insn->value;
+	case OP_EVENT:
+		return pkt->event == insn->value;
+	case OP_SUBEVENT:
+		return pkt->subevent == insn->value;
+	case OP_HANDLE:
+		return pkt->handle == insn->value;
+	case OP_ADDR:
+		return pkt->addr && !memcmp(pkt->addr, insn->addr, 6);
+	case OP_CID:
+		return pkt->cid == insn->value;
+	case OP_ATT_HANDLE:
+		return pkt->att_handle == insn->value;
+	}
+
+	return false;
+}
+
+static bool init_pkt(struct filter_pkt *pkt, uint16_t index, uint16_t opcode)
+{
+	switch (opcode) {
+	case BTSNOOP_OPCODE_COMMAND_PKT:
+	case BTSNOOP_OPCODE_ACL_TX_PKT:
+	case BTSNOOP_OPCODE_SCO_TX_PKT:
+	case BTSNOOP_OPCODE_ISO_TX_PKT:
+		pkt->in = false;
+		break;
+	case BTSNOOP_OPCODE_EVENT_PKT:
+	case BTSNOOP_OPCODE_ACL_RX_PKT:
+	case BTSNOOP_OPCODE_SCO_RX_PKT:
+	case BTSNOOP_OPCODE_ISO_RX_PKT:
+		pkt->in = true;
+		break;
+	default:
+		return false;
+	}
+
+	pkt->index = index;
+	pkt->opcode = opcode;
+	pkt->hci_opcode = -1;
+	pkt->event = -1;
+	pkt->subevent = -1;
+	pkt->handle = -1;
+	pkt->addr = NULL;
+	pkt->cid = -1;
+	pkt->att_handle = -1;
+	pkt->disconnected = false;
+
+	return true;
+}
+
+bool filter_match(struct filter *filter, uint16_t index, uint16_t opcode,
+					const void *data, uint16_t size)
+{
+	bool stack[MAX_DEPTH];
+	struct filter_pkt pkt;
+	unsigned int i, sp = 0;
+
+	if (!filter || !filter->len)
+		return true;
+
+	/* Anything but HCI traffic always passes */
+	if (!init_pkt(&pkt, index, opcode))
+		return true;
+
+	parse_pkt(filter, &pkt, data, size);
+
+	for (i = 0; i < filter->len; i++) {
+		const struct filter_insn *insn = &filter->insns[i];
+
+		switch (insn->op) {
+		case OP_AND:
+			sp--;
+			stack[sp - 1] = stack[sp - 1] && stack[sp];
+			break;
+		case OP_OR:
+			sp--;
+			stack[sp - 1] = stack[sp - 1] || stack[sp];
+			break;
+		case OP_NOT:
+			stack[sp - 1] = !stack[sp - 1];
+			break;
+		default:
+			stack[sp++] = match_insn(insn, &pkt);
+			break;
+		}
+	}
+
+	return stack[0];
+}
+
+/* Connection tracking only, for sorting packets by connection or device */
+struct filter *filter_new(void)
+{
+	struct filter *filter;
+
+	filter = new0(struct filter, 1);
+	filter->fields = FIELD_TRACK_ADDR;
+	filter->conns = queue_new();
+
+	return filter;
+}
+
+bool filter_get_conn(struct filter *filter, uint16_t index, uint16_t opcode,
+					const void *data, uint16_t size,
+					int *handle, const uint8_t **addr,
+					bool *disconnected)
+{
+	struct filter_pkt pkt;
+
+	if (!filter || !init_pkt(&pkt, index, opcode))
+		return false;
+
+	parse_pkt(filter, &pkt, data, size);
+
+	*handle = pkt.handle;
+	*addr = pkt.addr;
+	*disconnected = pkt.disconnected;
+
+	return pkt.handle >= 0 || pkt.addr;
+}
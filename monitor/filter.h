@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct filter;
+
+struct filter *filter_compile(const char *str);
+void filter_free(struct filter *filter);
+
+bool filter_match(struct filter *filter, uint16_t index, uint16_t opcode,
+					const void *data, uint16_t size);
+
+struct filter *filter_new(void);
+/* The address is only valid until the next packet is passed in */
+bool filter_get_conn(struct filter *filter, uint16_t index, uint16_t opcode,
+					const void *data, uint16_t size,
+					int *handle, const uint8_t **addr,
+					bool *disconnected);
@@ -86,9 +86,10 @@
 #define L2CAP_SAR_END		0x02
 #define L2CAP_SAR_CONTINUE	0x03
 
-#define MAX_CHAN 64
+#define CONN_HASH_SIZE 64
 
 struct chan_data {
+	uint16_t id;
 	uint16_t index;
 	uint16_t handle;
 	uint8_t ident;
@@ -103,125 +104,271 @@ struct chan_data {
 	struct packet_latency tx_l;
 };
 
-static struct chan_data chan_list[MAX_CHAN];
+struct chan_conn {
+	uint16_t index;
+	uint16_t handle;
+	struct queue *chans;
+};
+
+/* Channels are kept per connection, with the connections hashed by index
+ * and handle. The id of each channel is its slot in chan_ids and is what
+ * frame->chan refers to, released channels are recycled so ids stay small.
+ */
+static struct queue *conn_table[CONN_HASH_SIZE];
+static struct chan_data **chan_ids;
+static unsigned int chan_ids_size;
+static unsigned int chan_ids_alloc;
+static struct queue *chan_free;
+
+/* Channels created on an AMP controller receive data on ctrlid instead */
+static struct queue *amp_chans;
+
+static unsigned int conn_hash(uint16_t index, uint16_t handle)
+{
+	return (index * 31 + handle) % CONN_HASH_SIZE;
+}
+
+static struct chan_conn *get_conn(uint16_t index, uint16_t handle,
+								bool create)
+{
+	struct queue **bucket = &conn_table[conn_hash(index, handle)];
+	const struct queue_entry *entry;
+	struct chan_conn *conn;
+
+	for (entry = queue_get_entries(*bucket); entry; entry = entry->next) {
+		conn = entry->data;
+
+		if (conn->index == index && conn->handle == handle)
+			return conn;
+	}
+
+	if (!create)
+		return NULL;
+
+	if (!*bucket)
+		*bucket = queue_new();
+
+	conn = new0(struct chan_conn, 1);
+	conn->index = index;
+	conn->handle = handle;
+	conn->chans = queue_new();
+	queue_push_tail(*bucket, conn);
+
+	return conn;
+}
+
+static struct chan_data *chan_alloc(void)
+{
+	struct chan_data *chan;
+
+	chan = queue_pop_head(chan_free);
+	if (chan)
+		return chan;
+
+	/* UINT16_MAX is reserved for frames without a channel */
+	if (chan_ids_size == UINT16_MAX)
+		return NULL;
+
+	if (chan_ids_size == chan_ids_alloc) {
+		unsigned int size = chan_ids_alloc ? chan_ids_alloc * 2 : 64;
+		struct chan_data **ids;
+
+		ids = realloc(chan_ids, size * sizeof(*ids));
+		if (!ids)
+			return NULL;
+
+		chan_ids = ids;
+		chan_ids_alloc = size;
+	}
+
+	chan = new0(struct chan_data, 1);
+	chan->id = chan_ids_size++;
+	chan_ids[chan->id] = chan;
+
+	return chan;
+}
+
+static void chan_reset(struct chan_data *chan)
+{
+	uint16_t id = chan->id;
+
+	memset(chan, 0, sizeof(*chan));
+	chan->id = id;
+}
+
+static void chan_release(struct chan_conn *conn, struct chan_data *chan)
+{
+	queue_remove(conn->chans, chan);
+
+	if (chan->ctrlid)
+		queue_remove(amp_chans, chan);
+
+	chan->handle = 0;
+
+	if (!chan_free)
+		chan_free = queue_new();
+
+	queue_push_tail(chan_free, chan);
+}
+
+void l2cap_release_conn(uint16_t index, uint16_t handle)
+{
+	struct queue *bucket = conn_table[conn_hash(index, handle)];
+	struct chan_conn *conn;
+	struct chan_data *chan;
+
+	conn = get_conn(index, handle, false);
+	if (!conn)
+		return;
+
+	while ((chan = queue_peek_head(conn->chans)))
+		chan_release(conn, chan);
+
+	queue_remove(bucket, conn);
+	queue_destroy(conn->chans, NULL);
+	free(conn);
+}
+
+static struct chan_data *find_chan(struct chan_conn *conn, bool in,
+								uint16_t cid)
+{
+	const struct queue_entry *entry;
+
+	if (!conn)
+		return NULL;
+
+	for (entry = queue_get_entries(conn->chans); entry;
+						entry = entry->next) {
+		struct chan_data *chan = entry->data;
+
+		if (in ? chan->scid == cid : chan->dcid == cid)
+			return chan;
+	}
+
+	return NULL;
+}
+
+static struct chan_data *find_frame_chan(const struct l2cap_frame *frame,
+								uint16_t cid)
+{
+	return find_chan(get_conn(frame->index, frame->handle, false),
+							frame->in, cid);
+}
 
 static void assign_scid(const struct l2cap_frame *frame, uint16_t scid,
 			uint16_t psm, uint8_t mode, uint8_t ctrlid)
 {
-	int i, n = -1;
+	const struct queue_entry *entry;
+	struct chan_conn *conn;
+	struct chan_data *chan = NULL;
 	uint8_t seq_num = 1;
 
 	if (!scid)
 		return;
 
-	for (i = 0; i < MAX_CHAN; i++) {
-		if (n < 0 && chan_list[i].handle == 0x0000) {
-			n = i;
-			continue;
-		}
+	conn = get_conn(frame->index, frame->handle, true);
 
-		if (chan_list[i].index != frame->index)
-			continue;
+	for (entry = queue_get_entries(conn->chans); entry;
+						entry = entry->next) {
+		struct chan_data *data = entry->data;
 
-		if (chan_list[i].handle != frame->handle)
-			continue;
-
-		if (chan_list[i].psm == psm)
+		if (data->psm == psm)
 			seq_num++;
 
 		/* Don't break on match - we still need to go through all
 		 * channels to find proper seq_num.
 		 */
-		if (frame->in) {
-			if (chan_list[i].dcid == scid)
-				n = i;
-		} else {
-			if (chan_list[i].scid == scid)
-				n = i;
-		}
+		if (frame->in ? data->dcid == scid : data->scid == scid)
+			chan = data;
 	}
 
-	if (n < 0)
-		return;
+	/* Reuse the existing channel, and its id, when the cid is reused */
+	if (chan) {
+		queue_remove(conn->chans, chan);
+		if (chan->ctrlid)
+			queue_remove(amp_chans, chan);
+	} else {
+		chan = chan_alloc();
+		if (!chan)
+			return;
+	}
 
-	memset(&chan_list[n], 0, sizeof(chan_list[n]));
-	chan_list[n].index = frame->index;
-	chan_list[n].handle = frame->handle;
-	chan_list[n].ident = frame->ident;
+	chan_reset(chan);
+	chan->index = frame->index;
+	chan->handle = frame->handle;
+	chan->ident = frame->ident;
 
 	if (frame->in)
-		chan_list[n].dcid = scid;
+		chan->dcid = scid;
 	else
-		chan_list[n].scid = scid;
+		chan->scid = scid;
+
+	chan->psm = psm;
+	chan->ctrlid = ctrlid;
+	chan->mode = mode;
 
-	chan_list[n].psm = psm;
-	chan_list[n].ctrlid = ctrlid;
-	chan_list[n].mode = mode;
+	chan->seq_num = seq_num;
 
-	chan_list[n].seq_num = seq_num;
+	queue_push_tail(conn->chans, chan);
+
+	if (ctrlid) {
+		if (!amp_chans)
+			amp_chans = queue_new();
+
+		queue_push_tail(amp_chans, chan);
+	}
 }
 
 static void release_scid(const struct l2cap_frame *frame, uint16_t scid)
 {
-	int i;
-
-	for (i = 0; i < MAX_CHAN; i++) {
-		if (chan_list[i].index != frame->index)
-			continue;
+	struct chan_conn *conn;
+	struct chan_data *chan;
 
-		if (chan_list[i].handle != frame->handle)
-			continue;
+	conn = get_conn(frame->index, frame->handle, false);
 
-		if (frame->in) {
-			if (chan_list[i].scid == scid) {
-				chan_list[i].handle = 0;
-				break;
-			}
-		} else {
-			if (chan_list[i].dcid == scid) {
-				chan_list[i].handle = 0;
-				break;
-			}
-		}
-	}
+	chan = find_chan(conn, frame->in, scid);
+	if (chan)
+		chan_release(conn, chan);
 }
 
 static void assign_dcid(const struct l2cap_frame *frame, uint16_t dcid,
 								uint16_t scid)
 {
-	int i;
+	const struct queue_entry *entry;
+	struct chan_conn *conn;
 
-	for (i = 0; i < MAX_CHAN; i++) {
-		if (chan_list[i].index != frame->index)
-			continue;
+	conn = get_conn(frame->index, frame->handle, false);
+	if (!conn)
+		return;
 
-		if (chan_list[i].handle != frame->handle)
-			continue;
+	for (entry = queue_get_entries(conn->chans); entry;
+						entry = entry->next) {
+		struct chan_data *chan = entry->data;
 
-		if (frame->ident != 0 && chan_list[i].ident != frame->ident)
+		if (frame->ident != 0 && chan->ident != frame->ident)
 			continue;
 
 		if (frame->in) {
 			if (scid) {
-				if (chan_list[i].scid == scid) {
-					chan_list[i].dcid = dcid;
+				if (chan->scid == scid) {
+					chan->dcid = dcid;
 					break;
 				}
 			} else {
-				if (chan_list[i].scid && !chan_list[i].dcid) {
-					chan_list[i].dcid = dcid;
+				if (chan->scid && !chan->dcid) {
+					chan->dcid = dcid;
 					break;
 				}
 			}
 		} else {
 			if (scid) {
-				if (chan_list[i].dcid == scid) {
-					chan_list[i].scid = dcid;
+				if (chan->dcid == scid) {
+					chan->scid = dcid;
 					break;
 				}
 			} else {
-				if (chan_list[i].dcid && !chan_list[i].scid) {
-					chan_list[i].scid = dcid;
+				if (chan->dcid && !chan->scid) {
+					chan->scid = dcid;
 					break;
 				}
 			}
@@ -232,69 +379,47 @@ static void assign_dcid(const struct l2cap_frame *frame, uint16_t dcid,
 static void assign_mode(const struct l2cap_frame *frame,
 					uint8_t mode, uint16_t dcid)
 {
-	int i;
-
-	for (i = 0; i < MAX_CHAN; i++) {
-		if (chan_list[i].index != frame->index)
-			continue;
-
-		if (chan_list[i].handle != frame->handle)
-			continue;
+	struct chan_data *chan = find_frame_chan(frame, dcid);
 
-		if (frame->in) {
-			if (chan_list[i].scid == dcid) {
-				chan_list[i].mode = mode;
-				break;
-			}
-		} else {
-			if (chan_list[i].dcid == dcid) {
-				chan_list[i].mode = mode;
-				break;
-			}
-		}
-	}
+	if (chan)
+		chan->mode = mode;
 }
 
-static int get_chan_data_index(const struct l2cap_frame *frame)
+static struct chan_data *lookup_chan(const struct l2cap_frame *frame)
 {
-	int i;
+	const struct queue_entry *entry;
+	struct chan_data *chan;
 
-	for (i = 0; i < MAX_CHAN; i++) {
-		if (chan_list[i].index != frame->index &&
-					chan_list[i].ctrlid == 0)
-			continue;
+	chan = find_frame_chan(frame, frame->cid);
+	if (chan && !chan->ctrlid)
+		return chan;
 
-		if (chan_list[i].ctrlid != 0 &&
-					chan_list[i].ctrlid != frame->index)
-			continue;
+	for (entry = queue_get_entries(amp_chans); entry;
+						entry = entry->next) {
+		chan = entry->data;
 
-		if (chan_list[i].handle != frame->handle)
+		if (chan->ctrlid != frame->index ||
+					chan->handle != frame->handle)
 			continue;
 
-		if (frame->in) {
-			if (chan_list[i].scid == frame->cid)
-				return i;
-		} else {
-			if (chan_list[i].dcid == frame->cid)
-				return i;
-		}
+		if (frame->in ? chan->scid == frame->cid :
+						chan->dcid == frame->cid)
+			return chan;
 	}
 
-	return -1;
+	return NULL;
 }
 
 static struct chan_data *get_chan(const struct l2cap_frame *frame)
 {
-	int i;
-
-	if (frame->chan != UINT16_MAX)
-		return &chan_list[frame->chan];
+	if (frame->chan != UINT16_MAX) {
+		if (frame->chan >= chan_ids_size)
+			return NULL;
 
-	i = get_chan_data_index(frame);
-	if (i < 0)
-		return NULL;
+		return chan_ids[frame->chan];
+	}
 
-	return &chan_list[i];
+	return lookup_chan(frame);
 }
 
 static uint16_t get_psm(const struct l2cap_frame *frame)
@@ -330,27 +455,10 @@ static uint8_t get_seq_num(const struct l2cap_frame *frame)
 static void assign_ext_ctrl(const struct l2cap_frame *frame,
 					uint8_t ext_ctrl, uint16_t dcid)
 {
-	int i;
-
-	for (i = 0; i < MAX_CHAN; i++) {
-		if (chan_list[i].index != frame->index)
-			continue;
+	struct chan_data *chan = find_frame_chan(frame, dcid);
 
-		if (chan_list[i].handle != frame->handle)
-			continue;
-
-		if (frame->in) {
-			if (chan_list[i].scid == dcid) {
-				chan_list[i].ext_ctrl = ext_ctrl;
-				break;
-			}
-		} else {
-			if (chan_list[i].dcid == dcid) {
-				chan_list[i].ext_ctrl = ext_ctrl;
-				break;
-			}
-		}
-	}
+	if (chan)
+		chan->ext_ctrl = ext_ctrl;
 }
 
 static uint8_t get_ext_ctrl(const struct l2cap_frame *frame)
@@ -1562,6 +1670,8 @@ void l2cap_frame_init(struct l2cap_frame *frame, uint16_t index, bool in,
 				uint16_t cid, uint16_t psm,
 				const void *data, uint16_t size)
 {
+	struct chan_data *chan;
+
 	frame->index   = index;
 	frame->in      = in;
 	frame->handle  = handle;
@@ -1569,7 +1679,8 @@ void l2cap_frame_init(struct l2cap_frame *frame, uint16_t index, bool in,
 	frame->cid     = cid;
 	frame->data    = data;
 	frame->size    = size;
-	frame->chan    = get_chan_data_index(frame);
+	chan = lookup_chan(frame);
+	frame->chan    = chan ? chan->id : UINT16_MAX;
 	frame->psm     = psm ? psm : get_psm(frame);
 	frame->mode    = get_mode(frame);
 	frame->seq_num = psm ? 1 : get_seq_num(frame);
@@ -30,6 +30,7 @@
 #include "analyze.h"
 #include "ellisys.h"
 #include "control.h"
+#include "output.h"
 #include "display.h"
 
 static void signal_callback(int signum, void *user_data)
@@ -72,6 +73,11 @@ static void usage(void)
 		"\t                       Read data from RTT\n"
 		"\t-R  --rtt [<address>],[<area>],[<name>]\n"
 		"\t                       RTT control block parameters\n"
+		"\t-b, --rcvbuf <bytes>   Set monitor socket receive buffer\n"
+		"\t-F, --filter <expr>    Only process matching HCI packets\n"
+		"\t-o, --offset <secs>    Start reading at time offset\n"
+		"\t-W, --pcap <file>      Save traces in pcap format\n"
+		"\t-x, --split-by <mode>  Split saved traces by conn/device\n"
 		"\t-C, --columns [width]  Output width if not a terminal\n"
 		"\t-c, --color [mode]     Output color: auto/always/never\n"
 		"\t-h, --help             Show help options\n");
@@ -98,6 +104,11 @@ static const struct option main_options[] = {
 	{ "no-pager",  no_argument,       NULL, 'P' },
 	{ "jlink",     required_argument, NULL, 'J' },
 	{ "rtt",       required_argument, NULL, 'R' },
+	{ "rcvbuf",    required_argument, NULL, 'b' },
+	{ "filter",    required_argument, NULL, 'F' },
+	{ "offset",    required_argument, NULL, 'o' },
+	{ "pcap",      required_argument, NULL, 'W' },
+	{ "split-by",  required_argument, NULL, 'x' },
 	{ "columns",   required_argument, NULL, 'C' },
 	{ "color",     required_argument, NULL, 'c' },
 	{ "todo",      no_argument,       NULL, '#' },
@@ -112,6 +123,8 @@ int main(int argc, char *argv[])
 	bool use_pager = true;
 	const char *reader_path = NULL;
 	const char *writer_path = NULL;
+	const char *pcap_path = NULL;
+	unsigned int split_mode = OUTPUT_SPLIT_NONE;
 	const char *analyze_path = NULL;
 	const char *ellisys_server = NULL;
 	const char *tty = NULL;
@@ -131,7 +144,7 @@ int main(int argc, char *argv[])
 		struct sockaddr_un addr;
 
 		opt = getopt_long(argc, argv,
-				"r:w:a:s:p:i:d:B:V:MNtTSAIE:PJ:R:C:c:vh",
+			"r:w:a:s:p:i:d:B:V:MNtTSAIE:PJ:R:b:F:o:W:x:C:c:vh",
 				main_options, NULL);
 		if (opt < 0)
 			break;
@@ -218,6 +231,29 @@ int main(int argc, char *argv[])
 		case 'R':
 			rtt = optarg;
 			break;
+		case 'b':
+			control_set_rcvbuf(atoi(optarg));
+			break;
+		case 'F':
+			if (!packet_set_capture_filter(optarg))
+				return EXIT_FAILURE;
+			break;
+		case 'o':
+			control_set_offset(strtoul(optarg, NULL, 10));
+			break;
+		case 'W':
+			pcap_path = optarg;
+			break;
+		case 'x':
+			if (strcmp("conn", optarg) == 0)
+				split_mode = OUTPUT_SPLIT_CONN;
+			else if (strcmp("device", optarg) == 0)
+				split_mode = OUTPUT_SPLIT_DEVICE;
+			else {
+				fprintf(stderr, "Invalid split mode\n");
+				return EXIT_FAILURE;
+			}
+			break;
 		case 'C':
 			set_default_pager_num_columns(atoi(optarg));
 			break;
@@ -270,19 +306,24 @@ int main(int argc, char *argv[])
 		return EXIT_SUCCESS;
 	}
 
+	if (split_mode != OUTPUT_SPLIT_NONE && !writer_path && !pcap_path) {
+		fprintf(stderr, "Splitting requires --write or --pcap\n");
+		return EXIT_FAILURE;
+	}
+
+	if ((writer_path || pcap_path) &&
+			!output_open(writer_path, pcap_path, split_mode))
+		return EXIT_FAILURE;
+
 	if (reader_path) {
 		if (ellisys_server)
 			ellisys_enable(ellisys_server, ellisys_port);
 
 		control_reader(reader_path, use_pager);
+		output_close();
 		return EXIT_SUCCESS;
 	}
 
-	if (writer_path && !control_writer(writer_path)) {
-		printf("Failed to open '%s'\n", writer_path);
-		return EXIT_FAILURE;
-	}
-
 	if (ellisys_server)
 		ellisys_enable(ellisys_server, ellisys_port);
 
@@ -297,6 +338,7 @@ int main(int argc, char *argv[])
 
 	exit_status = mainloop_run_with_signal(signal_callback, NULL);
 
+	output_close();
 	keys_cleanup();
 
 	return exit_status;
@@ -0,0 +1,505 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <endian.h>
+#include <limits.h>
+#include <sys/uio.h>
+
+#include "src/shared/util.h"
+#include "src/shared/queue.h"
+#include "src/shared/btsnoop.h"
+#include "src/shared/pcap.h"
+
+#include "filter.h"
+#include "output.h"
+
+#define FILE_HASH_SIZE		256
+#define FILE_BUFFER_SIZE	16384
+#define PCAP_SNAPLEN		(4 + 1 + BTSNOOP_MAX_PACKET_SIZE)
+
+/* Each split file takes up to two descriptors, stay well below the usual
+ * limit of 1024.
+ */
+#define MAX_OPEN_FILES		64
+
+enum file_state {
+	FILE_OPEN,
+	FILE_CLOSED,		/* Next open starts a new file */
+	FILE_EVICTED,		/* Next open continues the file */
+	FILE_FAILED,		/* Packets go to the main file instead */
+};
+
+struct output_file {
+	char *key;
+	unsigned int opened;
+	enum file_state state;
+	struct btsnoop *btsnoop;
+	struct pcap *pcap;
+};
+
+struct output_pkt {
+	struct timeval tv;
+	uint16_t index;
+	uint16_t opcode;
+	uint16_t size;
+	uint8_t data[];
+};
+
+static const char *btsnoop_path;
+static const char *pcap_path;
+static unsigned int split_mode;
+
+static struct output_file main_file;
+static struct queue *file_table[FILE_HASH_SIZE];
+static struct queue *open_files;
+static struct filter *tracker;
+static struct queue *index_pkts;
+
+static bool get_h4(uint16_t opcode, uint8_t *type, uint32_t *dir)
+{
+	switch (opcode) {
+	case BTSNOOP_OPCODE_COMMAND_PKT:
+		*type = 0x01;
+		*dir = 0;
+		return true;
+	case BTSNOOP_OPCODE_EVENT_PKT:
+		*type = 0x04;
+		*dir = 1;
+		return true;
+	case BTSNOOP_OPCODE_ACL_TX_PKT:
+		*type = 0x02;
+		*dir = 0;
+		return true;
+	case BTSNOOP_OPCODE_ACL_RX_PKT:
+		*type = 0x02;
+		*dir = 1;
+		return true;
+	case BTSNOOP_OPCODE_SCO_TX_PKT:
+		*type = 0x03;
+		*dir = 0;
+		return true;
+	case BTSNOOP_OPCODE_SCO_RX_PKT:
+		*type = 0x03;
+		*dir = 1;
+		return true;
+	case BTSNOOP_OPCODE_ISO_TX_PKT:
+		*type = 0x05;
+		*dir = 0;
+		return true;
+	case BTSNOOP_OPCODE_ISO_RX_PKT:
+		*type = 0x05;
+		*dir = 1;
+		return true;
+	}
+
+	return false;
+}
+
+/* BLUETOOTH_HCI_H4_WITH_PHDR records start with the direction in network
+ * byte order, followed by the H:4 packet type.
+ */
+static void write_pcap(struct pcap *pcap, struct timeval *tv, uint16_t opcode,
+					const void *data, uint16_t size)
+{
+	struct iovec iov[3];
+	uint32_t dir;
+	uint8_t type;
+
+	if (!pcap || !get_h4(opcode, &type, &dir))
+		return;
+
+	dir = htobe32(dir);
+
+	iov[0].iov_base = &dir;
+	iov[0].iov_len = sizeof(dir);
+	iov[1].iov_base = &type;
+	iov[1].iov_len = sizeof(type);
+	iov[2].iov_base = (void *) data;
+	iov[2].iov_len = size;
+
+	pcap_write(pcap, tv, iov, 3);
+}
+
+static void write_file(struct output_file *file, struct timeval *tv,
+				uint16_t index, uint16_t opcode, uint32_t drops,
+				const void *data, uint16_t size)
+{
+	btsnoop_write_hci(file->btsnoop, tv, index, opcode, drops, data, size);
+	write_pcap(file->pcap, tv, opcode, data, size);
+}
+
+/* Insert the key in front of the extension, so trace.log is split into
+ * trace-<key>.log and the viewers still recognize the files.
+ */
+static char *split_path(const char *path, const char *key)
+{
+	const char *ext, *base;
+	char *str;
+
+	base = strrchr(path, '/');
+	base = base ? base + 1 : path;
+
+	ext = strrchr(base, '.');
+	if (!ext || ext == base)
+		ext = path + strlen(path);
+
+	if (asprintf(&str, "%.*s-%s%s", (int) (ext - path), path, key,
+								ext) < 0)
+		return NULL;
+
+	return str;
+}
+
+static void replay_index(void *data, void *user_data)
+{
+	struct output_pkt *pkt = data;
+	struct output_file *file = user_data;
+
+	btsnoop_write_hci(file->btsnoop, &pkt->tv, pkt->index, pkt->opcode,
+						0, pkt->data, pkt->size);
+}
+
+static void close_file(struct output_file *file, enum file_state state)
+{
+	btsnoop_unref(file->btsnoop);
+	file->btsnoop = NULL;
+
+	pcap_unref(file->pcap);
+	file->pcap = NULL;
+
+	if (file->state == FILE_OPEN)
+		queue_remove(open_files, file);
+
+	file->state = state;
+}
+
+static void open_file(struct output_file *file)
+{
+	bool append = file->state == FILE_EVICTED;
+	char name[48];
+	const char *key = file->key;
+	char *path;
+
+	/* Only the least recently used files are kept open, the others are
+	 * continued once they see traffic again.
+	 */
+	if (queue_length(open_files) >= MAX_OPEN_FILES)
+		close_file(queue_peek_head(open_files), FILE_EVICTED);
+
+	/* A later connection with the same key must not truncate the file */
+	if (!append)
+		file->opened++;
+
+	if (file->opened > 1) {
+		snprintf(name, sizeof(name), "%s-%u", file->key, file->opened);
+		key = name;
+	}
+
+	file->state = FILE_OPEN;
+	queue_push_tail(open_files, file);
+
+	if (btsnoop_path) {
+		path = split_path(btsnoop_path, key);
+		if (append)
+			file->btsnoop = btsnoop_append(path,
+						BTSNOOP_FORMAT_MONITOR);
+		else
+			file->btsnoop = btsnoop_create(path, 0, 0,
+						BTSNOOP_FORMAT_MONITOR);
+		if (!file->btsnoop) {
+			fprintf(stderr, "Failed to open '%s'\n", path);
+			free(path);
+			goto failed;
+		}
+		free(path);
+
+		btsnoop_set_buffer_size(file->btsnoop, FILE_BUFFER_SIZE);
+
+		/* Each file must be readable on its own */
+		if (!append)
+			queue_foreach(index_pkts, replay_index, file);
+	}
+
+	if (pcap_path) {
+		path = split_path(pcap_path, key);
+		if (append)
+			file->pcap = pcap_append(path,
+					PCAP_TYPE_BLUETOOTH_HCI_H4_WITH_PHDR,
+					PCAP_SNAPLEN);
+		else
+			file->pcap = pcap_create(path,
+					PCAP_TYPE_BLUETOOTH_HCI_H4_WITH_PHDR,
+					PCAP_SNAPLEN);
+		if (!file->pcap) {
+			fprintf(stderr, "Failed to open '%s'\n", path);
+			free(path);
+			goto failed;
+		}
+		free(path);
+
+		pcap_set_buffer_size(file->pcap, FILE_BUFFER_SIZE);
+	}
+
+	return;
+
+failed:
+	/* Rather than losing the packets, keep them in the main file */
+	close_file(file, FILE_FAILED);
+}
+
+static struct output_file *create_file(const char *key)
+{
+	struct output_file *file;
+
+	file = new0(struct output_file, 1);
+	file->key = strdup(key);
+	file->state = FILE_CLOSED;
+
+	open_file(file);
+
+	return file;
+}
+
+static unsigned int hash_key(const char *key)
+{
+	unsigned int hash = 5381;
+
+	while (*key)
+		hash = hash * 33 + *key++;
+
+	return hash % FILE_HASH_SIZE;
+}
+
+static bool match_key(const void *data, const void *match_data)
+{
+	const struct output_file *file = data;
+
+	return !strcmp(file->key, match_data);
+}
+
+static struct output_file *get_file(const char *key)
+{
+	struct queue **bucket = &file_table[hash_key(key)];
+	struct output_file *file;
+
+	if (!*bucket)
+		*bucket = queue_new();
+
+	file = queue_find(*bucket, match_key, key);
+	if (!file) {
+		file = create_file(key);
+		queue_push_tail(*bucket, file);
+	} else if (file->state == FILE_OPEN) {
+		/* Keep the least recently used file at the head */
+		if (queue_peek_tail(open_files) != file) {
+			queue_remove(open_files, file);
+			queue_push_tail(open_files, file);
+		}
+	} else if (file->state != FILE_FAILED)
+		open_file(file);
+
+	if (file->state == FILE_FAILED)
+		return &main_file;
+
+	return file;
+}
+
+static void format_addr(char *str, const uint8_t *addr)
+{
+	sprintf(str, "%2.2X%2.2X%2.2X%2.2X%2.2X%2.2X", addr[5], addr[4],
+					addr[3], addr[2], addr[1], addr[0]);
+}
+
+static struct output_file *lookup_file(uint16_t index, uint16_t opcode,
+					const void *data, uint16_t size,
+					bool *disconnected)
+{
+	const uint8_t *addr;
+	char key[32], str[13];
+	int handle;
+
+	if (!filter_get_conn(tracker, index, opcode, data, size, &handle,
+							&addr, disconnected))
+		return &main_file;
+
+	switch (split_mode) {
+	case OUTPUT_SPLIT_CONN:
+		/* Setup traffic without a handle stays in the main file */
+		if (handle < 0)
+			return &main_file;
+
+		if (addr) {
+			format_addr(str, addr);
+			snprintf(key, sizeof(key), "hci%u-%s-%4.4x", index,
+								str, handle);
+		} else
+			snprintf(key, sizeof(key), "hci%u-%4.4x", index,
+								handle);
+		break;
+	case OUTPUT_SPLIT_DEVICE:
+		if (addr)
+			format_addr(key, addr);
+		else
+			snprintf(key, sizeof(key), "hci%u-%4.4x", index,
+								handle);
+		break;
+	default:
+		return &main_file;
+	}
+
+	return get_file(key);
+}
+
+static bool match_index(const void *data, const void *match_data)
+{
+	const struct output_pkt *pkt = data;
+
+	return pkt->index == PTR_TO_UINT(match_data);
+}
+
+static void track_index(struct timeval *tv, uint16_t index, uint16_t opcode,
+					const void *data, uint16_t size)
+{
+	struct output_pkt *pkt;
+
+	switch (opcode) {
+	case BTSNOOP_OPCODE_NEW_INDEX:
+	case BTSNOOP_OPCODE_OPEN_INDEX:
+	case BTSNOOP_OPCODE_INDEX_INFO:
+		break;
+	case BTSNOOP_OPCODE_DEL_INDEX:
+		queue_remove_all(index_pkts, match_index,
+						UINT_TO_PTR(index), free);
+		return;
+	default:
+		return;
+	}
+
+	pkt = malloc(sizeof(*pkt) + size);
+	if (!pkt)
+		return;
+
+	pkt->tv = *tv;
+	pkt->index = index;
+	pkt->opcode = opcode;
+	pkt->size = size;
+	memcpy(pkt->data, data, size);
+
+	queue_push_tail(index_pkts, pkt);
+}
+
+bool output_open(const char *btsnoop, const char *pcap, unsigned int split)
+{
+	if (btsnoop) {
+		main_file.btsnoop = btsnoop_create(btsnoop, 0, 0,
+						BTSNOOP_FORMAT_MONITOR);
+		if (!main_file.btsnoop) {
+			fprintf(stderr, "Failed to open '%s'\n", btsnoop);
+			return false;
+		}
+	}
+
+	if (pcap) {
+		main_file.pcap = pcap_create(pcap,
+					PCAP_TYPE_BLUETOOTH_HCI_H4_WITH_PHDR,
+					PCAP_SNAPLEN);
+		if (!main_file.pcap) {
+			fprintf(stderr, "Failed to open '%s'\n", pcap);
+			btsnoop_unref(main_file.btsnoop);
+			main_file.btsnoop = NULL;
+			return false;
+		}
+	}
+
+	btsnoop_path = btsnoop;
+	pcap_path = pcap;
+	split_mode = split;
+
+	if (split_mode == OUTPUT_SPLIT_NONE)
+		return true;
+
+	/* Splitting writes to many files at once, so batch up the writes */
+	btsnoop_set_buffer_size(main_file.btsnoop, FILE_BUFFER_SIZE);
+	pcap_set_buffer_size(main_file.pcap, FILE_BUFFER_SIZE);
+
+	tracker = filter_new();
+	index_pkts = queue_new();
+	open_files = queue_new();
+
+	return true;
+}
+
+bool output_enabled(void)
+{
+	return main_file.btsnoop || main_file.pcap;
+}
+
+void output_write(struct timeval *tv, uint16_t index, uint16_t opcode,
+				uint32_t drops, const void *data, uint16_t size)
+{
+	struct output_file *file;
+	bool disconnected = false;
+
+	if (!tv || !output_enabled())
+		return;
+
+	if (split_mode == OUTPUT_SPLIT_NONE) {
+		write_file(&main_file, tv, index, opcode, drops, data, size);
+		return;
+	}
+
+	track_index(tv, index, opcode, data, size);
+
+	file = lookup_file(index, opcode, data, size, &disconnected);
+	write_file(file, tv, index, opcode, drops, data, size);
+
+	/* Nothing follows the Disconnect Complete, so release the file */
+	if (disconnected && split_mode == OUTPUT_SPLIT_CONN &&
+							file != &main_file)
+		close_file(file, FILE_CLOSED);
+}
+
+static void free_file(void *data)
+{
+	struct output_file *file = data;
+
+	close_file(file, FILE_CLOSED);
+	free(file->key);
+	free(file);
+}
+
+void output_close(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < FILE_HASH_SIZE; i++) {
+		queue_destroy(file_table[i], free_file);
+		file_table[i] = NULL;
+	}
+
+	btsnoop_unref(main_file.btsnoop);
+	pcap_unref(main_file.pcap);
+	memset(&main_file, 0, sizeof(main_file));
+
+	queue_destroy(open_files, NULL);
+	open_files = NULL;
+
+	queue_destroy(index_pkts, free);
+	index_pkts = NULL;
+
+	filter_free(tracker);
+	tracker = NULL;
+}
@@ -0,0 +1,22 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct timeval;
+
+#define OUTPUT_SPLIT_NONE	0
+#define OUTPUT_SPLIT_CONN	1
+#define OUTPUT_SPLIT_DEVICE	2
+
+bool output_open(const char *btsnoop, const char *pcap, unsigned int split);
+bool output_enabled(void);
+void output_write(struct timeval *tv, uint16_t index, uint16_t opcode,
+				uint32_t drops, const void *data, uint16_t size);
+void output_close(void);
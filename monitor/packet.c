@@ -49,6 +49,7 @@
 #include "msft.h"
 #include "intel.h"
 #include "broadcom.h"
+#include "filter.h"
 
 #define COLOR_CHANNEL_LABEL		COLOR_WHITE
 #define COLOR_FRAME_LABEL		COLOR_WHITE
@@ -104,6 +105,7 @@ static time_t time_offset = ((time_t) -1);
 static int priority_level = BTSNOOP_PRIORITY_DEBUG;
 static unsigned long filter_mask = 0;
 static bool index_filter = false;
+static struct filter *capture_filter = NULL;
 static uint16_t index_current = 0;
 static uint16_t fallback_manufacturer = UNKNOWN_MANUFACTURER;
 
@@ -253,6 +255,8 @@ static struct packet_conn_data *release_handle(uint16_t handle)
 			if (conn->destroy)
 				conn->destroy(conn, conn->data);
 
+			l2cap_release_conn(conn->index, handle);
+
 			pool = get_pool(conn->index, conn->type);
 			if (pool)
 				pool->tx -= queue_length(conn->tx_q);
@@ -375,6 +379,26 @@ void packet_select_index(uint16_t index)
 	index_filter = true;
 }
 
+bool packet_set_capture_filter(const char *str)
+{
+	struct filter *filter;
+
+	filter = filter_compile(str);
+	if (!filter)
+		return false;
+
+	filter_free(capture_filter);
+	capture_filter = filter;
+
+	return true;
+}
+
+bool packet_filter_match(uint16_t index, uint16_t opcode,
+					const void *data, uint16_t size)
+{
+	return filter_match(capture_filter, index, opcode, data, size);
+}
+
 #define print_space(x) printf("%*c", (x), ' ');
 
 void packet_set_fallback_manufacturer(uint16_t manufacturer)
@@ -63,6 +63,9 @@ void packet_del_filter(unsigned long filter);
 
 void packet_set_priority(const char *priority);
 void packet_select_index(uint16_t index);
+bool packet_set_capture_filter(const char *str);
+bool packet_filter_match(uint16_t index, uint16_t opcode,
+					const void *data, uint16_t size);
 void packet_set_fallback_manufacturer(uint16_t manufacturer);
 void packet_set_msft_evt_prefix(const uint8_t *prefix, uint8_t len);
 
@@ -233,6 +233,7 @@ struct pending_list_items {
 	uint32_t start;
 	uint32_t end;
 	uint64_t total;
+	bool restart;
 };
 
 struct avrcp_player {
@@ -2576,6 +2577,26 @@ static const char *subtype_to_string(uint32_t subtype)
 	return "None";
 }
 
+static void ct_set_uid_counter(struct avrcp_player *player,
+						uint16_t uid_counter)
+{
+	if (player->uid_counter == uid_counter)
+		return;
+
+	player->uid_counter = uid_counter;
+
+	/* Items already fetched are released along with the old UIDs */
+	if (player->p) {
+		g_slist_free(player->p->items);
+		player->p->items = NULL;
+		player->p->restart = true;
+	}
+
+	/* Cached browsing results refer to the old UIDs */
+	if (player->user_data)
+		media_player_uids_changed(player->user_data);
+}
+
 static struct media_item *parse_media_element(struct avrcp *session,
 					uint8_t *operands, uint16_t len)
 {
@@ -2659,6 +2680,7 @@ static gboolean avrcp_list_items_rsp(struct avctp *conn, uint8_t *operands,
 	struct avrcp *session = user_data;
 	struct avrcp_player *player = session->controller->player;
 	struct pending_list_items *p = player->p;
+	GSList *list;
 	uint16_t count;
 	uint64_t items;
 	size_t i;
@@ -2687,6 +2709,15 @@ static gboolean avrcp_list_items_rsp(struct avctp *conn, uint8_t *operands,
 		goto done;
 	}
 
+	ct_set_uid_counter(player, get_be16(&pdu->params[1]));
+
+	/* Start over so the positions match the new UIDs */
+	if (p->restart) {
+		p->restart = false;
+		avrcp_list_items(session, p->start, p->end);
+		return FALSE;
+	}
+
 	count = get_be16(&operands[6]);
 	if (count == 0)
 		goto done;
@@ -2732,12 +2763,15 @@ static gboolean avrcp_list_items_rsp(struct avctp *conn, uint8_t *operands,
 	}
 
 done:
-	media_player_list_complete(player->user_data, p->items, err);
-
-	g_slist_free(p->items);
+	/* Completing may already start the next listing */
+	list = p->items;
 	g_free(p);
 	player->p = NULL;
 
+	media_player_list_complete(player->user_data, list, err);
+
+	g_slist_free(list);
+
 	return FALSE;
 }
 
@@ -2835,7 +2869,7 @@ static gboolean avrcp_set_browsed_player_rsp(struct avctp *conn,
 							operand_count < 13)
 		return FALSE;
 
-	player->uid_counter = get_be16(&pdu->params[1]);
+	ct_set_uid_counter(player, get_be16(&pdu->params[1]));
 	player->browsed = true;
 
 	items = get_be32(&pdu->params[3]);
@@ -3304,7 +3338,7 @@ static gboolean avrcp_search_rsp(struct avctp *conn, uint8_t *operands,
 		goto done;
 	}
 
-	player->uid_counter = get_be16(&pdu->params[1]);
+	ct_set_uid_counter(player, get_be16(&pdu->params[1]));
 	ret = get_be32(&pdu->params[3]);
 
 done:
@@ -3498,7 +3532,7 @@ static gboolean avrcp_get_total_numberofitems_rsp(struct avctp *conn,
 	if (pdu->params[0] == AVRCP_STATUS_OUT_OF_BOUNDS)
 		goto done;
 
-	player->uid_counter = get_be16(&pdu->params[1]);
+	ct_set_uid_counter(player, get_be16(&pdu->params[1]));
 	num_of_items = get_be32(&pdu->params[3]);
 
 	if (!num_of_items)
@@ -3935,7 +3969,7 @@ static void avrcp_uids_changed(struct avrcp *session, struct avrcp_header *pdu)
 {
 	struct avrcp_player *player = session->controller->player;
 
-	player->uid_counter = get_be16(&pdu->params[1]);
+	ct_set_uid_counter(player, get_be16(&pdu->params[1]));
 }
 
 static gboolean avrcp_handle_event(struct avctp *conn, uint8_t code,
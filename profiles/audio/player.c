@@ -37,6 +37,9 @@
 #define MEDIA_FOLDER_INTERFACE "org.bluez.MediaFolder1"
 #define MEDIA_ITEM_INTERFACE "org.bluez.MediaItem1"
 
+/* Number of items fetched ahead of a ListItems range */
+#define LIST_PREFETCH 32
+
 struct player_callback {
 	const struct media_player_callback *cbs;
 	void *user_data;
@@ -57,6 +60,7 @@ struct media_item {
 	bool			playable;	/* Item playable flag */
 	uint64_t		uid;		/* Item uid */
 	GHashTable		*metadata;	/* Item metadata */
+	bool			exported;	/* Registered on D-Bus */
 };
 
 struct media_folder {
@@ -65,6 +69,11 @@ struct media_folder {
 	uint32_t		number_of_items;/* Number of items */
 	GSList			*subfolders;
 	GSList			*items;
+	GHashTable		*uids;		/* Items by uid */
+	GHashTable		*index;		/* Items by position */
+	uint32_t		list_start;	/* Pending ListItems range */
+	uint32_t		list_end;
+	uint32_t		fetch_start;	/* Position of first fetched */
 	DBusMessage		*msg;
 };
 
@@ -640,12 +649,18 @@ static DBusMessage *media_player_release(DBusConnection *conn, DBusMessage *msg,
 	return g_dbus_create_reply(msg, DBUS_TYPE_INVALID);
 }
 
+static bool media_item_export(struct media_item *item);
+
 static void parse_folder_list(gpointer data, gpointer user_data)
 {
 	struct media_item *item = data;
 	DBusMessageIter *array = user_data;
 	DBusMessageIter entry;
 
+	/* Items are only registered once they are handed out */
+	if (!media_item_export(item))
+		return;
+
 	dbus_message_iter_open_container(array, DBUS_TYPE_DICT_ENTRY, NULL,
 								&entry);
 
@@ -658,22 +673,47 @@ static void parse_folder_list(gpointer data, gpointer user_data)
 	dbus_message_iter_close_container(array, &entry);
 }
 
-void media_player_list_complete(struct media_player *mp, GSList *items,
-								int err)
+static void media_folder_reset_index(struct media_folder *folder)
 {
-	struct media_folder *folder = mp->scope;
-	DBusMessage *reply;
-	DBusMessageIter iter, array;
+	if (folder->index)
+		g_hash_table_remove_all(folder->index);
+}
 
-	if (folder == NULL || folder->msg == NULL)
+static struct media_item *media_folder_index_get(struct media_folder *folder,
+							uint32_t pos)
+{
+	if (!folder->index)
+		return NULL;
+
+	return g_hash_table_lookup(folder->index, GUINT_TO_POINTER(pos));
+}
+
+/* Positions come from the remote, so only what has actually been fetched
+ * takes up memory.
+ */
+static void media_folder_index_set(struct media_folder *folder, uint32_t pos,
+						struct media_item *item)
+{
+	if (folder->number_of_items && pos >= folder->number_of_items)
 		return;
 
-	if (err < 0) {
-		reply = btd_error_failed(folder->msg, strerror(-err));
-		goto done;
-	}
+	if (!folder->index)
+		folder->index = g_hash_table_new(g_direct_hash,
+							g_direct_equal);
 
-	reply = dbus_message_new_method_return(folder->msg);
+	g_hash_table_insert(folder->index, GUINT_TO_POINTER(pos), item);
+}
+
+static DBusMessage *media_folder_list_reply(struct media_folder *folder,
+							DBusMessage *msg,
+							uint32_t start,
+							uint32_t end)
+{
+	DBusMessage *reply;
+	DBusMessageIter iter, array;
+	uint32_t i;
+
+	reply = dbus_message_new_method_return(msg);
 
 	dbus_message_iter_init_append(reply, &iter);
 
@@ -688,15 +728,83 @@ void media_player_list_complete(struct media_player *mp, GSList *items,
 					DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
 					&array);
 
-	g_slist_foreach(items, parse_folder_list, &array);
+	for (i = start; i <= end; i++) {
+		struct media_item *item = media_folder_index_get(folder, i);
+
+		if (!item)
+			break;
+
+		parse_folder_list(item, &array);
+	}
+
 	dbus_message_iter_close_container(&iter, &array);
 
+	return reply;
+}
+
+void media_player_list_complete(struct media_player *mp, GSList *items,
+								int err)
+{
+	struct media_folder *folder = mp->scope;
+	DBusMessage *reply;
+	uint32_t pos;
+	GSList *l;
+
+	if (folder == NULL || folder->msg == NULL)
+		return;
+
+	if (err < 0) {
+		reply = btd_error_failed(folder->msg, strerror(-err));
+		goto done;
+	}
+
+	for (l = items, pos = folder->fetch_start; l; l = l->next, pos++)
+		media_folder_index_set(folder, pos, l->data);
+
+	/* The UIDs changed while fetching, so the cached items in front of
+	 * the fetched ones are gone and have to be fetched again.
+	 */
+	if (folder->list_start < folder->fetch_start &&
+			!media_folder_index_get(folder, folder->list_start)) {
+		struct player_callback *cb = mp->cb;
+
+		err = cb->cbs->list_items(mp, folder->item->name,
+					folder->list_start, folder->list_end,
+					cb->user_data);
+		if (err < 0) {
+			reply = btd_error_failed(folder->msg, strerror(-err));
+			goto done;
+		}
+
+		folder->fetch_start = folder->list_start;
+		return;
+	}
+
+	reply = media_folder_list_reply(folder, folder->msg,
+					folder->list_start, folder->list_end);
+
 done:
 	g_dbus_send_message(btd_get_dbus_connection(), reply);
 	dbus_message_unref(folder->msg);
 	folder->msg = NULL;
 }
 
+static void media_folder_clear_items(struct media_folder *folder);
+
+void media_player_uids_changed(struct media_player *mp)
+{
+	DBG("%s", mp->path);
+
+	/* Neither positions nor UIDs are valid anymore, ListItems has to
+	 * fetch again.
+	 */
+	if (mp->scope)
+		media_folder_clear_items(mp->scope);
+
+	if (mp->playlist && mp->playlist != mp->scope)
+		media_folder_clear_items(mp->playlist);
+}
+
 static struct media_item *
 media_player_create_subfolder(struct media_player *mp, const char *name,
 								uint64_t uid)
@@ -899,7 +1007,7 @@ static DBusMessage *media_folder_list_items(DBusConnection *conn,
 	struct media_folder *folder = mp->scope;
 	struct player_callback *cb = mp->cb;
 	DBusMessageIter iter;
-	uint32_t start, end;
+	uint32_t start, end, fetch_start, fetch_end;
 	int err;
 
 	dbus_message_iter_init(msg, &iter);
@@ -913,11 +1021,34 @@ static DBusMessage *media_folder_list_items(DBusConnection *conn,
 	if (folder->msg != NULL)
 		return btd_error_failed(msg, strerror(EBUSY));
 
-	err = cb->cbs->list_items(mp, folder->item->name, start, end,
-							cb->user_data);
+	/* Skip what has already been fetched */
+	for (fetch_start = start; fetch_start <= end; fetch_start++) {
+		if (!media_folder_index_get(folder, fetch_start))
+			break;
+	}
+
+	/* The whole range is cached, reply without asking the remote */
+	if (fetch_start > end || (folder->number_of_items &&
+				fetch_start >= folder->number_of_items))
+		return media_folder_list_reply(folder, msg, start, end);
+
+	/* Fetch ahead so scrolling can be served from the cache */
+	fetch_end = end;
+	if (folder->number_of_items) {
+		if (fetch_end < fetch_start + LIST_PREFETCH - 1)
+			fetch_end = fetch_start + LIST_PREFETCH - 1;
+		if (fetch_end > folder->number_of_items - 1)
+			fetch_end = folder->number_of_items - 1;
+	}
+
+	err = cb->cbs->list_items(mp, folder->item->name, fetch_start,
+						fetch_end, cb->user_data);
 	if (err < 0)
 		return btd_error_failed(msg, strerror(-err));
 
+	folder->list_start = start;
+	folder->list_end = end;
+	folder->fetch_start = fetch_start;
 	folder->msg = dbus_message_ref(msg);
 
 	return NULL;
@@ -939,18 +1070,37 @@ static void media_item_destroy(void *data)
 
 	DBG("%s", item->path);
 
-	g_dbus_unregister_interface(btd_get_dbus_connection(), item->path,
+	if (item->exported)
+		g_dbus_unregister_interface(btd_get_dbus_connection(),
+						item->path,
 						MEDIA_ITEM_INTERFACE);
 
 	media_item_free(item);
 }
 
+static void media_folder_clear_items(struct media_folder *folder)
+{
+	media_folder_reset_index(folder);
+
+	if (folder->uids)
+		g_hash_table_remove_all(folder->uids);
+
+	g_slist_free_full(folder->items, media_item_destroy);
+	folder->items = NULL;
+}
+
 static void media_folder_destroy(void *data)
 {
 	struct media_folder *folder = data;
 
 	g_slist_free_full(folder->subfolders, media_folder_destroy);
-	g_slist_free_full(folder->items, media_item_destroy);
+	media_folder_clear_items(folder);
+
+	if (folder->uids)
+		g_hash_table_destroy(folder->uids);
+
+	if (folder->index)
+		g_hash_table_destroy(folder->index);
 
 	if (folder->msg != NULL)
 		dbus_message_unref(folder->msg);
@@ -981,8 +1131,7 @@ static void media_player_change_scope(struct media_player *mp,
 		goto done;
 
 cleanup:
-	g_slist_free_full(mp->scope->items, media_item_destroy);
-	mp->scope->items = NULL;
+	media_folder_clear_items(mp->scope);
 
 	/* Destroy search folder if it exists and is not being set as scope */
 	if (mp->search != NULL && folder != mp->search) {
@@ -1590,19 +1739,10 @@ void media_player_set_playlist(struct media_player *mp, const char *name)
 static struct media_item *media_folder_find_item(struct media_folder *folder,
 								uint64_t uid)
 {
-	GSList *l;
-
-	if (uid == 0)
+	if (uid == 0 || !folder->uids)
 		return NULL;
 
-	for (l = folder->items; l; l = l->next) {
-		struct media_item *item = l->data;
-
-		if (item->uid == uid)
-			return item;
-	}
-
-	return NULL;
+	return g_hash_table_lookup(folder->uids, &uid);
 }
 
 static DBusMessage *media_item_play(DBusConnection *conn, DBusMessage *msg,
@@ -1862,10 +2002,33 @@ void media_item_set_playable(struct media_item *item, bool value)
 
 	item->playable = value;
 
+	if (!item->exported)
+		return;
+
 	g_dbus_emit_property_changed(btd_get_dbus_connection(), item->path,
 					MEDIA_ITEM_INTERFACE, "Playable");
 }
 
+static bool media_item_export(struct media_item *item)
+{
+	if (item->exported)
+		return true;
+
+	if (!g_dbus_register_interface(btd_get_dbus_connection(),
+					item->path, MEDIA_ITEM_INTERFACE,
+					media_item_methods,
+					NULL,
+					media_item_properties, item, NULL)) {
+		error("D-Bus failed to register %s on %s path",
+					MEDIA_ITEM_INTERFACE, item->path);
+		return false;
+	}
+
+	item->exported = true;
+
+	return true;
+}
+
 static struct media_item *media_folder_create_item(struct media_player *mp,
 						struct media_folder *folder,
 						const char *name,
@@ -1899,13 +2062,8 @@ static struct media_item *media_folder_create_item(struct media_player *mp,
 	item->type = type;
 	item->folder_type = PLAYER_FOLDER_TYPE_INVALID;
 
-	if (!g_dbus_register_interface(btd_get_dbus_connection(),
-					item->path, MEDIA_ITEM_INTERFACE,
-					media_item_methods,
-					NULL,
-					media_item_properties, item, NULL)) {
-		error("D-Bus failed to register %s on %s path",
-					MEDIA_ITEM_INTERFACE, item->path);
+	/* Other items are registered on D-Bus when first handed out */
+	if (type == PLAYER_ITEM_TYPE_FOLDER && !media_item_export(item)) {
 		media_item_free(item);
 		return NULL;
 	}
@@ -1914,6 +2072,13 @@ static struct media_item *media_folder_create_item(struct media_player *mp,
 		folder->items = g_slist_prepend(folder->items, item);
 		item->metadata = g_hash_table_new_full(g_str_hash, g_str_equal,
 							g_free, g_free);
+
+		if (!folder->uids)
+			folder->uids = g_hash_table_new(g_int64_hash,
+							g_int64_equal);
+
+		if (uid)
+			g_hash_table_insert(folder->uids, &item->uid, item);
 	}
 
 	DBG("%s", item->path);
@@ -2006,7 +2171,7 @@ struct media_item *media_player_set_playlist_item(struct media_player *mp,
 
 	item = media_folder_create_item(mp, folder, NULL,
 						PLAYER_ITEM_TYPE_AUDIO, uid);
-	if (item == NULL)
+	if (item == NULL || !media_item_export(item))
 		return NULL;
 
 	media_item_set_playable(item, true);
@@ -2027,10 +2192,8 @@ struct media_item *media_player_set_playlist_item(struct media_player *mp,
 
 void media_player_clear_playlist(struct media_player *mp)
 {
-	if (mp->playlist) {
-		g_slist_free_full(mp->playlist->items, media_item_destroy);
-		mp->playlist->items = NULL;
-	}
+	if (mp->playlist)
+		media_folder_clear_items(mp->playlist);
 
 	g_dbus_emit_property_changed(btd_get_dbus_connection(), mp->path,
 					MEDIA_PLAYER_INTERFACE, "Playlist");
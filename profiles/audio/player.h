@@ -103,6 +103,7 @@ void media_player_play_item_complete(struct media_player *mp, int err);
 void media_item_set_playable(struct media_item *item, bool value);
 void media_player_list_complete(struct media_player *mp, GSList *items,
 								int err);
+void media_player_uids_changed(struct media_player *mp);
 void media_player_change_folder_complete(struct media_player *player,
 						const char *path, uint64_t uid,
 						int ret);
@@ -77,6 +77,7 @@
 #define CONN_SCAN_TIMEOUT (3)
 #define IDLE_DISCOV_TIMEOUT (5)
 #define TEMP_DEV_TIMEOUT (3 * 60)
+#define IGNORED_CACHE_SIZE 256
 #define BONDING_TIMEOUT (2 * 60)
 
 #define SCAN_TYPE_BREDR (1 << BDADDR_BREDR)
@@ -217,6 +218,13 @@ struct discovery_filter {
 	bool auto_connect;
 };
 
+/* Reports of devices not wanted by any discovery client */
+struct ignored_device {
+	bdaddr_t bdaddr;
+	uint8_t bdaddr_type;
+	uint64_t hash;
+};
+
 struct discovery_client {
 	struct btd_adapter *adapter;
 	DBusMessage *msg;
@@ -302,6 +310,9 @@ struct btd_adapter {
 	struct discovery_client *client;	/* active discovery client */
 
 	GSList *discovery_found;	/* list of found devices */
+	unsigned int adv_processed;	/* fully processed reports */
+	unsigned int adv_skipped;	/* unchanged reports skipped */
+	struct ignored_device *ignored;	/* recently ignored reports */
 	unsigned int discovery_idle_timeout; /* timeout between discovery
 					      * runs
 					      */
@@ -1714,6 +1725,16 @@ static void invalidate_rssi_and_tx_power(gpointer a)
 
 	device_set_rssi(dev, 0);
 	device_set_tx_power(dev, 127);
+
+	/* Next report has to restore the TX power */
+	device_set_adv_hash(dev, 0, false);
+}
+
+static void ignored_cache_reset(struct btd_adapter *adapter)
+{
+	if (adapter->ignored)
+		memset(adapter->ignored, 0, IGNORED_CACHE_SIZE *
+						sizeof(*adapter->ignored));
 }
 
 static void discovery_cleanup(struct btd_adapter *adapter, int timeout)
@@ -1722,6 +1743,8 @@ static void discovery_cleanup(struct btd_adapter *adapter, int timeout)
 
 	adapter->discovery_type = 0x00;
 
+	ignored_cache_reset(adapter);
+
 	if (adapter->discovery_idle_timeout > 0) {
 		timeout_remove(adapter->discovery_idle_timeout);
 		adapter->discovery_idle_timeout = 0;
@@ -1731,6 +1754,14 @@ static void discovery_cleanup(struct btd_adapter *adapter, int timeout)
 						invalidate_rssi_and_tx_power);
 	adapter->discovery_found = NULL;
 
+	if (adapter->adv_processed || adapter->adv_skipped)
+		DBG("reports: %u processed, %u skipped",
+					adapter->adv_processed,
+					adapter->adv_skipped);
+
+	adapter->adv_processed = 0;
+	adapter->adv_skipped = 0;
+
 	if (!adapter->devices)
 		return;
 
@@ -1779,6 +1810,8 @@ static void discovery_remove(struct discovery_client *client)
 
 	DBG("owner %s", client->owner);
 
+	ignored_cache_reset(adapter);
+
 	adapter->set_filter_list = g_slist_remove(adapter->set_filter_list,
 								client);
 
@@ -1875,6 +1908,8 @@ static void start_discovery_complete(uint8_t status, uint16_t length,
 		else
 			adapter->filtered_discovery = false;
 
+		ignored_cache_reset(adapter);
+
 		discovery_complete(adapter, status);
 
 		if (adapter->discovering)
@@ -2386,6 +2421,9 @@ static int update_discovery_filter(struct btd_adapter *adapter)
 
 	DBG("");
 
+	/* Clients or their filters changed */
+	ignored_cache_reset(adapter);
+
 	if (discovery_filter_to_mgmt_cp(adapter, &sd_cp)) {
 		btd_error(adapter->dev_id,
 				"discovery_filter_to_mgmt_cp returned error");
@@ -6001,6 +6039,7 @@ static void adapter_free(gpointer user_data)
 	if (adapter->allowed_uuid_set)
 		g_hash_table_destroy(adapter->allowed_uuid_set);
 
+	g_free(adapter->ignored);
 	g_free(adapter);
 }
 
@@ -7282,6 +7321,124 @@ static bool device_is_discoverable(struct btd_adapter *adapter,
 	return discoverable;
 }
 
+static uint64_t adv_hash(const uint8_t *data, uint8_t data_len,
+					uint8_t bdaddr_type, uint32_t flags)
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+	uint8_t i;
+
+	/* FNV-1a over the report flags and the raw AD payload */
+	hash = (hash ^ bdaddr_type) * 0x100000001b3ull;
+	hash = (hash ^ flags) * 0x100000001b3ull;
+	hash = (hash ^ data_len) * 0x100000001b3ull;
+
+	for (i = 0; i < data_len; i++)
+		hash = (hash ^ data[i]) * 0x100000001b3ull;
+
+	return hash;
+}
+
+static void update_rssi(struct btd_adapter *adapter, struct btd_device *dev,
+								int8_t rssi)
+{
+	if (adapter->filtered_discovery)
+		device_set_rssi_with_delta(dev, rssi, 0);
+	else
+		device_set_rssi(dev, rssi);
+}
+
+/* Reports with the same payload as the last fully processed one of the
+ * device would only update the RSSI, unless a discovery client asked for
+ * duplicates or filters by RSSI, or the device is to be connected.
+ */
+static bool device_found_unchanged(struct btd_adapter *adapter,
+					struct btd_device *dev, uint64_t hash,
+					uint8_t bdaddr_type, int8_t rssi,
+					bool not_connectable, bool monitoring)
+{
+	GSList *l;
+
+	if (adapter->discovery_list) {
+		if (!g_slist_find(adapter->discovery_found, dev))
+			return false;
+
+		for (l = adapter->discovery_list; l; l = g_slist_next(l)) {
+			struct discovery_client *client = l->data;
+			struct discovery_filter *item;
+
+			item = client->discovery_filter;
+			if (item && (item->duplicate ||
+					item->rssi != DISTANCE_VAL_INVALID ||
+					item->pathloss != DISTANCE_VAL_INVALID))
+				return false;
+		}
+	} else if (!monitoring ||
+			g_slist_find(adapter->connect_list, dev))
+		return false;
+
+	if (!device_adv_unchanged(dev, hash, bdaddr_type, !not_connectable))
+		return false;
+
+	update_rssi(adapter, dev, rssi);
+	adapter->adv_skipped++;
+
+	return true;
+}
+
+static struct ignored_device *ignored_lookup(struct btd_adapter *adapter,
+						const bdaddr_t *bdaddr,
+						uint8_t bdaddr_type)
+{
+	uint8_t idx = bdaddr_type;
+	int i;
+
+	if (!adapter->ignored)
+		adapter->ignored = g_new0(struct ignored_device,
+							IGNORED_CACHE_SIZE);
+
+	for (i = 0; i < 6; i++)
+		idx = idx * 31 + bdaddr->b[i];
+
+	return &adapter->ignored[idx % IGNORED_CACHE_SIZE];
+}
+
+static bool device_found_ignored(struct btd_adapter *adapter,
+					const bdaddr_t *bdaddr,
+					uint8_t bdaddr_type, uint64_t hash)
+{
+	struct ignored_device *ignored;
+
+	ignored = ignored_lookup(adapter, bdaddr, bdaddr_type);
+
+	return ignored->hash == hash && ignored->bdaddr_type == bdaddr_type &&
+				!bacmp(&ignored->bdaddr, bdaddr);
+}
+
+/* Remember a report that did not create a device object, unless the
+ * decision depends on the RSSI which changes from report to report.
+ */
+static void device_found_ignore(struct btd_adapter *adapter,
+					const bdaddr_t *bdaddr,
+					uint8_t bdaddr_type, uint64_t hash)
+{
+	struct ignored_device *ignored;
+	GSList *l;
+
+	for (l = adapter->discovery_list; l; l = g_slist_next(l)) {
+		struct discovery_client *client = l->data;
+		struct discovery_filter *item = client->discovery_filter;
+
+		if (item && (item->rssi != DISTANCE_VAL_INVALID ||
+					item->pathloss != DISTANCE_VAL_INVALID))
+			return;
+	}
+
+	ignored = ignored_lookup(adapter, bdaddr, bdaddr_type);
+	bacpy(&ignored->bdaddr, bdaddr);
+	ignored->bdaddr_type = bdaddr_type;
+	ignored->hash = hash;
+}
+
 void btd_adapter_device_found(struct btd_adapter *adapter,
 					const bdaddr_t *bdaddr,
 					uint8_t bdaddr_type, int8_t rssi,
@@ -7301,6 +7458,8 @@ void btd_adapter_device_found(struct btd_adapter *adapter,
 	bool scan_rsp;
 	bool duplicate = false;
 	bool auto_connect = false;
+	bool bredr;
+	uint64_t hash;
 	struct queue *matched_monitors = NULL;
 
 	confirm = (flags & MGMT_DEV_FOUND_CONFIRM_NAME);
@@ -7331,6 +7490,28 @@ void btd_adapter_device_found(struct btd_adapter *adapter,
 	if (!adapter->discovering && !monitoring)
 		return;
 
+	hash = adv_hash(data, data_len, bdaddr_type, flags);
+
+	dev = btd_adapter_find_device(adapter, bdaddr, bdaddr_type);
+	if (dev && device_found_unchanged(adapter, dev, hash, bdaddr_type,
+					rssi, not_connectable, monitoring)) {
+		if (matched_monitors) {
+			btd_adv_monitor_notify_monitors(
+						adapter->adv_monitor_manager,
+						dev, rssi, matched_monitors);
+			queue_destroy(matched_monitors, NULL);
+		}
+		return;
+	}
+
+	if (!dev && !monitoring && device_found_ignored(adapter, bdaddr,
+							bdaddr_type, hash)) {
+		adapter->adv_skipped++;
+		return;
+	}
+
+	adapter->adv_processed++;
+
 	memset(&eir_data, 0, sizeof(eir_data));
 	eir_parse(&eir_data, data, data_len);
 
@@ -7339,7 +7520,6 @@ void btd_adapter_device_found(struct btd_adapter *adapter,
 	discoverable = device_is_discoverable(adapter, &eir_data, addr,
 						bdaddr_type, &auto_connect);
 
-	dev = btd_adapter_find_device(adapter, bdaddr, bdaddr_type);
 	if (!dev) {
 		/* In case of being just a scan response don't attempt to create
 		 * the device.
@@ -7365,7 +7545,15 @@ void btd_adapter_device_found(struct btd_adapter *adapter,
 						eir_data.rsi)
 			monitoring = true;
 
-		if (!discoverable && !monitoring) {
+		/* Only export objects for devices that a discovery client
+		 * would be notified about below.
+		 */
+		if (!monitoring && (!discoverable || !adapter->discovery_list ||
+				(!eir_data.rsi && adapter->filtered_discovery &&
+				!is_filter_match(adapter->discovery_list,
+							&eir_data, rssi)))) {
+			device_found_ignore(adapter, bdaddr, bdaddr_type,
+									hash);
 			eir_data_free(&eir_data);
 			return;
 		}
@@ -7388,8 +7576,9 @@ void btd_adapter_device_found(struct btd_adapter *adapter,
 	 * kernels send them merged, so once we know which mgmt version
 	 * supports this we can make the non-zero check conditional.
 	 */
-	if (bdaddr_type != BDADDR_BREDR && eir_data.flags &&
-					!(eir_data.flags & EIR_BREDR_UNSUP)) {
+	bredr = bdaddr_type != BDADDR_BREDR && eir_data.flags &&
+					!(eir_data.flags & EIR_BREDR_UNSUP);
+	if (bredr) {
 		device_set_bredr_support(dev);
 		/* Update last seen for BR/EDR in case its flag is set */
 		device_update_last_seen(dev, BDADDR_BREDR, !not_connectable);
@@ -7424,10 +7613,7 @@ void btd_adapter_device_found(struct btd_adapter *adapter,
 	if (name_resolve_failed)
 		device_name_resolve_fail(dev);
 
-	if (adapter->filtered_discovery)
-		device_set_rssi_with_delta(dev, rssi, 0);
-	else
-		device_set_rssi(dev, rssi);
+	update_rssi(adapter, dev, rssi);
 
 	if (eir_data.tx_power != 127)
 		device_set_tx_power(dev, eir_data.tx_power);
@@ -7474,6 +7660,9 @@ void btd_adapter_device_found(struct btd_adapter *adapter,
 
 	eir_data_free(&eir_data);
 
+	/* Identical reports can skip all of the above from now on */
+	device_set_adv_hash(dev, hash, bredr);
+
 	/* After the device is updated, notify the matched Adv monitors */
 	if (matched_monitors) {
 		btd_adv_monitor_notify_monitors(adapter->adv_monitor_manager,
@@ -63,6 +63,7 @@ struct btd_adv_monitor_manager {
 
 	struct queue *apps;	/* apps who registered for Adv monitoring */
 	struct queue *merged_patterns;
+	struct bt_ad_matcher *matcher;	/* Patterns of merged_patterns */
 };
 
 struct adv_monitor_app {
@@ -241,9 +242,13 @@ static void merged_pattern_free(void *data)
 	queue_destroy(merged_pattern->patterns, pattern_free);
 	queue_destroy(merged_pattern->monitors, NULL);
 
-	if (merged_pattern->manager)
+	if (merged_pattern->manager) {
 		queue_remove(merged_pattern->manager->merged_patterns,
 							merged_pattern);
+		bt_ad_matcher_remove(merged_pattern->manager->matcher,
+							merged_pattern);
+	}
+
 	free(merged_pattern);
 }
 
@@ -1237,6 +1242,12 @@ static void monitor_proxy_added_cb(GDBusProxy *proxy, void *user_data)
 		monitor->merged_pattern->manager = monitor->app->manager;
 		queue_push_tail(monitor->app->manager->merged_patterns,
 						monitor->merged_pattern);
+
+		if (monitor->merged_pattern->type == MONITOR_TYPE_OR_PATTERNS)
+			bt_ad_matcher_add(monitor->app->manager->matcher,
+					monitor->merged_pattern->patterns,
+					monitor->merged_pattern);
+
 		merged_pattern_add(monitor->merged_pattern);
 	} else {
 		/* Since there is a matching pattern, abandon the one we have */
@@ -1710,6 +1721,7 @@ static struct btd_adv_monitor_manager *manager_new(
 	manager->adapter_id = btd_adapter_get_index(adapter);
 	manager->apps = queue_new();
 	manager->merged_patterns = queue_new();
+	manager->matcher = bt_ad_matcher_new();
 
 	mgmt_register(manager->mgmt, MGMT_EV_ADV_MONITOR_REMOVED,
 			manager->adapter_id, adv_monitor_removed_callback,
@@ -1733,6 +1745,7 @@ static void manager_free(struct btd_adv_monitor_manager *manager)
 
 	queue_destroy(manager->apps, app_destroy);
 	queue_destroy(manager->merged_patterns, merged_pattern_free);
+	bt_ad_matcher_free(manager->matcher);
 
 	free(manager);
 }
@@ -1843,12 +1856,11 @@ bool btd_adv_monitor_offload_enabled(struct btd_adv_monitor_manager *manager)
 				MGMT_ADV_MONITOR_FEATURE_MASK_OR_PATTERNS);
 }
 
-/* Processes the content matching based pattern(s) of a monitor */
+/* Collects the active monitors sharing a content-matched pattern */
 static void adv_match_per_monitor(void *data, void *user_data)
 {
 	struct adv_monitor *monitor = data;
 	struct adv_content_filter_info *info = user_data;
-	struct queue *patterns;
 
 	if (!monitor) {
 		error("Unexpected NULL adv_monitor object upon match");
@@ -1858,35 +1870,19 @@ static void adv_match_per_monitor(void *data, void *user_data)
 	if (monitor->state != MONITOR_STATE_ACTIVE)
 		return;
 
-	if (!monitor->merged_pattern)
-		return;
-
-	patterns = monitor->merged_pattern->patterns;
-	if (monitor->merged_pattern->type == MONITOR_TYPE_OR_PATTERNS &&
-				bt_ad_pattern_match(info->ad, patterns)) {
-		goto matched;
-	}
-
-	return;
-
-matched:
 	if (!info->matched_monitors)
 		info->matched_monitors = queue_new();
 
 	queue_push_tail(info->matched_monitors, monitor);
 }
 
-/* Processes the content matching for the monitor(s) of an app */
-static void adv_match_per_app(void *data, void *user_data)
+/* Processes a merged pattern matched by the manager's matcher */
+static void adv_match_per_pattern(void *data, void *user_data)
 {
-	struct adv_monitor_app *app = data;
-
-	if (!app) {
-		error("Unexpected NULL adv_monitor_app object upon match");
-		return;
-	}
+	struct adv_monitor_merged_pattern *merged_pattern = data;
 
-	queue_foreach(app->monitors, adv_match_per_monitor, user_data);
+	queue_foreach(merged_pattern->monitors, adv_match_per_monitor,
+								user_data);
 }
 
 /* Processes the content matching for every app without RSSI filtering and
@@ -1906,7 +1902,11 @@ struct queue *btd_adv_monitor_content_filter(
 	info.ad = ad;
 	info.matched_monitors = NULL;
 
-	queue_foreach(manager->apps, adv_match_per_app, &info);
+	/* Every pattern is looked up at once, whatever the number of
+	 * monitors.
+	 */
+	bt_ad_matcher_match(manager->matcher, ad, adv_match_per_pattern,
+								&info);
 
 	return info.matched_monitors;
 }
@@ -299,6 +299,9 @@ struct btd_device {
 	int8_t		rssi;
 	int8_t		tx_power;
 
+	uint64_t	adv_hash[2];		/* Last advertising reports */
+	bool		adv_bredr;
+
 	GIOChannel	*att_io;
 	guint		store_id;
 
@@ -5076,19 +5079,62 @@ void device_update_last_seen(struct btd_device *device, uint8_t bdaddr_type,
 							bool connectable)
 {
 	struct bearer_state *state;
+	time_t now = time(NULL);
+	bool restart;
 
 	state = get_state(device, bdaddr_type);
 
-	state->last_seen = time(NULL);
+	/* The timer has a resolution of seconds, so there is no need to
+	 * restart it for every advertising report within the same second.
+	 */
+	restart = state->last_seen != now || !device->temporary_timer;
+
+	state->last_seen = now;
 	state->connectable = connectable;
 
-	if (!device_is_temporary(device))
+	if (!device_is_temporary(device) || !restart)
 		return;
 
 	/* Restart temporary timer */
 	set_temporary_timer(device, btd_opts.tmpto);
 }
 
+/* Refresh a device whose advertising data has the same hash as one of the
+ * last fully processed reports, returns false if the data has changed.
+ */
+bool device_adv_unchanged(struct btd_device *device, uint64_t hash,
+					uint8_t bdaddr_type, bool connectable)
+{
+	if (!hash || (device->adv_hash[0] != hash &&
+				device->adv_hash[1] != hash))
+		return false;
+
+	device_update_last_seen(device, bdaddr_type, connectable);
+
+	if (device->adv_bredr)
+		device_update_last_seen(device, BDADDR_BREDR, connectable);
+
+	return true;
+}
+
+void device_set_adv_hash(struct btd_device *device, uint64_t hash,
+								bool bredr)
+{
+	if (!hash) {
+		memset(device->adv_hash, 0, sizeof(device->adv_hash));
+		device->adv_bredr = false;
+		return;
+	}
+
+	/* Scannable devices alternate between two reports */
+	if (device->adv_hash[0] != hash) {
+		device->adv_hash[1] = device->adv_hash[0];
+		device->adv_hash[0] = hash;
+	}
+
+	device->adv_bredr |= bredr;
+}
+
 void btd_device_set_connectable(struct btd_device *device, bool connectable)
 {
 	device_update_last_seen(device, device->bdaddr_type, connectable);
@@ -6791,6 +6837,8 @@ void device_load_svc_chng_ccc(struct btd_device *device, uint16_t *ccc_le,
 void device_set_rssi_with_delta(struct btd_device *device, int8_t rssi,
 							int8_t delta_threshold)
 {
+	GDbusPropertyChangedFlags flags = 0;
+
 	if (!device)
 		return;
 
@@ -6818,8 +6866,14 @@ void device_set_rssi_with_delta(struct btd_device *device, int8_t rssi,
 		device->rssi = rssi;
 	}
 
-	g_dbus_emit_property_changed(dbus_conn, device->path,
-						DEVICE_INTERFACE, "RSSI");
+	/* RSSI changes are rate limited, an invalidated RSSI is signalled
+	 * right away.
+	 */
+	if (!rssi)
+		flags = G_DBUS_PROPERTY_CHANGED_FLAG_FLUSH;
+
+	g_dbus_emit_property_changed_full(dbus_conn, device->path,
+					DEVICE_INTERFACE, "RSSI", flags);
 }
 
 void device_set_rssi(struct btd_device *device, int8_t rssi)
@@ -7938,6 +7992,9 @@ void btd_device_init(void)
 	dbus_conn = btd_get_dbus_connection();
 	service_state_cb_id = btd_service_add_state_cb(
 						service_state_changed, NULL);
+
+	/* RSSI changes with every advertising report, signal it at 1 Hz */
+	g_dbus_set_property_changed_interval(DEVICE_INTERFACE, "RSSI", 1000);
 }
 
 void btd_device_cleanup(void)
@@ -34,6 +34,10 @@ void device_update_addr(struct btd_device *device, const bdaddr_t *bdaddr,
 							uint8_t bdaddr_type);
 void device_set_bredr_support(struct btd_device *device);
 void device_set_le_support(struct btd_device *device, uint8_t bdaddr_type);
+bool device_adv_unchanged(struct btd_device *device, uint64_t hash,
+					uint8_t bdaddr_type, bool connectable);
+void device_set_adv_hash(struct btd_device *device, uint64_t hash,
+								bool bredr);
 void device_update_last_seen(struct btd_device *device, uint8_t bdaddr_type,
 							bool connectable);
 void device_merge_duplicate(struct btd_device *dev, struct btd_device *dup);
@@ -1346,10 +1346,15 @@ static void free_options(void)
 static void disconnect_dbus(void)
 {
 	DBusConnection *conn = btd_get_dbus_connection();
+	unsigned int emitted, suppressed;
 
 	if (!conn || !dbus_connection_get_is_connected(conn))
 		return;
 
+	g_dbus_get_property_changed_stats(&emitted, &suppressed);
+	DBG("PropertiesChanged: %u emitted, %u suppressed", emitted,
+								suppressed);
+
 	g_dbus_detach_object_manager(conn);
 	set_dbus_connection(NULL);
 
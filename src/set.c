@@ -28,6 +28,7 @@
 #include "src/shared/queue.h"
 #include "src/shared/ad.h"
 #include "src/shared/crypto.h"
+#include "src/shared/resolver.h"
 #include "src/shared/att.h"
 #include "src/shared/gatt-db.h"
 
@@ -38,7 +39,11 @@
 #include "dbus-common.h"
 #include "set.h"
 
+/* RSIs change along with the RPA, by default every 15 minutes */
+#define RSI_TIMEOUT	900
+
 static struct queue *set_list;
+static struct bt_resolver *resolver;
 
 struct btd_device_set {
 	struct btd_adapter *adapter;
@@ -262,24 +267,14 @@ static void foreach_rsi(void *data, void *user_data)
 {
 	struct bt_ad_data *ad = data;
 	struct btd_device_set *set = user_data;
-	struct bt_crypto *crypto;
-	uint8_t res[3];
+	struct btd_device_set *match;
 
 	if (ad->type != BT_AD_CSIP_RSI || ad->len < 6)
 		return;
 
-	crypto = bt_crypto_new();
-	if (!crypto)
-		return;
-
-	if (!bt_crypto_sih(crypto, set->sirk, ad->data + 3, res)) {
-		bt_crypto_unref(crypto);
-		return;
-	}
-
-	bt_crypto_unref(crypto);
-
-	if (memcmp(ad->data, res, sizeof(res)))
+	/* Sets of other adapters may share the same SIRK */
+	match = bt_resolver_resolve(resolver, ad->data);
+	if (!match || memcmp(match->sirk, set->sirk, sizeof(set->sirk)))
 		return;
 
 	/* Attempt to use existing gatt_db from set if device has never been
@@ -347,10 +342,13 @@ struct btd_device_set *btd_set_add_device(struct btd_device *device,
 	if (!set)
 		return NULL;
 
-	if (!set_list)
+	if (!set_list) {
 		set_list = queue_new();
+		resolver = bt_resolver_new(RSI_TIMEOUT);
+	}
 
 	queue_push_tail(set_list, set);
+	bt_resolver_add_key(resolver, set->sirk, set);
 
 done:
 	/* Attempt to add devices which have matching RSI */
@@ -380,6 +378,8 @@ bool btd_set_remove_device(struct btd_device_set *set,
 	if (!queue_remove(set_list, set))
 		return false;
 
+	bt_resolver_remove_key(resolver, set);
+
 	/* Unregister if there are no devices left in the set */
 	g_dbus_unregister_interface(btd_get_dbus_connection(), set->path,
 						BTD_DEVICE_SET_INTERFACE);
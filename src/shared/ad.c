@@ -1477,3 +1477,308 @@ struct bt_ad_pattern *bt_ad_pattern_match(struct bt_ad *ad,
 
 	return info.matched_pattern;
 }
+
+/* The matcher indexes every pattern by AD type, offset and first byte, so
+ * each AD structure is looked up once instead of being compared against
+ * every pattern of every set.
+ */
+struct matcher_set {
+	void *user_data;
+	unsigned int generation;
+	struct queue *entries;
+};
+
+struct matcher_entry {
+	struct matcher_set *set;
+	struct matcher_offset *node;
+	struct bt_ad_pattern pattern;
+};
+
+struct matcher_offset {
+	uint8_t type;
+	uint8_t offset;
+	unsigned int count;
+	struct queue *bytes[256];
+};
+
+struct bt_ad_matcher {
+	struct queue *types[256];
+	struct queue *sets;
+	unsigned int generation;
+};
+
+struct matcher_info {
+	struct bt_ad_matcher *matcher;
+	bt_ad_func_t func;
+	void *user_data;
+};
+
+struct bt_ad_matcher *bt_ad_matcher_new(void)
+{
+	struct bt_ad_matcher *matcher;
+
+	matcher = new0(struct bt_ad_matcher, 1);
+	matcher->sets = queue_new();
+
+	return matcher;
+}
+
+static bool match_offset(const void *data, const void *match_data)
+{
+	const struct matcher_offset *node = data;
+
+	return node->offset == PTR_TO_UINT(match_data);
+}
+
+static struct matcher_offset *matcher_get_offset(struct bt_ad_matcher *matcher,
+						uint8_t type, uint8_t offset)
+{
+	struct matcher_offset *node;
+
+	if (!matcher->types[type])
+		matcher->types[type] = queue_new();
+
+	node = queue_find(matcher->types[type], match_offset,
+						UINT_TO_PTR(offset));
+	if (node)
+		return node;
+
+	node = new0(struct matcher_offset, 1);
+	node->type = type;
+	node->offset = offset;
+	queue_push_tail(matcher->types[type], node);
+
+	return node;
+}
+
+static void matcher_entry_free(struct bt_ad_matcher *matcher,
+						struct matcher_entry *entry)
+{
+	struct matcher_offset *node = entry->node;
+	uint8_t byte = entry->pattern.data[0];
+
+	queue_remove(node->bytes[byte], entry);
+	if (queue_isempty(node->bytes[byte])) {
+		queue_destroy(node->bytes[byte], NULL);
+		node->bytes[byte] = NULL;
+	}
+
+	free(entry);
+
+	if (--node->count)
+		return;
+
+	queue_remove(matcher->types[node->type], node);
+
+	if (queue_isempty(matcher->types[node->type])) {
+		queue_destroy(matcher->types[node->type], NULL);
+		matcher->types[node->type] = NULL;
+	}
+
+	free(node);
+}
+
+static void matcher_set_free(struct bt_ad_matcher *matcher,
+						struct matcher_set *set)
+{
+	struct matcher_entry *entry;
+
+	while ((entry = queue_pop_head(set->entries)))
+		matcher_entry_free(matcher, entry);
+
+	queue_destroy(set->entries, NULL);
+	free(set);
+}
+
+static void matcher_add_pattern(void *data, void *user_data)
+{
+	struct bt_ad_pattern *pattern = data;
+	struct matcher_set *set = user_data;
+	struct matcher_entry *entry;
+
+	entry = new0(struct matcher_entry, 1);
+	entry->set = set;
+	memcpy(&entry->pattern, pattern, sizeof(*pattern));
+	queue_push_tail(set->entries, entry);
+}
+
+static void matcher_index_entry(void *data, void *user_data)
+{
+	struct matcher_entry *entry = data;
+	struct bt_ad_matcher *matcher = user_data;
+	struct matcher_offset *node;
+	uint8_t byte = entry->pattern.data[0];
+
+	node = matcher_get_offset(matcher, entry->pattern.type,
+						entry->pattern.offset);
+	if (!node->bytes[byte])
+		node->bytes[byte] = queue_new();
+
+	queue_push_tail(node->bytes[byte], entry);
+	node->count++;
+	entry->node = node;
+}
+
+static bool match_set(const void *data, const void *match_data)
+{
+	const struct matcher_set *set = data;
+
+	return set->user_data == match_data;
+}
+
+/* Adds a set of patterns, user_data is reported by bt_ad_matcher_match()
+ * whenever any of them matches.
+ */
+bool bt_ad_matcher_add(struct bt_ad_matcher *matcher, struct queue *patterns,
+							void *user_data)
+{
+	struct matcher_set *set;
+
+	if (!matcher || queue_isempty(patterns))
+		return false;
+
+	if (queue_find(matcher->sets, match_set, user_data))
+		return false;
+
+	set = new0(struct matcher_set, 1);
+	set->user_data = user_data;
+	set->entries = queue_new();
+
+	queue_foreach(patterns, matcher_add_pattern, set);
+	queue_foreach(set->entries, matcher_index_entry, matcher);
+
+	queue_push_tail(matcher->sets, set);
+
+	return true;
+}
+
+bool bt_ad_matcher_remove(struct bt_ad_matcher *matcher, void *user_data)
+{
+	struct matcher_set *set;
+
+	if (!matcher)
+		return false;
+
+	set = queue_remove_if(matcher->sets, match_set, user_data);
+	if (!set)
+		return false;
+
+	matcher_set_free(matcher, set);
+
+	return true;
+}
+
+void bt_ad_matcher_free(struct bt_ad_matcher *matcher)
+{
+	struct matcher_set *set;
+
+	if (!matcher)
+		return;
+
+	while ((set = queue_pop_head(matcher->sets)))
+		matcher_set_free(matcher, set);
+
+	queue_destroy(matcher->sets, NULL);
+	free(matcher);
+}
+
+static void matcher_lookup(struct matcher_info *info, uint8_t type,
+					const uint8_t *data, size_t len)
+{
+	struct bt_ad_matcher *matcher = info->matcher;
+	const struct queue_entry *n, *e;
+
+	for (n = queue_get_entries(matcher->types[type]); n; n = n->next) {
+		const struct matcher_offset *node = n->data;
+
+		if (node->offset >= len)
+			continue;
+
+		e = queue_get_entries(node->bytes[data[node->offset]]);
+		for (; e; e = e->next) {
+			const struct matcher_entry *entry = e->data;
+			const struct bt_ad_pattern *pattern = &entry->pattern;
+			struct matcher_set *set = entry->set;
+
+			/* Sets are reported once per advertisement */
+			if (set->generation == matcher->generation)
+				continue;
+
+			if (len < pattern->offset + pattern->len)
+				continue;
+
+			if (memcmp(data + pattern->offset + 1,
+					pattern->data + 1, pattern->len - 1))
+				continue;
+
+			set->generation = matcher->generation;
+			info->func(set->user_data, info->user_data);
+		}
+	}
+}
+
+static void matcher_manufacturer(void *data, void *user_data)
+{
+	struct bt_ad_manufacturer_data *manufacturer_data = data;
+	uint8_t all_data[BT_EA_MAX_DATA_LEN + 2];
+
+	/* Take the manufacturer ID into account */
+	memcpy(&all_data[0], &manufacturer_data->manufacturer_id, 2);
+	memcpy(&all_data[2], manufacturer_data->data, manufacturer_data->len);
+
+	matcher_lookup(user_data, BT_AD_MANUFACTURER_DATA, all_data,
+						manufacturer_data->len + 2);
+}
+
+static void matcher_service(void *data, void *user_data)
+{
+	struct bt_ad_service_data *service_data = data;
+
+	/* Like bt_ad_pattern_match() any service data pattern applies */
+	matcher_lookup(user_data, BT_AD_SERVICE_DATA16, service_data->data,
+							service_data->len);
+	matcher_lookup(user_data, BT_AD_SERVICE_DATA32, service_data->data,
+							service_data->len);
+	matcher_lookup(user_data, BT_AD_SERVICE_DATA128, service_data->data,
+							service_data->len);
+}
+
+static void matcher_data(void *data, void *user_data)
+{
+	struct bt_ad_data *ad_data = data;
+
+	matcher_lookup(user_data, ad_data->type, ad_data->data, ad_data->len);
+}
+
+/* Calls func once with the user_data of every set having at least one
+ * pattern matching ad, equivalent to bt_ad_pattern_match() on each set.
+ */
+void bt_ad_matcher_match(struct bt_ad_matcher *matcher, struct bt_ad *ad,
+					bt_ad_func_t func, void *user_data)
+{
+	struct matcher_info info;
+
+	if (!matcher || !ad || !func || queue_isempty(matcher->sets))
+		return;
+
+	/* Restart the generations rather than report a set twice */
+	if (!++matcher->generation) {
+		const struct queue_entry *e;
+
+		for (e = queue_get_entries(matcher->sets); e; e = e->next) {
+			struct matcher_set *set = e->data;
+
+			set->generation = 0;
+		}
+
+		matcher->generation = 1;
+	}
+
+	info.matcher = matcher;
+	info.func = func;
+	info.user_data = user_data;
+
+	queue_foreach(ad->manufacturer_data, matcher_manufacturer, &info);
+	queue_foreach(ad->service_data, matcher_service, &info);
+	queue_foreach(ad->data, matcher_data, &info);
+}
@@ -0,0 +1,365 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <sys/uio.h>
+
+#include "src/shared/util.h"
+#include "src/shared/aes.h"
+
+/* All operations on secret data are done without table lookups or branches
+ * depending on it, so neither keys nor the state can leak through the
+ * cache or timing.
+ */
+
+static inline uint32_t rol32(uint32_t val, unsigned int n)
+{
+	return (val << n) | (val >> (32 - n));
+}
+
+/* Boyar-Peralta S-box circuit, q[i] holds bit i of every input byte */
+static void sbox_bitslice(uint32_t q[8])
+{
+	uint32_t x0, x1, x2, x3, x4, x5, x6, x7;
+	uint32_t y1, y2, y3, y4, y5, y6, y7, y8, y9;
+	uint32_t y10, y11, y12, y13, y14, y15, y16, y17, y18, y19;
+	uint32_t y20, y21;
+	uint32_t z0, z1, z2, z3, z4, z5, z6, z7, z8, z9;
+	uint32_t z10, z11, z12, z13, z14, z15, z16, z17;
+	uint32_t t0, t1, t2, t3, t4, t5, t6, t7, t8, t9;
+	uint32_t t10, t11, t12, t13, t14, t15, t16, t17, t18, t19;
+	uint32_t t20, t21, t22, t23, t24, t25, t26, t27, t28, t29;
+	uint32_t t30, t31, t32, t33, t34, t35, t36, t37, t38, t39;
+	uint32_t t40, t41, t42, t43, t44, t45, t46, t47, t48, t49;
+	uint32_t t50, t51, t52, t53, t54, t55, t56, t57, t58, t59;
+	uint32_t t60, t61, t62, t63, t64, t65, t66, t67;
+	uint32_t s0, s1, s2, s3, s4, s5, s6, s7;
+
+	x0 = q[7];
+	x1 = q[6];
+	x2 = q[5];
+	x3 = q[4];
+	x4 = q[3];
+	x5 = q[2];
+	x6 = q[1];
+	x7 = q[0];
+
+	/* Top linear transformation */
+	y14 = x3 ^ x5;
+	y13 = x0 ^ x6;
+	y9 = x0 ^ x3;
+	y8 = x0 ^ x5;
+	t0 = x1 ^ x2;
+	y1 = t0 ^ x7;
+	y4 = y1 ^ x3;
+	y12 = y13 ^ y14;
+	y2 = y1 ^ x0;
+	y5 = y1 ^ x6;
+	y3 = y5 ^ y8;
+	t1 = x4 ^ y12;
+	y15 = t1 ^ x5;
+	y20 = t1 ^ x1;
+	y6 = y15 ^ x7;
+	y10 = y15 ^ t0;
+	y11 = y20 ^ y9;
+	y7 = x7 ^ y11;
+	y17 = y10 ^ y11;
+	y19 = y10 ^ y8;
+	y16 = t0 ^ y11;
+	y21 = y13 ^ y16;
+	y18 = x0 ^ y16;
+
+	/* Non-linear section */
+	t2 = y12 & y15;
+	t3 = y3 & y6;
+	t4 = t3 ^ t2;
+	t5 = y4 & x7;
+	t6 = t5 ^ t2;
+	t7 = y13 & y16;
+	t8 = y5 & y1;
+	t9 = t8 ^ t7;
+	t10 = y2 & y7;
+	t11 = t10 ^ t7;
+	t12 = y9 & y11;
+	t13 = y14 & y17;
+	t14 = t13 ^ t12;
+	t15 = y8 & y10;
+	t16 = t15 ^ t12;
+	t17 = t4 ^ t14;
+	t18 = t6 ^ t16;
+	t19 = t9 ^ t14;
+	t20 = t11 ^ t16;
+	t21 = t17 ^ y20;
+	t22 = t18 ^ y19;
+	t23 = t19 ^ y21;
+	t24 = t20 ^ y18;
+
+	t25 = t21 ^ t22;
+	t26 = t21 & t23;
+	t27 = t24 ^ t26;
+	t28 = t25 & t27;
+	t29 = t28 ^ t22;
+	t30 = t23 ^ t24;
+	t31 = t22 ^ t26;
+	t32 = t31 & t30;
+	t33 = t32 ^ t24;
+	t34 = t23 ^ t33;
+	t35 = t27 ^ t33;
+	t36 = t24 & t35;
+	t37 = t36 ^ t34;
+	t38 = t27 ^ t36;
+	t39 = t29 & t38;
+	t40 = t25 ^ t39;
+
+	t41 = t40 ^ t37;
+	t42 = t29 ^ t33;
+	t43 = t29 ^ t40;
+	t44 = t33 ^ t37;
+	t45 = t42 ^ t41;
+	z0 = t44 & y15;
+	z1 = t37 & y6;
+	z2 = t33 & x7;
+	z3 = t43 & y16;
+	z4 = t40 & y1;
+	z5 = t29 & y7;
+	z6 = t42 & y11;
+	z7 = t45 & y17;
+	z8 = t41 & y10;
+	z9 = t44 & y12;
+	z10 = t37 & y3;
+	z11 = t33 & y4;
+	z12 = t43 & y13;
+	z13 = t40 & y5;
+	z14 = t29 & y2;
+	z15 = t42 & y9;
+	z16 = t45 & y14;
+	z17 = t41 & y8;
+
+	/* Bottom linear transformation */
+	t46 = z15 ^ z16;
+	t47 = z10 ^ z11;
+	t48 = z5 ^ z13;
+	t49 = z9 ^ z10;
+	t50 = z2 ^ z12;
+	t51 = z2 ^ z5;
+	t52 = z7 ^ z8;
+	t53 = z0 ^ z3;
+	t54 = z6 ^ z7;
+	t55 = z16 ^ z17;
+	t56 = z12 ^ t48;
+	t57 = t50 ^ t53;
+	t58 = z4 ^ t46;
+	t59 = z3 ^ t54;
+	t60 = t46 ^ t57;
+	t61 = z14 ^ t57;
+	t62 = t52 ^ t58;
+	t63 = t49 ^ t58;
+	t64 = z4 ^ t59;
+	t65 = t61 ^ t62;
+	t66 = z1 ^ t63;
+	s0 = t59 ^ t63;
+	s6 = t56 ^ ~t62;
+	s7 = t48 ^ ~t60;
+	t67 = t64 ^ t65;
+	s3 = t53 ^ t66;
+	s4 = t51 ^ t66;
+	s5 = t47 ^ t65;
+	s1 = t64 ^ ~s3;
+	s2 = t55 ^ ~t67;
+
+	q[7] = s0;
+	q[6] = s1;
+	q[5] = s2;
+	q[4] = s3;
+	q[3] = s4;
+	q[2] = s5;
+	q[1] = s6;
+	q[0] = s7;
+}
+
+/* SubBytes of all 16 bytes of the state at once */
+static void sub_bytes(uint32_t s[4])
+{
+	const uint32_t m = 0x01010101;
+	uint32_t q[8];
+	int i, j;
+
+	for (i = 0; i < 8; i++)
+		q[i] = ((s[0] >> i) & m) | ((s[1] >> i) & m) << 1 |
+			((s[2] >> i) & m) << 2 | ((s[3] >> i) & m) << 3;
+
+	sbox_bitslice(q);
+
+	for (j = 0; j < 4; j++) {
+		s[j] = 0;
+
+		for (i = 0; i < 8; i++)
+			s[j] |= ((q[i] >> j) & m) << i;
+	}
+}
+
+static uint32_t sub_word(uint32_t w)
+{
+	uint32_t s[4] = { w };
+
+	sub_bytes(s);
+
+	return s[0];
+}
+
+/* Columns are stored with the first row in the most significant octet */
+static void shift_rows(uint32_t s[4])
+{
+	uint32_t t[4];
+	int i;
+
+	for (i = 0; i < 4; i++)
+		t[i] = (s[i] & 0xff000000) | (s[(i + 1) % 4] & 0x00ff0000) |
+			(s[(i + 2) % 4] & 0x0000ff00) |
+			(s[(i + 3) % 4] & 0x000000ff);
+
+	memcpy(s, t, sizeof(t));
+}
+
+/* Multiplication of each octet by x in GF(2^8) */
+static inline uint32_t xtime(uint32_t w)
+{
+	return ((w & 0x7f7f7f7f) << 1) ^ (((w >> 7) & 0x01010101) * 0x1b);
+}
+
+static uint32_t mix_column(uint32_t a)
+{
+	uint32_t t = xtime(a);
+
+	return t ^ rol32(a ^ t, 8) ^ rol32(a, 16) ^ rol32(a, 24);
+}
+
+/* Doubling in GF(2^128) as used to derive the CMAC subkeys */
+static void cmac_double(const uint8_t in[16], uint8_t out[16])
+{
+	uint8_t msb = in[0] & 0x80;
+	int i;
+
+	for (i = 0; i < 15; i++)
+		out[i] = (in[i] << 1) | (in[i + 1] >> 7);
+
+	out[15] = in[15] << 1;
+
+	if (msb)
+		out[15] ^= 0x87;
+}
+
+void bt_aes_set_key(struct bt_aes_key *key, const uint8_t k[16])
+{
+	static const uint8_t zero[16];
+	uint32_t *rk = key->rk;
+	uint8_t rcon = 0x01, l[16];
+	int i;
+
+	for (i = 0; i < 4; i++)
+		rk[i] = get_be32(k + i * 4);
+
+	for (i = 4; i < 44; i++) {
+		uint32_t tmp = rk[i - 1];
+
+		if (!(i % 4)) {
+			tmp = sub_word(tmp << 8 | tmp >> 24) ^
+						(uint32_t) rcon << 24;
+			rcon = (rcon << 1) ^ ((rcon & 0x80) ? 0x1b : 0);
+		}
+
+		rk[i] = rk[i - 4] ^ tmp;
+	}
+
+	/* RFC 4493, section 2.3 */
+	bt_aes_encrypt(key, zero, l);
+	cmac_double(l, key->k1);
+	cmac_double(key->k1, key->k2);
+}
+
+void bt_aes_encrypt(const struct bt_aes_key *key, const uint8_t in[16],
+							uint8_t out[16])
+{
+	const uint32_t *rk = key->rk;
+	uint32_t s[4];
+	int round, i;
+
+	for (i = 0; i < 4; i++)
+		s[i] = get_be32(in + i * 4) ^ rk[i];
+
+	for (round = 1; round <= 10; round++) {
+		rk += 4;
+
+		sub_bytes(s);
+		shift_rows(s);
+
+		for (i = 0; i < 4; i++) {
+			/* The last round has no MixColumns */
+			if (round < 10)
+				s[i] = mix_column(s[i]);
+
+			s[i] ^= rk[i];
+		}
+	}
+
+	for (i = 0; i < 4; i++)
+		put_be32(s[i], out + i * 4);
+}
+
+static void xor_block(uint8_t *dst, const uint8_t *src, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		dst[i] ^= src[i];
+}
+
+/* RFC 4493, section 2.4, the message is the concatenation of the iovecs */
+void bt_aes_cmac(const struct bt_aes_key *key, const struct iovec *iov,
+					size_t iov_len, uint8_t res[16])
+{
+	uint8_t x[16] = {}, block[16];
+	size_t i, len = 0;
+
+	for (i = 0; i < iov_len; i++) {
+		const uint8_t *data = iov[i].iov_base;
+		size_t left = iov[i].iov_len;
+
+		while (left) {
+			size_t n;
+
+			/* Keep the last block for the subkey */
+			if (len == 16) {
+				xor_block(x, block, 16);
+				bt_aes_encrypt(key, x, x);
+				len = 0;
+			}
+
+			n = 16 - len < left ? 16 - len : left;
+			memcpy(block + len, data, n);
+			len += n;
+			data += n;
+			left -= n;
+		}
+	}
+
+	if (len == 16) {
+		xor_block(block, key->k1, 16);
+	} else {
+		block[len] = 0x80;
+		memset(block + len + 1, 0, 15 - len);
+		xor_block(block, key->k2, 16);
+	}
+
+	xor_block(x, block, 16);
+	bt_aes_encrypt(key, x, res);
+}
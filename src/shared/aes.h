@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct iovec;
+
+/* Expanded AES-128 key, all values are in FIPS-197 byte order with the most
+ * significant octet first.
+ */
+struct bt_aes_key {
+	uint32_t rk[44];	/* Round keys */
+	uint8_t k1[16];		/* CMAC subkeys */
+	uint8_t k2[16];
+};
+
+void bt_aes_set_key(struct bt_aes_key *key, const uint8_t k[16]);
+void bt_aes_encrypt(const struct bt_aes_key *key, const uint8_t in[16],
+							uint8_t out[16]);
+void bt_aes_cmac(const struct bt_aes_key *key, const struct iovec *iov,
+					size_t iov_len, uint8_t res[16]);
@@ -134,6 +134,8 @@ static const struct {
 	{ BT_ATT_OP_PREP_WRITE_RSP,		ATT_OP_TYPE_RSP },
 	{ BT_ATT_OP_EXEC_WRITE_REQ,		ATT_OP_TYPE_REQ },
 	{ BT_ATT_OP_EXEC_WRITE_RSP,		ATT_OP_TYPE_RSP },
+	{ BT_ATT_OP_READ_MULT_VL_REQ,		ATT_OP_TYPE_REQ },
+	{ BT_ATT_OP_READ_MULT_VL_RSP,		ATT_OP_TYPE_RSP },
 	{ BT_ATT_OP_HANDLE_NFY,			ATT_OP_TYPE_NFY },
 	{ BT_ATT_OP_HANDLE_NFY_MULT,		ATT_OP_TYPE_NFY },
 	{ BT_ATT_OP_HANDLE_IND,			ATT_OP_TYPE_IND },
@@ -171,6 +173,7 @@ static const struct {
 	{ BT_ATT_OP_WRITE_REQ,			BT_ATT_OP_WRITE_RSP },
 	{ BT_ATT_OP_PREP_WRITE_REQ,		BT_ATT_OP_PREP_WRITE_RSP },
 	{ BT_ATT_OP_EXEC_WRITE_REQ,		BT_ATT_OP_EXEC_WRITE_RSP },
+	{ BT_ATT_OP_READ_MULT_VL_REQ,		BT_ATT_OP_READ_MULT_VL_RSP },
 	{ }
 };
 
@@ -1193,7 +1196,8 @@ static uint8_t io_get_type(int fd)
 	return BT_ATT_LE;
 }
 
-static struct bt_att_chan *bt_att_chan_new(int fd, uint8_t type)
+static struct bt_att_chan *bt_att_chan_new(int fd, uint8_t type,
+								uint16_t mtu)
 {
 	struct bt_att_chan *chan;
 
@@ -1222,7 +1226,7 @@ static struct bt_att_chan *bt_att_chan_new(int fd, uint8_t type)
 		chan->mtu = BT_ATT_DEFAULT_LE_MTU;
 		break;
 	default:
-		chan->mtu = io_get_mtu(chan->fd);
+		chan->mtu = mtu ? mtu : io_get_mtu(chan->fd);
 	}
 
 	if (chan->mtu < BT_ATT_DEFAULT_LE_MTU)
@@ -1263,7 +1267,7 @@ struct bt_att *bt_att_new(int fd, bool ext_signed)
 	struct bt_att *att;
 	struct bt_att_chan *chan;
 
-	chan = bt_att_chan_new(fd, io_get_type(fd));
+	chan = bt_att_chan_new(fd, io_get_type(fd), 0);
 	if (!chan)
 		return NULL;
 
@@ -1331,14 +1335,14 @@ bool bt_att_set_close_on_unref(struct bt_att *att, bool do_close)
 	return true;
 }
 
-int bt_att_attach_fd(struct bt_att *att, int fd)
+static int attach_fd(struct bt_att *att, int fd, uint16_t mtu)
 {
 	struct bt_att_chan *chan;
 
 	if (!att || fd < 0)
 		return -EINVAL;
 
-	chan = bt_att_chan_new(fd, BT_ATT_EATT);
+	chan = bt_att_chan_new(fd, BT_ATT_EATT, mtu);
 	if (!chan)
 		return -EINVAL;
 
@@ -1347,6 +1351,22 @@ int bt_att_attach_fd(struct bt_att *att, int fd)
 	return 0;
 }
 
+int bt_att_attach_fd(struct bt_att *att, int fd)
+{
+	return attach_fd(att, fd, 0);
+}
+
+/* For transports that cannot report the MTU, such as the socket pairs
+ * standing in for EATT channels in the unit tests.
+ */
+int bt_att_attach_fd_mtu(struct bt_att *att, int fd, uint16_t mtu)
+{
+	if (!mtu)
+		return -EINVAL;
+
+	return attach_fd(att, fd, mtu);
+}
+
 int bt_att_get_fd(struct bt_att *att)
 {
 	struct bt_att_chan *chan;
@@ -30,6 +30,7 @@ bool bt_att_set_close_on_unref(struct bt_att *att, bool do_close);
 int bt_att_get_fd(struct bt_att *att);
 
 int bt_att_attach_fd(struct bt_att *att, int fd);
+int bt_att_attach_fd_mtu(struct bt_att *att, int fd, uint16_t mtu);
 
 int bt_att_get_channels(struct bt_att *att);
 
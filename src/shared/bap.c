@@ -5539,6 +5539,8 @@ clone:
 	bap->idle_id = bt_gatt_client_idle_register(bap->client, bap_idle,
 								bap, NULL);
 
+	bt_gatt_client_batch_begin(bap->client);
+
 	if (bap->rdb->pacs) {
 		uint16_t value_handle;
 		struct bt_pacs *pacs = bap->rdb->pacs;
@@ -5625,7 +5627,7 @@ clone:
 
 		bap_cp_attach(bap);
 
-		return true;
+		goto done;
 	}
 
 	bt_uuid16_create(&uuid, PACS_UUID);
@@ -5634,6 +5636,9 @@ clone:
 	bt_uuid16_create(&uuid, ASCS_UUID);
 	gatt_db_foreach_service(bap->rdb->db, &uuid, foreach_ascs_service, bap);
 
+done:
+	bt_gatt_client_batch_end(bap->client);
+
 	return true;
 }
 
@@ -1545,10 +1545,14 @@ bool bt_bass_attach(struct bt_bass *bass, struct bt_gatt_client *client)
 
 	bass_attach_att(bass, bt_gatt_client_get_att(client));
 
+	bt_gatt_client_batch_begin(bass->client);
+
 	bt_uuid16_create(&uuid, BASS_UUID);
 	gatt_db_foreach_service(bass->rdb->db, &uuid, foreach_bass_service,
 				bass);
 
+	bt_gatt_client_batch_end(bass->client);
+
 	return true;
 }
 
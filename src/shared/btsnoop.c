@@ -22,6 +22,7 @@
 #include <limits.h>
 #include <arpa/inet.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 
 #include "src/shared/btsnoop.h"
 
@@ -47,6 +48,55 @@ static const uint8_t btsnoop_id[] = { 0x62, 0x74, 0x73, 0x6e,
 
 static const uint32_t btsnoop_version = 1;
 
+/* Compressed files share the BTSnoop header, with a different pattern, and
+ * carry the regular packet records in blocks compressed using the LZ4 block
+ * format. On close an index of all blocks with their time range is appended,
+ * which is located through the trailer at the very end of the file.
+ */
+static const uint8_t btsnoop_z_id[] = { 0x62, 0x74, 0x73, 0x6e,
+					0x6f, 0x6f, 0x70, 0x7a };
+
+static const uint8_t btsnoop_index_id[] = { 0x62, 0x74, 0x73, 0x6e,
+					    0x69, 0x64, 0x78, 0x00 };
+
+#define BTSNOOP_BLOCK_SIZE	65536
+#define BTSNOOP_ZBLOCK_SIZE	(BTSNOOP_BLOCK_SIZE + 512)
+#define BTSNOOP_BLOCK_USEC	1000000
+
+#define BTSNOOP_BLOCK_LZ4	1
+#define BTSNOOP_BLOCK_RAW	2
+#define BTSNOOP_BLOCK_INDEX	3
+
+struct btsnoop_block {
+	uint32_t	type;		/* Block Type */
+	uint32_t	len;		/* Stored Length */
+	uint32_t	size;		/* Original Length */
+	uint32_t	count;		/* Number of Records */
+	uint64_t	first_ts;	/* Timestamp of first record */
+	uint64_t	last_ts;	/* Timestamp of last record */
+} __attribute__ ((packed));
+#define BTSNOOP_BLOCK_HDR_SIZE (sizeof(struct btsnoop_block))
+
+struct btsnoop_index {
+	uint64_t	offset;		/* Block Offset */
+	uint64_t	first_ts;	/* Timestamp of first record */
+	uint64_t	last_ts;	/* Timestamp of last record */
+	uint32_t	count;		/* Number of Records */
+} __attribute__ ((packed));
+#define BTSNOOP_INDEX_SIZE (sizeof(struct btsnoop_index))
+
+struct btsnoop_trailer {
+	uint64_t	offset;		/* Index Block Offset */
+	uint8_t		id[8];		/* Identification Pattern */
+} __attribute__ ((packed));
+#define BTSNOOP_TRAILER_SIZE (sizeof(struct btsnoop_trailer))
+
+#define LZ4_HASH_LOG		12
+#define LZ4_MIN_MATCH		4
+#define LZ4_MF_LIMIT		12
+#define LZ4_LAST_LITERALS	5
+#define LZ4_MAX_OFFSET		65535
+
 struct pklg_pkt {
 	uint32_t	len;
 	uint64_t	ts;
@@ -68,8 +118,219 @@ struct btsnoop {
 	size_t cur_size;
 	unsigned int max_count;
 	unsigned int cur_count;
+	bool writer;
+	bool compressed;
+	uint8_t *block;
+	uint8_t *zblock;
+	size_t block_len;
+	size_t block_pos;
+	uint32_t block_count;
+	uint64_t block_first_ts;
+	uint64_t block_last_ts;
+	struct btsnoop_index *blocks;
+	size_t num_blocks;
+	size_t max_blocks;
+	uint8_t *wbuf;
+	size_t wbuf_size;
+	size_t wbuf_len;
 };
 
+static uint32_t lz4_read32(const uint8_t *ptr)
+{
+	uint32_t val;
+
+	memcpy(&val, ptr, sizeof(val));
+
+	return val;
+}
+
+static uint32_t lz4_hash(uint32_t val)
+{
+	return (val * 2654435761u) >> (32 - LZ4_HASH_LOG);
+}
+
+static uint8_t *lz4_put_length(uint8_t *op, size_t len)
+{
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+
+	*op++ = len;
+
+	return op;
+}
+
+/* Greedy single probe compressor, the output buffer must be large enough
+ * for incompressible input (len + len / 255 + 16).
+ */
+static size_t lz4_compress(const uint8_t *src, size_t len, uint8_t *dst)
+{
+	uint32_t table[1 << LZ4_HASH_LOG];
+	const uint8_t *ip = src, *anchor = src;
+	const uint8_t *end = src + len;
+	uint8_t *op = dst;
+	size_t lit;
+
+	memset(table, 0, sizeof(table));
+
+	while (len >= LZ4_MF_LIMIT + 1 && ip + LZ4_MF_LIMIT <= end) {
+		const uint8_t *match, *limit = end - LZ4_LAST_LITERALS;
+		uint32_t val = lz4_read32(ip);
+		uint32_t h = lz4_hash(val);
+		size_t mlen;
+		uint8_t *token;
+
+		match = src + table[h];
+		table[h] = ip - src;
+
+		if (match >= ip || ip - match > LZ4_MAX_OFFSET ||
+						lz4_read32(match) != val) {
+			ip++;
+			continue;
+		}
+
+		mlen = LZ4_MIN_MATCH;
+		while (ip + mlen < limit && match[mlen] == ip[mlen])
+			mlen++;
+
+		lit = ip - anchor;
+		token = op++;
+		*token = (lit < 15 ? lit : 15) << 4;
+		if (lit >= 15)
+			op = lz4_put_length(op, lit - 15);
+
+		memcpy(op, anchor, lit);
+		op += lit;
+
+		*op++ = (ip - match) & 0xff;
+		*op++ = (ip - match) >> 8;
+
+		mlen -= LZ4_MIN_MATCH;
+		*token |= mlen < 15 ? mlen : 15;
+		if (mlen >= 15)
+			op = lz4_put_length(op, mlen - 15);
+
+		ip += mlen + LZ4_MIN_MATCH;
+		anchor = ip;
+	}
+
+	lit = end - anchor;
+	*op++ = (lit < 15 ? lit : 15) << 4;
+	if (lit >= 15)
+		op = lz4_put_length(op, lit - 15);
+
+	memcpy(op, anchor, lit);
+	op += lit;
+
+	return op - dst;
+}
+
+static bool lz4_get_length(const uint8_t **ip, const uint8_t *end,
+								size_t *len)
+{
+	uint8_t val;
+
+	do {
+		if (*ip >= end)
+			return false;
+
+		val = *(*ip)++;
+		*len += val;
+	} while (val == 255);
+
+	return true;
+}
+
+static ssize_t lz4_decompress(const uint8_t *src, size_t len, uint8_t *dst,
+								size_t size)
+{
+	const uint8_t *ip = src, *end = src + len;
+	uint8_t *op = dst, *op_end = dst + size;
+
+	while (ip < end) {
+		uint8_t token = *ip++;
+		size_t lit = token >> 4, mlen = token & 0x0f;
+		size_t offset;
+
+		if (lit == 15 && !lz4_get_length(&ip, end, &lit))
+			return -1;
+
+		if (lit > (size_t) (end - ip) || lit > (size_t) (op_end - op))
+			return -1;
+
+		memcpy(op, ip, lit);
+		ip += lit;
+		op += lit;
+
+		/* The last sequence only has literals */
+		if (ip == end)
+			break;
+
+		if (end - ip < 2)
+			return -1;
+
+		offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+
+		if (!offset || offset > (size_t) (op - dst))
+			return -1;
+
+		if (mlen == 15 && !lz4_get_length(&ip, end, &mlen))
+			return -1;
+
+		mlen += LZ4_MIN_MATCH;
+		if (mlen > (size_t) (op_end - op))
+			return -1;
+
+		/* Matches may overlap with their own output */
+		for (; mlen > 0; mlen--, op++)
+			*op = *(op - offset);
+	}
+
+	return op - dst;
+}
+
+static bool btsnoop_write_hdr(struct btsnoop *btsnoop)
+{
+	struct btsnoop_hdr hdr;
+	ssize_t written;
+
+	if (btsnoop->compressed)
+		memcpy(hdr.id, btsnoop_z_id, sizeof(btsnoop_z_id));
+	else
+		memcpy(hdr.id, btsnoop_id, sizeof(btsnoop_id));
+
+	hdr.version = htobe32(btsnoop_version);
+	hdr.type = htobe32(btsnoop->format);
+
+	written = write(btsnoop->fd, &hdr, BTSNOOP_HDR_SIZE);
+	if (written < 0)
+		return false;
+
+	btsnoop->cur_size = BTSNOOP_HDR_SIZE;
+
+	return true;
+}
+
+static bool btsnoop_alloc_blocks(struct btsnoop *btsnoop)
+{
+	btsnoop->block = malloc(BTSNOOP_BLOCK_SIZE);
+	btsnoop->zblock = malloc(BTSNOOP_ZBLOCK_SIZE);
+
+	return btsnoop->block && btsnoop->zblock;
+}
+
+static void btsnoop_free(struct btsnoop *btsnoop)
+{
+	if (btsnoop->fd >= 0)
+		close(btsnoop->fd);
+
+	free(btsnoop->block);
+	free(btsnoop->zblock);
+	free(btsnoop->blocks);
+	free(btsnoop->wbuf);
+	free(btsnoop);
+}
+
 struct btsnoop *btsnoop_open(const char *path, unsigned long flags)
 {
 	struct btsnoop *btsnoop;
@@ -99,6 +360,16 @@ struct btsnoop *btsnoop_open(const char *path, unsigned long flags)
 
 		btsnoop->format = be32toh(hdr.type);
 		btsnoop->index = 0xffff;
+	} else if (!memcmp(hdr.id, btsnoop_z_id, sizeof(btsnoop_z_id))) {
+		if (be32toh(hdr.version) != btsnoop_version)
+			goto failed;
+
+		btsnoop->format = be32toh(hdr.type);
+		btsnoop->index = 0xffff;
+		btsnoop->compressed = true;
+
+		if (!btsnoop_alloc_blocks(btsnoop))
+			goto failed;
 	} else {
 		if (!(btsnoop->flags & BTSNOOP_FLAG_PKLG_SUPPORT))
 			goto failed;
@@ -120,20 +391,18 @@ struct btsnoop *btsnoop_open(const char *path, unsigned long flags)
 	return btsnoop_ref(btsnoop);
 
 failed:
-	close(btsnoop->fd);
-	free(btsnoop);
+	btsnoop_free(btsnoop);
 
 	return NULL;
 }
 
-struct btsnoop *btsnoop_create(const char *path, size_t max_size,
-					unsigned int max_count, uint32_t format)
+static struct btsnoop *create(const char *path, size_t max_size,
+					unsigned int max_count, uint32_t format,
+					bool compressed)
 {
 	struct btsnoop *btsnoop;
-	struct btsnoop_hdr hdr;
 	const char *real_path;
 	char tmp[PATH_MAX];
-	ssize_t written;
 
 	if (!max_size && max_count)
 		return NULL;
@@ -162,21 +431,269 @@ struct btsnoop *btsnoop_create(const char *path, size_t max_size,
 	btsnoop->path = path;
 	btsnoop->max_count = max_count;
 	btsnoop->max_size = max_size;
+	btsnoop->writer = true;
+	btsnoop->compressed = compressed;
 
-	memcpy(hdr.id, btsnoop_id, sizeof(btsnoop_id));
-	hdr.version = htobe32(btsnoop_version);
-	hdr.type = htobe32(btsnoop->format);
+	if (compressed && !btsnoop_alloc_blocks(btsnoop)) {
+		btsnoop_free(btsnoop);
+		return NULL;
+	}
 
-	written = write(btsnoop->fd, &hdr, BTSNOOP_HDR_SIZE);
-	if (written < 0) {
-		close(btsnoop->fd);
+	if (!btsnoop_write_hdr(btsnoop)) {
+		btsnoop_free(btsnoop);
+		return NULL;
+	}
+
+	return btsnoop_ref(btsnoop);
+}
+
+struct btsnoop *btsnoop_create(const char *path, size_t max_size,
+					unsigned int max_count, uint32_t format)
+{
+	return create(path, max_size, max_count, format, false);
+}
+
+struct btsnoop *btsnoop_create_compressed(const char *path, size_t max_size,
+					unsigned int max_count, uint32_t format)
+{
+	return create(path, max_size, max_count, format, true);
+}
+
+/* Continue writing an existing uncompressed file of the same format, or
+ * start a new one if there is none.
+ */
+struct btsnoop *btsnoop_append(const char *path, uint32_t format)
+{
+	struct btsnoop *btsnoop;
+	struct btsnoop_hdr hdr;
+	struct stat st;
+	ssize_t len;
+
+	btsnoop = calloc(1, sizeof(*btsnoop));
+	if (!btsnoop)
+		return NULL;
+
+	btsnoop->fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC,
+									0644);
+	if (btsnoop->fd < 0) {
 		free(btsnoop);
 		return NULL;
 	}
 
-	btsnoop->cur_size = BTSNOOP_HDR_SIZE;
+	btsnoop->format = format;
+	btsnoop->index = 0xffff;
+	btsnoop->writer = true;
+
+	if (fstat(btsnoop->fd, &st) < 0)
+		goto failed;
+
+	if (!st.st_size) {
+		if (!btsnoop_write_hdr(btsnoop))
+			goto failed;
+
+		return btsnoop_ref(btsnoop);
+	}
+
+	len = pread(btsnoop->fd, &hdr, BTSNOOP_HDR_SIZE, 0);
+	if (len < 0 || len != BTSNOOP_HDR_SIZE)
+		goto failed;
+
+	if (memcmp(hdr.id, btsnoop_id, sizeof(btsnoop_id)) ||
+				be32toh(hdr.version) != btsnoop_version ||
+				be32toh(hdr.type) != format)
+		goto failed;
+
+	btsnoop->cur_size = st.st_size;
 
 	return btsnoop_ref(btsnoop);
+
+failed:
+	btsnoop_free(btsnoop);
+
+	return NULL;
+}
+
+static bool btsnoop_write_index(struct btsnoop *btsnoop)
+{
+	struct btsnoop_block hdr;
+	struct btsnoop_trailer trailer;
+	struct iovec iov[3];
+	size_t len = btsnoop->num_blocks * BTSNOOP_INDEX_SIZE;
+	ssize_t written;
+
+	if (!btsnoop->num_blocks)
+		return true;
+
+	hdr.type = htobe32(BTSNOOP_BLOCK_INDEX);
+	hdr.len = htobe32(len);
+	hdr.size = htobe32(len);
+	hdr.count = htobe32(btsnoop->num_blocks);
+	hdr.first_ts = btsnoop->blocks[0].first_ts;
+	hdr.last_ts = btsnoop->blocks[btsnoop->num_blocks - 1].last_ts;
+
+	trailer.offset = htobe64(btsnoop->cur_size);
+	memcpy(trailer.id, btsnoop_index_id, sizeof(btsnoop_index_id));
+
+	iov[0].iov_base = &hdr;
+	iov[0].iov_len = BTSNOOP_BLOCK_HDR_SIZE;
+	iov[1].iov_base = btsnoop->blocks;
+	iov[1].iov_len = len;
+	iov[2].iov_base = &trailer;
+	iov[2].iov_len = BTSNOOP_TRAILER_SIZE;
+
+	btsnoop->num_blocks = 0;
+
+	written = writev(btsnoop->fd, iov, 3);
+	if (written < 0)
+		return false;
+
+	btsnoop->cur_size += written;
+
+	return true;
+}
+
+static bool btsnoop_rotate(struct btsnoop *btsnoop);
+
+static bool btsnoop_flush_block(struct btsnoop *btsnoop)
+{
+	struct btsnoop_block hdr;
+	struct btsnoop_index *entry;
+	struct iovec iov[2];
+	size_t len, needed;
+	ssize_t written;
+
+	if (!btsnoop->block_count)
+		return true;
+
+	len = lz4_compress(btsnoop->block, btsnoop->block_len,
+							btsnoop->zblock);
+	if (len < btsnoop->block_len) {
+		hdr.type = htobe32(BTSNOOP_BLOCK_LZ4);
+		iov[1].iov_base = btsnoop->zblock;
+	} else {
+		len = btsnoop->block_len;
+		hdr.type = htobe32(BTSNOOP_BLOCK_RAW);
+		iov[1].iov_base = btsnoop->block;
+	}
+
+	hdr.len = htobe32(len);
+	hdr.size = htobe32(btsnoop->block_len);
+	hdr.count = htobe32(btsnoop->block_count);
+	hdr.first_ts = htobe64(btsnoop->block_first_ts);
+	hdr.last_ts = htobe64(btsnoop->block_last_ts);
+
+	iov[0].iov_base = &hdr;
+	iov[0].iov_len = BTSNOOP_BLOCK_HDR_SIZE;
+	iov[1].iov_len = len;
+
+	btsnoop->block_len = 0;
+	btsnoop->block_count = 0;
+
+	/* Leave room for the index when checking the size limit */
+	needed = 2 * BTSNOOP_BLOCK_HDR_SIZE + len + BTSNOOP_TRAILER_SIZE +
+				(btsnoop->num_blocks + 1) * BTSNOOP_INDEX_SIZE;
+
+	if (btsnoop->max_size && btsnoop->num_blocks &&
+			btsnoop->max_size <= btsnoop->cur_size + needed)
+		if (!btsnoop_rotate(btsnoop))
+			return false;
+
+	if (btsnoop->num_blocks == btsnoop->max_blocks) {
+		size_t size = btsnoop->max_blocks * 2;
+		struct btsnoop_index *blocks;
+
+		if (!size)
+			size = 64;
+
+		blocks = realloc(btsnoop->blocks, size * BTSNOOP_INDEX_SIZE);
+		if (!blocks)
+			return false;
+
+		btsnoop->blocks = blocks;
+		btsnoop->max_blocks = size;
+	}
+
+	entry = &btsnoop->blocks[btsnoop->num_blocks];
+	entry->offset = htobe64(btsnoop->cur_size);
+	entry->first_ts = hdr.first_ts;
+	entry->last_ts = hdr.last_ts;
+	entry->count = hdr.count;
+
+	written = writev(btsnoop->fd, iov, 2);
+	if (written < 0)
+		return false;
+
+	btsnoop->num_blocks++;
+	btsnoop->cur_size += written;
+
+	return true;
+}
+
+static bool btsnoop_write_block(struct btsnoop *btsnoop,
+				const struct btsnoop_pkt *pkt,
+				const void *data, uint16_t size)
+{
+	uint64_t ts = be64toh(pkt->ts);
+
+	/* A record has to fit into a single block */
+	if (BTSNOOP_PKT_SIZE + size > BTSNOOP_BLOCK_SIZE)
+		return false;
+
+	/* There is no timer, so a block is only flushed by the first packet
+	 * arriving more than a second after it was started. Until then the
+	 * pending packets of an idle capture stay in memory.
+	 */
+	if (btsnoop->block_count && (btsnoop->block_len + BTSNOOP_PKT_SIZE +
+				size > BTSNOOP_BLOCK_SIZE ||
+				ts > btsnoop->block_first_ts +
+						BTSNOOP_BLOCK_USEC))
+		if (!btsnoop_flush_block(btsnoop))
+			return false;
+
+	if (!btsnoop->block_count)
+		btsnoop->block_first_ts = ts;
+
+	btsnoop->block_last_ts = ts;
+	btsnoop->block_count++;
+
+	memcpy(btsnoop->block + btsnoop->block_len, pkt, BTSNOOP_PKT_SIZE);
+	btsnoop->block_len += BTSNOOP_PKT_SIZE;
+
+	if (data && size > 0) {
+		memcpy(btsnoop->block + btsnoop->block_len, data, size);
+		btsnoop->block_len += size;
+	}
+
+	return true;
+}
+
+static bool btsnoop_flush(struct btsnoop *btsnoop)
+{
+	ssize_t written;
+
+	if (!btsnoop->wbuf_len)
+		return true;
+
+	written = write(btsnoop->fd, btsnoop->wbuf, btsnoop->wbuf_len);
+	btsnoop->wbuf_len = 0;
+
+	return written >= 0;
+}
+
+static bool btsnoop_write_buf(struct btsnoop *btsnoop, const void *data,
+								size_t size)
+{
+	if (btsnoop->wbuf_len + size > btsnoop->wbuf_size &&
+						!btsnoop_flush(btsnoop))
+		return false;
+
+	if (size > btsnoop->wbuf_size)
+		return write(btsnoop->fd, data, size) >= 0;
+
+	memcpy(btsnoop->wbuf + btsnoop->wbuf_len, data, size);
+	btsnoop->wbuf_len += size;
+
+	return true;
 }
 
 struct btsnoop *btsnoop_ref(struct btsnoop *btsnoop)
@@ -197,10 +714,45 @@ void btsnoop_unref(struct btsnoop *btsnoop)
 	if (__sync_sub_and_fetch(&btsnoop->ref_count, 1))
 		return;
 
-	if (btsnoop->fd >= 0)
-		close(btsnoop->fd);
+	if (btsnoop->writer && btsnoop->compressed && btsnoop->fd >= 0) {
+		btsnoop_flush_block(btsnoop);
+		btsnoop_write_index(btsnoop);
+	}
 
-	free(btsnoop);
+	if (btsnoop->writer && btsnoop->fd >= 0)
+		btsnoop_flush(btsnoop);
+
+	btsnoop_free(btsnoop);
+}
+
+/* Collect uncompressed records in memory and only write them out once the
+ * buffer is full, on rotation or when the file is closed.
+ */
+bool btsnoop_set_buffer_size(struct btsnoop *btsnoop, size_t size)
+{
+	uint8_t *buf;
+
+	if (!btsnoop || !btsnoop->writer || btsnoop->compressed)
+		return false;
+
+	if (!btsnoop_flush(btsnoop))
+		return false;
+
+	if (!size) {
+		free(btsnoop->wbuf);
+		btsnoop->wbuf = NULL;
+		btsnoop->wbuf_size = 0;
+		return true;
+	}
+
+	buf = realloc(btsnoop->wbuf, size);
+	if (!buf)
+		return false;
+
+	btsnoop->wbuf = buf;
+	btsnoop->wbuf_size = size;
+
+	return true;
 }
 
 uint32_t btsnoop_get_format(struct btsnoop *btsnoop)
@@ -213,9 +765,12 @@ uint32_t btsnoop_get_format(struct btsnoop *btsnoop)
 
 static bool btsnoop_rotate(struct btsnoop *btsnoop)
 {
-	struct btsnoop_hdr hdr;
 	char path[PATH_MAX];
-	ssize_t written;
+
+	if (btsnoop->compressed)
+		btsnoop_write_index(btsnoop);
+	else
+		btsnoop_flush(btsnoop);
 
 	close(btsnoop->fd);
 
@@ -234,17 +789,7 @@ static bool btsnoop_rotate(struct btsnoop *btsnoop)
 	if (btsnoop->fd < 0)
 		return false;
 
-	memcpy(hdr.id, btsnoop_id, sizeof(btsnoop_id));
-	hdr.version = htobe32(btsnoop_version);
-	hdr.type = htobe32(btsnoop->format);
-
-	written = write(btsnoop->fd, &hdr, BTSNOOP_HDR_SIZE);
-	if (written < 0)
-		return false;
-
-	btsnoop->cur_size = BTSNOOP_HDR_SIZE;
-
-	return true;
+	return btsnoop_write_hdr(btsnoop);
 }
 
 bool btsnoop_write(struct btsnoop *btsnoop, struct timeval *tv,
@@ -258,11 +803,6 @@ bool btsnoop_write(struct btsnoop *btsnoop, struct timeval *tv,
 	if (!btsnoop || !tv)
 		return false;
 
-	if (btsnoop->max_size && btsnoop->max_size <=
-			btsnoop->cur_size + size + BTSNOOP_PKT_SIZE)
-		if (!btsnoop_rotate(btsnoop))
-			return false;
-
 	ts = (tv->tv_sec - 946684800ll) * 1000000ll + tv->tv_usec;
 
 	pkt.size  = htobe32(size);
@@ -271,6 +811,27 @@ bool btsnoop_write(struct btsnoop *btsnoop, struct timeval *tv,
 	pkt.drops = htobe32(drops);
 	pkt.ts    = htobe64(ts + 0x00E03AB44A676000ll);
 
+	if (btsnoop->compressed)
+		return btsnoop_write_block(btsnoop, &pkt, data, size);
+
+	if (btsnoop->max_size && btsnoop->max_size <=
+			btsnoop->cur_size + size + BTSNOOP_PKT_SIZE)
+		if (!btsnoop_rotate(btsnoop))
+			return false;
+
+	if (btsnoop->wbuf) {
+		if (!btsnoop_write_buf(btsnoop, &pkt, BTSNOOP_PKT_SIZE))
+			return false;
+
+		if (data && size > 0 &&
+				!btsnoop_write_buf(btsnoop, data, size))
+			return false;
+
+		btsnoop->cur_size += BTSNOOP_PKT_SIZE + size;
+
+		return true;
+	}
+
 	written = write(btsnoop->fd, &pkt, BTSNOOP_PKT_SIZE);
 	if (written < 0)
 		return false;
@@ -504,6 +1065,82 @@ static uint16_t get_opcode_from_flags(uint8_t type, uint32_t flags)
 	return 0xffff;
 }
 
+static bool btsnoop_load_block(struct btsnoop *btsnoop)
+{
+	struct btsnoop_block hdr;
+	uint32_t type, len, size;
+	ssize_t r;
+
+	r = read(btsnoop->fd, &hdr, BTSNOOP_BLOCK_HDR_SIZE);
+	if (r == 0)
+		return false;
+
+	if (r < 0 || r != BTSNOOP_BLOCK_HDR_SIZE)
+		goto failed;
+
+	type = be32toh(hdr.type);
+	len = be32toh(hdr.len);
+	size = be32toh(hdr.size);
+
+	/* The index marks the end of the packet data */
+	if (type == BTSNOOP_BLOCK_INDEX)
+		return false;
+
+	if (len > BTSNOOP_ZBLOCK_SIZE || size > BTSNOOP_BLOCK_SIZE)
+		goto failed;
+
+	switch (type) {
+	case BTSNOOP_BLOCK_RAW:
+		if (len != size)
+			goto failed;
+
+		r = read(btsnoop->fd, btsnoop->block, len);
+		if (r < 0 || (uint32_t) r != len)
+			goto failed;
+		break;
+	case BTSNOOP_BLOCK_LZ4:
+		r = read(btsnoop->fd, btsnoop->zblock, len);
+		if (r < 0 || (uint32_t) r != len)
+			goto failed;
+
+		r = lz4_decompress(btsnoop->zblock, len, btsnoop->block, size);
+		if (r < 0 || (uint32_t) r != size)
+			goto failed;
+		break;
+	default:
+		goto failed;
+	}
+
+	btsnoop->block_len = size;
+	btsnoop->block_pos = 0;
+
+	return true;
+
+failed:
+	btsnoop->aborted = true;
+	return false;
+}
+
+static ssize_t btsnoop_read_data(struct btsnoop *btsnoop, void *data,
+								size_t len)
+{
+	if (!btsnoop->compressed)
+		return read(btsnoop->fd, data, len);
+
+	if (btsnoop->block_pos == btsnoop->block_len &&
+					!btsnoop_load_block(btsnoop))
+		return btsnoop->aborted ? -1 : 0;
+
+	/* Records never span across blocks */
+	if (len > btsnoop->block_len - btsnoop->block_pos)
+		len = btsnoop->block_len - btsnoop->block_pos;
+
+	memcpy(data, btsnoop->block + btsnoop->block_pos, len);
+	btsnoop->block_pos += len;
+
+	return len;
+}
+
 bool btsnoop_read_hci(struct btsnoop *btsnoop, struct timeval *tv,
 					uint16_t *index, uint16_t *opcode,
 					void *data, uint16_t *size)
@@ -520,7 +1157,7 @@ bool btsnoop_read_hci(struct btsnoop *btsnoop, struct timeval *tv,
 	if (btsnoop->pklg_format)
 		return pklg_read_hci(btsnoop, tv, index, opcode, data, size);
 
-	len = read(btsnoop->fd, &pkt, BTSNOOP_PKT_SIZE);
+	len = btsnoop_read_data(btsnoop, &pkt, BTSNOOP_PKT_SIZE);
 	if (len == 0)
 		return false;
 
@@ -548,7 +1185,7 @@ bool btsnoop_read_hci(struct btsnoop *btsnoop, struct timeval *tv,
 		break;
 
 	case BTSNOOP_FORMAT_UART:
-		len = read(btsnoop->fd, &pkt_type, 1);
+		len = btsnoop_read_data(btsnoop, &pkt_type, 1);
 		if (len < 0) {
 			btsnoop->aborted = true;
 			return false;
@@ -569,7 +1206,7 @@ bool btsnoop_read_hci(struct btsnoop *btsnoop, struct timeval *tv,
 		return false;
 	}
 
-	len = read(btsnoop->fd, data, toread);
+	len = btsnoop_read_data(btsnoop, data, toread);
 	if (len < 0) {
 		btsnoop->aborted = true;
 		return false;
@@ -580,6 +1217,152 @@ bool btsnoop_read_hci(struct btsnoop *btsnoop, struct timeval *tv,
 	return true;
 }
 
+static uint64_t btsnoop_get_ts(const struct timeval *tv)
+{
+	uint64_t ts;
+
+	ts = (tv->tv_sec - 946684800ll) * 1000000ll + tv->tv_usec;
+
+	return ts + 0x00E03AB44A676000ll;
+}
+
+static bool btsnoop_seek_plain(struct btsnoop *btsnoop, uint64_t ts)
+{
+	struct btsnoop_pkt pkt;
+
+	if (lseek(btsnoop->fd, BTSNOOP_HDR_SIZE, SEEK_SET) < 0)
+		return false;
+
+	while (read(btsnoop->fd, &pkt, BTSNOOP_PKT_SIZE) == BTSNOOP_PKT_SIZE) {
+		if (be64toh(pkt.ts) >= ts) {
+			lseek(btsnoop->fd, -BTSNOOP_PKT_SIZE, SEEK_CUR);
+			return true;
+		}
+
+		if (lseek(btsnoop->fd, be32toh(pkt.len), SEEK_CUR) < 0)
+			break;
+	}
+
+	return false;
+}
+
+/* Look up the offset of the first block ending at or after ts, using the
+ * index when the file has been closed properly and by walking the block
+ * headers otherwise.
+ */
+static off_t btsnoop_find_block(struct btsnoop *btsnoop, uint64_t ts)
+{
+	struct btsnoop_trailer trailer;
+	struct btsnoop_block hdr;
+	struct btsnoop_index entry;
+	off_t offset;
+	uint32_t i, count;
+
+	if (lseek(btsnoop->fd, -BTSNOOP_TRAILER_SIZE, SEEK_END) < 0)
+		goto scan;
+
+	if (read(btsnoop->fd, &trailer, BTSNOOP_TRAILER_SIZE) !=
+						BTSNOOP_TRAILER_SIZE)
+		goto scan;
+
+	if (memcmp(trailer.id, btsnoop_index_id, sizeof(btsnoop_index_id)))
+		goto scan;
+
+	if (lseek(btsnoop->fd, be64toh(trailer.offset), SEEK_SET) < 0)
+		goto scan;
+
+	if (read(btsnoop->fd, &hdr, BTSNOOP_BLOCK_HDR_SIZE) !=
+						BTSNOOP_BLOCK_HDR_SIZE)
+		goto scan;
+
+	if (be32toh(hdr.type) != BTSNOOP_BLOCK_INDEX)
+		goto scan;
+
+	count = be32toh(hdr.count);
+
+	for (i = 0; i < count; i++) {
+		if (read(btsnoop->fd, &entry, BTSNOOP_INDEX_SIZE) !=
+							BTSNOOP_INDEX_SIZE)
+			goto scan;
+
+		if (be64toh(entry.last_ts) >= ts)
+			return be64toh(entry.offset);
+	}
+
+	return -1;
+
+scan:
+	offset = lseek(btsnoop->fd, BTSNOOP_HDR_SIZE, SEEK_SET);
+
+	while (offset >= 0) {
+		if (read(btsnoop->fd, &hdr, BTSNOOP_BLOCK_HDR_SIZE) !=
+						BTSNOOP_BLOCK_HDR_SIZE)
+			break;
+
+		if (be32toh(hdr.type) == BTSNOOP_BLOCK_INDEX)
+			break;
+
+		if (be64toh(hdr.last_ts) >= ts)
+			return offset;
+
+		offset = lseek(btsnoop->fd, be32toh(hdr.len), SEEK_CUR);
+	}
+
+	return -1;
+}
+
+static bool btsnoop_seek_block(struct btsnoop *btsnoop, uint64_t ts)
+{
+	off_t offset;
+
+	btsnoop->block_len = 0;
+	btsnoop->block_pos = 0;
+
+	offset = btsnoop_find_block(btsnoop, ts);
+	if (offset < 0) {
+		lseek(btsnoop->fd, 0, SEEK_END);
+		return false;
+	}
+
+	if (lseek(btsnoop->fd, offset, SEEK_SET) < 0 ||
+					!btsnoop_load_block(btsnoop))
+		return false;
+
+	/* Skip the records of the block preceding ts */
+	while (btsnoop->block_pos + BTSNOOP_PKT_SIZE <= btsnoop->block_len) {
+		struct btsnoop_pkt pkt;
+
+		memcpy(&pkt, btsnoop->block + btsnoop->block_pos,
+							BTSNOOP_PKT_SIZE);
+
+		if (be64toh(pkt.ts) >= ts)
+			break;
+
+		btsnoop->block_pos += BTSNOOP_PKT_SIZE + be32toh(pkt.len);
+	}
+
+	if (btsnoop->block_pos > btsnoop->block_len)
+		btsnoop->block_pos = btsnoop->block_len;
+
+	return true;
+}
+
+bool btsnoop_seek(struct btsnoop *btsnoop, const struct timeval *tv)
+{
+	uint64_t ts;
+
+	if (!btsnoop || !tv || btsnoop->writer || btsnoop->pklg_format)
+		return false;
+
+	ts = btsnoop_get_ts(tv);
+	btsnoop->aborted = false;
+
+	if (btsnoop->compressed)
+		return btsnoop_seek_block(btsnoop, ts);
+
+	return btsnoop_seek_plain(btsnoop, ts);
+}
+
 bool btsnoop_read_phy(struct btsnoop *btsnoop, struct timeval *tv,
 			uint16_t *frequency, void *data, uint16_t *size)
 {
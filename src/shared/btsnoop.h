@@ -92,12 +92,17 @@ struct btsnoop;
 struct btsnoop *btsnoop_open(const char *path, unsigned long flags);
 struct btsnoop *btsnoop_create(const char *path, size_t max_size,
 				unsigned int max_count, uint32_t format);
+struct btsnoop *btsnoop_create_compressed(const char *path, size_t max_size,
+				unsigned int max_count, uint32_t format);
+struct btsnoop *btsnoop_append(const char *path, uint32_t format);
 
 struct btsnoop *btsnoop_ref(struct btsnoop *btsnoop);
 void btsnoop_unref(struct btsnoop *btsnoop);
 
 uint32_t btsnoop_get_format(struct btsnoop *btsnoop);
 
+bool btsnoop_set_buffer_size(struct btsnoop *btsnoop, size_t size);
+
 bool btsnoop_write(struct btsnoop *btsnoop, struct timeval *tv, uint32_t flags,
 			uint32_t drops, const void *data, uint16_t size);
 bool btsnoop_write_hci(struct btsnoop *btsnoop, struct timeval *tv,
@@ -111,3 +116,5 @@ bool btsnoop_read_hci(struct btsnoop *btsnoop, struct timeval *tv,
 					void *data, uint16_t *size);
 bool btsnoop_read_phy(struct btsnoop *btsnoop, struct timeval *tv,
 			uint16_t *frequency, void *data, uint16_t *size);
+
+bool btsnoop_seek(struct btsnoop *btsnoop, const struct timeval *tv);
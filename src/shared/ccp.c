@@ -1206,13 +1206,17 @@ bool bt_ccp_attach(struct bt_ccp *ccp, struct bt_gatt_client *client)
 	if (!ccp->client)
 		return false;
 
+	bt_gatt_client_batch_begin(ccp->client);
+
 	if (ccp->rdb->ccs) {
 		bt_ccp_call_state_attach(ccp);
-		return true;
+	} else {
+		bt_uuid16_create(&uuid, GTBS_UUID);
+		gatt_db_foreach_service(ccp->rdb->db, &uuid,
+						foreach_ccs_service, ccp);
 	}
 
-	bt_uuid16_create(&uuid, GTBS_UUID);
-	gatt_db_foreach_service(ccp->rdb->db, &uuid, foreach_ccs_service, ccp);
+	bt_gatt_client_batch_end(ccp->client);
 
 	return true;
 }
@@ -18,6 +18,7 @@
 #include <sys/socket.h>
 
 #include "src/shared/util.h"
+#include "src/shared/aes.h"
 #include "src/shared/crypto.h"
 
 #ifndef HAVE_LINUX_IF_ALG_H
@@ -64,11 +65,24 @@ struct af_alg_iv {
 
 #define ATT_SIGN_LEN	12
 
+/* Number of expanded keys kept around, enough for resolving a few IRKs or
+ * signing with a few CSRKs without expanding the keys again.
+ */
+#define KEY_CACHE_SIZE	8
+
+struct crypto_key {
+	bool valid;
+	uint8_t k[16];
+	struct bt_aes_key aes;
+};
+
 struct bt_crypto {
 	int ref_count;
 	int ecb_aes;
 	int urandom;
 	int cmac_aes;
+	struct crypto_key keys[KEY_CACHE_SIZE];
+	unsigned int next_key;
 };
 
 static int urandom_setup(void)
@@ -126,6 +140,47 @@ static int cmac_aes_setup(void)
 	return fd;
 }
 
+/* Known answer tests from FIPS-197 appendix C.1 and RFC 4493 section 4 */
+static bool aes_self_test(void)
+{
+	static const uint8_t key[16] = {
+			0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+			0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
+	static const uint8_t in[16] = {
+			0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+			0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff };
+	static const uint8_t exp[16] = {
+			0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+			0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a };
+	static const uint8_t cmac_key[16] = {
+			0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+			0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c };
+	static const uint8_t cmac_msg[16] = {
+			0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96,
+			0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a };
+	static const uint8_t cmac_exp[16] = {
+			0x07, 0x0a, 0x16, 0xb4, 0x6b, 0x4d, 0x41, 0x44,
+			0xf7, 0x9b, 0xdd, 0x9d, 0xd0, 0x4a, 0x28, 0x7c };
+	struct iovec iov = {
+		.iov_base = (void *) cmac_msg,
+		.iov_len = sizeof(cmac_msg),
+	};
+	struct bt_aes_key aes;
+	uint8_t out[16];
+
+	bt_aes_set_key(&aes, key);
+	bt_aes_encrypt(&aes, in, out);
+	if (memcmp(out, exp, 16))
+		return false;
+
+	bt_aes_set_key(&aes, cmac_key);
+	bt_aes_cmac(&aes, &iov, 1, out);
+	if (memcmp(out, cmac_exp, 16))
+		return false;
+
+	return true;
+}
+
 static struct bt_crypto *singleton;
 
 struct bt_crypto *bt_crypto_new(void)
@@ -134,17 +189,23 @@ struct bt_crypto *bt_crypto_new(void)
 		return bt_crypto_ref(singleton);
 
 	singleton = new0(struct bt_crypto, 1);
+	singleton->ecb_aes = -1;
+	singleton->cmac_aes = -1;
 
-	singleton->ecb_aes = ecb_aes_setup();
-	if (singleton->ecb_aes < 0) {
+	singleton->urandom = urandom_setup();
+	if (singleton->urandom < 0) {
 		free(singleton);
 		singleton = NULL;
 		return NULL;
 	}
 
-	singleton->urandom = urandom_setup();
-	if (singleton->urandom < 0) {
-		close(singleton->ecb_aes);
+	/* AES is done in process, the kernel is only a fallback */
+	if (aes_self_test())
+		return bt_crypto_ref(singleton);
+
+	singleton->ecb_aes = ecb_aes_setup();
+	if (singleton->ecb_aes < 0) {
+		close(singleton->urandom);
 		free(singleton);
 		singleton = NULL;
 		return NULL;
@@ -181,8 +242,14 @@ void bt_crypto_unref(struct bt_crypto *crypto)
 		return;
 
 	close(crypto->urandom);
-	close(crypto->ecb_aes);
-	close(crypto->cmac_aes);
+
+	if (crypto->ecb_aes >= 0)
+		close(crypto->ecb_aes);
+
+	if (crypto->cmac_aes >= 0)
+		close(crypto->cmac_aes);
+
+	util_explicit_bzero(crypto->keys, sizeof(crypto->keys));
 
 	free(crypto);
 	singleton = NULL;
@@ -251,6 +318,86 @@ static bool alg_encrypt(int fd, const void *inbuf, size_t inlen,
 	return true;
 }
 
+/* Returns the expanded key, reusing it if it has been used recently */
+static const struct bt_aes_key *get_key(struct bt_crypto *crypto,
+						const uint8_t k[16])
+{
+	struct crypto_key *key;
+	unsigned int i;
+
+	for (i = 0; i < KEY_CACHE_SIZE; i++) {
+		key = &crypto->keys[i];
+
+		if (key->valid && !memcmp(key->k, k, 16))
+			return &key->aes;
+	}
+
+	key = &crypto->keys[crypto->next_key];
+	crypto->next_key = (crypto->next_key + 1) % KEY_CACHE_SIZE;
+
+	key->valid = true;
+	memcpy(key->k, k, 16);
+	bt_aes_set_key(&key->aes, k);
+
+	return &key->aes;
+}
+
+/* All arguments have the most significant octet first */
+static bool aes_ecb_be(struct bt_crypto *crypto, const uint8_t key[16],
+				const uint8_t in[16], uint8_t out[16])
+{
+	bool ret;
+	int fd;
+
+	if (crypto->ecb_aes < 0) {
+		bt_aes_encrypt(get_key(crypto, key), in, out);
+		return true;
+	}
+
+	fd = alg_new(crypto->ecb_aes, key, 16);
+	if (fd < 0)
+		return false;
+
+	ret = alg_encrypt(fd, in, 16, out, 16);
+
+	close(fd);
+
+	return ret;
+}
+
+static bool aes_cmac_iov_be(struct bt_crypto *crypto, const uint8_t key[16],
+				const struct iovec *iov, size_t iov_len,
+				uint8_t res[16])
+{
+	ssize_t len;
+	int fd;
+
+	if (crypto->cmac_aes < 0) {
+		bt_aes_cmac(get_key(crypto, key), iov, iov_len, res);
+		return true;
+	}
+
+	fd = alg_new(crypto->cmac_aes, key, 16);
+	if (fd < 0)
+		return false;
+
+	len = writev(fd, iov, iov_len);
+	if (len < 0) {
+		close(fd);
+		return false;
+	}
+
+	len = read(fd, res, 16);
+	if (len < 0) {
+		close(fd);
+		return false;
+	}
+
+	close(fd);
+
+	return true;
+}
+
 static inline void swap_buf(const uint8_t *src, uint8_t *dst, uint16_t len)
 {
 	int i;
@@ -264,8 +411,7 @@ bool bt_crypto_sign_att(struct bt_crypto *crypto, const uint8_t key[16],
 				uint32_t sign_cnt,
 				uint8_t signature[ATT_SIGN_LEN])
 {
-	int fd;
-	int len;
+	struct iovec iov;
 	uint8_t tmp[16], out[16];
 	uint16_t msg_len = m_len + sizeof(uint32_t);
 	uint8_t msg[msg_len];
@@ -283,26 +429,14 @@ bool bt_crypto_sign_att(struct bt_crypto *crypto, const uint8_t key[16],
 	/* The most significant octet of key corresponds to key[0] */
 	swap_buf(key, tmp, 16);
 
-	fd = alg_new(crypto->cmac_aes, tmp, 16);
-	if (fd < 0)
-		return false;
-
 	/* Swap msg before signing */
 	swap_buf(msg, msg_s, msg_len);
 
-	len = send(fd, msg_s, msg_len, 0);
-	if (len < 0) {
-		close(fd);
-		return false;
-	}
+	iov.iov_base = msg_s;
+	iov.iov_len = msg_len;
 
-	len = read(fd, out, 16);
-	if (len < 0) {
-		close(fd);
+	if (!aes_cmac_iov_be(crypto, tmp, &iov, 1, out))
 		return false;
-	}
-
-	close(fd);
 
 	/*
 	 * As to BT spec. 4.1 Vol[3], Part C, chapter 10.4.1 sign counter should
@@ -358,7 +492,6 @@ bool bt_crypto_e(struct bt_crypto *crypto, const uint8_t key[16],
 			const uint8_t plaintext[16], uint8_t encrypted[16])
 {
 	uint8_t tmp[16], in[16], out[16];
-	int fd;
 
 	if (!crypto)
 		return false;
@@ -366,24 +499,15 @@ bool bt_crypto_e(struct bt_crypto *crypto, const uint8_t key[16],
 	/* The most significant octet of key corresponds to key[0] */
 	swap_buf(key, tmp, 16);
 
-	fd = alg_new(crypto->ecb_aes, tmp, 16);
-	if (fd < 0)
-		return false;
-
-
 	/* Most significant octet of plaintextData corresponds to in[0] */
 	swap_buf(plaintext, in, 16);
 
-	if (!alg_encrypt(fd, in, 16, out, 16)) {
-		close(fd);
+	if (!aes_ecb_be(crypto, tmp, in, out))
 		return false;
-	}
 
 	/* Most significant octet of encryptedData corresponds to out[0] */
 	swap_buf(out, encrypted, 16);
 
-	close(fd);
-
 	return true;
 }
 
@@ -589,31 +713,15 @@ bool bt_crypto_s1(struct bt_crypto *crypto, const uint8_t k[16],
 static bool aes_cmac_be(struct bt_crypto *crypto, const uint8_t key[16],
 			const uint8_t *msg, size_t msg_len, uint8_t res[16])
 {
-	ssize_t len;
-	int fd;
+	struct iovec iov = {
+		.iov_base = (void *) msg,
+		.iov_len = msg_len,
+	};
 
 	if (msg_len > CMAC_MSG_MAX)
 		return false;
 
-	fd = alg_new(crypto->cmac_aes, key, 16);
-	if (fd < 0)
-		return false;
-
-	len = send(fd, msg, msg_len, 0);
-	if (len < 0) {
-		close(fd);
-		return false;
-	}
-
-	len = read(fd, res, 16);
-	if (len < 0) {
-		close(fd);
-		return false;
-	}
-
-	close(fd);
-
-	return true;
+	return aes_cmac_iov_be(crypto, key, &iov, 1, res);
 }
 
 static bool aes_cmac(struct bt_crypto *crypto, const uint8_t key[16],
@@ -725,31 +833,11 @@ bool bt_crypto_gatt_hash(struct bt_crypto *crypto, struct iovec *iov,
 				size_t iov_len, uint8_t res[16])
 {
 	const uint8_t key[16] = {};
-	ssize_t len;
-	int fd;
 
 	if (!crypto)
 		return false;
 
-	fd = alg_new(crypto->cmac_aes, key, 16);
-	if (fd < 0)
-		return false;
-
-	len = writev(fd, iov, iov_len);
-	if (len < 0) {
-		close(fd);
-		return false;
-	}
-
-	len = read(fd, res, 16);
-	if (len < 0) {
-		close(fd);
-		return false;
-	}
-
-	close(fd);
-
-	return true;
+	return aes_cmac_iov_be(crypto, key, iov, iov_len, res);
 }
 
 /*
@@ -652,10 +652,14 @@ bool bt_csip_attach(struct bt_csip *csip, struct bt_gatt_client *client)
 	csip->idle_id = bt_gatt_client_idle_register(csip->client, csip_idle,
 								csip, NULL);
 
+	bt_gatt_client_batch_begin(csip->client);
+
 	bt_uuid16_create(&uuid, CSIS_UUID);
 	gatt_db_foreach_service(csip->rdb->db, &uuid, foreach_csis_service,
 				csip);
 
+	bt_gatt_client_batch_end(csip->client);
+
 	return true;
 }
 
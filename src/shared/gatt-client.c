@@ -114,12 +114,22 @@ struct bt_gatt_client {
 
 	struct bt_gatt_request *discovery_req;
 	unsigned int mtu_req_id;
+
+	/* Descriptor discoveries, one per channel at most */
+	struct queue *desc_reqs;
+
+	/* Reads deferred until bt_gatt_client_batch_end() */
+	unsigned int batch_depth;
+	struct queue *batch_reads;
+	struct queue *batch_ops;
+	bool no_read_mult_vl;
 };
 
 struct request {
 	struct bt_gatt_client *client;
 	bool long_write;
 	bool prep_write;
+	bool batched;
 	bool removed;
 	int ref_count;
 	unsigned int id;
@@ -213,6 +223,28 @@ static void request_unref(void *data)
 	free(req);
 }
 
+struct batch_read {
+	struct bt_gatt_client *client;
+	unsigned int att_id;
+	struct queue *reqs;
+};
+
+static void batch_read_free(void *data)
+{
+	struct batch_read *batch = data;
+
+	queue_remove(batch->client->batch_ops, batch);
+	queue_destroy(batch->reqs, request_unref);
+	free(batch);
+}
+
+static void batch_read_cancel(void *data)
+{
+	struct batch_read *batch = data;
+
+	bt_att_cancel(batch->client->att, batch->att_id);
+}
+
 struct notify_chrc {
 	struct bt_gatt_client *client;
 	struct gatt_db_attribute *attr;
@@ -366,6 +398,20 @@ struct handle_range {
 	uint16_t end;
 };
 
+static struct handle_range *range_new(uint16_t start, uint16_t end)
+{
+	struct handle_range *range;
+
+	if (!start || !end || start > end)
+		return NULL;
+
+	range = new0(struct handle_range, 1);
+	range->start = start;
+	range->end = end;
+
+	return range;
+}
+
 struct discovery_op;
 
 typedef void (*discovery_op_complete_func_t)(struct discovery_op *op,
@@ -379,6 +425,12 @@ struct discovery_op {
 	struct queue *pending_svcs;
 	struct queue *pending_chrcs;
 	struct queue *ext_prop_desc;
+	struct queue *desc_ranges;
+	struct queue *desc_svcs;
+	unsigned int desc_pending;
+	bool desc_failed;
+	bool ext_prop_reading;
+	uint8_t desc_ecode;
 	struct gatt_db_attribute *cur_svc;
 	struct gatt_db_attribute *hash;
 	uint8_t server_feat;
@@ -403,6 +455,8 @@ static void discovery_op_free(struct discovery_op *op)
 	queue_destroy(op->pending_svcs, NULL);
 	queue_destroy(op->pending_chrcs, free);
 	queue_destroy(op->ext_prop_desc, NULL);
+	queue_destroy(op->desc_ranges, free);
+	queue_destroy(op->desc_svcs, NULL);
 	free(op);
 }
 
@@ -505,6 +559,8 @@ static struct discovery_op *discovery_op_create(struct bt_gatt_client *client,
 	op->pending_svcs = queue_new();
 	op->pending_chrcs = queue_new();
 	op->ext_prop_desc = queue_new();
+	op->desc_ranges = queue_new();
+	op->desc_svcs = queue_new();
 	op->client = client;
 	op->complete_func = complete_func;
 	op->failure_func = failure_func;
@@ -564,6 +620,14 @@ static void discovery_req_clear(struct bt_gatt_client *client)
 	client->discovery_req = NULL;
 }
 
+static void discovery_req_cancel(void *data)
+{
+	struct bt_gatt_request *req = data;
+
+	bt_gatt_request_cancel(req);
+	bt_gatt_request_unref(req);
+}
+
 static void discover_remove_pending(struct discovery_op *op,
 					struct gatt_db_attribute *attr)
 {
@@ -704,9 +768,77 @@ struct chrc {
 	bt_uuid_t uuid;
 };
 
+struct desc_discovery {
+	struct discovery_op *op;
+	struct bt_gatt_request *req;
+};
+
+static void desc_discovery_free(void *data)
+{
+	struct desc_discovery *desc = data;
+
+	discovery_op_unref(desc->op);
+	free(desc);
+}
+
 static void discover_descs_cb(bool success, uint8_t att_ecode,
 						struct bt_gatt_result *result,
 						void *user_data);
+static bool read_ext_prop_desc(struct discovery_op *op);
+
+/*
+ * Descriptor ranges don't depend on each other so they are discovered in
+ * parallel, using as many requests as there are ATT channels (EATT).
+ * Extended Properties values are read one at a time as they are found.
+ */
+static bool discover_descs_next(struct discovery_op *op)
+{
+	struct bt_gatt_client *client = op->client;
+	struct handle_range *range;
+	unsigned int max;
+
+	max = MAX(bt_att_get_channels(client->att), 1);
+
+	while (!op->desc_failed && op->desc_pending < max) {
+		struct desc_discovery *desc;
+
+		if (!op->ext_prop_reading && read_ext_prop_desc(op)) {
+			op->ext_prop_reading = true;
+			op->desc_pending++;
+			continue;
+		}
+
+		range = queue_pop_head(op->desc_ranges);
+		if (!range)
+			break;
+
+		desc = new0(struct desc_discovery, 1);
+		desc->op = discovery_op_ref(op);
+		desc->req = bt_gatt_discover_descriptors(client->att,
+							range->start,
+							range->end,
+							discover_descs_cb,
+							desc,
+							desc_discovery_free);
+		free(range);
+
+		if (!desc->req) {
+			DBG(client, "Failed to start descriptor discovery");
+			desc_discovery_free(desc);
+			op->desc_failed = true;
+			break;
+		}
+
+		queue_push_tail(client->desc_reqs, desc->req);
+		op->desc_pending++;
+	}
+
+	/* Wait for the outstanding requests before reporting errors */
+	if (op->desc_pending)
+		return true;
+
+	return !op->desc_failed;
+}
 
 static bool discover_descs(struct discovery_op *op, bool *discovering)
 {
@@ -717,19 +849,20 @@ static bool discover_descs(struct discovery_op *op, bool *discovering)
 
 	*discovering = false;
 
+	/*
+	 * Insert all characteristics first so the descriptor ranges are known
+	 * upfront.
+	 */
 	while ((chrc_data = queue_pop_head(op->pending_chrcs))) {
 		struct gatt_db_attribute *svc;
+		struct handle_range *range;
 		uint16_t start, end;
 
 		/* Adjust current service */
 		svc = gatt_db_get_service(client->db, chrc_data->value_handle);
 		if (op->cur_svc != svc) {
-			if (op->cur_svc) {
-				queue_remove(op->pending_svcs, op->cur_svc);
-
-				/* Done with the current service */
-				gatt_db_service_set_active(op->cur_svc, true);
-			}
+			if (svc)
+				queue_push_tail(op->desc_svcs, svc);
 
 			op->cur_svc = svc;
 		}
@@ -798,35 +931,25 @@ static bool discover_descs(struct discovery_op *op, bool *discovering)
 			}
 		}
 
-		/* Check if the start range is within characteristic range */
-		if (desc_start > chrc_data->end_handle) {
-			free(chrc_data);
-			continue;
-		}
-
-		client->discovery_req = bt_gatt_discover_descriptors(
-							client->att, desc_start,
-							chrc_data->end_handle,
-							discover_descs_cb,
-							discovery_op_ref(op),
-							discovery_op_unref);
-		if (client->discovery_req) {
-			*discovering = true;
-			goto done;
-		}
-
-		DBG(client, "Failed to start descriptor discovery");
+		range = range_new(desc_start, chrc_data->end_handle);
+		if (range)
+			queue_push_tail(op->desc_ranges, range);
 
-		discovery_op_unref(op);
+		free(chrc_data);
+	}
 
+	if (!discover_descs_next(op))
 		goto failed;
+
+	if (op->desc_pending) {
+		*discovering = true;
+		return true;
 	}
 
-	/* Done with the current service */
-	discover_remove_pending(op, op->cur_svc);
+	/* Done with the services whose characteristics were discovered */
+	while ((attr = queue_pop_head(op->desc_svcs)))
+		discover_remove_pending(op, attr);
 
-done:
-	free(chrc_data);
 	return true;
 
 failed:
@@ -868,15 +991,49 @@ static bool read_ext_prop_desc(struct discovery_op *op)
 	return true;
 }
 
+static void discover_descs_complete(struct discovery_op *op, bool success,
+							uint8_t att_ecode)
+{
+	bool discovering;
+
+	if (!success && !op->desc_failed) {
+		op->desc_failed = true;
+		op->desc_ecode = att_ecode;
+	}
+
+	discover_descs_next(op);
+
+	/* Wait for the remaining requests */
+	if (op->desc_pending)
+		return;
+
+	if (op->desc_failed) {
+		discovery_op_complete(op, false, op->desc_ecode);
+		return;
+	}
+
+	if (!discover_descs(op, &discovering)) {
+		discovery_op_complete(op, false, att_ecode);
+		return;
+	}
+
+	if (discovering)
+		return;
+
+	discovery_op_complete(op, true, att_ecode);
+}
+
 static void ext_prop_read_cb(bool success, uint8_t att_ecode,
 					const uint8_t *value, uint16_t length,
 					void *user_data)
 {
 	struct discovery_op *op = user_data;
 	struct bt_gatt_client *client = op->client;
-	bool discovering;
 	struct gatt_db_attribute *desc_attr = NULL;
 
+	op->ext_prop_reading = false;
+	op->desc_pending--;
+
 	if (!success)
 		goto done;
 
@@ -890,30 +1047,21 @@ static void ext_prop_read_cb(bool success, uint8_t att_ecode,
 						ext_prop_write_cb, client))
 		goto failed;
 
-	/* Any other descriptor to read? */
-	if (read_ext_prop_desc(op))
-		return;
-
-	if (!discover_descs(op, &discovering))
-			goto failed;
-
-	if (discovering)
-		return;
-
 	goto done;
 
 failed:
 	success = false;
 
 done:
-	discovery_op_complete(op, success, att_ecode);
+	discover_descs_complete(op, success, att_ecode);
 }
 
 static void discover_descs_cb(bool success, uint8_t att_ecode,
 						struct bt_gatt_result *result,
 						void *user_data)
 {
-	struct discovery_op *op = user_data;
+	struct desc_discovery *desc = user_data;
+	struct discovery_op *op = desc->op;
 	struct bt_gatt_client *client = op->client;
 	struct bt_gatt_iter iter;
 	struct gatt_db_attribute *attr;
@@ -922,10 +1070,13 @@ static void discover_descs_cb(bool success, uint8_t att_ecode,
 	bt_uuid_t uuid;
 	char uuid_str[MAX_LEN_UUID_STR];
 	unsigned int desc_count;
-	bool discovering;
 	bt_uuid_t ext_prop_uuid;
 
-	discovery_req_clear(client);
+	if (queue_remove(client->desc_reqs, desc->req))
+		bt_gatt_request_unref(desc->req);
+
+	desc->req = NULL;
+	op->desc_pending--;
 
 	if (!success) {
 		if (att_ecode == BT_ATT_ERROR_ATTRIBUTE_NOT_FOUND) {
@@ -933,7 +1084,7 @@ static void discover_descs_cb(bool success, uint8_t att_ecode,
 			goto next;
 		}
 
-		goto done;
+		goto failed;
 	}
 
 	if (!result || !bt_gatt_iter_init(&iter, result))
@@ -976,24 +1127,13 @@ static void discover_descs_cb(bool success, uint8_t att_ecode,
 			queue_push_tail(op->ext_prop_desc, attr);
 	}
 
-	/* If we got extended prop descriptor, lets read it right away */
-	if (read_ext_prop_desc(op))
-		return;
-
-next:
-	if (!discover_descs(op, &discovering))
-		goto failed;
-
-	if (discovering)
-		return;
-
-	goto done;
+	goto next;
 
 failed:
 	success = false;
 
-done:
-	discovery_op_complete(op, success, att_ecode);
+next:
+	discover_descs_complete(op, success, att_ecode);
 }
 
 static void discover_chrcs_cb(bool success, uint8_t att_ecode,
@@ -1084,8 +1224,8 @@ next:
 	}
 
 	/*
-	 * Sequentially discover descriptors for each characteristic and insert
-	 * the characteristics into the database as we proceed.
+	 * Insert the characteristics into the database and discover their
+	 * descriptors, in parallel when there are several ATT channels.
 	 */
 	if (!discover_descs(op, &discovering))
 		goto failed;
@@ -1111,20 +1251,6 @@ static bool match_handle_range(const void *data, const void *match_data)
 					(match_range->start <= range->end);
 }
 
-static struct handle_range *range_new(uint16_t start, uint16_t end)
-{
-	struct handle_range *range;
-
-	if (!start || !end || start > end)
-		return NULL;
-
-	range = new0(struct handle_range, 1);
-	range->start = start;
-	range->end = end;
-
-	return range;
-}
-
 static void remove_discov_range(struct discovery_op *op, uint16_t start,
 								uint16_t end)
 {
@@ -1664,6 +1790,13 @@ static void complete_notify_request(void *data)
 						notify_data->user_data);
 }
 
+static unsigned int write_value(struct bt_gatt_client *client,
+					uint16_t value_handle,
+					const uint8_t *value, uint16_t length,
+					bt_gatt_client_callback_t callback,
+					void *user_data,
+					bt_gatt_client_destroy_func_t destroy);
+
 static bool notify_data_write_ccc(struct notify_data *notify_data, bool enable,
 					bt_gatt_client_callback_t callback)
 {
@@ -1685,7 +1818,10 @@ static bool notify_data_write_ccc(struct notify_data *notify_data, bool enable,
 			return false;
 	}
 
-	att_id = bt_gatt_client_write_value(notify_data->client,
+	/* Unlike other writes this does not wait for batched reads, so
+	 * registering for notifications does not split a batch.
+	 */
+	att_id = write_value(notify_data->client,
 						notify_data->chrc->ccc_handle,
 						(void *)&value, sizeof(value),
 						callback,
@@ -2312,7 +2448,10 @@ static void bt_gatt_client_free(struct bt_gatt_client *client)
 	queue_destroy(client->clones, NULL);
 	queue_destroy(client->svc_chngd_queue, free);
 	queue_destroy(client->long_write_queue, request_unref);
+	queue_destroy(client->batch_reads, request_unref);
+	queue_destroy(client->batch_ops, batch_read_cancel);
 	queue_destroy(client->pending_requests, request_unref);
+	queue_destroy(client->desc_reqs, discovery_req_cancel);
 
 	if (client->parent) {
 		queue_remove(client->parent->clones, client);
@@ -2359,6 +2498,9 @@ static struct bt_gatt_client *gatt_client_new(struct gatt_db *db,
 	client->notify_list = queue_new();
 	client->notify_chrcs = queue_new();
 	client->pending_requests = queue_new();
+	client->desc_reqs = queue_new();
+	client->batch_reads = queue_new();
+	client->batch_ops = queue_new();
 
 	client->nfy_id = bt_att_register(att, BT_ATT_OP_HANDLE_NFY,
 						notify_cb, client, NULL);
@@ -2622,6 +2764,10 @@ static bool cancel_request(struct request *req)
 {
 	req->removed = true;
 
+	/* Batched reads share one ATT request, just drop the result */
+	if (req->batched)
+		return true;
+
 	if (req->long_write)
 		return cancel_long_write_req(req->client, req);
 
@@ -2657,6 +2803,8 @@ bool bt_gatt_client_cancel_all(struct bt_gatt_client *client)
 		return false;
 
 	queue_remove_all(client->pending_requests, NULL, NULL, cancel_pending);
+	queue_remove_all(client->desc_reqs, NULL, NULL, discovery_req_cancel);
+	queue_remove_all(client->batch_ops, NULL, NULL, batch_read_cancel);
 
 	if (client->discovery_req) {
 		bt_gatt_request_cancel(client->discovery_req);
@@ -2915,6 +3063,59 @@ done:
 						op->iov.iov_len, op->user_data);
 }
 
+static bool read_long_send(struct request *req)
+{
+	struct read_long_op *op = req->data;
+	uint8_t att_op;
+	uint8_t pdu[4];
+	uint16_t pdu_len;
+
+	put_le16(op->value_handle, pdu);
+	pdu_len = sizeof(op->value_handle);
+
+	/*
+	 * Core v4.2, part F, section 1.3.4.4.5:
+	 * If the attribute value has a fixed length that is less than or equal
+	 * to (ATT_MTU - 3) octets in length, then an Error Response can be sent
+	 * with the error code «Attribute Not Long».
+	 *
+	 * To remove need for caller to handle "Attribute Not Long" error when
+	 * reading characteristics with short values, use Read Request for
+	 * reading first part of characteristics value instead of Read Blob
+	 * Request. Both are allowed in this case.
+	 */
+
+	if (op->offset) {
+		att_op = BT_ATT_OP_READ_BLOB_REQ;
+		pdu_len += sizeof(op->offset);
+
+		put_le16(op->offset, pdu + 2);
+	} else {
+		att_op = BT_ATT_OP_READ_REQ;
+	}
+
+	req->batched = false;
+	req->att_id = bt_att_send(op->client->att, att_op, pdu, pdu_len,
+					read_long_cb, request_ref(req),
+					request_unref);
+	if (!req->att_id) {
+		request_unref(req);
+		return false;
+	}
+
+	return true;
+}
+
+static bool batch_active(struct bt_gatt_client *client)
+{
+	if (!client->batch_depth || client->no_read_mult_vl)
+		return false;
+
+	/* Read Multiple Variable Length is mandatory with EATT */
+	return bt_gatt_client_get_features(client) &
+						BT_GATT_CHRC_CLI_FEAT_EATT;
+}
+
 unsigned int bt_gatt_client_read_long_value(struct bt_gatt_client *client,
 					uint16_t value_handle, uint16_t offset,
 					bt_gatt_client_read_callback_t callback,
@@ -2923,9 +3124,6 @@ unsigned int bt_gatt_client_read_long_value(struct bt_gatt_client *client,
 {
 	struct request *req;
 	struct read_long_op *op;
-	uint8_t att_op;
-	uint8_t pdu[4];
-	uint16_t pdu_len;
 
 	if (!client)
 		return 0;
@@ -2948,40 +3146,181 @@ unsigned int bt_gatt_client_read_long_value(struct bt_gatt_client *client,
 	req->data = op;
 	req->destroy = destroy_read_long_op;
 
-	put_le16(value_handle, pdu);
-	pdu_len = sizeof(value_handle);
+	if (!offset && batch_active(client)) {
+		req->batched = true;
+		queue_push_tail(client->batch_reads, req);
+		return req->id;
+	}
 
-	/*
-	 * Core v4.2, part F, section 1.3.4.4.5:
-	 * If the attribute value has a fixed length that is less than or equal
-	 * to (ATT_MTU - 3) octets in length, then an Error Response can be sent
-	 * with the error code «Attribute Not Long».
-	 *
-	 * To remove need for caller to handle "Attribute Not Long" error when
-	 * reading characteristics with short values, use Read Request for
-	 * reading first part of characteristics value instead of Read Blob
-	 * Request. Both are allowed in this case.
+	if (!read_long_send(req)) {
+		op->destroy = NULL;
+		request_unref(req);
+		return 0;
+	}
+
+	request_unref(req);
+
+	return req->id;
+}
+
+static void batch_read_send(void *data, void *user_data)
+{
+	struct request *req = data;
+	struct read_long_op *op = req->data;
+
+	if (read_long_send(req))
+		return;
+
+	if (op->callback)
+		op->callback(false, 0, NULL, 0, op->user_data);
+}
+
+static void read_mult_vl_cb(uint8_t opcode, const void *pdu, uint16_t length,
+								void *user_data)
+{
+	struct batch_read *batch = user_data;
+	const struct queue_entry *entry;
+	const uint8_t *ptr = pdu;
+	struct queue *reqs;
+
+	if (opcode != BT_ATT_OP_READ_MULT_VL_RSP || (!pdu && length)) {
+		if (opcode == BT_ATT_OP_ERROR_RSP &&
+				process_error(pdu, length) ==
+					BT_ATT_ERROR_REQUEST_NOT_SUPPORTED)
+			batch->client->no_read_mult_vl = true;
+
+		/* Retry each read on its own so errors are reported per
+		 * attribute.
+		 */
+		length = 0;
+	}
+
+	/* A callback may free the batch, e.g. by freeing the client, in which
+	 * case the remaining requests are marked as removed.
 	 */
+	reqs = batch->reqs;
+	batch->reqs = queue_new();
 
-	if (op->offset) {
-		att_op = BT_ATT_OP_READ_BLOB_REQ;
-		pdu_len += sizeof(op->offset);
+	for (entry = queue_get_entries(reqs); entry; entry = entry->next) {
+		struct request *req = entry->data;
+		struct read_long_op *op = req->data;
+		uint16_t len;
 
-		put_le16(op->offset, pdu + 2);
-	} else {
-		att_op = BT_ATT_OP_READ_REQ;
+		/* The tuple list may be truncated due to the ATT_MTU */
+		if (length < 2) {
+			if (!req->removed)
+				batch_read_send(req, NULL);
+			continue;
+		}
+
+		len = get_le16(ptr);
+		ptr += 2;
+		length -= 2;
+
+		/* Cancelled reads still take up their tuple */
+		if (req->removed) {
+			len = MIN(len, length);
+			ptr += len;
+			length -= len;
+			continue;
+		}
+
+		/* Fetch the remaining of a truncated value with Read Blob */
+		if (len > length) {
+			append_chunk(op, ptr, length);
+			length = 0;
+			batch_read_send(req, NULL);
+			continue;
+		}
+
+		append_chunk(op, ptr, len);
+		ptr += len;
+		length -= len;
+
+		if (op->callback)
+			op->callback(true, 0, op->iov.iov_base,
+					op->iov.iov_len, op->user_data);
 	}
 
-	req->att_id = bt_att_send(client->att, att_op, pdu, pdu_len,
-					read_long_cb, req, request_unref);
+	queue_destroy(reqs, request_unref);
+}
 
-	if (!req->att_id) {
-		op->destroy = NULL;
-		request_unref(req);
-		return 0;
+static void batch_flush(struct bt_gatt_client *client)
+{
+	uint8_t pdu[BT_ATT_MAX_LE_MTU];
+	struct batch_read *batch;
+	struct request *req;
+	unsigned int max;
+
+	max = MIN((size_t) (bt_att_get_mtu(client->att) - 1), sizeof(pdu)) / 2;
+
+	while (!queue_isempty(client->batch_reads)) {
+		uint16_t len = 0;
+
+		batch = new0(struct batch_read, 1);
+		batch->client = client;
+		batch->reqs = queue_new();
+
+		while (queue_length(batch->reqs) < max &&
+			(req = queue_pop_head(client->batch_reads))) {
+			struct read_long_op *op = req->data;
+
+			if (req->removed) {
+				request_unref(req);
+				continue;
+			}
+
+			put_le16(op->value_handle, pdu + len);
+			len += 2;
+			queue_push_tail(batch->reqs, req);
+		}
+
+		/* Read Multiple requires at least two handles */
+		if (queue_length(batch->reqs) > 1)
+			batch->att_id = bt_att_send(client->att,
+						BT_ATT_OP_READ_MULT_VL_REQ,
+						pdu, len, read_mult_vl_cb,
+						batch, batch_read_free);
+
+		if (batch->att_id) {
+			queue_push_tail(client->batch_ops, batch);
+			continue;
+		}
+
+		/* Fall back to individual reads */
+		queue_foreach(batch->reqs, batch_read_send, NULL);
+		batch_read_free(batch);
 	}
+}
 
-	return req->id;
+/* Writes must not overtake the reads batched before them */
+static void batch_flush_reads(struct bt_gatt_client *client)
+{
+	if (client->att && !queue_isempty(client->batch_reads))
+		batch_flush(client);
+}
+
+bool bt_gatt_client_batch_begin(struct bt_gatt_client *client)
+{
+	if (!client)
+		return false;
+
+	client->batch_depth++;
+
+	return true;
+}
+
+bool bt_gatt_client_batch_end(struct bt_gatt_client *client)
+{
+	if (!client || !client->batch_depth)
+		return false;
+
+	if (--client->batch_depth)
+		return true;
+
+	batch_flush(client);
+
+	return true;
 }
 
 unsigned int bt_gatt_client_write_without_response(
@@ -2997,6 +3336,8 @@ unsigned int bt_gatt_client_write_without_response(
 	if (!client)
 		return 0;
 
+	batch_flush_reads(client);
+
 	req = request_create(client);
 	if (!req)
 		return 0;
@@ -3061,7 +3402,7 @@ done:
 		op->callback(success, att_ecode, op->user_data);
 }
 
-unsigned int bt_gatt_client_write_value(struct bt_gatt_client *client,
+static unsigned int write_value(struct bt_gatt_client *client,
 					uint16_t value_handle,
 					const uint8_t *value, uint16_t length,
 					bt_gatt_client_callback_t callback,
@@ -3072,9 +3413,6 @@ unsigned int bt_gatt_client_write_value(struct bt_gatt_client *client,
 	struct write_op *op;
 	uint8_t *pdu = newa(uint8_t, 2 + length);
 
-	if (!client)
-		return 0;
-
 	op = new0(struct write_op, 1);
 
 	req = request_create(client);
@@ -3106,6 +3444,22 @@ unsigned int bt_gatt_client_write_value(struct bt_gatt_client *client,
 	return req->id;
 }
 
+unsigned int bt_gatt_client_write_value(struct bt_gatt_client *client,
+					uint16_t value_handle,
+					const uint8_t *value, uint16_t length,
+					bt_gatt_client_callback_t callback,
+					void *user_data,
+					bt_gatt_client_destroy_func_t destroy)
+{
+	if (!client)
+		return 0;
+
+	batch_flush_reads(client);
+
+	return write_value(client, value_handle, value, length, callback,
+							user_data, destroy);
+}
+
 struct long_write_op {
 	struct bt_gatt_client *client;
 	bool reliable;
@@ -3343,6 +3697,8 @@ unsigned int bt_gatt_client_write_long_value(struct bt_gatt_client *client,
 	if (!client)
 		return 0;
 
+	batch_flush_reads(client);
+
 	if ((size_t)(length + offset) > UINT16_MAX)
 		return 0;
 
@@ -3514,6 +3870,8 @@ unsigned int bt_gatt_client_prepare_write(struct bt_gatt_client *client,
 	if (!client)
 		return 0;
 
+	batch_flush_reads(client);
+
 	if (client->in_long_write)
 		return 0;
 
@@ -85,6 +85,15 @@ unsigned int bt_gatt_client_read_multiple(struct bt_gatt_client *client,
 					void *user_data,
 					bt_gatt_client_destroy_func_t destroy);
 
+/* Reads issued between begin and end are sent with Read Multiple Variable
+ * Length requests when EATT is in use. Writes first send the reads queued
+ * before them, except for the CCC writes of register_notify: those go out
+ * right away, so notifications may arrive before the batched reads are
+ * answered.
+ */
+bool bt_gatt_client_batch_begin(struct bt_gatt_client *client);
+bool bt_gatt_client_batch_end(struct bt_gatt_client *client);
+
 unsigned int bt_gatt_client_write_without_response(
 					struct bt_gatt_client *client,
 					uint16_t value_handle,
@@ -58,6 +58,7 @@ struct gatt_db {
 	struct bt_crypto *crypto;
 	uint8_t hash[16];
 	unsigned int hash_id;
+	bool hash_stale;
 	uint16_t last_handle;
 	struct queue *services;
 
@@ -68,6 +69,15 @@ struct gatt_db {
 	void *authorize_data;
 
 	struct gatt_db_ccc *ccc;
+
+	/* Attributes grouped by type, rebuilt on lookup when stale */
+	struct queue *types;
+	bool types_stale;
+};
+
+struct attribute_type {
+	uint128_t key;
+	struct queue *attribs;
 };
 
 struct notify {
@@ -106,6 +116,7 @@ struct gatt_db_attribute {
 	struct gatt_db_service *service;
 	uint16_t handle;
 	bt_uuid_t uuid;
+	uint128_t key;		/* uuid expanded to 128 bits */
 	uint32_t permissions;
 	uint16_t value_len;
 	uint8_t *value;
@@ -131,8 +142,31 @@ struct gatt_db_service {
 	bool claimed;
 	uint16_t num_handles;
 	struct gatt_db_attribute **attributes;
+
+	/* Serialized hash input of the service, rebuilt when NULL */
+	uint8_t *hash_data;
+	size_t hash_len;
 };
 
+static void uuid_to_key(const bt_uuid_t *uuid, uint128_t *key)
+{
+	bt_uuid_t uuid128;
+
+	memset(&uuid128, 0, sizeof(uuid128));
+	bt_uuid_to_uuid128(uuid, &uuid128);
+	*key = uuid128.value.u128;
+}
+
+static bool attribute_match_type(const struct gatt_db_attribute *attr,
+						const bt_uuid_t *uuid,
+						const uint128_t *key)
+{
+	if (attr->uuid.type == BT_UUID16 && uuid->type == BT_UUID16)
+		return attr->uuid.value.u16 == uuid->value.u16;
+
+	return !memcmp(&attr->key, key, sizeof(*key));
+}
+
 static void set_attribute_data(struct gatt_db_attribute *attribute,
 						gatt_db_read_t read_func,
 						gatt_db_write_t write_func,
@@ -204,6 +238,16 @@ static void attribute_destroy(struct gatt_db_attribute *attribute)
 	free(attribute);
 }
 
+static void service_hash_invalidate(struct gatt_db_service *service)
+{
+	free(service->hash_data);
+	service->hash_data = NULL;
+	service->hash_len = 0;
+
+	if (service->db)
+		service->db->hash_stale = true;
+}
+
 static struct gatt_db_attribute *new_attribute(struct gatt_db_service *service,
 							uint16_t handle,
 							const bt_uuid_t *type,
@@ -217,6 +261,7 @@ static struct gatt_db_attribute *new_attribute(struct gatt_db_service *service,
 	attribute->service = service;
 	attribute->handle = handle;
 	attribute->uuid = *type;
+	uuid_to_key(type, &attribute->key);
 	attribute->value_len = len;
 	if (len) {
 		attribute->value = malloc0(len);
@@ -230,6 +275,11 @@ static struct gatt_db_attribute *new_attribute(struct gatt_db_service *service,
 	attribute->pending_writes = queue_new();
 	attribute->notify_list = queue_new();
 
+	service_hash_invalidate(service);
+
+	if (service->db)
+		service->db->types_stale = true;
+
 	return attribute;
 
 failed:
@@ -255,6 +305,7 @@ struct gatt_db *gatt_db_new(void)
 	db->crypto = bt_crypto_new();
 	db->services = queue_new();
 	db->notify_list = queue_new();
+	db->types = queue_new();
 	db->last_handle = 0x0000;
 
 	return gatt_db_ref(db);
@@ -368,85 +419,145 @@ static void handle_notify(void *data, void *user_data)
 		notify->service_removed(notify_data->attr, notify->user_data);
 }
 
-struct hash_data {
-	struct iovec *iov;
-	uint16_t i;
-};
-
-static void gen_hash_m(struct gatt_db_attribute *attr, void *user_data)
+static bool attribute_hashed(const struct gatt_db_attribute *attr)
 {
-	struct hash_data *hash = user_data;
-	uint8_t *data;
-	size_t len;
-
-	if (!attr || !attr->value)
-		return;
-
 	if (bt_uuid_len(&attr->uuid) != 2)
-		return;
+		return false;
 
 	switch (attr->uuid.value.u16) {
 	case GATT_PRIM_SVC_UUID:
 	case GATT_SND_SVC_UUID:
 	case GATT_INCLUDE_UUID:
 	case GATT_CHARAC_UUID:
-		/* Allocate space for handle + type + value */
-		len = 2 + 2 + attr->value_len;
-		data = malloc(2 + 2 + attr->value_len);
-		put_le16(attr->handle, data);
-		bt_uuid_to_le(&attr->uuid, data + 2);
-		memcpy(data + 4, attr->value, attr->value_len);
-		break;
 	case GATT_CHARAC_USER_DESC_UUID:
 	case GATT_CLIENT_CHARAC_CFG_UUID:
 	case GATT_SERVER_CHARAC_CFG_UUID:
 	case GATT_CHARAC_FMT_UUID:
 	case GATT_CHARAC_AGREG_FMT_UUID:
-		/* Allocate space for handle + type  */
-		len = 2 + 2;
-		data = malloc(2 + 2 + attr->value_len);
-		put_le16(attr->handle, data);
-		bt_uuid_to_le(&attr->uuid, data + 2);
+		return true;
+	}
+
+	return false;
+}
+
+/* Only the values of declarations are part of the hash input, descriptors
+ * just need to have a value to be included.
+ */
+static bool attribute_hash_value(const struct gatt_db_attribute *attr)
+{
+	if (bt_uuid_len(&attr->uuid) != 2)
+		return false;
+
+	switch (attr->uuid.value.u16) {
+	case GATT_PRIM_SVC_UUID:
+	case GATT_SND_SVC_UUID:
+	case GATT_INCLUDE_UUID:
+	case GATT_CHARAC_UUID:
+		return true;
+	}
+
+	return false;
+}
+
+static void attribute_value_changed(struct gatt_db_attribute *attr,
+							bool had_value)
+{
+	if (!attribute_hashed(attr))
+		return;
+
+	/* Rewriting the value of a descriptor, e.g. a CCC, does not change
+	 * the hash.
+	 */
+	if (attribute_hash_value(attr) || had_value != !!attr->value)
+		service_hash_invalidate(attr->service);
+}
+
+/* Returns the length of the attribute hash input, storing it in data if
+ * not NULL.
+ */
+static size_t gen_hash_m(struct gatt_db_attribute *attr, uint8_t *data)
+{
+	size_t len;
+
+	if (!attr || !attr->value || !attribute_hashed(attr))
+		return 0;
+
+	switch (attr->uuid.value.u16) {
+	case GATT_PRIM_SVC_UUID:
+	case GATT_SND_SVC_UUID:
+	case GATT_INCLUDE_UUID:
+	case GATT_CHARAC_UUID:
+		/* handle + type + value */
+		len = 2 + 2 + attr->value_len;
+		if (data)
+			memcpy(data + 4, attr->value, attr->value_len);
 		break;
 	default:
-		return;
+		/* handle + type */
+		len = 2 + 2;
+		break;
 	}
 
-	hash->iov[hash->i].iov_base = data;
-	hash->iov[hash->i].iov_len = len;
-
-	hash->i++;
+	if (data) {
+		put_le16(attr->handle, data);
+		bt_uuid_to_le(&attr->uuid, data + 2);
+	}
 
-	return;
+	return len;
 }
 
-static void service_gen_hash_m(struct gatt_db_attribute *attr, void *user_data)
+static void service_gen_hash(struct gatt_db_service *service)
 {
-	gatt_db_service_foreach(attr, NULL, gen_hash_m, user_data);
+	size_t len = 0;
+	int i;
+
+	for (i = 0; i < service->num_handles; i++)
+		len += gen_hash_m(service->attributes[i], NULL);
+
+	service->hash_data = malloc(len ? len : 1);
+	service->hash_len = 0;
+
+	for (i = 0; i < service->num_handles; i++)
+		service->hash_len += gen_hash_m(service->attributes[i],
+					service->hash_data + service->hash_len);
 }
 
+/* Only services changed since the last update are serialized again, the
+ * hash is then computed over the cached input of every active service.
+ */
 static bool db_hash_update(void *user_data)
 {
 	struct gatt_db *db = user_data;
-	struct hash_data hash;
-	uint16_t i;
+	const struct queue_entry *entry;
+	struct iovec *iov;
+	size_t n = 0;
 
 	db->hash_id = 0;
 
 	if (gatt_db_isempty(db))
 		return false;
 
-	hash.iov = new0(struct iovec, db->last_handle + 1);
-	hash.i = 0;
+	iov = new0(struct iovec, queue_length(db->services));
 
-	gatt_db_foreach_service(db, NULL, service_gen_hash_m, &hash);
-	bt_crypto_gatt_hash(db->crypto, hash.iov, db->last_handle + 1,
-				db->hash);
+	for (entry = queue_get_entries(db->services); entry;
+							entry = entry->next) {
+		struct gatt_db_service *service = entry->data;
+
+		if (!service->active)
+			continue;
+
+		if (!service->hash_data)
+			service_gen_hash(service);
+
+		iov[n].iov_base = service->hash_data;
+		iov[n].iov_len = service->hash_len;
+		n++;
+	}
 
-	for (i = 0; i < hash.i; i++)
-		free(hash.iov[i].iov_base);
+	bt_crypto_gatt_hash(db->crypto, iov, n, db->hash);
+	db->hash_stale = false;
 
-	free(hash.iov);
+	free(iov);
 
 	return false;
 }
@@ -480,6 +591,8 @@ static void notify_service_changed(struct gatt_db *db,
 {
 	struct notify_data data;
 
+	db->hash_stale = true;
+
 	if (!added)
 		notify_attribute_changed(service);
 
@@ -493,10 +606,14 @@ static void notify_service_changed(struct gatt_db *db,
 
 	queue_foreach(db->notify_list, handle_notify, &data);
 
-	/* Trigger hash update */
-	if (!db->hash_id && db->crypto)
+	/* Postpone the hash update until changes settle down */
+	if (db->crypto) {
+		if (db->hash_id)
+			timeout_remove(db->hash_id);
+
 		db->hash_id = timeout_add(HASH_UPDATE_TIMEOUT, db_hash_update,
 								db, NULL);
+	}
 
 	gatt_db_unref(db);
 }
@@ -509,13 +626,25 @@ static void gatt_db_service_destroy(void *data)
 	if (service->active)
 		notify_service_changed(service->db, service, false);
 
+	if (service->db)
+		service->db->types_stale = true;
+
 	for (i = 0; i < service->num_handles; i++)
 		attribute_destroy(service->attributes[i]);
 
 	free(service->attributes);
+	free(service->hash_data);
 	free(service);
 }
 
+static void attribute_type_free(void *data)
+{
+	struct attribute_type *type = data;
+
+	queue_destroy(type->attribs, NULL);
+	free(type);
+}
+
 static void gatt_db_destroy(struct gatt_db *db)
 {
 	if (!db)
@@ -534,6 +663,7 @@ static void gatt_db_destroy(struct gatt_db *db)
 		timeout_remove(db->hash_id);
 
 	queue_destroy(db->services, gatt_db_service_destroy);
+	queue_destroy(db->types, attribute_type_free);
 	free(db->ccc);
 	free(db);
 }
@@ -714,9 +844,11 @@ uint8_t *gatt_db_get_hash(struct gatt_db *db)
 	if (!db || !db->crypto)
 		return NULL;
 
-	/* Generate hash if if has not been generated yet */
-	if (db->hash_id || !memcmp(db->hash, hash, 16)) {
-		timeout_remove(db->hash_id);
+	/* Generate hash if it is out of date or has not been generated yet */
+	if (db->hash_stale || !memcmp(db->hash, hash, 16)) {
+		if (db->hash_id)
+			timeout_remove(db->hash_id);
+
 		db_hash_update(db);
 	}
 
@@ -824,6 +956,8 @@ struct gatt_db_attribute *gatt_db_insert_service(struct gatt_db *db,
 	service->db = db;
 	service->attributes[0]->handle = handle;
 	service->num_handles = num_handles;
+	service_hash_invalidate(service);
+	db->types_stale = true;
 
 	/* Fast-forward last_handle if the new service was added to the end */
 	db->last_handle = MAX(handle + num_handles - 1, db->last_handle);
@@ -1453,11 +1587,61 @@ unsigned int gatt_db_find_by_type_value(struct gatt_db *db,
 	return data.num_of_res;
 }
 
-static void read_by_type(struct gatt_db_attribute *attribute, void *user_data)
+static bool match_attribute_type(const void *a, const void *b)
 {
-	struct queue *queue = user_data;
+	const struct attribute_type *type = a;
+	const uint128_t *key = b;
 
-	queue_push_tail(queue, attribute);
+	return !memcmp(&type->key, key, sizeof(*key));
+}
+
+static void type_index_add(void *data, void *user_data)
+{
+	struct gatt_db_service *service = data;
+	struct queue *types = user_data;
+	int i;
+
+	for (i = 0; i < service->num_handles; i++) {
+		struct gatt_db_attribute *attr = service->attributes[i];
+		struct attribute_type *type;
+
+		if (!attr)
+			continue;
+
+		type = queue_find(types, match_attribute_type, &attr->key);
+		if (!type) {
+			type = new0(struct attribute_type, 1);
+			type->key = attr->key;
+			type->attribs = queue_new();
+			queue_push_tail(types, type);
+		}
+
+		queue_push_tail(type->attribs, attr);
+	}
+}
+
+static struct queue *type_index_lookup(struct gatt_db *db,
+						const bt_uuid_t *uuid)
+{
+	struct attribute_type *type;
+	uint128_t key;
+
+	/* Services are kept sorted by handle so each list ends up sorted as
+	 * well.
+	 */
+	if (db->types_stale) {
+		queue_remove_all(db->types, NULL, NULL, attribute_type_free);
+		queue_foreach(db->services, type_index_add, db->types);
+		db->types_stale = false;
+	}
+
+	uuid_to_key(uuid, &key);
+
+	type = queue_find(db->types, match_attribute_type, &key);
+	if (!type)
+		return NULL;
+
+	return type->attribs;
 }
 
 void gatt_db_read_by_type(struct gatt_db *db, uint16_t start_handle,
@@ -1465,8 +1649,30 @@ void gatt_db_read_by_type(struct gatt_db *db, uint16_t start_handle,
 						const bt_uuid_t type,
 						struct queue *queue)
 {
-	gatt_db_foreach_in_range(db, &type, read_by_type, queue,
-						start_handle, end_handle);
+	const struct queue_entry *entry;
+	struct queue *attribs;
+
+	if (!db || start_handle > end_handle)
+		return;
+
+	attribs = type_index_lookup(db, &type);
+	if (!attribs)
+		return;
+
+	for (entry = queue_get_entries(attribs); entry; entry = entry->next) {
+		struct gatt_db_attribute *attr = entry->data;
+
+		if (attr->handle < start_handle)
+			continue;
+
+		if (attr->handle > end_handle)
+			break;
+
+		if (!attr->service->active)
+			continue;
+
+		queue_push_tail(queue, attr);
+	}
 }
 
 
@@ -1497,6 +1703,7 @@ void gatt_db_foreach_service(struct gatt_db *db, const bt_uuid_t *uuid,
 struct foreach_data {
 	gatt_db_attribute_cb_t func;
 	const bt_uuid_t *uuid;
+	uint128_t key;
 	void *user_data;
 	uint16_t start, end;
 	bool attr;
@@ -1515,7 +1722,8 @@ static void foreach_service_in_range(void *data, void *user_data)
 			/* Compare with attribute UUID in case it is a lookup
 			 * by group type.
 			 */
-			if (bt_uuid_cmp(&attribute->uuid, foreach_data->uuid))
+			if (!attribute_match_type(attribute, foreach_data->uuid,
+							&foreach_data->key))
 				return;
 		}
 	}
@@ -1558,8 +1766,9 @@ static void foreach_in_range(void *data, void *user_data)
 		if (attribute->handle > foreach_data->end)
 			return;
 
-		if (foreach_data->uuid && bt_uuid_cmp(foreach_data->uuid,
-							&attribute->uuid))
+		if (foreach_data->uuid && !attribute_match_type(attribute,
+							foreach_data->uuid,
+							&foreach_data->key))
 			continue;
 
 		foreach_data->func(attribute, foreach_data->user_data);
@@ -1585,6 +1794,9 @@ void gatt_db_foreach_service_in_range(struct gatt_db *db,
 	data.end = end_handle;
 	data.attr = false;
 
+	if (uuid)
+		uuid_to_key(uuid, &data.key);
+
 	queue_foreach(db->services, foreach_in_range, &data);
 }
 
@@ -1606,6 +1818,9 @@ void gatt_db_foreach_in_range(struct gatt_db *db, const bt_uuid_t *uuid,
 	data.end = end_handle;
 	data.attr = true;
 
+	if (uuid)
+		uuid_to_key(uuid, &data.key);
+
 	queue_foreach(db->services, foreach_in_range, &data);
 }
 
@@ -1616,6 +1831,7 @@ void gatt_db_service_foreach(struct gatt_db_attribute *attrib,
 {
 	struct gatt_db_service *service;
 	struct gatt_db_attribute *attr;
+	uint128_t key;
 	uint16_t i;
 
 	if (!attrib || !func)
@@ -1623,12 +1839,15 @@ void gatt_db_service_foreach(struct gatt_db_attribute *attrib,
 
 	service = attrib->service;
 
+	if (uuid)
+		uuid_to_key(uuid, &key);
+
 	for (i = 0; i < service->num_handles; i++) {
 		attr = service->attributes[i];
 		if (!attr)
 			continue;
 
-		if (uuid && bt_uuid_cmp(uuid, &attr->uuid))
+		if (uuid && !attribute_match_type(attr, uuid, &key))
 			continue;
 
 		func(attr, user_data);
@@ -2215,6 +2434,7 @@ bool gatt_db_attribute_write(struct gatt_db_attribute *attrib, uint16_t offset,
 					void *user_data)
 {
 	uint8_t err = 0;
+	bool had_value;
 
 	if (!attrib || (!func && attrib->write_func))
 		return false;
@@ -2258,6 +2478,8 @@ bool gatt_db_attribute_write(struct gatt_db_attribute *attrib, uint16_t offset,
 	if (len == 0)
 		goto done;
 
+	had_value = attrib->value;
+
 	/* For values stored in db allocate on demand */
 	if (!attrib->value || offset >= attrib->value_len ||
 				len > (unsigned) (attrib->value_len - offset)) {
@@ -2278,6 +2500,8 @@ bool gatt_db_attribute_write(struct gatt_db_attribute *attrib, uint16_t offset,
 
 	memcpy(&attrib->value[offset], value, len);
 
+	attribute_value_changed(attrib, had_value);
+
 done:
 	if (func)
 		func(attrib, err, user_data);
@@ -2363,6 +2587,8 @@ bool gatt_db_attribute_reset(struct gatt_db_attribute *attrib)
 	attrib->value = NULL;
 	attrib->value_len = 0;
 
+	attribute_value_changed(attrib, true);
+
 	return true;
 }
 
@@ -18,6 +18,7 @@
 #include <glib.h>
 
 #include "src/shared/io.h"
+#include "src/shared/timeout.h"
 
 #define	IO_ERR_WATCH_RATELIMIT		(500 * G_TIME_SPAN_MILLISECOND)
 
@@ -169,10 +170,13 @@ static gboolean watch_callback(GIOChannel *channel, GIOCondition cond,
 	if (!destroy && (cond & (G_IO_ERR | G_IO_NVAL)))
 		return FALSE;
 
-	if (watch->callback)
-		result = watch->callback(watch->io, watch->user_data);
-	else
-		result = false;
+	if (!watch->callback)
+		return FALSE;
+
+	/* Time must not skip ahead of the I/O being handled */
+	timeout_hold_virtual_clock(true);
+	result = watch->callback(watch->io, watch->user_data);
+	timeout_hold_virtual_clock(false);
 
 	return result ? TRUE : FALSE;
 }
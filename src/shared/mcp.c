@@ -1459,6 +1459,8 @@ bool bt_mcp_attach(struct bt_mcp *mcp, struct bt_gatt_client *client)
 	if (!mcp->client)
 		return false;
 
+	bt_gatt_client_batch_begin(mcp->client);
+
 	if (mcp->rdb->mcs) {
 		bt_mcp_mp_name_attach(mcp);
 		bt_mcp_track_changed_attach(mcp);
@@ -1469,12 +1471,13 @@ bool bt_mcp_attach(struct bt_mcp *mcp, struct bt_gatt_client *client)
 		bt_mcp_media_cp_attach(mcp);
 		bt_mcp_media_cp_op_supported_attach(mcp);
 		bt_mcp_content_control_id_supported_attach(mcp);
-
-		return true;
+	} else {
+		bt_uuid16_create(&uuid, GMCS_UUID);
+		gatt_db_foreach_service(mcp->rdb->db, &uuid,
+						foreach_mcs_service, mcp);
 	}
 
-	bt_uuid16_create(&uuid, GMCS_UUID);
-	gatt_db_foreach_service(mcp->rdb->db, &uuid, foreach_mcs_service, mcp);
+	bt_gatt_client_batch_end(mcp->client);
 
 	return true;
 }
@@ -0,0 +1,467 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+
+#include "src/shared/util.h"
+#include "src/shared/queue.h"
+#include "src/shared/io.h"
+#include "src/shared/pacer.h"
+
+/* Maximum number of SDUs handed to a single sendmmsg() */
+#define PACER_BURST	16
+
+#define NSEC_PER_USEC	1000ULL
+#define NSEC_PER_SEC	1000000000ULL
+
+struct pacer_stream {
+	unsigned int id;
+	int sk;
+	int fd;
+	uint8_t *data;
+	size_t base;		/* Input offset of data */
+	size_t buf_size;
+	bool mapped;
+	bool eof;
+	uint16_t sdu_len;
+	uint64_t start;
+	uint64_t interval;
+	uint32_t prefill;
+	uint32_t seq;
+	uint64_t retry;
+	int err;
+	bool done;
+	struct bt_pacer_stats stats;
+	bt_pacer_complete_func_t func;
+	bt_pacer_destroy_func_t destroy;
+	void *user_data;
+};
+
+struct bt_pacer {
+	struct io *timer;
+	struct queue *streams;
+	unsigned int next_id;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/* The first prefill SDUs are due immediately so the controller always has
+ * the configured latency worth of data queued, after that one SDU is due
+ * per interval. Deadlines are derived from the start time rather than the
+ * previous wakeup so timer jitter does not accumulate.
+ */
+static uint64_t stream_deadline(struct pacer_stream *stream, uint32_t seq)
+{
+	if (seq < stream->prefill)
+		return stream->start;
+
+	return stream->start + (seq - stream->prefill + 1) * stream->interval;
+}
+
+/* Returns the number of bytes available past the current offset, reading
+ * more of the input if less than len are buffered.
+ */
+static size_t stream_fill(struct pacer_stream *stream, size_t len)
+{
+	size_t avail = stream->stats.size - stream->stats.offset;
+	ssize_t ret;
+
+	if (stream->eof || avail >= len)
+		return avail;
+
+	/* Move the remaining bytes to the front to make room */
+	memmove(stream->data, stream->data + stream->stats.offset -
+						stream->base, avail);
+	stream->base = stream->stats.offset;
+
+	while (avail < len) {
+		ret = read(stream->fd, stream->data + avail,
+						stream->buf_size - avail);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+
+			if (errno != EAGAIN)
+				stream->err = -errno;
+
+			break;
+		}
+
+		if (!ret) {
+			stream->eof = true;
+			break;
+		}
+
+		avail += ret;
+		stream->stats.size += ret;
+	}
+
+	return avail;
+}
+
+static void stream_free(void *data)
+{
+	struct pacer_stream *stream = data;
+
+	if (stream->destroy)
+		stream->destroy(stream->user_data);
+
+	if (stream->mapped)
+		munmap(stream->data, stream->stats.size);
+	else
+		free(stream->data);
+
+	free(stream);
+}
+
+static void stream_complete(void *data)
+{
+	struct pacer_stream *stream = data;
+
+	if (stream->func)
+		stream->func(stream->id, stream->err, &stream->stats,
+							stream->user_data);
+
+	stream_free(stream);
+}
+
+static bool match_stream_done(const void *data, const void *user_data)
+{
+	const struct pacer_stream *stream = data;
+
+	return stream->done;
+}
+
+static bool match_stream_id(const void *data, const void *user_data)
+{
+	const struct pacer_stream *stream = data;
+
+	return stream->id == PTR_TO_UINT(user_data);
+}
+
+static void stream_send(struct pacer_stream *stream, uint64_t now)
+{
+	struct mmsghdr msgs[PACER_BURST];
+	struct iovec iov[PACER_BURST];
+	uint64_t window;
+	int n, due, ret, i;
+
+	/* SDUs that could no longer make it within the transport latency are
+	 * dropped so the stream catches up instead of lagging behind forever.
+	 */
+	window = MAX(stream->prefill, 1U) * stream->interval;
+
+	while (!stream->eof || stream->stats.offset < stream->stats.size) {
+		size_t offset, avail;
+
+		while (now > stream_deadline(stream, stream->seq) + window) {
+			avail = stream_fill(stream, stream->sdu_len);
+			if (!avail || (avail < stream->sdu_len && !stream->eof))
+				break;
+
+			stream->stats.offset += MIN(avail, stream->sdu_len);
+			stream->stats.dropped++;
+			stream->seq++;
+		}
+
+		due = 0;
+		while (due < PACER_BURST && stream_deadline(stream,
+						stream->seq + due) <= now)
+			due++;
+
+		if (!due)
+			return;
+
+		avail = stream_fill(stream, due * stream->sdu_len);
+		if (!avail)
+			break;
+
+		memset(msgs, 0, sizeof(msgs));
+		offset = stream->stats.offset - stream->base;
+		avail += offset;
+
+		for (n = 0; n < due && offset < avail; n++) {
+			size_t len = MIN(avail - offset, stream->sdu_len);
+
+			/* Wait for the rest of a partial SDU unless the input
+			 * has ended.
+			 */
+			if (len < stream->sdu_len && !stream->eof)
+				break;
+
+			iov[n].iov_base = stream->data + offset;
+			iov[n].iov_len = len;
+			msgs[n].msg_hdr.msg_iov = &iov[n];
+			msgs[n].msg_hdr.msg_iovlen = 1;
+			offset += len;
+		}
+
+		if (!n)
+			break;
+
+		ret = sendmmsg(stream->sk, msgs, n, MSG_DONTWAIT);
+		if (ret < 0) {
+			if (errno == EAGAIN || errno == ENOBUFS)
+				ret = 0;
+			else {
+				stream->err = -errno;
+				stream->done = true;
+				return;
+			}
+		}
+
+		for (i = 0; i < ret; i++) {
+			if (now >= stream_deadline(stream, stream->seq) +
+							stream->interval)
+				stream->stats.late++;
+
+			stream->stats.offset += iov[i].iov_len;
+			stream->stats.sent++;
+			stream->seq++;
+		}
+
+		/* Socket buffer is full, try again later */
+		if (ret < n) {
+			stream->retry = now + stream->interval / 2;
+			return;
+		}
+	}
+
+	/* Input that is not ready yet is polled again later */
+	if (!stream->err && (!stream->eof || stream->stats.offset <
+							stream->stats.size)) {
+		stream->retry = now + stream->interval / 2;
+		return;
+	}
+
+	stream->done = true;
+}
+
+static void pacer_arm(struct bt_pacer *pacer)
+{
+	const struct queue_entry *entry;
+	struct itimerspec ts;
+	uint64_t next = 0;
+
+	for (entry = queue_get_entries(pacer->streams); entry;
+							entry = entry->next) {
+		struct pacer_stream *stream = entry->data;
+		uint64_t deadline;
+
+		deadline = MAX(stream_deadline(stream, stream->seq),
+							stream->retry);
+		if (!next || deadline < next)
+			next = deadline;
+	}
+
+	memset(&ts, 0, sizeof(ts));
+
+	/* A zero expiration would disarm the timer, expire right away */
+	if (next) {
+		ts.it_value.tv_sec = next / NSEC_PER_SEC;
+		ts.it_value.tv_nsec = next % NSEC_PER_SEC;
+		if (!ts.it_value.tv_sec && !ts.it_value.tv_nsec)
+			ts.it_value.tv_nsec = 1;
+	}
+
+	timerfd_settime(io_get_fd(pacer->timer), TFD_TIMER_ABSTIME, &ts, NULL);
+}
+
+static void pacer_run(struct bt_pacer *pacer)
+{
+	const struct queue_entry *entry;
+	uint64_t now = now_ns();
+
+	for (entry = queue_get_entries(pacer->streams); entry;
+							entry = entry->next) {
+		struct pacer_stream *stream = entry->data;
+
+		if (stream->retry > now)
+			continue;
+
+		stream->retry = 0;
+		stream_send(stream, now);
+	}
+
+	queue_remove_all(pacer->streams, match_stream_done, NULL,
+							stream_complete);
+
+	pacer_arm(pacer);
+}
+
+static bool pacer_timer_read(struct io *io, void *user_data)
+{
+	struct bt_pacer *pacer = user_data;
+	uint64_t exp;
+
+	if (read(io_get_fd(io), &exp, sizeof(exp)) < 0 && errno != EAGAIN)
+		return false;
+
+	pacer_run(pacer);
+
+	return true;
+}
+
+struct bt_pacer *bt_pacer_new(void)
+{
+	struct bt_pacer *pacer;
+	int fd;
+
+	fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	pacer = new0(struct bt_pacer, 1);
+	pacer->streams = queue_new();
+	pacer->timer = io_new(fd);
+	io_set_close_on_destroy(pacer->timer, true);
+	io_set_read_handler(pacer->timer, pacer_timer_read, pacer, NULL);
+
+	return pacer;
+}
+
+void bt_pacer_free(struct bt_pacer *pacer)
+{
+	if (!pacer)
+		return;
+
+	io_destroy(pacer->timer);
+	queue_destroy(pacer->streams, stream_free);
+	free(pacer);
+}
+
+static bool stream_load(struct pacer_stream *stream, int fd)
+{
+	struct stat st;
+	int flags;
+
+	/* Map regular files so no system calls are needed to fetch SDUs */
+	if (!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0) {
+		void *data;
+
+		data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data != MAP_FAILED) {
+			madvise(data, st.st_size, MADV_WILLNEED);
+			stream->data = data;
+			stream->stats.size = st.st_size;
+			stream->mapped = true;
+			stream->eof = true;
+			return true;
+		}
+	}
+
+	/* Otherwise, like for pipes, the input is read as SDUs become due.
+	 * A writer falling behind must not stall the main loop.
+	 */
+	flags = fcntl(fd, F_GETFL);
+	if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+		return false;
+
+	stream->fd = fd;
+	stream->buf_size = PACER_BURST * stream->sdu_len;
+	stream->data = malloc(stream->buf_size);
+
+	return stream->data;
+}
+
+unsigned int bt_pacer_add(struct bt_pacer *pacer, int sk, int fd,
+				uint16_t sdu_len, uint32_t interval,
+				uint16_t latency,
+				bt_pacer_complete_func_t func, void *user_data,
+				bt_pacer_destroy_func_t destroy)
+{
+	struct pacer_stream *stream;
+
+	if (!pacer || sk < 0 || fd < 0 || !sdu_len || !interval)
+		return 0;
+
+	stream = new0(struct pacer_stream, 1);
+	stream->sdu_len = sdu_len;
+
+	if (!stream_load(stream, fd)) {
+		stream_free(stream);
+		return 0;
+	}
+
+	if (pacer->next_id < 1)
+		pacer->next_id = 1;
+
+	stream->id = pacer->next_id++;
+	stream->sk = sk;
+	stream->interval = interval * NSEC_PER_USEC;
+	/* Keep ROUND_CLOSEST(latency / interval) SDUs queued ahead */
+	stream->prefill = (latency * 1000U + interval / 2) / interval;
+	stream->start = now_ns();
+	stream->func = func;
+	stream->destroy = destroy;
+	stream->user_data = user_data;
+
+	queue_push_tail(pacer->streams, stream);
+
+	pacer_arm(pacer);
+
+	return stream->id;
+}
+
+bool bt_pacer_remove(struct bt_pacer *pacer, unsigned int id)
+{
+	struct pacer_stream *stream;
+
+	if (!pacer)
+		return false;
+
+	stream = queue_remove_if(pacer->streams, match_stream_id,
+							UINT_TO_PTR(id));
+	if (!stream)
+		return false;
+
+	stream_free(stream);
+
+	pacer_arm(pacer);
+
+	return true;
+}
+
+bool bt_pacer_get_stats(struct bt_pacer *pacer, unsigned int id,
+					struct bt_pacer_stats *stats)
+{
+	struct pacer_stream *stream;
+
+	if (!pacer || !stats)
+		return false;
+
+	stream = queue_find(pacer->streams, match_stream_id, UINT_TO_PTR(id));
+	if (!stream)
+		return false;
+
+	*stats = stream->stats;
+
+	return true;
+}
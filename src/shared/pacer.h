@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct bt_pacer;
+
+struct bt_pacer_stats {
+	uint32_t sent;		/* SDUs sent */
+	uint32_t late;		/* SDUs sent after their interval had passed */
+	uint32_t dropped;	/* SDUs skipped for exceeding the latency */
+	size_t offset;		/* Bytes consumed from the input */
+	size_t size;		/* Bytes read from the input so far */
+};
+
+typedef void (*bt_pacer_complete_func_t)(unsigned int id, int err,
+					const struct bt_pacer_stats *stats,
+					void *user_data);
+typedef void (*bt_pacer_destroy_func_t)(void *user_data);
+
+struct bt_pacer *bt_pacer_new(void);
+void bt_pacer_free(struct bt_pacer *pacer);
+
+unsigned int bt_pacer_add(struct bt_pacer *pacer, int sk, int fd,
+				uint16_t sdu_len, uint32_t interval,
+				uint16_t latency,
+				bt_pacer_complete_func_t func, void *user_data,
+				bt_pacer_destroy_func_t destroy);
+bool bt_pacer_remove(struct bt_pacer *pacer, unsigned int id);
+bool bt_pacer_get_stats(struct bt_pacer *pacer, unsigned int id,
+					struct bt_pacer_stats *stats);
@@ -16,6 +16,9 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
 
 #include "src/shared/util.h"
 #include "src/shared/pcap.h"
@@ -47,11 +50,16 @@ struct pcap_ppi {
 } __attribute__ ((packed));
 #define PCAP_PPI_SIZE (sizeof(struct pcap_ppi))
 
+#define PCAP_MAX_IOV	4
+
 struct pcap {
 	int ref_count;
 	int fd;
 	uint32_t type;
 	uint32_t snaplen;
+	uint8_t *buf;
+	size_t buf_size;
+	size_t buf_len;
 };
 
 struct pcap *pcap_open(const char *path)
@@ -92,6 +100,109 @@ failed:
 	return NULL;
 }
 
+struct pcap *pcap_create(const char *path, uint32_t type, uint32_t snaplen)
+{
+	struct pcap *pcap;
+	struct pcap_hdr hdr;
+	ssize_t written;
+
+	pcap = calloc(1, sizeof(*pcap));
+	if (!pcap)
+		return NULL;
+
+	pcap->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+				S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (pcap->fd < 0) {
+		free(pcap);
+		return NULL;
+	}
+
+	hdr.magic_number = 0xa1b2c3d4;
+	hdr.version_major = 2;
+	hdr.version_minor = 4;
+	hdr.thiszone = 0;
+	hdr.sigfigs = 0;
+	hdr.snaplen = snaplen;
+	hdr.network = type;
+
+	written = write(pcap->fd, &hdr, PCAP_HDR_SIZE);
+	if (written < 0 || written != PCAP_HDR_SIZE) {
+		close(pcap->fd);
+		free(pcap);
+		return NULL;
+	}
+
+	pcap->snaplen = snaplen;
+	pcap->type = type;
+
+	return pcap_ref(pcap);
+}
+
+/* Continue writing an existing file of the same type, or start a new one
+ * if there is none.
+ */
+struct pcap *pcap_append(const char *path, uint32_t type, uint32_t snaplen)
+{
+	struct pcap *pcap;
+	struct pcap_hdr hdr;
+	struct stat st;
+	ssize_t len;
+
+	pcap = calloc(1, sizeof(*pcap));
+	if (!pcap)
+		return NULL;
+
+	pcap->fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC,
+				S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (pcap->fd < 0) {
+		free(pcap);
+		return NULL;
+	}
+
+	if (fstat(pcap->fd, &st) < 0)
+		goto failed;
+
+	if (!st.st_size) {
+		close(pcap->fd);
+		free(pcap);
+		return pcap_create(path, type, snaplen);
+	}
+
+	len = pread(pcap->fd, &hdr, PCAP_HDR_SIZE, 0);
+	if (len < 0 || len != PCAP_HDR_SIZE)
+		goto failed;
+
+	if (hdr.magic_number != 0xa1b2c3d4 || hdr.network != type)
+		goto failed;
+
+	if (hdr.version_major != 2 || hdr.version_minor != 4)
+		goto failed;
+
+	pcap->snaplen = hdr.snaplen;
+	pcap->type = type;
+
+	return pcap_ref(pcap);
+
+failed:
+	close(pcap->fd);
+	free(pcap);
+
+	return NULL;
+}
+
+static bool pcap_flush(struct pcap *pcap)
+{
+	ssize_t written;
+
+	if (!pcap->buf_len)
+		return true;
+
+	written = write(pcap->fd, pcap->buf, pcap->buf_len);
+	pcap->buf_len = 0;
+
+	return written >= 0;
+}
+
 struct pcap *pcap_ref(struct pcap *pcap)
 {
 	if (!pcap)
@@ -110,12 +221,42 @@ void pcap_unref(struct pcap *pcap)
 	if (__sync_sub_and_fetch(&pcap->ref_count, 1))
 		return;
 
-	if (pcap->fd >= 0)
+	if (pcap->fd >= 0) {
+		pcap_flush(pcap);
 		close(pcap->fd);
+	}
 
+	free(pcap->buf);
 	free(pcap);
 }
 
+/* Collect records in memory and only write them out once the buffer is
+ * full or the file is closed.
+ */
+bool pcap_set_buffer_size(struct pcap *pcap, size_t size)
+{
+	uint8_t *buf;
+
+	if (!pcap || !pcap_flush(pcap))
+		return false;
+
+	if (!size) {
+		free(pcap->buf);
+		pcap->buf = NULL;
+		pcap->buf_size = 0;
+		return true;
+	}
+
+	buf = realloc(pcap->buf, size);
+	if (!buf)
+		return false;
+
+	pcap->buf = buf;
+	pcap->buf_size = size;
+
+	return true;
+}
+
 uint32_t pcap_get_type(struct pcap *pcap)
 {
 	if (!pcap)
@@ -219,3 +360,69 @@ bool pcap_read_ppi(struct pcap *pcap, struct timeval *tv, uint32_t *type,
 
 	return true;
 }
+
+bool pcap_write(struct pcap *pcap, struct timeval *tv,
+					const struct iovec *iov, int iovcnt)
+{
+	struct pcap_pkt pkt;
+	struct iovec vec[PCAP_MAX_IOV + 1];
+	uint32_t len = 0, incl_len;
+	ssize_t written;
+	int i;
+
+	if (!pcap || pcap->fd < 0 || iovcnt > PCAP_MAX_IOV)
+		return false;
+
+	for (i = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
+
+	incl_len = len;
+	if (pcap->snaplen && incl_len > pcap->snaplen)
+		incl_len = pcap->snaplen;
+
+	pkt.ts_sec = tv->tv_sec;
+	pkt.ts_usec = tv->tv_usec;
+	pkt.incl_len = incl_len;
+	pkt.orig_len = len;
+
+	if (pcap->buf && PCAP_PKT_SIZE + incl_len <= pcap->buf_size) {
+		if (pcap->buf_len + PCAP_PKT_SIZE + incl_len > pcap->buf_size &&
+							!pcap_flush(pcap))
+			return false;
+
+		memcpy(pcap->buf + pcap->buf_len, &pkt, PCAP_PKT_SIZE);
+		pcap->buf_len += PCAP_PKT_SIZE;
+
+		for (i = 0; i < iovcnt && incl_len; i++) {
+			size_t n = iov[i].iov_len < incl_len ?
+						iov[i].iov_len : incl_len;
+
+			memcpy(pcap->buf + pcap->buf_len, iov[i].iov_base, n);
+			pcap->buf_len += n;
+			incl_len -= n;
+		}
+
+		return true;
+	}
+
+	if (!pcap_flush(pcap))
+		return false;
+
+	vec[0].iov_base = &pkt;
+	vec[0].iov_len = PCAP_PKT_SIZE;
+
+	for (i = 0; i < iovcnt; i++) {
+		size_t n = iov[i].iov_len < incl_len ?
+					iov[i].iov_len : incl_len;
+
+		vec[i + 1].iov_base = iov[i].iov_base;
+		vec[i + 1].iov_len = n;
+		incl_len -= n;
+	}
+
+	written = writev(pcap->fd, vec, 1 + iovcnt);
+	if (written < 0)
+		return false;
+
+	return true;
+}
@@ -8,6 +8,7 @@
  *
  */
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <sys/time.h>
@@ -15,15 +16,21 @@
 #define PCAP_TYPE_INVALID		0
 #define PCAP_TYPE_USER0			147
 #define PCAP_TYPE_PPI			192
+#define PCAP_TYPE_BLUETOOTH_HCI_H4_WITH_PHDR	201
 #define PCAP_TYPE_BLUETOOTH_LE_LL	251
 
 struct pcap;
+struct iovec;
 
 struct pcap *pcap_open(const char *path);
+struct pcap *pcap_create(const char *path, uint32_t type, uint32_t snaplen);
+struct pcap *pcap_append(const char *path, uint32_t type, uint32_t snaplen);
 
 struct pcap *pcap_ref(struct pcap *pcap);
 void pcap_unref(struct pcap *pcap);
 
+bool pcap_set_buffer_size(struct pcap *pcap, size_t size);
+
 uint32_t pcap_get_type(struct pcap *pcap);
 uint32_t pcap_get_snaplen(struct pcap *pcap);
 
@@ -32,3 +39,5 @@ bool pcap_read(struct pcap *pcap, struct timeval *tv,
 bool pcap_read_ppi(struct pcap *pcap, struct timeval *tv, uint32_t *type,
 					void *data, uint32_t size,
 					uint32_t *offset, uint32_t *len);
+bool pcap_write(struct pcap *pcap, struct timeval *tv,
+					const struct iovec *iov, int iovcnt);
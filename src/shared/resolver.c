@@ -0,0 +1,187 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <time.h>
+
+#include "src/shared/util.h"
+#include "src/shared/aes.h"
+#include "src/shared/resolver.h"
+
+#define CACHE_SIZE	256
+
+struct resolver_key {
+	void *user_data;
+	struct bt_aes_key aes;
+};
+
+struct resolver_entry {
+	uint8_t val[6];
+	time_t expire;
+	void *user_data;	/* NULL if no key resolved it */
+};
+
+struct bt_resolver {
+	struct resolver_key *keys;
+	unsigned int num_keys;
+	unsigned int timeout;
+	struct resolver_entry cache[CACHE_SIZE];
+};
+
+/* Resolves RPAs (ah) and RSIs (sih) against all keys at once, results are
+ * cached for timeout seconds, which should match the lifetime of the
+ * random values.
+ */
+struct bt_resolver *bt_resolver_new(unsigned int timeout)
+{
+	struct bt_resolver *resolver;
+
+	resolver = new0(struct bt_resolver, 1);
+	resolver->timeout = timeout;
+
+	return resolver;
+}
+
+void bt_resolver_free(struct bt_resolver *resolver)
+{
+	if (!resolver)
+		return;
+
+	util_explicit_bzero(resolver->keys,
+				resolver->num_keys * sizeof(*resolver->keys));
+	free(resolver->keys);
+	free(resolver);
+}
+
+static void resolver_flush(struct bt_resolver *resolver)
+{
+	memset(resolver->cache, 0, sizeof(resolver->cache));
+}
+
+static struct resolver_key *resolver_find(struct bt_resolver *resolver,
+							void *user_data)
+{
+	unsigned int i;
+
+	for (i = 0; i < resolver->num_keys; i++) {
+		if (resolver->keys[i].user_data == user_data)
+			return &resolver->keys[i];
+	}
+
+	return NULL;
+}
+
+/* Adds a key, or replaces the key of user_data if it has already been added.
+ * As for bt_crypto_ah() the least significant octet of key comes first.
+ */
+bool bt_resolver_add_key(struct bt_resolver *resolver, const uint8_t key[16],
+							void *user_data)
+{
+	struct resolver_key *entry;
+	uint8_t k[16];
+	int i;
+
+	if (!resolver || !user_data)
+		return false;
+
+	entry = resolver_find(resolver, user_data);
+	if (!entry) {
+		entry = realloc(resolver->keys, (resolver->num_keys + 1) *
+						sizeof(*resolver->keys));
+		if (!entry)
+			return false;
+
+		resolver->keys = entry;
+		entry = &resolver->keys[resolver->num_keys++];
+		entry->user_data = user_data;
+	}
+
+	for (i = 0; i < 16; i++)
+		k[i] = key[15 - i];
+
+	bt_aes_set_key(&entry->aes, k);
+
+	resolver_flush(resolver);
+
+	return true;
+}
+
+bool bt_resolver_remove_key(struct bt_resolver *resolver, void *user_data)
+{
+	struct resolver_key *entry;
+
+	if (!resolver)
+		return false;
+
+	entry = resolver_find(resolver, user_data);
+	if (!entry)
+		return false;
+
+	*entry = resolver->keys[--resolver->num_keys];
+
+	resolver_flush(resolver);
+
+	return true;
+}
+
+static time_t resolver_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec;
+}
+
+/* Returns the user_data of the key resolving val, where val is laid out
+ * like an RPA or an RSI: hash in the first three octets followed by prand,
+ * least significant octet first.
+ */
+void *bt_resolver_resolve(struct bt_resolver *resolver, const uint8_t val[6])
+{
+	struct resolver_entry *entry;
+	uint8_t in[16] = {}, out[16];
+	void *user_data = NULL;
+	unsigned int i;
+	time_t now;
+
+	if (!resolver || !resolver->num_keys)
+		return NULL;
+
+	now = resolver_now();
+
+	entry = &resolver->cache[val[0] ^ val[3] ^ val[5]];
+	if (entry->expire > now && !memcmp(entry->val, val, 6))
+		return entry->user_data;
+
+	/* r' = padding || prand with the most significant octet first */
+	in[13] = val[5];
+	in[14] = val[4];
+	in[15] = val[3];
+
+	for (i = 0; i < resolver->num_keys; i++) {
+		bt_aes_encrypt(&resolver->keys[i].aes, in, out);
+
+		/* hash = e(k, r') mod 2^24 */
+		if (out[15] == val[0] && out[14] == val[1] &&
+							out[13] == val[2]) {
+			user_data = resolver->keys[i].user_data;
+			break;
+		}
+	}
+
+	memcpy(entry->val, val, 6);
+	entry->expire = now + resolver->timeout;
+	entry->user_data = user_data;
+
+	return user_data;
+}
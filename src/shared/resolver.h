@@ -0,0 +1,21 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct bt_resolver;
+
+struct bt_resolver *bt_resolver_new(unsigned int timeout);
+void bt_resolver_free(struct bt_resolver *resolver);
+
+bool bt_resolver_add_key(struct bt_resolver *resolver, const uint8_t key[16],
+							void *user_data);
+bool bt_resolver_remove_key(struct bt_resolver *resolver, void *user_data);
+
+void *bt_resolver_resolve(struct bt_resolver *resolver, const uint8_t val[6]);
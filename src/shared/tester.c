@@ -19,7 +19,10 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
+#include <inttypes.h>
 #include <signal.h>
+#include <time.h>
+#include <malloc.h>
 #include <sys/signalfd.h>
 #include <sys/socket.h>
 
@@ -77,6 +80,24 @@ enum test_stage {
 	TEST_STAGE_POST_TEARDOWN,
 };
 
+#define BENCH_DEFAULT_ITERATIONS	1000
+
+struct test_bench {
+	unsigned int iterations;
+	unsigned int warmup;
+	unsigned int count;
+	uint64_t *samples;
+	uint64_t start;
+	size_t heap_start;
+	int64_t heap_bytes;
+	uint64_t total;
+	uint64_t min;
+	uint64_t max;
+	uint64_t p50;
+	uint64_t p90;
+	uint64_t p99;
+};
+
 struct test_case {
 	char *name;
 	enum test_result result;
@@ -97,6 +118,7 @@ struct test_case {
 	unsigned int teardown_id;
 	tester_destroy_func_t destroy;
 	void *user_data;
+	struct test_bench *bench;
 };
 
 static char *tester_name;
@@ -110,8 +132,12 @@ static gboolean option_quiet = FALSE;
 static gboolean option_debug = FALSE;
 static gboolean option_monitor = FALSE;
 static gboolean option_list = FALSE;
+static gboolean option_virtual_time = FALSE;
+static gboolean option_bench = FALSE;
+static gint option_iterations = 0;
 static const char *option_prefix = NULL;
 static const char *option_string = NULL;
+static const char *option_json = NULL;
 
 struct monitor_hdr {
 	uint16_t opcode;
@@ -131,7 +157,7 @@ static void test_destroy(gpointer data)
 	struct test_case *test = data;
 
 	if (test->timeout_id > 0)
-		timeout_remove(test->timeout_id);
+		g_source_remove(test->timeout_id);
 
 	if (test->teardown_id > 0)
 		g_source_remove(test->teardown_id);
@@ -139,6 +165,11 @@ static void test_destroy(gpointer data)
 	if (test->destroy)
 		test->destroy(test->user_data);
 
+	if (test->bench) {
+		free(test->bench->samples);
+		free(test->bench);
+	}
+
 	free(test->name);
 	free(test);
 }
@@ -350,6 +381,47 @@ void tester_add(const char *name, const void *test_data,
 					teardown_func, NULL, 0, NULL, NULL);
 }
 
+void tester_add_bench(const char *name, const void *test_data,
+					tester_data_func_t setup_func,
+					tester_data_func_t bench_func,
+					tester_data_func_t teardown_func,
+					unsigned int iterations)
+{
+	struct test_case *test;
+	struct test_bench *bench;
+	GList *last = g_list_last(test_list);
+
+	tester_add_full(name, test_data, NULL, setup_func, bench_func,
+					teardown_func, NULL, 0, NULL, NULL);
+
+	/* Filtered out or only listed */
+	if (g_list_last(test_list) == last)
+		return;
+
+	test = g_list_last(test_list)->data;
+
+	bench = new0(struct test_bench, 1);
+
+	/* Without --bench a benchmark runs once as a functional test */
+	if (option_bench) {
+		if (option_iterations > 0)
+			bench->iterations = option_iterations;
+		else if (iterations)
+			bench->iterations = iterations;
+		else
+			bench->iterations = BENCH_DEFAULT_ITERATIONS;
+
+		bench->warmup = bench->iterations / 10 ? : 1;
+	} else {
+		bench->iterations = 1;
+		bench->warmup = 0;
+	}
+
+	bench->samples = new0(uint64_t, bench->iterations);
+
+	test->bench = bench;
+}
+
 static struct test_case *tester_get_test(void)
 {
 	if (!test_current)
@@ -368,6 +440,82 @@ void *tester_get_data(void)
 	return test->user_data;
 }
 
+static double bench_ops_per_sec(struct test_bench *bench)
+{
+	if (!bench->total)
+		return 0;
+
+	return (double) bench->iterations * 1000000000 / bench->total;
+}
+
+static void bench_json_string(FILE *fp, const char *str)
+{
+	fputc('"', fp);
+
+	for (; *str; str++) {
+		unsigned char c = *str;
+
+		if (c == '"' || c == '\\')
+			fprintf(fp, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(fp, "\\u%04x", c);
+		else
+			fputc(c, fp);
+	}
+
+	fputc('"', fp);
+}
+
+static void bench_write_json(void)
+{
+	const char *sep = "";
+	FILE *fp;
+	GList *list;
+
+	if (!option_json)
+		return;
+
+	fp = fopen(option_json, "w");
+	if (!fp) {
+		tester_warn("Failed to open %s: %s", option_json,
+							strerror(errno));
+		return;
+	}
+
+	fprintf(fp, "{\n  \"tester\": ");
+	bench_json_string(fp, tester_name);
+	fprintf(fp, ",\n  \"benchmarks\": [");
+
+	for (list = g_list_first(test_list); list; list = g_list_next(list)) {
+		struct test_case *test = list->data;
+		struct test_bench *bench = test->bench;
+
+		if (!bench || test->result != TEST_RESULT_PASSED)
+			continue;
+
+		fprintf(fp, "%s\n    { \"name\": ", sep);
+		bench_json_string(fp, test->name);
+		fprintf(fp, ", ");
+		fprintf(fp, "\"iterations\": %u, \"warmup\": %u, ",
+					bench->iterations, bench->warmup);
+		fprintf(fp, "\"ops_per_sec\": %.1f, ", bench_ops_per_sec(bench));
+		fprintf(fp, "\"mean_ns\": %" PRIu64 ", ",
+					bench->total / bench->iterations);
+		fprintf(fp, "\"min_ns\": %" PRIu64 ", \"p50_ns\": %" PRIu64
+				", \"p90_ns\": %" PRIu64 ", \"p99_ns\": %" PRIu64
+				", \"max_ns\": %" PRIu64 ", ",
+				bench->min, bench->p50, bench->p90, bench->p99,
+				bench->max);
+		fprintf(fp, "\"heap_bytes_per_op\": %" PRId64 " }",
+				bench->heap_bytes / (int64_t) bench->iterations);
+
+		sep = ",";
+	}
+
+	fprintf(fp, "\n  ]\n}\n");
+	fclose(fp);
+}
+
 static int tester_summarize(void)
 {
 	unsigned int not_run = 0, passed = 0, failed = 0;
@@ -393,6 +541,9 @@ static int tester_summarize(void)
 		case TEST_RESULT_PASSED:
 			print_summary(test->name, COLOR_GREEN, "Passed",
 						"%8.3f seconds", exec_time);
+			if (test->bench && option_bench)
+				tester_log("%-52s %.1f ops/sec", "",
+					bench_ops_per_sec(test->bench));
 			passed++;
 			break;
 		case TEST_RESULT_FAILED:
@@ -420,6 +571,8 @@ static int tester_summarize(void)
 	execution_time = g_timer_elapsed(test_timer, NULL);
 	tester_log("Overall execution time: %.3g seconds", execution_time);
 
+	bench_write_json();
+
 	return failed;
 }
 
@@ -440,7 +593,7 @@ static gboolean teardown_callback(gpointer user_data)
 	return FALSE;
 }
 
-static bool test_timeout(gpointer user_data)
+static gboolean test_timeout(gpointer user_data)
 {
 	struct test_case *test = user_data;
 
@@ -480,10 +633,10 @@ static void next_test_case(void)
 
 	test->start_time = g_timer_elapsed(test_timer, NULL);
 
+	/* Always on real time, the virtual clock may skip ahead */
 	if (test->timeout > 0)
-		test->timeout_id = timeout_add_seconds(test->timeout,
-							test_timeout, test,
-							NULL);
+		test->timeout_id = g_timeout_add_seconds(test->timeout,
+							test_timeout, test);
 
 	test->stage = TEST_STAGE_PRE_SETUP;
 
@@ -502,6 +655,141 @@ static gboolean setup_callback(gpointer user_data)
 	return FALSE;
 }
 
+static uint64_t bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static size_t bench_heap_used(void)
+{
+#ifdef HAVE_MALLINFO2
+	return mallinfo2().uordblks;
+#else
+	return 0;
+#endif
+}
+
+static gboolean bench_callback(gpointer user_data)
+{
+	struct test_case *test = user_data;
+	struct test_bench *bench = test->bench;
+
+	/* Test already failed or timed out */
+	if (!test_current || test_current->data != test ||
+				test->stage != TEST_STAGE_RUN ||
+				test->result != TEST_RESULT_NOT_RUN)
+		return FALSE;
+
+	if (bench->count == bench->warmup)
+		bench->heap_start = bench_heap_used();
+
+	bench->start = bench_now();
+	test->test_func(test->test_data);
+
+	return FALSE;
+}
+
+static int bench_cmp(const void *a, const void *b)
+{
+	uint64_t va = *(const uint64_t *) a;
+	uint64_t vb = *(const uint64_t *) b;
+
+	return va < vb ? -1 : va > vb;
+}
+
+static uint64_t bench_percentile(struct test_bench *bench, unsigned int pct)
+{
+	return bench->samples[(bench->iterations - 1) * pct / 100];
+}
+
+static void bench_finish(struct test_case *test)
+{
+	struct test_bench *bench = test->bench;
+	unsigned int i;
+
+	bench->heap_bytes = (int64_t) bench_heap_used() - bench->heap_start;
+
+	qsort(bench->samples, bench->iterations, sizeof(uint64_t), bench_cmp);
+
+	bench->total = 0;
+	for (i = 0; i < bench->iterations; i++)
+		bench->total += bench->samples[i];
+
+	bench->min = bench->samples[0];
+	bench->max = bench->samples[bench->iterations - 1];
+	bench->p50 = bench_percentile(bench, 50);
+	bench->p90 = bench_percentile(bench, 90);
+	bench->p99 = bench_percentile(bench, 99);
+
+	if (option_bench)
+		print_progress(test->name, COLOR_BLACK,
+			"%u iterations, %.1f ops/sec, p50 %" PRIu64 " ns, "
+			"p99 %" PRIu64 " ns, %" PRId64 " heap bytes/op",
+			bench->iterations, bench_ops_per_sec(bench),
+			bench->p50, bench->p99,
+			bench->heap_bytes / (int64_t) bench->iterations);
+
+	tester_test_passed();
+}
+
+void tester_bench_iteration_complete(void)
+{
+	struct test_case *test;
+	struct test_bench *bench;
+	uint64_t elapsed;
+
+	if (!test_current)
+		return;
+
+	test = test_current->data;
+	bench = test->bench;
+
+	if (!bench || test->stage != TEST_STAGE_RUN ||
+				test->result != TEST_RESULT_NOT_RUN)
+		return;
+
+	elapsed = bench_now() - bench->start;
+
+	if (bench->count >= bench->warmup)
+		bench->samples[bench->count - bench->warmup] = elapsed;
+
+	if (++bench->count < bench->warmup + bench->iterations) {
+		g_idle_add(bench_callback, test);
+		return;
+	}
+
+	bench_finish(test);
+}
+
+bool tester_bench_get_stats(struct tester_bench_stats *stats)
+{
+	struct test_case *test;
+	struct test_bench *bench;
+
+	if (!test_current || !stats)
+		return false;
+
+	test = test_current->data;
+	bench = test->bench;
+
+	if (!bench || test->result != TEST_RESULT_PASSED)
+		return false;
+
+	stats->iterations = bench->iterations;
+	stats->warmup = bench->warmup;
+	stats->total_ns = bench->total;
+	stats->min_ns = bench->min;
+	stats->p50_ns = bench->p50;
+	stats->p99_ns = bench->p99;
+	stats->max_ns = bench->max;
+
+	return true;
+}
+
 static gboolean run_callback(gpointer user_data)
 {
 	struct test_case *test = user_data;
@@ -509,6 +797,12 @@ static gboolean run_callback(gpointer user_data)
 	test->stage = TEST_STAGE_RUN;
 
 	print_progress(test->name, COLOR_BLACK, "run");
+
+	if (test->bench) {
+		test->bench->count = 0;
+		return bench_callback(test);
+	}
+
 	test->test_func(test->test_data);
 
 	return FALSE;
@@ -554,7 +848,7 @@ void tester_pre_setup_failed(void)
 		return;
 
 	if (test->timeout_id > 0) {
-		timeout_remove(test->timeout_id);
+		g_source_remove(test->timeout_id);
 		test->timeout_id = 0;
 	}
 
@@ -576,7 +870,7 @@ void tester_pre_setup_abort(void)
 		return;
 
 	if (test->timeout_id > 0) {
-		timeout_remove(test->timeout_id);
+		g_source_remove(test->timeout_id);
 		test->timeout_id = 0;
 	}
 
@@ -627,7 +921,7 @@ void tester_setup_failed(void)
 	test->stage = TEST_STAGE_POST_TEARDOWN;
 
 	if (test->timeout_id > 0) {
-		timeout_remove(test->timeout_id);
+		g_source_remove(test->timeout_id);
 		test->timeout_id = 0;
 	}
 
@@ -650,7 +944,7 @@ static void test_result(enum test_result result)
 		return;
 
 	if (test->timeout_id > 0) {
-		timeout_remove(test->timeout_id);
+		g_source_remove(test->timeout_id);
 		test->timeout_id = 0;
 	}
 
@@ -780,7 +1074,7 @@ struct wait_data {
 	void *user_data;
 };
 
-static gboolean wait_callback(gpointer user_data)
+static bool wait_callback(void *user_data)
 {
 	struct wait_data *wait = user_data;
 	struct test_case *test = wait->test;
@@ -790,7 +1084,7 @@ static gboolean wait_callback(gpointer user_data)
 	if (wait->seconds > 0) {
 		print_progress(test->name, COLOR_BLACK, "%u seconds left",
 								wait->seconds);
-		return TRUE;
+		return true;
 	}
 
 	print_progress(test->name, COLOR_BLACK, "waiting done");
@@ -799,7 +1093,7 @@ static gboolean wait_callback(gpointer user_data)
 
 	free(wait);
 
-	return FALSE;
+	return false;
 }
 
 void tester_wait(unsigned int seconds, tester_wait_func_t func,
@@ -822,7 +1116,7 @@ void tester_wait(unsigned int seconds, tester_wait_func_t func,
 	wait->func = func;
 	wait->user_data = user_data;
 
-	g_timeout_add(1000, wait_callback, wait);
+	timeout_add(1000, wait_callback, wait, NULL);
 
 	print_progress(test->name, COLOR_BLACK, "waiting %u seconds", seconds);
 }
@@ -867,6 +1161,14 @@ static GOptionEntry options[] = {
 				"Run tests matching provided prefix" },
 	{ "string", 's', 0, G_OPTION_ARG_STRING, &option_string,
 				"Run tests matching provided string" },
+	{ "virtual-time", 't', 0, G_OPTION_ARG_NONE, &option_virtual_time,
+				"Run timeouts on a virtual clock" },
+	{ "bench", 'b', 0, G_OPTION_ARG_NONE, &option_bench,
+				"Run benchmarks with full iterations" },
+	{ "iterations", 'i', 0, G_OPTION_ARG_INT, &option_iterations,
+				"Override the number of benchmark iterations" },
+	{ "json", 'j', 0, G_OPTION_ARG_STRING, &option_json,
+				"Write benchmark results as JSON to file" },
 	{ NULL },
 };
 
@@ -896,6 +1198,9 @@ void tester_init(int *argc, char ***argv)
 
 	mainloop_init();
 
+	if (option_virtual_time == TRUE)
+		timeout_set_virtual_clock(true);
+
 	tester_name = strrchr(*argv[0], '/');
 	if (!tester_name)
 		tester_name = strdup(*argv[0]);
@@ -55,6 +55,29 @@ void tester_add(const char *name, const void *test_data,
 					tester_data_func_t test_func,
 					tester_data_func_t teardown_func);
 
+/* Benchmarks call tester_bench_iteration_complete() from bench_func (or
+ * once its asynchronous work is done) to finish each iteration.
+ */
+void tester_add_bench(const char *name, const void *test_data,
+					tester_data_func_t setup_func,
+					tester_data_func_t bench_func,
+					tester_data_func_t teardown_func,
+					unsigned int iterations);
+void tester_bench_iteration_complete(void);
+
+struct tester_bench_stats {
+	unsigned int iterations;
+	unsigned int warmup;
+	uint64_t total_ns;
+	uint64_t min_ns;
+	uint64_t p50_ns;
+	uint64_t p99_ns;
+	uint64_t max_ns;
+};
+
+/* Results of the current benchmark, available once it has passed */
+bool tester_bench_get_stats(struct tester_bench_stats *stats);
+
 void *tester_get_data(void);
 
 void tester_pre_setup_complete(void);
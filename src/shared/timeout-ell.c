@@ -109,3 +109,13 @@ unsigned int timeout_add_seconds(unsigned int timeout, timeout_func_t func,
 {
 	return timeout_add(timeout * 1000, func, user_data, destroy);
 }
+
+bool timeout_set_virtual_clock(bool enable)
+{
+	/* Not supported with ELL timeouts */
+	return !enable;
+}
+
+void timeout_hold_virtual_clock(bool hold)
+{
+}
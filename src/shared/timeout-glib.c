@@ -16,8 +16,31 @@ struct timeout_data {
 	timeout_func_t func;
 	timeout_destroy_func_t destroy;
 	void *user_data;
+	unsigned int id;
+	unsigned int interval;
+	guint64 expiry;
+	bool removed;
 };
 
+/* Virtual clock timeouts are kept sorted by expiry and fired by an idle
+ * source of the lowest priority, so time only advances (instantly) to
+ * the next deadline once nothing else is pending on the main loop.
+ *
+ * While an I/O callback is dispatching, e.g. from a nested main loop, the
+ * clock is held and follows real time instead of skipping ahead of it.
+ */
+#define VIRTUAL_ID_FLAG 0x80000000
+
+static bool virtual_clock;
+static guint64 virtual_now;
+static unsigned int virtual_id;
+static GList *virtual_list;
+static struct timeout_data *virtual_current;
+static guint virtual_source_id;
+static gint64 virtual_wait_start;
+static unsigned int virtual_holds;
+static bool virtual_yielded;
+
 static gboolean timeout_callback(gpointer user_data)
 {
 	struct timeout_data *data  = user_data;
@@ -38,12 +61,207 @@ static void timeout_destroy(gpointer user_data)
 	g_free(data);
 }
 
+static gint virtual_cmp(gconstpointer a, gconstpointer b)
+{
+	const struct timeout_data *data_a = a;
+	const struct timeout_data *data_b = b;
+
+	if (data_a->expiry != data_b->expiry)
+		return data_a->expiry < data_b->expiry ? -1 : 1;
+
+	return data_a->id < data_b->id ? -1 : data_a->id > data_b->id;
+}
+
+/* Account for the real time spent waiting for the next deadline */
+static void virtual_sync(void)
+{
+	gint64 now;
+
+	if (!virtual_wait_start)
+		return;
+
+	now = g_get_monotonic_time() / 1000;
+	virtual_now += now - virtual_wait_start;
+	virtual_wait_start = now;
+}
+
+static gboolean virtual_dispatch(gpointer user_data);
+
+static void virtual_schedule(void)
+{
+	if (virtual_source_id)
+		g_source_remove(virtual_source_id);
+
+	virtual_sync();
+	virtual_wait_start = 0;
+	virtual_source_id = 0;
+
+	if (virtual_list)
+		virtual_source_id = g_idle_add_full(G_PRIORITY_LOW,
+						virtual_dispatch, NULL, NULL);
+}
+
+static gboolean virtual_wait_done(gpointer user_data)
+{
+	virtual_source_id = 0;
+	virtual_schedule();
+
+	return FALSE;
+}
+
+static gboolean virtual_dispatch(gpointer user_data)
+{
+	struct timeout_data *data;
+	guint id = virtual_source_id;
+	bool result;
+
+	if (!virtual_list) {
+		virtual_source_id = 0;
+		return FALSE;
+	}
+
+	data = virtual_list->data;
+
+	if (data->expiry > virtual_now) {
+		if (virtual_holds) {
+			virtual_wait_start = g_get_monotonic_time() / 1000;
+			virtual_source_id = g_timeout_add(data->expiry -
+							virtual_now,
+							virtual_wait_done,
+							NULL);
+			return FALSE;
+		}
+
+		/* Let I/O that became ready since the last poll go first, a
+		 * source that is still ready on the next run has a lower
+		 * priority and would otherwise never be dispatched.
+		 */
+		if (!virtual_yielded && g_main_context_pending(NULL)) {
+			virtual_yielded = true;
+			return TRUE;
+		}
+
+		virtual_now = data->expiry;
+	}
+
+	virtual_yielded = false;
+
+	virtual_list = g_list_delete_link(virtual_list, virtual_list);
+
+	virtual_current = data;
+	result = data->func(data->user_data);
+	virtual_current = NULL;
+
+	if (result && !data->removed) {
+		data->expiry = virtual_now + data->interval;
+		virtual_list = g_list_insert_sorted(virtual_list, data,
+								virtual_cmp);
+	} else
+		timeout_destroy(data);
+
+	/* Rescheduled from within the callback */
+	if (virtual_source_id != id)
+		return FALSE;
+
+	if (virtual_list)
+		return TRUE;
+
+	virtual_source_id = 0;
+
+	return FALSE;
+}
+
+static unsigned int virtual_add(unsigned int timeout, timeout_func_t func,
+			void *user_data, timeout_destroy_func_t destroy)
+{
+	struct timeout_data *data;
+
+	data = g_try_new0(struct timeout_data, 1);
+	if (!data)
+		return 0;
+
+	data->func = func;
+	data->destroy = destroy;
+	data->user_data = user_data;
+	data->interval = timeout;
+
+	virtual_sync();
+	data->expiry = virtual_now + timeout;
+
+	if (++virtual_id & VIRTUAL_ID_FLAG)
+		virtual_id = 1;
+
+	data->id = virtual_id | VIRTUAL_ID_FLAG;
+
+	virtual_list = g_list_insert_sorted(virtual_list, data, virtual_cmp);
+
+	if (!virtual_source_id || virtual_list->data == data)
+		virtual_schedule();
+
+	return data->id;
+}
+
+static gint virtual_match_id(gconstpointer a, gconstpointer b)
+{
+	const struct timeout_data *data = a;
+
+	return data->id != GPOINTER_TO_UINT(b);
+}
+
+static void virtual_remove(unsigned int id)
+{
+	GList *l;
+
+	/* Removed from its own callback, destroyed once it returns */
+	if (virtual_current && virtual_current->id == id) {
+		virtual_current->removed = true;
+		return;
+	}
+
+	l = g_list_find_custom(virtual_list, GUINT_TO_POINTER(id),
+							virtual_match_id);
+	if (!l)
+		return;
+
+	timeout_destroy(l->data);
+	virtual_list = g_list_delete_link(virtual_list, l);
+}
+
+bool timeout_set_virtual_clock(bool enable)
+{
+	/* Switching clocks with timeouts pending would mix both domains */
+	if (virtual_list)
+		return false;
+
+	virtual_clock = enable;
+
+	return true;
+}
+
+void timeout_hold_virtual_clock(bool hold)
+{
+	if (hold) {
+		virtual_holds++;
+		return;
+	}
+
+	if (!virtual_holds)
+		return;
+
+	/* Skip ahead again once the I/O callbacks are done */
+	if (!--virtual_holds && virtual_wait_start)
+		virtual_schedule();
+}
+
 unsigned int timeout_add(unsigned int timeout, timeout_func_t func,
 			void *user_data, timeout_destroy_func_t destroy)
 {
 	struct timeout_data *data;
 	guint id;
 
+	if (virtual_clock)
+		return virtual_add(timeout, func, user_data, destroy);
+
 	data = g_try_new0(struct timeout_data, 1);
 	if (!data)
 		return 0;
@@ -67,6 +285,11 @@ void timeout_remove(unsigned int id)
 	if (!id)
 		return;
 
+	if (id & VIRTUAL_ID_FLAG) {
+		virtual_remove(id);
+		return;
+	}
+
 	source = g_main_context_find_source_by_id(NULL, id);
 	if (source)
 		g_source_destroy(source);
@@ -78,6 +301,9 @@ unsigned int timeout_add_seconds(unsigned int timeout, timeout_func_t func,
 	struct timeout_data *data;
 	guint id;
 
+	if (virtual_clock && timeout)
+		return virtual_add(timeout * 1000, func, user_data, destroy);
+
 	data = g_try_new0(struct timeout_data, 1);
 	if (!data)
 		return 0;
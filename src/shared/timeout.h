@@ -19,3 +19,6 @@ void timeout_remove(unsigned int id);
 
 unsigned int timeout_add_seconds(unsigned int timeout, timeout_func_t func,
 			void *user_data, timeout_destroy_func_t destroy);
+
+bool timeout_set_virtual_clock(bool enable);
+void timeout_hold_virtual_clock(bool hold);
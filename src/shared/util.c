@@ -313,6 +313,21 @@ ssize_t util_getrandom(void *buf, size_t buflen, unsigned int flags)
 #endif
 }
 
+/* Helper for clearing secrets in case explicit_bzero unavailable
+ * (glibc < 2.25), the volatile stores cannot be optimized away.
+ */
+void util_explicit_bzero(void *buf, size_t len)
+{
+#ifdef HAVE_EXPLICIT_BZERO
+	explicit_bzero(buf, len);
+#else
+	volatile uint8_t *p = buf;
+
+	while (len--)
+		*p++ = 0;
+#endif
+}
+
 /* Helpers for bitfield operations */
 
 /* Find unique id in range from 1 to max but no bigger than 64. */
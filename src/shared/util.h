@@ -153,6 +153,7 @@ bool util_ltv_foreach(const uint8_t *data, uint8_t len, uint8_t *type,
 unsigned char util_get_dt(const char *parent, const char *name);
 
 ssize_t util_getrandom(void *buf, size_t buflen, unsigned int flags);
+void util_explicit_bzero(void *buf, size_t len);
 
 uint8_t util_get_uid(uint64_t *bitmap, uint8_t max);
 void util_clear_uid(uint64_t *bitmap, uint8_t id);
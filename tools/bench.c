@@ -0,0 +1,661 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <syslog.h>
+#include <time.h>
+#include <inttypes.h>
+#include <sys/epoll.h>
+#include <sys/param.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+
+#include "src/shared/util.h"
+#include "tools/bench.h"
+
+#define BENCH_MAX_EVENTS	16
+
+/* Latency histogram with 8 linear sub-buckets per power of two (in usec),
+ * which keeps the percentile error under 12.5% over the whole range.
+ */
+#define HIST_SUB_BITS		3
+#define HIST_SUB		(1 << HIST_SUB_BITS)
+#define HIST_BUCKETS		(HIST_SUB * 30)
+
+struct bench_stream {
+	int sk;
+	unsigned int id;
+	bool done;
+	bool blocked;
+	uint32_t seq;
+	int remaining;
+	uint64_t next_tx;
+	uint64_t frames;
+	uint64_t bytes;
+	uint64_t errors;
+	uint64_t lost;
+	uint64_t reordered;
+	uint64_t blocked_count;
+	uint64_t late;
+	uint64_t timed;
+	uint64_t lat_min;
+	uint64_t lat_max;
+	uint64_t lat_sum;
+	int64_t last_transit;
+	double jitter;
+	uint64_t first_ts;
+	uint64_t last_ts;
+	uint64_t hist[HIST_BUCKETS];
+};
+
+struct bench {
+	char *name;
+	bool sender;
+	int epoll_fd;
+	int signal_fd;
+	uint8_t *buf;
+	size_t frame_len;
+	struct bench_stream *streams;
+	unsigned int num_streams;
+	unsigned int active;
+	uint64_t start;
+	uint64_t end;
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned int hist_index(uint64_t us)
+{
+	unsigned int msb, idx;
+
+	if (us < HIST_SUB)
+		return us;
+
+	msb = 63 - __builtin_clzll(us);
+	idx = (msb - HIST_SUB_BITS + 1) * HIST_SUB +
+			((us >> (msb - HIST_SUB_BITS)) & (HIST_SUB - 1));
+
+	return idx < HIST_BUCKETS ? idx : HIST_BUCKETS - 1;
+}
+
+static uint64_t hist_lower(unsigned int idx)
+{
+	unsigned int msb;
+
+	if (idx < HIST_SUB)
+		return idx;
+
+	msb = idx / HIST_SUB + HIST_SUB_BITS - 1;
+
+	return (uint64_t) (HIST_SUB + idx % HIST_SUB) <<
+						(msb - HIST_SUB_BITS);
+}
+
+static uint64_t hist_upper(unsigned int idx)
+{
+	if (idx < HIST_SUB)
+		return idx + 1;
+
+	return hist_lower(idx) +
+		(1ULL << (idx / HIST_SUB - 1));
+}
+
+static uint64_t hist_percentile(const struct bench_stream *s,
+							unsigned int pct)
+{
+	uint64_t target, sum = 0;
+	unsigned int i;
+
+	if (!s->timed)
+		return 0;
+
+	target = (s->timed * pct + 99) / 100;
+
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		sum += s->hist[i];
+		if (sum >= target)
+			return hist_upper(i);
+	}
+
+	return hist_upper(HIST_BUCKETS - 1);
+}
+
+struct bench *bench_new(const char *name, bool sender)
+{
+	struct bench *bench;
+
+	bench = calloc(1, sizeof(*bench));
+	if (!bench)
+		return NULL;
+
+	bench->name = strdup(name);
+	bench->sender = sender;
+	bench->epoll_fd = -1;
+	bench->signal_fd = -1;
+
+	return bench;
+}
+
+void bench_free(struct bench *bench)
+{
+	unsigned int i;
+
+	if (!bench)
+		return;
+
+	for (i = 0; i < bench->num_streams; i++)
+		close(bench->streams[i].sk);
+
+	if (bench->epoll_fd >= 0)
+		close(bench->epoll_fd);
+
+	if (bench->signal_fd >= 0)
+		close(bench->signal_fd);
+
+	free(bench->streams);
+	free(bench->buf);
+	free(bench->name);
+	free(bench);
+}
+
+bool bench_add_stream(struct bench *bench, int sk)
+{
+	struct bench_stream *streams, *s;
+	int flags;
+
+	if (!bench || sk < 0)
+		return false;
+
+	streams = realloc(bench->streams,
+			(bench->num_streams + 1) * sizeof(*streams));
+	if (!streams)
+		return false;
+
+	bench->streams = streams;
+
+	flags = fcntl(sk, F_GETFL, 0);
+	if (flags < 0)
+		flags = 0;
+
+	fcntl(sk, F_SETFL, flags | O_NONBLOCK);
+
+	s = &bench->streams[bench->num_streams];
+	memset(s, 0, sizeof(*s));
+	s->sk = sk;
+	s->id = bench->num_streams++;
+	s->lat_min = UINT64_MAX;
+
+	return true;
+}
+
+unsigned int bench_get_num_streams(struct bench *bench)
+{
+	return bench ? bench->num_streams : 0;
+}
+
+static void stream_done(struct bench *bench, struct bench_stream *s)
+{
+	if (s->done)
+		return;
+
+	s->done = true;
+	bench->active--;
+
+	epoll_ctl(bench->epoll_fd, EPOLL_CTL_DEL, s->sk, NULL);
+}
+
+static void stream_set_events(struct bench *bench, struct bench_stream *s,
+							uint32_t events)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.ptr = s;
+
+	epoll_ctl(bench->epoll_fd, EPOLL_CTL_MOD, s->sk, &ev);
+}
+
+static void stream_rx_frame(struct bench_stream *s, const uint8_t *buf,
+						ssize_t len, uint64_t now)
+{
+	uint64_t sent, lat;
+	int64_t transit, d;
+	uint32_t seq;
+
+	if (len >= BENCH_LEN_SIZE && get_le32(buf + 4) != (uint32_t) len) {
+		s->errors++;
+		return;
+	}
+
+	if (!s->frames)
+		s->first_ts = now;
+
+	s->last_ts = now;
+	s->frames++;
+	s->bytes += len;
+
+	/* Too short to carry a sequence number, only count it */
+	if (len < BENCH_SEQ_SIZE)
+		return;
+
+	seq = get_le32(buf);
+
+	if (s->frames == 1)
+		s->seq = seq;
+
+	if (seq > s->seq) {
+		s->lost += seq - s->seq;
+		s->seq = seq + 1;
+	} else if (seq < s->seq) {
+		s->reordered++;
+		if (s->lost)
+			s->lost--;
+	} else
+		s->seq++;
+
+	if (len < BENCH_HDR_SIZE)
+		return;
+
+	sent = get_le64(buf + 8);
+	lat = now > sent ? now - sent : 0;
+	transit = (int64_t) lat;
+
+	if (s->timed) {
+		d = transit - s->last_transit;
+		if (d < 0)
+			d = -d;
+
+		/* Interarrival jitter estimator from RFC 3550 */
+		s->jitter += ((double) d - s->jitter) / 16.0;
+	}
+
+	s->last_transit = transit;
+
+	if (lat < s->lat_min)
+		s->lat_min = lat;
+
+	if (lat > s->lat_max)
+		s->lat_max = lat;
+
+	s->lat_sum += lat;
+	s->hist[hist_index(lat / 1000)]++;
+	s->timed++;
+}
+
+static void frame_put_hdr(uint8_t *buf, size_t len, uint32_t seq)
+{
+	uint8_t hdr[BENCH_HDR_SIZE];
+
+	put_le32(seq, hdr);
+	put_le32(len, hdr + 4);
+	put_le64(now_ns(), hdr + 8);
+
+	memcpy(buf, hdr, MIN(len, sizeof(hdr)));
+}
+
+static void stream_recv(struct bench *bench, struct bench_stream *s,
+							int num_frames)
+{
+	ssize_t len;
+
+	while (!s->done) {
+		len = recv(s->sk, bench->buf, bench->frame_len, 0);
+		if (len < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				return;
+
+			syslog(LOG_ERR, "Stream %u: read failed: %s (%d)",
+					s->id, strerror(errno), errno);
+			stream_done(bench, s);
+			return;
+		}
+
+		if (!len) {
+			stream_done(bench, s);
+			return;
+		}
+
+		stream_rx_frame(s, bench->buf, len, now_ns());
+
+		if (num_frames > 0 && s->frames >= (uint64_t) num_frames)
+			stream_done(bench, s);
+	}
+}
+
+static void stream_send(struct bench *bench, struct bench_stream *s,
+				unsigned int interval_us, uint64_t now)
+{
+	uint64_t interval = (uint64_t) interval_us * 1000;
+	ssize_t len;
+
+	while (!s->done && !s->blocked) {
+		if (interval && s->next_tx > now)
+			return;
+
+		frame_put_hdr(bench->buf, bench->frame_len, s->seq);
+
+		len = send(s->sk, bench->buf, bench->frame_len, 0);
+		if (len < 0) {
+			if (errno == EAGAIN || errno == ENOBUFS) {
+				s->blocked = true;
+				s->blocked_count++;
+				stream_set_events(bench, s, EPOLLOUT);
+				return;
+			}
+
+			if (errno == EINTR)
+				continue;
+
+			syslog(LOG_ERR, "Stream %u: send failed: %s (%d)",
+					s->id, strerror(errno), errno);
+			s->errors++;
+			stream_done(bench, s);
+			return;
+		}
+
+		if (!s->frames)
+			s->first_ts = now;
+
+		s->last_ts = now;
+		s->seq++;
+		s->frames++;
+		s->bytes += len;
+
+		if (s->remaining > 0 && !--s->remaining) {
+			stream_done(bench, s);
+			return;
+		}
+
+		if (!interval)
+			continue;
+
+		s->next_tx += interval;
+
+		/* Don't try to catch up with a burst once a full interval
+		 * behind, just account it and resynchronize.
+		 */
+		if (s->next_tx + interval <= now) {
+			s->late++;
+			s->next_tx = now + interval;
+		}
+	}
+}
+
+static int next_timeout(struct bench *bench, unsigned int interval_us,
+							uint64_t now)
+{
+	uint64_t next = UINT64_MAX;
+	unsigned int i;
+
+	if (!bench->sender || !interval_us)
+		return -1;
+
+	for (i = 0; i < bench->num_streams; i++) {
+		struct bench_stream *s = &bench->streams[i];
+
+		if (s->done || s->blocked)
+			continue;
+
+		if (s->next_tx < next)
+			next = s->next_tx;
+	}
+
+	if (next == UINT64_MAX)
+		return -1;
+
+	if (next <= now)
+		return 0;
+
+	/* Round up so we never wake up before the deadline */
+	return (next - now + 999999) / 1000000;
+}
+
+static int setup_signals(struct bench *bench)
+{
+	struct epoll_event ev;
+	sigset_t mask;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+
+	if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0)
+		return -errno;
+
+	bench->signal_fd = signalfd(-1, &mask, SFD_CLOEXEC);
+	if (bench->signal_fd < 0)
+		return -errno;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+
+	if (epoll_ctl(bench->epoll_fd, EPOLL_CTL_ADD, bench->signal_fd,
+								&ev) < 0)
+		return -errno;
+
+	return 0;
+}
+
+int bench_run(struct bench *bench, size_t frame_len, int num_frames,
+						unsigned int interval_us)
+{
+	struct epoll_event events[BENCH_MAX_EVENTS];
+	unsigned int i;
+	uint64_t now;
+	int err;
+
+	if (!bench || !bench->num_streams)
+		return -EINVAL;
+
+	if (!frame_len)
+		return -EINVAL;
+
+	bench->buf = malloc(frame_len);
+	if (!bench->buf)
+		return -ENOMEM;
+
+	bench->frame_len = frame_len;
+
+	for (i = BENCH_HDR_SIZE; i < frame_len; i++)
+		bench->buf[i] = 0x7f;
+
+	bench->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (bench->epoll_fd < 0)
+		return -errno;
+
+	err = setup_signals(bench);
+	if (err < 0)
+		return err;
+
+	bench->start = now_ns();
+
+	for (i = 0; i < bench->num_streams; i++) {
+		struct bench_stream *s = &bench->streams[i];
+		struct epoll_event ev;
+
+		memset(&ev, 0, sizeof(ev));
+		ev.events = bench->sender ? 0 : EPOLLIN;
+		ev.data.ptr = s;
+
+		if (epoll_ctl(bench->epoll_fd, EPOLL_CTL_ADD, s->sk, &ev) < 0)
+			return -errno;
+
+		s->remaining = num_frames;
+		s->next_tx = bench->start;
+		bench->active++;
+	}
+
+	syslog(LOG_INFO, "%s %u streams ...",
+			bench->sender ? "Sending on" : "Receiving on",
+			bench->num_streams);
+
+	while (bench->active) {
+		int n;
+
+		now = now_ns();
+
+		if (bench->sender) {
+			for (i = 0; i < bench->num_streams; i++)
+				stream_send(bench, &bench->streams[i],
+							interval_us, now);
+
+			if (!bench->active)
+				break;
+		}
+
+		n = epoll_wait(bench->epoll_fd, events, BENCH_MAX_EVENTS,
+					next_timeout(bench, interval_us,
+								now_ns()));
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+
+			err = -errno;
+			break;
+		}
+
+		for (i = 0; i < (unsigned int) n; i++) {
+			struct bench_stream *s = events[i].data.ptr;
+
+			/* Interrupted, report what we have so far */
+			if (!s) {
+				bench->active = 0;
+				break;
+			}
+
+			if (s->done)
+				continue;
+
+			if (events[i].events & EPOLLIN)
+				stream_recv(bench, s, num_frames);
+
+			if (events[i].events & EPOLLOUT) {
+				s->blocked = false;
+				stream_set_events(bench, s, 0);
+			}
+
+			if (events[i].events & (EPOLLERR | EPOLLHUP))
+				stream_done(bench, s);
+		}
+	}
+
+	bench->end = now_ns();
+
+	return err;
+}
+
+static void print_stream_json(struct bench *bench, struct bench_stream *s,
+							FILE *fp)
+{
+	uint64_t duration = s->last_ts - s->first_ts;
+	unsigned int i;
+	bool first = true;
+
+	fprintf(fp, "    {\n");
+	fprintf(fp, "      \"id\": %u,\n", s->id);
+	fprintf(fp, "      \"frames\": %" PRIu64 ",\n", s->frames);
+	fprintf(fp, "      \"bytes\": %" PRIu64 ",\n", s->bytes);
+	fprintf(fp, "      \"duration_us\": %" PRIu64 ",\n", duration / 1000);
+	fprintf(fp, "      \"throughput_kbps\": %.2f,\n", duration ?
+			(double) s->bytes * 8 * 1000000.0 / duration : 0.0);
+	fprintf(fp, "      \"errors\": %" PRIu64 ",\n", s->errors);
+
+	if (bench->sender) {
+		fprintf(fp, "      \"blocked\": %" PRIu64 ",\n",
+							s->blocked_count);
+		fprintf(fp, "      \"late\": %" PRIu64 "\n", s->late);
+		fprintf(fp, "    }");
+		return;
+	}
+
+	fprintf(fp, "      \"lost\": %" PRIu64 ",\n", s->lost);
+	fprintf(fp, "      \"loss_ratio\": %.6f,\n", s->frames + s->lost ?
+			(double) s->lost / (s->frames + s->lost) : 0.0);
+	fprintf(fp, "      \"reordered\": %" PRIu64 ",\n", s->reordered);
+	fprintf(fp, "      \"timed\": %" PRIu64 ",\n", s->timed);
+	fprintf(fp, "      \"latency_us\": { \"min\": %" PRIu64
+			", \"avg\": %.1f, \"max\": %" PRIu64
+			", \"p50\": %" PRIu64 ", \"p90\": %" PRIu64
+			", \"p99\": %" PRIu64 " },\n",
+			s->timed ? s->lat_min / 1000 : 0,
+			s->timed ? (double) s->lat_sum / s->timed / 1000 : 0,
+			s->lat_max / 1000,
+			hist_percentile(s, 50), hist_percentile(s, 90),
+			hist_percentile(s, 99));
+	fprintf(fp, "      \"jitter_us\": %.1f,\n", s->jitter / 1000);
+	fprintf(fp, "      \"histogram\": [");
+
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		if (!s->hist[i])
+			continue;
+
+		fprintf(fp, "%s[%" PRIu64 ", %" PRIu64 "]", first ? "" : ", ",
+						hist_lower(i), s->hist[i]);
+		first = false;
+	}
+
+	fprintf(fp, "]\n    }");
+}
+
+void bench_print_json(struct bench *bench, FILE *fp)
+{
+	uint64_t frames = 0, bytes = 0, lost = 0, duration;
+	unsigned int i;
+
+	if (!bench)
+		return;
+
+	duration = bench->end > bench->start ? bench->end - bench->start : 0;
+
+	fprintf(fp, "{\n");
+	fprintf(fp, "  \"name\": \"%s\",\n", bench->name);
+	fprintf(fp, "  \"role\": \"%s\",\n",
+				bench->sender ? "sender" : "receiver");
+	fprintf(fp, "  \"frame_size\": %zu,\n", bench->frame_len);
+	fprintf(fp, "  \"duration_us\": %" PRIu64 ",\n", duration / 1000);
+	fprintf(fp, "  \"streams\": [\n");
+
+	for (i = 0; i < bench->num_streams; i++) {
+		struct bench_stream *s = &bench->streams[i];
+
+		print_stream_json(bench, s, fp);
+		fprintf(fp, "%s\n", i + 1 < bench->num_streams ? "," : "");
+
+		frames += s->frames;
+		bytes += s->bytes;
+		lost += s->lost;
+	}
+
+	fprintf(fp, "  ],\n");
+	fprintf(fp, "  \"total\": { \"frames\": %" PRIu64
+			", \"bytes\": %" PRIu64 ", \"lost\": %" PRIu64
+			", \"throughput_kbps\": %.2f }\n",
+			frames, bytes, lost, duration ?
+			(double) bytes * 8 * 1000000.0 / duration : 0.0);
+	fprintf(fp, "}\n");
+	fflush(fp);
+}
@@ -0,0 +1,34 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Benchmark frames start with a 32-bit sequence number, the 32-bit frame
+ * length and the 64-bit CLOCK_MONOTONIC send time in nanoseconds, so one-way
+ * latency is only meaningful when both ends run on the same host (e.g. btvirt
+ * or vhci emulation). Frames shorter than the header carry the fields that
+ * fit, and are only accounted for what they carry.
+ */
+#define BENCH_SEQ_SIZE		4
+#define BENCH_LEN_SIZE		8
+#define BENCH_HDR_SIZE		16
+
+struct bench;
+
+struct bench *bench_new(const char *name, bool sender);
+void bench_free(struct bench *bench);
+
+/* The socket is owned by the benchmark once added */
+bool bench_add_stream(struct bench *bench, int sk);
+unsigned int bench_get_num_streams(struct bench *bench);
+
+int bench_run(struct bench *bench, size_t frame_len, int num_frames,
+						unsigned int interval_us);
+
+void bench_print_json(struct bench *bench, FILE *fp);
@@ -36,6 +36,8 @@
 #include "src/shared/mainloop.h"
 #include "src/shared/btsnoop.h"
 
+#include "monitor/filter.h"
+
 #define MONITOR_INDEX_NONE 0xffff
 
 struct monitor_hdr {
@@ -45,6 +47,7 @@ struct monitor_hdr {
 } __attribute__ ((packed));
 
 static struct btsnoop *btsnoop_file = NULL;
+static struct filter *filter = NULL;
 
 static void data_callback(int fd, uint32_t events, void *user_data)
 {
@@ -99,6 +102,9 @@ static void data_callback(int fd, uint32_t events, void *user_data)
 		index  = le16_to_cpu(hdr.index);
 		pktlen = le16_to_cpu(hdr.len);
 
+		if (!filter_match(filter, index, opcode, buf, pktlen))
+			continue;
+
 		btsnoop_write_hci(btsnoop_file, tv, index, opcode, 0, buf,
 									pktlen);
 	}
@@ -196,6 +202,8 @@ static void usage(void)
 		"\t-p, --parents          Create basename parent directories\n"
 		"\t-l, --limit <limit>    Limit traces file size (rotate)\n"
 		"\t-c, --count <count>    Limit number of rotated files\n"
+		"\t-f, --filter <expr>    Only save matching HCI packets\n"
+		"\t-z, --compress         Save traces in compressed blocks\n"
 		"\t-v, --version          Show version\n"
 		"\t-h, --help             Show help options\n");
 }
@@ -205,6 +213,8 @@ static const struct option main_options[] = {
 	{ "parents",	no_argument,		NULL, 'p' },
 	{ "limit",	required_argument,	NULL, 'l' },
 	{ "count",	required_argument,	NULL, 'c' },
+	{ "filter",	required_argument,	NULL, 'f' },
+	{ "compress",	no_argument,		NULL, 'z' },
 	{ "version",	no_argument,		NULL, 'v' },
 	{ "help",	no_argument,		NULL, 'h' },
 	{ }
@@ -263,6 +273,7 @@ int main(int argc, char *argv[])
 	unsigned long max_count = 0;
 	size_t size_limit = 0;
 	bool parents = false;
+	bool compress = false;
 	int exit_status;
 	char *endptr;
 
@@ -273,7 +284,7 @@ int main(int argc, char *argv[])
 	while (true) {
 		int opt;
 
-		opt = getopt_long(argc, argv, "b:l:c:vhp", main_options,
+		opt = getopt_long(argc, argv, "b:l:c:f:zvhp", main_options,
 									NULL);
 		if (opt < 0)
 			break;
@@ -314,6 +325,15 @@ int main(int argc, char *argv[])
 		case 'c':
 			max_count = strtoul(optarg, &endptr, 10);
 			break;
+		case 'f':
+			filter_free(filter);
+			filter = filter_compile(optarg);
+			if (!filter)
+				return EXIT_FAILURE;
+			break;
+		case 'z':
+			compress = true;
+			break;
 		case 'p':
 			if (getppid() != 1) {
 				fprintf(stderr, "Parents option allowed only "
@@ -345,7 +365,11 @@ int main(int argc, char *argv[])
 	if (parents && create_dir(path) < 0)
 		return EXIT_FAILURE;
 
-	btsnoop_file = btsnoop_create(path, size_limit, max_count,
+	if (compress)
+		btsnoop_file = btsnoop_create_compressed(path, size_limit,
+					max_count, BTSNOOP_FORMAT_MONITOR);
+	else
+		btsnoop_file = btsnoop_create(path, size_limit, max_count,
 							BTSNOOP_FORMAT_MONITOR);
 	if (!btsnoop_file)
 		return EXIT_FAILURE;
@@ -362,6 +386,7 @@ int main(int argc, char *argv[])
 	mainloop_sd_notify("STATUS=Quitting");
 
 	btsnoop_unref(btsnoop_file);
+	filter_free(filter);
 
 	return exit_status;
 }
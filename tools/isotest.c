@@ -42,6 +42,7 @@
 #include "lib/iso.h"
 
 #include "src/shared/util.h"
+#include "tools/bench.h"
 
 #define NSEC_USEC(_t) (_t / 1000L)
 #define SEC_USEC(_t)  (_t  * 1000000L)
@@ -82,6 +83,9 @@ static bool inout;
 
 static uint8_t num_bis = 1;
 
+static struct bench *bench;
+static unsigned int num_streams;
+
 struct lookup_table {
 	const char *name;
 	int flag;
@@ -588,6 +592,18 @@ static void do_listen(char *filename,
 		if (nsk < 0)
 			continue;
 
+		/* Benchmark serves all streams from a single process */
+		if (bench) {
+			bench_add_stream(bench, nsk);
+
+			if (bench_get_num_streams(bench) < num_streams)
+				continue;
+
+			close(sk);
+			handler(fd, nsk, peer);
+			break;
+		}
+
 		if (fork()) {
 			/* Parent */
 			close(nsk);
@@ -631,6 +647,20 @@ error:
 	exit(1);
 }
 
+static void bench_recv_mode(int fd, int sk, char *peer)
+{
+	int err;
+
+	err = bench_run(bench, data_size, -1, 0);
+	if (err < 0)
+		syslog(LOG_ERR, "Benchmark failed: %s (%d)", strerror(-err),
+									-err);
+
+	bench_print_json(bench, stdout);
+	bench_free(bench);
+	exit(err < 0 ? 1 : 0);
+}
+
 static void dump_mode(int fd, int sk, char *peer)
 {
 	int len;
@@ -975,6 +1005,75 @@ static void send_mode(char *filename, char *peer, int i, bool repeat)
 	do_send(sk, fd, peer, repeat);
 }
 
+static void bench_send_mode(char **peers, int count)
+{
+	struct bt_iso_qos qos;
+	struct bt_iso_io_qos *out;
+	socklen_t len;
+	int i, sk = -1, err;
+
+	mgmt_set_experimental();
+
+	bench = bench_new("isotest", true);
+
+	for (i = 0; i < count; i++) {
+		if (!strcmp(peers[i], "00:00:00:00:00:00") && num_bis > 1) {
+			int *sk_arr = bcast_do_connect_mbis(num_bis, peers[i]);
+
+			if (!sk_arr)
+				exit(1);
+
+			for (int j = 0; j < num_bis; j++)
+				bench_add_stream(bench, sk_arr[j]);
+
+			sk = sk_arr[0];
+			free(sk_arr);
+			continue;
+		}
+
+		sk = do_connect(peers[i]);
+		if (sk < 0) {
+			syslog(LOG_ERR, "Can't connect to the server: %s (%d)",
+							strerror(errno), errno);
+			exit(1);
+		}
+
+		bench_add_stream(bench, sk);
+	}
+
+	/* Pace every stream at the SDU interval of the first one */
+	if (!strcmp(peers[0], "00:00:00:00:00:00"))
+		out = &qos.bcast.out;
+	else
+		out = &qos.ucast.out;
+
+	memset(&qos, 0, sizeof(qos));
+	len = sizeof(qos);
+	if (getsockopt(sk, SOL_BLUETOOTH, BT_ISO_QOS, &qos, &len) < 0) {
+		syslog(LOG_ERR, "Can't get Output QoS socket option: %s (%d)",
+				strerror(errno), errno);
+
+		/* Fall back to the requested QoS */
+		qos = *iso_qos;
+		if (!out->sdu)
+			out->sdu = data_size;
+
+		syslog(LOG_INFO, "Using requested SDU %u interval %u usec",
+						out->sdu, out->interval);
+	}
+
+	if (!out->interval)
+		syslog(LOG_WARNING, "No SDU interval, sending unpaced");
+
+	err = bench_run(bench, out->sdu, -1, out->interval);
+	if (err < 0)
+		syslog(LOG_ERR, "Benchmark failed: %s (%d)", strerror(-err),
+									-err);
+
+	bench_print_json(bench, stdout);
+	bench_free(bench);
+}
+
 static void reconnect_mode(char *peer)
 {
 	mgmt_set_experimental();
@@ -1125,6 +1224,7 @@ static void usage(void)
 		"\t-s, --send [filename,...] connect and send "
 		"(client/broadcaster)\n"
 		"\t-n, --silent             connect and be silent (client)\n"
+		"\t-x, --bench [streams]    benchmark send/receive streams\n"
 		"Options:\n"
 		"\t[-b, --bytes <value>]\n"
 		"\t[-i, --device <num>]\n"
@@ -1156,6 +1256,7 @@ static const struct option main_options[] = {
 	{ "receive",   optional_argument, NULL, 'r'},
 	{ "send",      optional_argument, NULL, 's'},
 	{ "silent",    no_argument,       NULL, 'n'},
+	{ "bench",     optional_argument, NULL, 'x'},
 	{ "bytes",     required_argument, NULL, 'b'},
 	{ "index",     required_argument, NULL, 'i'},
 	{ "jitter",    required_argument, NULL, 'j'},
@@ -1205,6 +1306,7 @@ int main(int argc, char *argv[])
 	int sk, mode = RECV;
 	char *filename = NULL;
 	bool repeat = false;
+	bool use_bench = false;
 	unsigned int i;
 	uint8_t nconn = 1;
 	char *peer;
@@ -1218,7 +1320,7 @@ int main(int argc, char *argv[])
 		int opt;
 
 		opt = getopt_long(argc, argv,
-			"d::cmr::s::nb:i:j:hqt:CV:W:M:S:P:F:I:L:Y:R:B:G:T:e:k:N:",
+			"d::cmr::s::nx::b:i:j:hqt:CV:W:M:S:P:F:I:L:Y:R:B:G:T:e:k:N:",
 			main_options, NULL);
 		if (opt < 0)
 			break;
@@ -1254,6 +1356,12 @@ int main(int argc, char *argv[])
 			mode = CONNECT;
 			break;
 
+		case 'x':
+			use_bench = true;
+			if (optarg)
+				num_streams = atoi(optarg);
+			break;
+
 		case 'b':
 			if (optarg && atoi(optarg) < MAX_DATA_SIZE)
 				data_size = atoi(optarg);
@@ -1429,6 +1537,31 @@ int main(int argc, char *argv[])
 
 	openlog("isotest", LOG_PERROR | LOG_PID, LOG_LOCAL0);
 
+	if (use_bench) {
+		if (!num_streams)
+			num_streams = num_bis;
+
+		switch (mode) {
+		case SEND:
+			if (!(argc - optind)) {
+				usage();
+				exit(1);
+			}
+
+			bench_send_mode(argv + optind, argc - optind);
+			goto done;
+
+		case RECV:
+			bench = bench_new("isotest", false);
+			do_listen(NULL, bench_recv_mode, argc - optind ?
+						argv[optind] : NULL);
+			goto done;
+		default:
+			usage();
+			exit(1);
+		}
+	}
+
 	if (!(argc - optind)) {
 		switch (mode) {
 		case RECV:
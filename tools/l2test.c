@@ -37,6 +37,7 @@
 
 #include "src/shared/util.h"
 #include "monitor/display.h"
+#include "tools/bench.h"
 
 #define NIBBLE_TO_ASCII(c)  ((c) < 0x0a ? (c) + 0x30 : (c) + 0x57)
 
@@ -63,6 +64,8 @@ enum {
 	CSENDRECV,
 	INFOREQ,
 	PAIRING,
+	BENCHRECV,
+	BENCHSEND,
 };
 
 static unsigned char *buf;
@@ -109,6 +112,11 @@ static int seq_start = 0;
 
 static const char *filename = NULL;
 
+/* Benchmark streams and per stream frame interval in usec */
+static struct bench *bench = NULL;
+static unsigned int num_streams = 1;
+static unsigned int bench_interval = 0;
+
 static int rfcmode = 0;
 static int central = 0;
 static int auth = 0;
@@ -693,7 +701,8 @@ static void do_listen(void (*handler)(int sk))
 							strerror(errno), errno);
 			goto error;
 		}
-		if (fork()) {
+		/* Benchmark serves all streams from a single process */
+		if (!bench && fork()) {
 			/* Parent */
 			close(nsk);
 			continue;
@@ -771,6 +780,16 @@ static void do_listen(void (*handler)(int sk))
 			}
 		}
 
+		if (bench) {
+			bench_add_stream(bench, nsk);
+
+			if (bench_get_num_streams(bench) < num_streams) {
+				syslog(LOG_INFO, "Waiting for %u more streams",
+				num_streams - bench_get_num_streams(bench));
+				continue;
+			}
+		}
+
 		handler(nsk);
 		close(sk);
 
@@ -1065,6 +1084,50 @@ static void send_and_recv_mode(int sk)
 	return;
 }
 
+static void bench_run_streams(long size)
+{
+	int err;
+
+	err = bench_run(bench, size, num_frames, bench_interval);
+	if (err < 0)
+		syslog(LOG_ERR, "Benchmark failed: %s (%d)", strerror(-err),
+									-err);
+
+	bench_print_json(bench, stdout);
+}
+
+static void bench_recv_mode(int sk)
+{
+	/* Connectionless channels only have the listening socket */
+	if (!bench_get_num_streams(bench))
+		bench_add_stream(bench, sk);
+
+	bench_run_streams(data_size < 0 ? imtu : data_size);
+	bench_free(bench);
+}
+
+static void bench_send_mode(char *svr)
+{
+	unsigned int i;
+	int sk;
+
+	for (i = 0; i < num_streams; i++) {
+		sk = do_connect(svr);
+		if (sk < 0)
+			exit(1);
+
+		bench_add_stream(bench, sk);
+	}
+
+	bench_run_streams(data_size < 0 ? omtu : data_size);
+
+	if (disc_delay)
+		usleep(disc_delay);
+
+	syslog(LOG_INFO, "Closing %u streams ...", num_streams);
+	bench_free(bench);
+}
+
 static void reconnect_mode(char *svr)
 {
 	while (1) {
@@ -1327,7 +1390,9 @@ static void usage(void)
 		"\t-c connect, disconnect, connect, ...\n"
 		"\t-m multiple connects\n"
 		"\t-p trigger dedicated bonding\n"
-		"\t-z information request\n");
+		"\t-z information request\n"
+		"\t-l listen and benchmark incoming streams\n"
+		"\t-o connect and benchmark outgoing streams\n");
 
 	printf("Options:\n"
 		"\t[-b bytes] [-i device] [-P psm] [-J cid]\n"
@@ -1356,7 +1421,9 @@ static void usage(void)
 		"\t[-M] become central\n"
 		"\t[-T] enable timestamps\n"
 		"\t[-V type] address type (help for list, default = bredr)\n"
-		"\t[-e seq] initial sequence value (default = 0)\n");
+		"\t[-e seq] initial sequence value (default = 0)\n"
+		"\t[-f num] number of benchmark streams (default = 1)\n"
+		"\t[-v useconds] benchmark frame interval (default = 0)\n");
 }
 
 int main(int argc, char *argv[])
@@ -1366,7 +1433,7 @@ int main(int argc, char *argv[])
 
 	bacpy(&bdaddr, BDADDR_ANY);
 
-	while ((opt = getopt(argc, argv, "a:b:cde:g:i:mnpqrstuwxyz"
+	while ((opt = getopt(argc, argv, "a:b:cde:f:g:i:lmnopqrstuv:wxyz"
 		"AB:C:D:EF:GH:I:J:K:L:MN:O:P:Q:RSTUV:W:X:Y:Z:")) != EOF) {
 		switch (opt) {
 		case 'r':
@@ -1433,6 +1500,25 @@ int main(int argc, char *argv[])
 			need_addr = 1;
 			break;
 
+		case 'l':
+			mode = BENCHRECV;
+			break;
+
+		case 'o':
+			mode = BENCHSEND;
+			need_addr = 1;
+			break;
+
+		case 'f':
+			num_streams = atoi(optarg);
+			if (!num_streams)
+				num_streams = 1;
+			break;
+
+		case 'v':
+			bench_interval = atoi(optarg);
+			break;
+
 		case 'b':
 			data_size = atoi(optarg);
 			break;
@@ -1685,6 +1771,16 @@ int main(int argc, char *argv[])
 		case PAIRING:
 			do_pairing(argv[optind]);
 			exit(0);
+
+		case BENCHRECV:
+			bench = bench_new("l2test", false);
+			do_listen(bench_recv_mode);
+			break;
+
+		case BENCHSEND:
+			bench = bench_new("l2test", true);
+			bench_send_mode(argv[optind]);
+			break;
 	}
 
 	syslog(LOG_INFO, "Exit");
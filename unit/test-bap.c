@@ -8633,6 +8633,41 @@ static void test_bsrc_str(void)
 	test_bsrc_str_2b();
 }
 
+static void bench_base_bis(uint8_t sid, uint8_t bis, uint8_t sgrp,
+				struct iovec *caps, struct iovec *meta,
+				struct bt_bap_qos *qos, void *user_data)
+{
+	unsigned int *count = user_data;
+
+	(*count)++;
+}
+
+/* Parse the BASE of a two BIS broadcast, as done for every PA report */
+static void bench_parse_base(const void *user_data)
+{
+	static const uint8_t base[] = {
+		BASE_LC3(40000, 1, 2, LC3_CFG_48_4, 0x00, 0x01, 0x00,
+								0x02, 0x00)
+	};
+	struct iovec iov = { (void *) base, sizeof(base) };
+	struct bt_bap_qos qos;
+	unsigned int count = 0;
+
+	memset(&qos, 0, sizeof(qos));
+
+	g_assert(bt_bap_parse_base(0x00, &iov, &qos, NULL, bench_base_bis,
+								&count));
+	g_assert_cmpint(count, ==, 2);
+
+	tester_bench_iteration_complete();
+}
+
+static void test_bench(void)
+{
+	tester_add_bench("BAP/bench/parse-base", NULL, NULL, bench_parse_base,
+								NULL, 0);
+}
+
 int main(int argc, char *argv[])
 {
 	tester_init(&argc, &argv);
@@ -8643,6 +8678,7 @@ int main(int argc, char *argv[])
 	test_bsnk_scc();
 	test_bsnk_str();
 	test_bsrc_str();
+	test_bench();
 
 	return tester_run();
 }
@@ -0,0 +1,430 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <endian.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include "src/shared/btsnoop.h"
+#include "src/shared/tester.h"
+
+#define PKT_COUNT	100
+#define PKT_USEC	100000		/* 10 packets per second */
+
+struct test_data {
+	bool compressed;
+};
+
+/* Block header of compressed files, all fields big endian */
+struct block_hdr {
+	uint32_t type;
+	uint32_t len;
+	uint32_t size;
+	uint32_t count;
+	uint64_t first_ts;
+	uint64_t last_ts;
+} __attribute__ ((packed));
+
+#define FILE_HDR_SIZE	16
+
+static void pkt_time(unsigned int i, struct timeval *tv)
+{
+	tv->tv_sec = 1700000000 + i * PKT_USEC / 1000000;
+	tv->tv_usec = i * PKT_USEC % 1000000;
+}
+
+/* Repetitive payloads of varying length so blocks do compress */
+static uint16_t pkt_data(unsigned int i, uint8_t *data)
+{
+	uint16_t len = 4 + (i * 37) % 200;
+	uint16_t j;
+
+	for (j = 0; j < len; j++)
+		data[j] = (j % 8) ? i : j;
+
+	return len;
+}
+
+static void write_pkts(struct btsnoop *btsnoop, unsigned int first,
+							unsigned int last)
+{
+	uint8_t buf[256];
+	unsigned int i;
+
+	for (i = first; i < last; i++) {
+		struct timeval tv;
+		uint16_t len = pkt_data(i, buf);
+
+		pkt_time(i, &tv);
+
+		g_assert(btsnoop_write_hci(btsnoop, &tv, i % 3,
+						BTSNOOP_OPCODE_ACL_TX_PKT, 0,
+						buf, len));
+	}
+}
+
+static char *create_file(const struct test_data *data, off_t *size)
+{
+	char *path = g_strdup("/tmp/test-btsnoop-XXXXXX");
+	struct btsnoop *btsnoop;
+	struct stat st;
+	int fd;
+
+	fd = mkstemp(path);
+	g_assert(fd >= 0);
+	close(fd);
+
+	if (data->compressed)
+		btsnoop = btsnoop_create_compressed(path, 0, 0,
+						BTSNOOP_FORMAT_MONITOR);
+	else
+		btsnoop = btsnoop_create(path, 0, 0, BTSNOOP_FORMAT_MONITOR);
+
+	g_assert(btsnoop);
+
+	write_pkts(btsnoop, 0, PKT_COUNT);
+
+	btsnoop_unref(btsnoop);
+
+	g_assert(stat(path, &st) == 0);
+
+	if (size)
+		*size = st.st_size;
+
+	return path;
+}
+
+/* Reads packets starting with packet first, returns how many were read */
+static unsigned int read_pkts(struct btsnoop *btsnoop, unsigned int first)
+{
+	uint8_t buf[BTSNOOP_MAX_PACKET_SIZE], expect[256];
+	unsigned int i;
+
+	for (i = first; ; i++) {
+		struct timeval tv, expect_tv;
+		uint16_t index, opcode, size, len;
+
+		if (!btsnoop_read_hci(btsnoop, &tv, &index, &opcode, buf,
+								&size))
+			break;
+
+		g_assert_cmpuint(i, <, PKT_COUNT);
+
+		pkt_time(i, &expect_tv);
+		len = pkt_data(i, expect);
+
+		g_assert_cmpint(tv.tv_sec, ==, expect_tv.tv_sec);
+		g_assert_cmpint(tv.tv_usec, ==, expect_tv.tv_usec);
+		g_assert_cmpuint(index, ==, i % 3);
+		g_assert_cmpuint(opcode, ==, BTSNOOP_OPCODE_ACL_TX_PKT);
+		g_assert_cmpuint(size, ==, len);
+		g_assert(!memcmp(buf, expect, len));
+	}
+
+	return i - first;
+}
+
+static void test_round_trip(const void *user_data)
+{
+	const struct test_data *data = user_data;
+	struct btsnoop *btsnoop;
+	off_t size;
+	char *path;
+
+	path = create_file(data, &size);
+
+	btsnoop = btsnoop_open(path, 0);
+	g_assert(btsnoop);
+	g_assert_cmpuint(btsnoop_get_format(btsnoop), ==,
+						BTSNOOP_FORMAT_MONITOR);
+
+	g_assert_cmpuint(read_pkts(btsnoop, 0), ==, PKT_COUNT);
+
+	btsnoop_unref(btsnoop);
+
+	if (data->compressed) {
+		struct test_data plain = { .compressed = false };
+		off_t plain_size;
+		char *plain_path;
+
+		plain_path = create_file(&plain, &plain_size);
+		tester_debug("Compressed %lld of %lld bytes",
+				(long long) size, (long long) plain_size);
+		g_assert_cmpint(size, <, plain_size);
+
+		unlink(plain_path);
+		g_free(plain_path);
+	}
+
+	unlink(path);
+	g_free(path);
+
+	tester_test_passed();
+}
+
+static void seek_check(const char *path, unsigned int pkt)
+{
+	struct btsnoop *btsnoop;
+	struct timeval tv;
+
+	btsnoop = btsnoop_open(path, 0);
+	g_assert(btsnoop);
+
+	pkt_time(pkt, &tv);
+	g_assert(btsnoop_seek(btsnoop, &tv));
+	g_assert_cmpuint(read_pkts(btsnoop, pkt), ==, PKT_COUNT - pkt);
+
+	/* Seeking backwards works as well */
+	pkt_time(pkt / 2, &tv);
+	g_assert(btsnoop_seek(btsnoop, &tv));
+	g_assert_cmpuint(read_pkts(btsnoop, pkt / 2), ==,
+							PKT_COUNT - pkt / 2);
+
+	/* Past the last packet there is nothing to read */
+	pkt_time(PKT_COUNT, &tv);
+	g_assert(!btsnoop_seek(btsnoop, &tv));
+	g_assert_cmpuint(read_pkts(btsnoop, PKT_COUNT), ==, 0);
+
+	btsnoop_unref(btsnoop);
+}
+
+static void test_seek(const void *user_data)
+{
+	const struct test_data *data = user_data;
+	char *path;
+
+	path = create_file(data, NULL);
+
+	/* The middle of a block and the first packet of one */
+	seek_check(path, 53);
+	seek_check(path, 44);
+
+	unlink(path);
+	g_free(path);
+
+	tester_test_passed();
+}
+
+static void read_block_hdr(int fd, off_t offset, struct block_hdr *hdr)
+{
+	g_assert(pread(fd, hdr, sizeof(*hdr), offset) == sizeof(*hdr));
+}
+
+/* Without the index, left behind when a capture is not closed properly,
+ * seeking walks the blocks.
+ */
+static void test_seek_no_index(const void *user_data)
+{
+	struct block_hdr hdr;
+	off_t offset = FILE_HDR_SIZE;
+	char *path;
+	int fd;
+
+	path = create_file(user_data, NULL);
+
+	fd = open(path, O_RDWR);
+	g_assert(fd >= 0);
+
+	/* Cut the file right before the index block */
+	for (;;) {
+		read_block_hdr(fd, offset, &hdr);
+		if (be32toh(hdr.type) == 3)
+			break;
+
+		offset += sizeof(hdr) + be32toh(hdr.len);
+	}
+
+	g_assert(ftruncate(fd, offset) == 0);
+	close(fd);
+
+	seek_check(path, 53);
+
+	unlink(path);
+	g_free(path);
+
+	tester_test_passed();
+}
+
+/* Only the records of the complete blocks are returned */
+static void test_truncated(const void *user_data)
+{
+	struct btsnoop *btsnoop;
+	struct block_hdr hdr[2];
+	off_t offset;
+	char *path;
+	int fd;
+
+	path = create_file(user_data, NULL);
+
+	fd = open(path, O_RDWR);
+	g_assert(fd >= 0);
+
+	read_block_hdr(fd, FILE_HDR_SIZE, &hdr[0]);
+	offset = FILE_HDR_SIZE + sizeof(hdr[0]) + be32toh(hdr[0].len);
+	read_block_hdr(fd, offset, &hdr[1]);
+
+	g_assert(ftruncate(fd, offset + sizeof(hdr[1]) +
+					be32toh(hdr[1].len) / 2) == 0);
+	close(fd);
+
+	btsnoop = btsnoop_open(path, 0);
+	g_assert(btsnoop);
+	g_assert_cmpuint(read_pkts(btsnoop, 0), ==, be32toh(hdr[0].count));
+	btsnoop_unref(btsnoop);
+
+	unlink(path);
+	g_free(path);
+
+	tester_test_passed();
+}
+
+static void corrupt_check(const char *path, off_t offset, const void *buf,
+						size_t len, unsigned int count)
+{
+	struct btsnoop *btsnoop;
+	int fd;
+
+	fd = open(path, O_RDWR);
+	g_assert(fd >= 0);
+	g_assert(pwrite(fd, buf, len, offset) == (ssize_t) len);
+	close(fd);
+
+	btsnoop = btsnoop_open(path, 0);
+	g_assert(btsnoop);
+	g_assert_cmpuint(read_pkts(btsnoop, 0), ==, count);
+	btsnoop_unref(btsnoop);
+}
+
+static void test_corrupt(const void *user_data)
+{
+	const uint32_t size = htobe32(0x100000);
+	const uint32_t type = htobe32(0x42);
+	const uint8_t token = 0xff;
+	uint32_t short_size;
+	struct block_hdr hdr[2];
+	off_t offset;
+	char *path;
+	int fd;
+
+	path = create_file(user_data, NULL);
+
+	fd = open(path, O_RDONLY);
+	g_assert(fd >= 0);
+	read_block_hdr(fd, FILE_HDR_SIZE, &hdr[0]);
+	offset = FILE_HDR_SIZE + sizeof(hdr[0]) + be32toh(hdr[0].len);
+	read_block_hdr(fd, offset, &hdr[1]);
+	close(fd);
+
+	/* Decompressed data longer than the stated original length */
+	g_assert_cmpuint(be32toh(hdr[1].type), ==, 1);
+	short_size = htobe32(be32toh(hdr[1].size) - 1);
+	corrupt_check(path, offset + 8, &short_size, sizeof(short_size),
+						be32toh(hdr[0].count));
+
+	/* Literal length running past the end of the compressed data */
+	corrupt_check(path, offset + sizeof(hdr[1]), &token, 1,
+						be32toh(hdr[0].count));
+
+	/* Unknown block type */
+	corrupt_check(path, offset, &type, sizeof(type),
+						be32toh(hdr[0].count));
+
+	/* Block larger than the maximum block size */
+	corrupt_check(path, FILE_HDR_SIZE + 8, &size, sizeof(size), 0);
+
+	unlink(path);
+	g_free(path);
+
+	tester_test_passed();
+}
+
+/* A file continued after being closed reads back as one capture */
+static void test_append(const void *user_data)
+{
+	char *path = g_strdup("/tmp/test-btsnoop-XXXXXX");
+	struct test_data compressed = { .compressed = true };
+	struct btsnoop *btsnoop;
+	char *compressed_path;
+	int fd;
+
+	fd = mkstemp(path);
+	g_assert(fd >= 0);
+	close(fd);
+
+	/* Empty files get a header */
+	btsnoop = btsnoop_append(path, BTSNOOP_FORMAT_MONITOR);
+	g_assert(btsnoop);
+	write_pkts(btsnoop, 0, PKT_COUNT / 2);
+	btsnoop_unref(btsnoop);
+
+	btsnoop = btsnoop_append(path, BTSNOOP_FORMAT_MONITOR);
+	g_assert(btsnoop);
+	write_pkts(btsnoop, PKT_COUNT / 2, PKT_COUNT);
+	btsnoop_unref(btsnoop);
+
+	btsnoop = btsnoop_open(path, 0);
+	g_assert(btsnoop);
+	g_assert_cmpuint(read_pkts(btsnoop, 0), ==, PKT_COUNT);
+	btsnoop_unref(btsnoop);
+
+	/* Neither another format nor compressed files can be continued */
+	g_assert(!btsnoop_append(path, BTSNOOP_FORMAT_HCI));
+
+	compressed_path = create_file(&compressed, NULL);
+	g_assert(!btsnoop_append(compressed_path, BTSNOOP_FORMAT_MONITOR));
+
+	unlink(compressed_path);
+	g_free(compressed_path);
+	unlink(path);
+	g_free(path);
+
+	tester_test_passed();
+}
+
+static const struct test_data plain_data = {
+	.compressed = false,
+};
+
+static const struct test_data compressed_data = {
+	.compressed = true,
+};
+
+int main(int argc, char *argv[])
+{
+	tester_init(&argc, &argv);
+
+	tester_add("/btsnoop/plain", &plain_data, NULL, test_round_trip,
+									NULL);
+	tester_add("/btsnoop/compressed", &compressed_data, NULL,
+						test_round_trip, NULL);
+	tester_add("/btsnoop/seek/plain", &plain_data, NULL, test_seek,
+									NULL);
+	tester_add("/btsnoop/seek/compressed", &compressed_data, NULL,
+							test_seek, NULL);
+	tester_add("/btsnoop/seek/no-index", &compressed_data, NULL,
+						test_seek_no_index, NULL);
+	tester_add("/btsnoop/truncated", &compressed_data, NULL,
+						test_truncated, NULL);
+	tester_add("/btsnoop/corrupt", &compressed_data, NULL,
+						test_corrupt, NULL);
+	tester_add("/btsnoop/append", NULL, NULL, test_append, NULL);
+
+	return tester_run();
+}
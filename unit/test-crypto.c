@@ -13,6 +13,7 @@
 #endif
 
 #include "src/shared/crypto.h"
+#include "src/shared/resolver.h"
 #include "src/shared/util.h"
 #include "src/shared/tester.h"
 
@@ -383,6 +384,147 @@ static void test_sih(const void *data)
 	tester_test_passed();
 }
 
+/* Core ah and CSIP sih sample data, laid out like an RPA or an RSI */
+static const uint8_t resolver_irk[16] = {
+			0x9b, 0x7d, 0x39, 0x0a, 0xa6, 0x10, 0x10, 0x34,
+			0x05, 0xad, 0xc8, 0x57, 0xa3, 0x34, 0x02, 0xec };
+static const uint8_t resolver_rpa[6] = { 0xaa, 0xfb, 0x0d, 0x94, 0x81, 0x70 };
+
+static const uint8_t resolver_sirk[16] = {
+			0xcd, 0xcc, 0x72, 0xdd, 0x86, 0x8c, 0xcd, 0xce,
+			0x22, 0xfd, 0xa1, 0x21, 0x09, 0x7d, 0x7d, 0x45 };
+static const uint8_t resolver_rsi[6] = { 0xda, 0x48, 0x19, 0x63, 0xf5, 0x69 };
+
+static void test_resolver_ah(const void *data)
+{
+	struct bt_resolver *resolver;
+	uint8_t val[6];
+	int a, b;
+
+	resolver = bt_resolver_new(60);
+
+	g_assert(bt_resolver_add_key(resolver, resolver_sirk, &b));
+	g_assert(bt_resolver_add_key(resolver, resolver_irk, &a));
+
+	g_assert(bt_resolver_resolve(resolver, resolver_rpa) == &a);
+
+	/* A different hash must not resolve */
+	memcpy(val, resolver_rpa, 6);
+	val[0] ^= 0x01;
+	g_assert(!bt_resolver_resolve(resolver, val));
+
+	bt_resolver_free(resolver);
+
+	tester_test_passed();
+}
+
+static void test_resolver_sih(const void *data)
+{
+	struct bt_resolver *resolver;
+	int a, b;
+
+	resolver = bt_resolver_new(60);
+
+	g_assert(bt_resolver_add_key(resolver, resolver_irk, &a));
+	g_assert(bt_resolver_add_key(resolver, resolver_sirk, &b));
+
+	g_assert(bt_resolver_resolve(resolver, resolver_rsi) == &b);
+
+	bt_resolver_free(resolver);
+
+	tester_test_passed();
+}
+
+static void test_resolver_cache(const void *data)
+{
+	struct bt_resolver *resolver;
+	int a, b;
+
+	resolver = bt_resolver_new(60);
+
+	/* A cached miss is dropped once a matching key is added */
+	g_assert(bt_resolver_add_key(resolver, resolver_sirk, &b));
+	g_assert(!bt_resolver_resolve(resolver, resolver_rpa));
+
+	g_assert(bt_resolver_add_key(resolver, resolver_irk, &a));
+	g_assert(bt_resolver_resolve(resolver, resolver_rpa) == &a);
+	g_assert(bt_resolver_resolve(resolver, resolver_rpa) == &a);
+
+	/* A cached hit is dropped once its key is removed */
+	g_assert(bt_resolver_remove_key(resolver, &a));
+	g_assert(!bt_resolver_remove_key(resolver, &a));
+	g_assert(!bt_resolver_resolve(resolver, resolver_rpa));
+
+	/* Replacing the key of b moves the hit over */
+	g_assert(bt_resolver_add_key(resolver, resolver_irk, &b));
+	g_assert(bt_resolver_resolve(resolver, resolver_rpa) == &b);
+	g_assert(!bt_resolver_resolve(resolver, resolver_rsi));
+
+	bt_resolver_free(resolver);
+
+	tester_test_passed();
+}
+
+/* A single operation is too short to be timed against the main loop, so
+ * each benchmark iteration runs a batch of them.
+ */
+#define BENCH_BATCH	64
+
+static const uint8_t bench_key[16] = {
+			0xec, 0x02, 0x34, 0xa3, 0x57, 0xc8, 0xad, 0x05,
+			0x34, 0x10, 0x10, 0xa6, 0x0a, 0x39, 0x7d, 0x9b };
+
+static void bench_ah(const void *data)
+{
+	uint8_t r[3] = { 0x00, 0x81, 0x70 }, hash[3];
+	int i;
+
+	for (i = 0; i < BENCH_BATCH; i++) {
+		r[0] = i;
+
+		if (!bt_crypto_ah(crypto, bench_key, r, hash)) {
+			tester_test_failed();
+			return;
+		}
+	}
+
+	tester_bench_iteration_complete();
+}
+
+static void bench_sign_att(const void *data)
+{
+	const uint8_t m[20] = { 0xd2, 0x12, 0x00, 0x13, 0x37 };
+	uint8_t signature[12];
+	int i;
+
+	for (i = 0; i < BENCH_BATCH; i++) {
+		if (!bt_crypto_sign_att(crypto, bench_key, m, sizeof(m), i,
+								signature)) {
+			tester_test_failed();
+			return;
+		}
+	}
+
+	tester_bench_iteration_complete();
+}
+
+static void bench_gatt_hash(const void *data)
+{
+	uint8_t db[512] = { 0x01, 0x00, 0x00, 0x28, 0x00, 0x18 };
+	struct iovec iov = { .iov_base = db, .iov_len = sizeof(db) };
+	uint8_t res[16];
+	int i;
+
+	for (i = 0; i < BENCH_BATCH; i++) {
+		if (!bt_crypto_gatt_hash(crypto, &iov, 1, res)) {
+			tester_test_failed();
+			return;
+		}
+	}
+
+	tester_bench_iteration_complete();
+}
+
 int main(int argc, char *argv[])
 {
 	int exit_status;
@@ -412,6 +554,18 @@ int main(int argc, char *argv[])
 	tester_add("/crypto/sef", NULL, NULL, test_sef, NULL);
 	tester_add("/crypto/sih", NULL, NULL, test_sih, NULL);
 
+	tester_add("/crypto/resolver/ah", NULL, NULL, test_resolver_ah, NULL);
+	tester_add("/crypto/resolver/sih", NULL, NULL, test_resolver_sih,
+									NULL);
+	tester_add("/crypto/resolver/cache", NULL, NULL, test_resolver_cache,
+									NULL);
+
+	tester_add_bench("/crypto/bench/ah", NULL, NULL, bench_ah, NULL, 0);
+	tester_add_bench("/crypto/bench/sign_att", NULL, NULL, bench_sign_att,
+								NULL, 0);
+	tester_add_bench("/crypto/bench/gatt_hash", NULL, NULL,
+						bench_gatt_hash, NULL, 0);
+
 	exit_status = tester_run();
 
 	bt_crypto_unref(crypto);
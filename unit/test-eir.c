@@ -21,6 +21,7 @@
 #include "lib/sdp.h"
 #include "src/shared/tester.h"
 #include "src/shared/util.h"
+#include "src/shared/queue.h"
 #include "src/shared/ad.h"
 #include "src/eir.h"
 
@@ -736,6 +737,138 @@ static const struct test_data uri_beacon_test = {
 	.uuid = uri_beacon_uuid,
 };
 
+struct matcher_pattern {
+	uint8_t type;
+	uint8_t offset;
+	uint8_t len;
+	uint8_t data[4];
+	bool match;
+};
+
+/* Flags, manufacturer 0x004c, service data 0x180d and appearance */
+static const uint8_t matcher_data[] = {
+		0x02, 0x01, 0x06,
+		0x05, 0xff, 0x4c, 0x00, 0x02, 0x15,
+		0x05, 0x16, 0x0d, 0x18, 0xaa, 0xbb,
+		0x03, 0x19, 0x41, 0x03,
+};
+
+static const struct matcher_pattern matcher_patterns[] = {
+	{ BT_AD_MANUFACTURER_DATA, 0, 2, { 0x4c, 0x00 }, true },
+	{ BT_AD_MANUFACTURER_DATA, 2, 2, { 0x02, 0x15 }, true },
+	{ BT_AD_MANUFACTURER_DATA, 0, 2, { 0x4c, 0x01 }, false },
+	{ BT_AD_MANUFACTURER_DATA, 3, 2, { 0x15, 0x00 }, false },
+	{ BT_AD_SERVICE_DATA16, 0, 2, { 0xaa, 0xbb }, true },
+	{ BT_AD_SERVICE_DATA128, 1, 1, { 0xbb }, true },
+	{ BT_AD_SERVICE_DATA16, 1, 1, { 0xaa }, false },
+	{ BT_AD_FLAGS, 0, 1, { 0x06 }, true },
+	{ BT_AD_FLAGS, 0, 1, { 0x04 }, false },
+	{ BT_AD_GAP_APPEARANCE, 0, 2, { 0x41, 0x03 }, true },
+	{ BT_AD_GAP_APPEARANCE, 1, 2, { 0x03, 0x00 }, false },
+	{ BT_AD_TX_POWER, 0, 1, { 0x00 }, false },
+};
+
+#define MATCHER_SETS	(ARRAY_SIZE(matcher_patterns) + 1)
+
+static void matcher_found(void *data, void *user_data)
+{
+	unsigned int *found = user_data;
+	unsigned int i = PTR_TO_UINT(data) - 1;
+
+	/* Every set is reported at most once */
+	g_assert(!(found[i / 32] & (1u << (i % 32))));
+	found[i / 32] |= 1u << (i % 32);
+}
+
+static void matcher_check(struct bt_ad_matcher *matcher, struct bt_ad *ad,
+					struct queue **sets, const bool *added)
+{
+	unsigned int found[(MATCHER_SETS + 31) / 32];
+	unsigned int i;
+
+	memset(found, 0, sizeof(found));
+	bt_ad_matcher_match(matcher, ad, matcher_found, found);
+
+	for (i = 0; i < MATCHER_SETS; i++) {
+		bool match = added[i] && bt_ad_pattern_match(ad, sets[i]);
+
+		tester_debug("set %u: %s", i, match ? "match" : "no match");
+		g_assert(!!(found[i / 32] & (1u << (i % 32))) == match);
+	}
+}
+
+static void test_matcher(const void *data)
+{
+	struct bt_ad_matcher *matcher;
+	struct queue *sets[MATCHER_SETS];
+	bool added[MATCHER_SETS];
+	struct bt_ad *ad;
+	unsigned int i;
+
+	ad = bt_ad_new_with_data(sizeof(matcher_data), matcher_data);
+	g_assert(ad);
+
+	matcher = bt_ad_matcher_new();
+
+	/* One set per pattern, the last one combines two of them */
+	for (i = 0; i < MATCHER_SETS; i++) {
+		sets[i] = queue_new();
+
+		if (i == MATCHER_SETS - 1) {
+			queue_push_tail(sets[i], bt_ad_pattern_new(
+					BT_AD_MANUFACTURER_DATA, 0, 2,
+					(const uint8_t *) "\x4c\x01"));
+			queue_push_tail(sets[i], bt_ad_pattern_new(
+					BT_AD_FLAGS, 0, 1,
+					(const uint8_t *) "\x06"));
+		} else {
+			const struct matcher_pattern *p = &matcher_patterns[i];
+
+			queue_push_tail(sets[i], bt_ad_pattern_new(p->type,
+						p->offset, p->len, p->data));
+			g_assert(!!bt_ad_pattern_match(ad, sets[i]) ==
+								p->match);
+		}
+
+		g_assert(bt_ad_matcher_add(matcher, sets[i],
+						UINT_TO_PTR(i + 1)));
+		added[i] = true;
+	}
+
+	matcher_check(matcher, ad, sets, added);
+
+	/* Matching again must report the same sets */
+	matcher_check(matcher, ad, sets, added);
+
+	/* Removed sets are no longer reported */
+	for (i = 0; i < MATCHER_SETS; i += 2) {
+		g_assert(bt_ad_matcher_remove(matcher, UINT_TO_PTR(i + 1)));
+		added[i] = false;
+	}
+
+	g_assert(!bt_ad_matcher_remove(matcher, UINT_TO_PTR(1)));
+
+	matcher_check(matcher, ad, sets, added);
+
+	/* Sets can be added back */
+	for (i = 0; i < MATCHER_SETS; i += 4) {
+		g_assert(bt_ad_matcher_add(matcher, sets[i],
+						UINT_TO_PTR(i + 1)));
+		added[i] = true;
+	}
+
+	matcher_check(matcher, ad, sets, added);
+
+	bt_ad_matcher_free(matcher);
+
+	for (i = 0; i < MATCHER_SETS; i++)
+		queue_destroy(sets[i], free);
+
+	bt_ad_unref(ad);
+
+	tester_test_passed();
+}
+
 int main(int argc, char *argv[])
 {
 	tester_init(&argc, &argv);
@@ -767,6 +900,7 @@ int main(int argc, char *argv[])
 									NULL);
 	tester_add("ad/g-tag", &gigaset_gtag_test, NULL, test_parsing, NULL);
 	tester_add("ad/uri-beacon", &uri_beacon_test, NULL, test_parsing, NULL);
+	tester_add("/ad/matcher", NULL, NULL, test_matcher, NULL);
 
 	return tester_run();
 }
@@ -328,6 +328,7 @@ struct test_step {
 	uint8_t expected_att_ecode;
 	const uint8_t *value;
 	uint16_t length;
+	uint8_t features;
 };
 
 static void destroy_context(struct context *context)
@@ -653,6 +654,7 @@ static struct context *create_context(uint16_t mtu, gconstpointer data)
 {
 	struct context *context = g_new0(struct context, 1);
 	const struct test_data *test_data = data;
+	const struct test_step *step = test_data->step;
 	GIOChannel *channel;
 	int err, sv[2];
 
@@ -684,7 +686,8 @@ static struct context *create_context(uint16_t mtu, gconstpointer data)
 		g_assert(context->client_db);
 
 		context->client = bt_gatt_client_new(context->client_db,
-							context->att, mtu, 0);
+						context->att, mtu,
+						step ? step->features : 0);
 		g_assert(context->client);
 
 		bt_gatt_client_set_debug(context->client, print_debug,
@@ -2137,6 +2140,154 @@ static const struct test_step test_multiple_read_6 = {
 	.expected_att_ecode = 0x0c
 };
 
+static const uint8_t batch_data_1[] = { 0x01, 0x02, 0x03 };
+static const uint8_t batch_data_2[] = { 0x04, 0x05 };
+static const uint8_t batch_data_3[] = { 0x06, 0x07, 0x08, 0x09, 0x0a };
+
+static const struct iovec batch_value_1 = {
+	.iov_base = (void *) batch_data_1,
+	.iov_len = sizeof(batch_data_1),
+};
+
+static const struct iovec batch_value_2 = {
+	.iov_base = (void *) batch_data_2,
+	.iov_len = sizeof(batch_data_2),
+};
+
+static const struct iovec batch_value_3 = {
+	.iov_base = (void *) batch_data_3,
+	.iov_len = sizeof(batch_data_3),
+};
+
+static struct context *batch_context;
+static unsigned int batch_pending;
+
+static void batch_read_cb(bool success, uint8_t att_ecode,
+					const uint8_t *value, uint16_t length,
+					void *user_data)
+{
+	const struct iovec *iov = user_data;
+
+	g_assert(success);
+	g_assert_cmpint(length, ==, iov->iov_len);
+	g_assert(!memcmp(value, iov->iov_base, length));
+
+	if (!--batch_pending)
+		context_quit(batch_context);
+}
+
+static void batch_cancelled_cb(bool success, uint8_t att_ecode,
+					const uint8_t *value, uint16_t length,
+					void *user_data)
+{
+	g_assert_not_reached();
+}
+
+static unsigned int batch_read(struct context *context, uint16_t handle,
+					const struct iovec *iov)
+{
+	unsigned int id;
+
+	id = bt_gatt_client_read_long_value(context->client, handle, 0,
+					batch_read_cb, (void *) iov, NULL);
+	g_assert(id);
+
+	batch_pending++;
+
+	return id;
+}
+
+static void test_batch_read(struct context *context)
+{
+	batch_context = context;
+	batch_pending = 0;
+
+	g_assert(bt_gatt_client_batch_begin(context->client));
+	batch_read(context, 0x0003, &batch_value_1);
+	batch_read(context, 0x0007, &batch_value_2);
+	batch_read(context, 0x0008, &batch_value_3);
+	g_assert(bt_gatt_client_batch_end(context->client));
+}
+
+/* The cancelled read in the middle still has its tuple in the response */
+static void test_batch_read_cancel(struct context *context)
+{
+	unsigned int id;
+
+	batch_context = context;
+	batch_pending = 0;
+
+	g_assert(bt_gatt_client_batch_begin(context->client));
+	batch_read(context, 0x0003, &batch_value_1);
+	id = bt_gatt_client_read_long_value(context->client, 0x0007, 0,
+						batch_cancelled_cb, NULL,
+						NULL);
+	g_assert(id);
+	batch_read(context, 0x0008, &batch_value_3);
+	g_assert(bt_gatt_client_batch_end(context->client));
+
+	g_assert(bt_gatt_client_cancel(context->client, id));
+}
+
+static void test_batch_read_truncated(struct context *context)
+{
+	batch_context = context;
+	batch_pending = 0;
+
+	g_assert(bt_gatt_client_batch_begin(context->client));
+	batch_read(context, 0x0003, &batch_value_1);
+	batch_read(context, 0x0008, &batch_value_3);
+	batch_read(context, 0x0007, &batch_value_2);
+	g_assert(bt_gatt_client_batch_end(context->client));
+}
+
+static void batch_write_cb(bool success, uint8_t att_ecode, void *user_data)
+{
+	g_assert(success);
+
+	if (!--batch_pending)
+		context_quit(batch_context);
+}
+
+/* The write goes out after the reads batched before it */
+static void test_batch_read_write(struct context *context)
+{
+	static const uint8_t value[] = { 0x01 };
+
+	batch_context = context;
+	batch_pending = 0;
+
+	g_assert(bt_gatt_client_batch_begin(context->client));
+	batch_read(context, 0x0003, &batch_value_1);
+	batch_read(context, 0x0007, &batch_value_2);
+	g_assert(bt_gatt_client_write_value(context->client, 0x0008, value,
+						sizeof(value), batch_write_cb,
+						NULL, NULL));
+	batch_pending++;
+	batch_read(context, 0x0008, &batch_value_3);
+	g_assert(bt_gatt_client_batch_end(context->client));
+}
+
+static const struct test_step test_batch_read_1 = {
+	.func = test_batch_read,
+	.features = BT_GATT_CHRC_CLI_FEAT_EATT,
+};
+
+static const struct test_step test_batch_read_2 = {
+	.func = test_batch_read_cancel,
+	.features = BT_GATT_CHRC_CLI_FEAT_EATT,
+};
+
+static const struct test_step test_batch_read_3 = {
+	.func = test_batch_read_truncated,
+	.features = BT_GATT_CHRC_CLI_FEAT_EATT,
+};
+
+static const struct test_step test_batch_read_4 = {
+	.func = test_batch_read_write,
+	.features = BT_GATT_CHRC_CLI_FEAT_EATT,
+};
+
 static void read_by_type_cb(bool success, uint8_t att_ecode,
 						struct bt_gatt_result *result,
 						void *user_data)
@@ -2412,6 +2563,326 @@ static void test_hash_db(gconstpointer data)
 	context_quit(context);
 }
 
+#define HASH_SVC_1	0x0001
+#define HASH_SVC_2	0x0010
+#define HASH_SVC_3	0x0020
+
+/* Service with a characteristic and a CCC stored in the db */
+static struct gatt_db_attribute *add_hash_service(struct gatt_db *db,
+						uint16_t handle, bool active)
+{
+	struct gatt_db_attribute *svc;
+	bt_uuid_t uuid;
+
+	bt_uuid16_create(&uuid, 0x1800 + handle);
+	svc = gatt_db_insert_service(db, handle, &uuid, true, 4);
+	g_assert(svc);
+
+	bt_uuid16_create(&uuid, 0x2a00 + handle);
+	g_assert(gatt_db_service_add_characteristic(svc, &uuid,
+						BT_ATT_PERM_READ,
+						BT_GATT_CHRC_PROP_READ |
+						BT_GATT_CHRC_PROP_NOTIFY,
+						NULL, NULL, NULL));
+
+	bt_uuid16_create(&uuid, GATT_CLIENT_CHARAC_CFG_UUID);
+	g_assert(gatt_db_service_add_descriptor(svc, &uuid,
+						BT_ATT_PERM_READ |
+						BT_ATT_PERM_WRITE,
+						NULL, NULL, NULL));
+
+	gatt_db_service_set_active(svc, active);
+
+	return svc;
+}
+
+static void write_hash_ccc(struct gatt_db *db, uint16_t value)
+{
+	struct gatt_db_attribute *ccc;
+	uint8_t pdu[2];
+
+	ccc = gatt_db_get_attribute(db, HASH_SVC_1 + 3);
+	g_assert(ccc);
+
+	put_le16(value, pdu);
+	g_assert(gatt_db_attribute_write(ccc, 0, pdu, sizeof(pdu), 0, NULL,
+							NULL, NULL));
+}
+
+/* Database built from scratch, so its hash cannot come from a cache */
+static struct gatt_db *make_hash_db(bool svc_2, bool svc_3_active, bool ccc)
+{
+	struct gatt_db *db = gatt_db_new();
+
+	add_hash_service(db, HASH_SVC_1, true);
+
+	if (svc_2)
+		add_hash_service(db, HASH_SVC_2, true);
+
+	add_hash_service(db, HASH_SVC_3, svc_3_active);
+
+	if (ccc)
+		write_hash_ccc(db, 0x0001);
+
+	return db;
+}
+
+static void check_hash(struct gatt_db *db, struct gatt_db *ref)
+{
+	g_assert(!memcmp(gatt_db_get_hash(db), gatt_db_get_hash(ref), 16));
+
+	gatt_db_unref(ref);
+}
+
+static void test_hash_cache(gconstpointer data)
+{
+	struct gatt_db *db = make_hash_db(false, true, false);
+	struct gatt_db_attribute *svc, *ccc;
+	uint8_t hash[16];
+
+	memcpy(hash, gatt_db_get_hash(db), sizeof(hash));
+
+	/* Insert a service between two others */
+	svc = add_hash_service(db, HASH_SVC_2, true);
+	check_hash(db, make_hash_db(true, true, false));
+	g_assert(memcmp(gatt_db_get_hash(db), hash, sizeof(hash)));
+
+	gatt_db_remove_service(db, svc);
+	check_hash(db, make_hash_db(false, true, false));
+	g_assert(!memcmp(gatt_db_get_hash(db), hash, sizeof(hash)));
+
+	/* Inactive services are not part of the hash */
+	svc = gatt_db_get_attribute(db, HASH_SVC_3);
+	gatt_db_service_set_active(svc, false);
+	check_hash(db, make_hash_db(false, false, false));
+
+	gatt_db_service_set_active(svc, true);
+	g_assert(!memcmp(gatt_db_get_hash(db), hash, sizeof(hash)));
+
+	/* A descriptor counts once it has a value, not by its value */
+	write_hash_ccc(db, 0x0001);
+	check_hash(db, make_hash_db(false, true, true));
+	g_assert(memcmp(gatt_db_get_hash(db), hash, sizeof(hash)));
+
+	write_hash_ccc(db, 0x0002);
+	check_hash(db, make_hash_db(false, true, true));
+
+	ccc = gatt_db_get_attribute(db, HASH_SVC_1 + 3);
+	gatt_db_attribute_reset(ccc);
+	g_assert(!memcmp(gatt_db_get_hash(db), hash, sizeof(hash)));
+
+	gatt_db_unref(db);
+
+	tester_test_passed();
+}
+
+/* Each side has two bearers, the second attached like an EATT channel */
+struct eatt_context {
+	struct bt_att *client_att;
+	struct bt_att *server_att;
+	struct bt_gatt_client *client;
+	struct bt_gatt_server *server;
+	struct gatt_db *client_db;
+	struct gatt_db *server_db;
+	int fds[2];
+	struct bt_att_chan *chans[2];
+	unsigned int find_info[2];
+	unsigned int concurrent;
+};
+
+static struct eatt_context eatt;
+
+static void eatt_find_info(struct bt_att_chan *chan, uint16_t mtu,
+					uint8_t opcode, const void *pdu,
+					uint16_t length, void *user_data)
+{
+	unsigned int i;
+	uint8_t op;
+
+	/* Another request still waiting to be read was sent in parallel */
+	for (i = 0; i < ARRAY_SIZE(eatt.fds); i++) {
+		if (recv(eatt.fds[i], &op, 1, MSG_PEEK | MSG_DONTWAIT) == 1 &&
+						op == BT_ATT_OP_FIND_INFO_REQ)
+			eatt.concurrent++;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(eatt.chans); i++) {
+		if (!eatt.chans[i])
+			eatt.chans[i] = chan;
+
+		if (eatt.chans[i] == chan) {
+			eatt.find_info[i]++;
+			return;
+		}
+	}
+
+	g_assert_not_reached();
+}
+
+static void eatt_ready_cb(bool success, uint8_t att_ecode, void *user_data)
+{
+	g_assert(success);
+
+	gatt_db_foreach_service(eatt.client_db, NULL, match_services,
+							eatt.server_db);
+
+	/* Descriptor discovery must have used both bearers at once */
+	tester_debug("Find Information: %u %u concurrent %u",
+				eatt.find_info[0], eatt.find_info[1],
+				eatt.concurrent);
+	g_assert(eatt.find_info[0] && eatt.find_info[1]);
+	g_assert(eatt.concurrent);
+
+	tester_test_passed();
+}
+
+static void setup_eatt(const void *data)
+{
+	int sv[2][2], i;
+
+	for (i = 0; i < 2; i++)
+		g_assert(!socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0,
+								sv[i]));
+
+	eatt.fds[0] = sv[0][1];
+	eatt.fds[1] = sv[1][1];
+
+	eatt.server_db = gatt_db_ref((struct gatt_db *) data);
+	eatt.server_att = bt_att_new(sv[0][1], false);
+	g_assert(eatt.server_att);
+	bt_att_set_close_on_unref(eatt.server_att, true);
+	g_assert(!bt_att_attach_fd_mtu(eatt.server_att, sv[1][1],
+						BT_ATT_DEFAULT_LE_MTU));
+
+	eatt.server = bt_gatt_server_new(eatt.server_db, eatt.server_att,
+							512, 0);
+	g_assert(eatt.server);
+
+	bt_att_register(eatt.server_att, BT_ATT_OP_FIND_INFO_REQ,
+					eatt_find_info, NULL, NULL);
+
+	eatt.client_db = gatt_db_new();
+	eatt.client_att = bt_att_new(sv[0][0], false);
+	g_assert(eatt.client_att);
+	bt_att_set_close_on_unref(eatt.client_att, true);
+	g_assert(!bt_att_attach_fd_mtu(eatt.client_att, sv[1][0],
+						BT_ATT_DEFAULT_LE_MTU));
+	g_assert_cmpint(bt_att_get_channels(eatt.client_att), ==, 2);
+
+	tester_setup_complete();
+}
+
+static void teardown_eatt(const void *data)
+{
+	bt_gatt_client_unref(eatt.client);
+	bt_gatt_server_unref(eatt.server);
+	bt_att_unref(eatt.client_att);
+	bt_att_unref(eatt.server_att);
+	gatt_db_unref(eatt.client_db);
+	gatt_db_unref(eatt.server_db);
+	memset(&eatt, 0, sizeof(eatt));
+
+	tester_teardown_complete();
+}
+
+static void test_client_eatt(const void *data)
+{
+	eatt.client = bt_gatt_client_new(eatt.client_db, eatt.client_att,
+							512, 0);
+	g_assert(eatt.client);
+
+	bt_gatt_client_set_debug(eatt.client, print_debug,
+						"bt_gatt_client:", NULL);
+	bt_gatt_client_ready_register(eatt.client, eatt_ready_cb, NULL,
+									NULL);
+}
+
+struct bench_context {
+	struct bt_att *att;
+	struct bt_gatt_server *server;
+	guint source;
+	int fd;
+};
+
+static struct bench_context bench;
+
+static gboolean bench_handler(GIOChannel *channel, GIOCondition cond,
+							gpointer user_data)
+{
+	uint8_t buf[512];
+	ssize_t len;
+
+	if (cond & (G_IO_NVAL | G_IO_ERR | G_IO_HUP)) {
+		bench.source = 0;
+		tester_test_failed();
+		return FALSE;
+	}
+
+	len = read(bench.fd, buf, sizeof(buf));
+	g_assert(len > 0);
+	g_assert_cmpint(buf[0], ==, BT_ATT_OP_READ_BY_GRP_TYPE_RSP);
+
+	tester_bench_iteration_complete();
+
+	return TRUE;
+}
+
+static void setup_bench_server(const void *data)
+{
+	struct gatt_db *db = (struct gatt_db *) data;
+	GIOChannel *channel;
+	int err, sv[2];
+
+	err = socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv);
+	g_assert(err == 0);
+
+	bench.att = bt_att_new(sv[0], false);
+	g_assert(bench.att);
+	bt_att_set_close_on_unref(bench.att, true);
+
+	bench.server = bt_gatt_server_new(db, bench.att, BT_ATT_DEFAULT_LE_MTU,
+									0);
+	g_assert(bench.server);
+
+	channel = g_io_channel_unix_new(sv[1]);
+
+	g_io_channel_set_close_on_unref(channel, TRUE);
+	g_io_channel_set_encoding(channel, NULL, NULL);
+	g_io_channel_set_buffered(channel, FALSE);
+
+	bench.source = g_io_add_watch(channel,
+				G_IO_IN | G_IO_HUP | G_IO_ERR | G_IO_NVAL,
+				bench_handler, NULL);
+	g_assert(bench.source > 0);
+
+	g_io_channel_unref(channel);
+
+	bench.fd = sv[1];
+
+	tester_setup_complete();
+}
+
+static void teardown_bench_server(const void *data)
+{
+	if (bench.source > 0)
+		g_source_remove(bench.source);
+
+	bt_gatt_server_unref(bench.server);
+	bt_att_unref(bench.att);
+	memset(&bench, 0, sizeof(bench));
+
+	tester_teardown_complete();
+}
+
+/* One Read By Group Type request/response round trip per iteration */
+static void bench_read_by_grp_type(const void *data)
+{
+	static const uint8_t pdu[] = { BT_ATT_OP_READ_BY_GRP_TYPE_REQ,
+					0x01, 0x00, 0xff, 0xff, 0x00, 0x28 };
+
+	g_assert(write(bench.fd, pdu, sizeof(pdu)) == sizeof(pdu));
+}
+
 int main(int argc, char *argv[])
 {
 	struct gatt_db *service_db_1, *service_db_2, *service_db_3;
@@ -4559,5 +5030,52 @@ int main(int argc, char *argv[])
 			test_hash_db, ts_tail_db, NULL,
 			{});
 
+	define_test_client("/robustness/batch-read", test_client, service_db_1,
+			&test_batch_read_1,
+			SERVICE_DATA_1_PDUS,
+			raw_pdu(0x20, 0x03, 0x00, 0x07, 0x00, 0x08, 0x00),
+			raw_pdu(0x21, 0x03, 0x00, 0x01, 0x02, 0x03, 0x02, 0x00,
+					0x04, 0x05, 0x05, 0x00, 0x06, 0x07,
+					0x08, 0x09, 0x0a));
+
+	define_test_client("/robustness/batch-read-cancel", test_client,
+			service_db_1, &test_batch_read_2,
+			SERVICE_DATA_1_PDUS,
+			raw_pdu(0x20, 0x03, 0x00, 0x07, 0x00, 0x08, 0x00),
+			raw_pdu(0x21, 0x03, 0x00, 0x01, 0x02, 0x03, 0x02, 0x00,
+					0x04, 0x05, 0x05, 0x00, 0x06, 0x07,
+					0x08, 0x09, 0x0a));
+
+	define_test_client("/robustness/batch-read-truncated", test_client,
+			service_db_1, &test_batch_read_3,
+			SERVICE_DATA_1_PDUS,
+			raw_pdu(0x20, 0x03, 0x00, 0x08, 0x00, 0x07, 0x00),
+			raw_pdu(0x21, 0x03, 0x00, 0x01, 0x02, 0x03, 0x05, 0x00,
+					0x06, 0x07),
+			raw_pdu(0x0c, 0x08, 0x00, 0x02, 0x00),
+			raw_pdu(0x0d, 0x08, 0x09, 0x0a),
+			raw_pdu(0x0a, 0x07, 0x00),
+			raw_pdu(0x0b, 0x04, 0x05));
+
+	define_test_client("/robustness/batch-read-write", test_client,
+			service_db_1, &test_batch_read_4,
+			SERVICE_DATA_1_PDUS,
+			raw_pdu(0x20, 0x03, 0x00, 0x07, 0x00),
+			raw_pdu(0x21, 0x03, 0x00, 0x01, 0x02, 0x03, 0x02, 0x00,
+					0x04, 0x05),
+			raw_pdu(0x12, 0x08, 0x00, 0x01),
+			raw_pdu(0x13),
+			raw_pdu(0x0a, 0x08, 0x00),
+			raw_pdu(0x0b, 0x06, 0x07, 0x08, 0x09, 0x0a));
+
+	tester_add("/robustness/hash-cache", NULL, NULL, test_hash_cache, NULL);
+
+	tester_add("/robustness/eatt-descriptors", ts_large_db_1, setup_eatt,
+					test_client_eatt, teardown_eatt);
+
+	tester_add_bench("/bench/server/read-by-grp-type", ts_large_db_1,
+				setup_bench_server, bench_read_by_grp_type,
+				teardown_bench_server, 0);
+
 	return tester_run();
 }
@@ -662,6 +662,120 @@ static void client_string_changed(const void *data)
 						context);
 }
 
+#define THROTTLE_INTERVAL	500
+
+static unsigned int throttle_changes;
+static unsigned int throttle_suppressed;
+static gint64 throttle_start;
+
+static void set_string_value(struct context *context, const char *value)
+{
+	g_free(context->data);
+	context->data = g_strdup(value);
+
+	g_dbus_emit_property_changed(context->dbus_conn, SERVICE_PATH,
+						SERVICE_NAME, "String");
+}
+
+static gboolean emit_string_burst(void *user_data)
+{
+	struct context *context = user_data;
+
+	g_dbus_get_property_changed_stats(NULL, &throttle_suppressed);
+
+	/* All within one interval, only the latest value is sent */
+	set_string_value(context, "value1");
+	set_string_value(context, "value2");
+	set_string_value(context, "value3");
+
+	context->timeout_source = g_timeout_add_seconds(5, timeout_test,
+								context);
+
+	return FALSE;
+}
+
+static void proxy_string_throttled(GDBusProxy *proxy, void *user_data)
+{
+	tester_debug("proxy %s found", g_dbus_proxy_get_interface(proxy));
+
+	g_idle_add(emit_string_burst, user_data);
+}
+
+static void property_string_throttled(GDBusProxy *proxy, const char *name,
+					DBusMessageIter *iter, void *user_data)
+{
+	struct context *context = user_data;
+	unsigned int suppressed;
+	const char *string;
+	gint64 elapsed;
+
+	g_assert(g_strcmp0(name, "String") == 0);
+	g_assert(dbus_message_iter_get_arg_type(iter) == DBUS_TYPE_STRING);
+
+	dbus_message_iter_get_basic(iter, &string);
+
+	tester_debug("property %s changed to %s", name, string);
+
+	switch (++throttle_changes) {
+	case 1:
+		g_assert(g_strcmp0(string, "value3") == 0);
+
+		g_dbus_get_property_changed_stats(NULL, &suppressed);
+		g_assert_cmpuint(suppressed - throttle_suppressed, >=, 2);
+
+		/* Held back until the interval of the last signal ends */
+		throttle_start = g_get_monotonic_time();
+		set_string_value(context, "value4");
+		break;
+	case 2:
+		g_assert(g_strcmp0(string, "value4") == 0);
+
+		elapsed = g_get_monotonic_time() - throttle_start;
+		tester_debug("delivered after %" G_GINT64_FORMAT " usec",
+								elapsed);
+		g_assert_cmpint(elapsed, >=, THROTTLE_INTERVAL * 1000 / 2);
+
+		g_dbus_set_property_changed_interval(SERVICE_NAME, "String",
+									0);
+		g_dbus_client_unref(context->dbus_client);
+		break;
+	default:
+		g_assert_not_reached();
+	}
+}
+
+static void client_property_throttled(const void *data)
+{
+	struct context *context = create_context();
+	static const GDBusPropertyTable string_properties[] = {
+		{ "String", "s", get_string, NULL, string_exists },
+		{ },
+	};
+
+	if (context == NULL)
+		return;
+
+	throttle_changes = 0;
+
+	g_dbus_set_property_changed_interval(SERVICE_NAME, "String",
+							THROTTLE_INTERVAL);
+
+	g_dbus_register_interface(context->dbus_conn,
+				SERVICE_PATH, SERVICE_NAME,
+				methods, signals, string_properties,
+				context, NULL);
+
+	context->dbus_client = g_dbus_client_new(context->dbus_conn,
+						SERVICE_NAME, SERVICE_PATH);
+
+	g_dbus_client_set_disconnect_watch(context->dbus_client,
+						disconnect_handler, context);
+	g_dbus_client_set_proxy_handlers(context->dbus_client,
+						proxy_string_throttled, NULL,
+						property_string_throttled,
+						context);
+}
+
 static void property_check_order(const DBusError *err, void *user_data)
 {
 	struct context *context = user_data;
@@ -934,6 +1048,9 @@ int main(int argc, char *argv[])
 	tester_add("/gdbus/client_string_changed", NULL, NULL,
 					client_string_changed, NULL);
 
+	tester_add("/gdbus/client_property_throttled", NULL, NULL,
+					client_property_throttled, NULL);
+
 	tester_add("/gdbus/client_check_order", NULL, NULL, client_check_order,
 					NULL);
 
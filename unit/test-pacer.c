@@ -0,0 +1,311 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "src/shared/util.h"
+#include "src/shared/pacer.h"
+#include "src/shared/tester.h"
+
+#define SDU_LEN		40
+
+struct test_data {
+	unsigned int sdus;	/* Full SDUs in the input */
+	unsigned int partial;	/* Length of a trailing partial SDU */
+	uint32_t interval;
+	uint16_t latency;
+	bool pipe;
+	unsigned int prefill;	/* SDUs expected to be sent right away */
+};
+
+struct context {
+	const struct test_data *data;
+	struct bt_pacer *pacer;
+	unsigned int id;
+	int sk[2];
+	int fd[2];
+	size_t written;
+	uint64_t start;
+	guint timeout;
+};
+
+static uint64_t now_usec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static size_t input_size(const struct test_data *data)
+{
+	return data->sdus * SDU_LEN + data->partial;
+}
+
+static void write_input(struct context *context, size_t len)
+{
+	uint8_t buf[SDU_LEN];
+	size_t i;
+
+	while (len) {
+		size_t n = MIN(len, sizeof(buf));
+
+		for (i = 0; i < n; i++)
+			buf[i] = context->written + i;
+
+		g_assert(write(context->fd[1], buf, n) == (ssize_t) n);
+
+		context->written += n;
+		len -= n;
+	}
+}
+
+/* SDUs keep their boundaries on the SEQPACKET socket and carry the input
+ * bytes in order.
+ */
+static void check_sdus(struct context *context, unsigned int count)
+{
+	const struct test_data *data = context->data;
+	size_t size = input_size(data), offset = 0;
+	uint8_t buf[SDU_LEN + 1];
+	unsigned int n;
+	ssize_t len;
+	int i;
+
+	for (n = 0; n < count; n++) {
+		len = recv(context->sk[1], buf, sizeof(buf), MSG_DONTWAIT);
+		g_assert_cmpint(len, ==, MIN(size - offset, SDU_LEN));
+
+		for (i = 0; i < len; i++)
+			g_assert_cmpint(buf[i], ==, (uint8_t) (offset + i));
+
+		offset += len;
+	}
+
+	len = recv(context->sk[1], buf, sizeof(buf), MSG_DONTWAIT);
+	g_assert(len < 0 && errno == EAGAIN);
+}
+
+static void destroy_context(struct context *context)
+{
+	if (context->timeout)
+		g_source_remove(context->timeout);
+
+	bt_pacer_free(context->pacer);
+
+	close(context->sk[0]);
+	close(context->sk[1]);
+	close(context->fd[0]);
+
+	if (context->fd[1] >= 0)
+		close(context->fd[1]);
+
+	g_free(context);
+}
+
+static gboolean context_quit(gpointer user_data)
+{
+	destroy_context(user_data);
+
+	tester_test_passed();
+
+	return FALSE;
+}
+
+static void test_complete(unsigned int id, int err,
+					const struct bt_pacer_stats *stats,
+					void *user_data)
+{
+	struct context *context = user_data;
+	const struct test_data *data = context->data;
+	unsigned int sdus = data->sdus + !!data->partial;
+	uint64_t elapsed = now_usec() - context->start;
+
+	g_assert_cmpuint(id, ==, context->id);
+	g_assert_cmpint(err, ==, 0);
+	g_assert_cmpuint(stats->sent, ==, sdus);
+	g_assert_cmpuint(stats->dropped, ==, 0);
+	g_assert_cmpuint(stats->size, ==, input_size(data));
+	g_assert_cmpuint(stats->offset, ==, stats->size);
+
+	/* One SDU per interval once the prefill has been sent */
+	tester_debug("Elapsed %" PRIu64 " usec", elapsed);
+	g_assert_cmpuint(elapsed, >=, (sdus - data->prefill) *
+							data->interval);
+
+	check_sdus(context, sdus);
+
+	/* The pacer cannot be freed from within its own callback */
+	context->id = 0;
+	g_idle_add(context_quit, context);
+}
+
+static struct context *create_context(const struct test_data *data)
+{
+	struct context *context = g_new0(struct context, 1);
+	char path[] = "/tmp/test-pacer-XXXXXX";
+
+	context->data = data;
+
+	g_assert(!socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0,
+							context->sk));
+
+	/* Blocking like the input files the player opens */
+	if (data->pipe) {
+		g_assert(!pipe2(context->fd, O_CLOEXEC));
+	} else {
+		context->fd[1] = mkstemp(path);
+		g_assert(context->fd[1] >= 0);
+		unlink(path);
+
+		write_input(context, input_size(data));
+
+		context->fd[0] = context->fd[1];
+		context->fd[1] = -1;
+		g_assert(lseek(context->fd[0], 0, SEEK_SET) == 0);
+	}
+
+	context->pacer = bt_pacer_new();
+	g_assert(context->pacer);
+
+	return context;
+}
+
+static unsigned int pacer_add(struct context *context)
+{
+	const struct test_data *data = context->data;
+
+	context->start = now_usec();
+	context->id = bt_pacer_add(context->pacer, context->sk[0],
+					context->fd[0], SDU_LEN,
+					data->interval, data->latency,
+					test_complete, context, NULL);
+	g_assert(context->id);
+
+	return context->id;
+}
+
+static void test_file(const void *user_data)
+{
+	pacer_add(create_context(user_data));
+}
+
+static gboolean prefill_check(gpointer user_data)
+{
+	struct context *context = user_data;
+	const struct test_data *data = context->data;
+	struct bt_pacer_stats stats;
+
+	context->timeout = 0;
+
+	g_assert(bt_pacer_get_stats(context->pacer, context->id, &stats));
+	g_assert_cmpuint(stats.sent, ==, data->prefill);
+	g_assert_cmpuint(stats.dropped, ==, 0);
+
+	check_sdus(context, data->prefill);
+
+	g_assert(bt_pacer_remove(context->pacer, context->id));
+	context->id = 0;
+	destroy_context(context);
+
+	tester_test_passed();
+
+	return FALSE;
+}
+
+/* Only the prefill is sent before the first interval has passed */
+static void test_prefill(const void *user_data)
+{
+	struct context *context = create_context(user_data);
+
+	pacer_add(context);
+
+	context->timeout = g_timeout_add(100, prefill_check, context);
+}
+
+static gboolean pipe_write(gpointer user_data)
+{
+	struct context *context = user_data;
+	const struct test_data *data = context->data;
+	struct bt_pacer_stats stats;
+
+	context->timeout = 0;
+
+	/* What was written so far has been sent without waiting for EOF */
+	g_assert(bt_pacer_get_stats(context->pacer, context->id, &stats));
+	g_assert_cmpuint(stats.sent, ==, 3);
+	g_assert_cmpuint(stats.offset, ==, context->written);
+
+	write_input(context, input_size(data) - context->written);
+
+	close(context->fd[1]);
+	context->fd[1] = -1;
+
+	return FALSE;
+}
+
+static void test_pipe(const void *user_data)
+{
+	struct context *context = create_context(user_data);
+
+	write_input(context, 3 * SDU_LEN);
+
+	pacer_add(context);
+
+	context->timeout = g_timeout_add(20, pipe_write, context);
+}
+
+static const struct test_data file_data = {
+	.sdus = 20,
+	.partial = 7,
+	.interval = 2000,
+	.latency = 10,
+	.prefill = 5,
+};
+
+static const struct test_data prefill_data = {
+	.sdus = 10,
+	.interval = 1000000,
+	.latency = 3000,
+	.prefill = 3,
+};
+
+static const struct test_data pipe_data = {
+	.sdus = 5,
+	.partial = 7,
+	.interval = 1000,
+	.latency = 100,
+	.pipe = true,
+	.prefill = 6,
+};
+
+int main(int argc, char *argv[])
+{
+	tester_init(&argc, &argv);
+
+	tester_add("/pacer/file", &file_data, NULL, test_file, NULL);
+	tester_add("/pacer/prefill", &prefill_data, NULL, test_prefill, NULL);
+	tester_add("/pacer/pipe", &pipe_data, NULL, test_pipe, NULL);
+
+	return tester_run();
+}
@@ -13,6 +13,7 @@
 #endif
 
 #define _GNU_SOURCE
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <sys/socket.h>
@@ -22,6 +23,7 @@
 
 #include "src/shared/io.h"
 #include "src/shared/util.h"
+#include "src/shared/timeout.h"
 #include "src/shared/tester.h"
 
 static void test_basic(const void *data)
@@ -80,13 +82,174 @@ static void test_io_send(const void *data)
 	tester_io_send();
 }
 
+struct virtual_io {
+	struct io *io;
+	int fd;
+	unsigned int timeout_id;
+	gint64 start;
+};
+
+static struct virtual_io virtual_io;
+
+static void virtual_io_done(void)
+{
+	io_destroy(virtual_io.io);
+	virtual_io.io = NULL;
+	close(virtual_io.fd);
+}
+
+static bool virtual_io_recv(struct io *io, void *user_data)
+{
+	unsigned char buf[1];
+
+	g_assert_cmpint(read(io_get_fd(io), buf, sizeof(buf)), ==, 1);
+
+	timeout_remove(virtual_io.timeout_id);
+	virtual_io_done();
+
+	tester_test_passed();
+
+	return false;
+}
+
+static bool virtual_io_timeout(void *user_data)
+{
+	virtual_io_done();
+
+	tester_test_failed();
+
+	return false;
+}
+
+static void virtual_io_new(void)
+{
+	int fd[2];
+
+	g_assert(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0,
+								fd) == 0);
+
+	virtual_io.io = io_new(fd[0]);
+	io_set_close_on_destroy(virtual_io.io, true);
+	io_set_read_handler(virtual_io.io, virtual_io_recv, NULL, NULL);
+
+	virtual_io.fd = fd[1];
+}
+
+/* Input that is already there is handled before the clock skips ahead */
+static void test_virtual_io(const void *data)
+{
+	virtual_io_new();
+
+	g_assert_cmpint(write(virtual_io.fd, "x", 1), ==, 1);
+
+	virtual_io.timeout_id = timeout_add(500, virtual_io_timeout, NULL,
+									NULL);
+}
+
+static bool virtual_idle_timeout(void *user_data)
+{
+	gint64 elapsed = g_get_monotonic_time() - virtual_io.start;
+
+	tester_debug("Elapsed %" G_GINT64_FORMAT " usec", elapsed);
+
+	/* Skipped ahead instead of waiting for the idle read watch */
+	g_assert_cmpint(elapsed, <, G_USEC_PER_SEC);
+
+	virtual_io_done();
+
+	tester_test_passed();
+
+	return false;
+}
+
+/* A read watch with nothing to read does not hold the clock */
+static void test_virtual_idle(const void *data)
+{
+	virtual_io_new();
+
+	virtual_io.start = g_get_monotonic_time();
+	virtual_io.timeout_id = timeout_add_seconds(5, virtual_idle_timeout,
+								NULL, NULL);
+}
+
+static unsigned int bench_calls;
+
+static void test_bench(const void *data)
+{
+	const unsigned int *usec = data;
+	void *buf = malloc(64);
+
+	g_assert(buf);
+	free(buf);
+
+	if (usec)
+		usleep(*usec);
+
+	bench_calls++;
+
+	tester_bench_iteration_complete();
+}
+
+static gboolean bench_async_complete(gpointer user_data)
+{
+	bench_calls++;
+
+	tester_bench_iteration_complete();
+
+	return FALSE;
+}
+
+static void test_bench_async(const void *data)
+{
+	g_idle_add(bench_async_complete, NULL);
+}
+
+static void teardown_bench(const void *data)
+{
+	const unsigned int *usec = data;
+	struct tester_bench_stats stats;
+
+	g_assert(tester_bench_get_stats(&stats));
+
+	/* Every warm-up and measured iteration ran exactly once */
+	g_assert_cmpuint(stats.iterations, >, 0);
+	g_assert_cmpuint(bench_calls, ==, stats.warmup + stats.iterations);
+
+	g_assert(stats.min_ns <= stats.p50_ns);
+	g_assert(stats.p50_ns <= stats.p99_ns);
+	g_assert(stats.p99_ns <= stats.max_ns);
+	g_assert(stats.total_ns >= stats.min_ns * stats.iterations);
+	g_assert(stats.total_ns <= stats.max_ns * stats.iterations);
+
+	if (usec)
+		g_assert(stats.min_ns >= *usec * 1000ULL);
+
+	bench_calls = 0;
+
+	tester_teardown_complete();
+}
+
+static const unsigned int bench_sleep_usec = 1000;
+
 int main(int argc, char *argv[])
 {
 	tester_init(&argc, &argv);
 
+	/* Run all tests on the virtual clock */
+	timeout_set_virtual_clock(true);
+
 	tester_add("/tester/basic", NULL, NULL, test_basic, NULL);
 	tester_add("/tester/setup_io", NULL, NULL, test_setup_io, NULL);
 	tester_add("/tester/io_send", NULL, NULL, test_io_send, NULL);
+	tester_add("/tester/virtual_io", NULL, NULL, test_virtual_io, NULL);
+	tester_add("/tester/virtual_idle", NULL, NULL, test_virtual_idle,
+									NULL);
+	tester_add_bench("/tester/bench", NULL, NULL, test_bench,
+							teardown_bench, 0);
+	tester_add_bench("/tester/bench_async", NULL, NULL, test_bench_async,
+							teardown_bench, 100);
+	tester_add_bench("/tester/bench_sleep", &bench_sleep_usec, NULL,
+					test_bench, teardown_bench, 5);
 
 	return tester_run();
 }
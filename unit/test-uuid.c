@@ -169,6 +169,30 @@ static void test_cmp(gconstpointer data)
 	tester_test_passed();
 }
 
+static void test_cmp_order(gconstpointer data)
+{
+	bt_uuid_t a, b, a128, b128;
+
+	bt_uuid16_create(&a, 0x12ff);
+	bt_uuid16_create(&b, 0x2a00);
+	bt_uuid_to_uuid128(&a, &a128);
+	bt_uuid_to_uuid128(&b, &b128);
+
+	g_assert(bt_uuid_cmp(&a, &b) < 0);
+	g_assert(bt_uuid_cmp(&b, &a) > 0);
+	g_assert(bt_uuid_cmp(&a128, &b128) < 0);
+	g_assert(bt_uuid_cmp(&a, &b128) < 0);
+	g_assert(bt_uuid_cmp(&b128, &a) > 0);
+
+	bt_uuid32_create(&a, 0x000012ff);
+	bt_uuid32_create(&b, 0x80000000);
+
+	g_assert(bt_uuid_cmp(&a, &b) < 0);
+	g_assert(bt_uuid_cmp(&a, &a128) == 0);
+	g_assert(bt_uuid_cmp(&b, &b128) > 0);
+	tester_test_passed();
+}
+
 static const struct uuid_test_data compress[] = {
 	{
 		.str = "00001234-0000-1000-8000-00805f9b34fb",
@@ -247,6 +271,8 @@ int main(int argc, char *argv[])
 	tester_add("/uuid/onetwentyeight/str", &uuid_128, NULL, test_str, NULL);
 	tester_add("/uuid/onetwentyeight/cmp", &uuid_128, NULL, test_cmp, NULL);
 
+	tester_add("/uuid/cmp/order", NULL, NULL, test_cmp_order, NULL);
+
 	for (i = 0; malformed[i]; i++) {
 		char *testpath;
 